@@ -20,10 +20,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <X11/Xutil.h>
 #include "xf_types.h"
 #include <freerdp/rfx.h>
 #include <freerdp/utils/stream.h>
 
+#include "xf_shm.h"
 #include "xf_decode.h"
 
 void
@@ -33,6 +35,9 @@ xf_decode_init(xfInfo * xfi)
 	{
 		case XF_CODEC_REMOTEFX:
 			xfi->rfx_context = rfx_context_new();
+			rfx_context_set_threads((RFX_CONTEXT *) xfi->rfx_context, xfi->rfx_threads);
+			if (xfi->image->bits_per_pixel != 32)
+				printf("xf_decode_init: RemoteFX needs a 32bpp visual, frames will not be drawn.\n");
 			break;
 
 		default:
@@ -48,47 +53,60 @@ xf_decode_uninit(xfInfo * xfi)
 }
 
 static void
-xf_decode_frame(xfInfo * xfi, int x, int y, uint8 * bitmapData, uint32 bitmapDataLength)
+xf_decode_frame(xfInfo * xfi, int x, int y, int width, int height, uint8 * bitmapData, uint32 bitmapDataLength)
 {
 	int i;
 	int tx, ty;
-	XImage * image;
+	int last;
+	RFX_SURFACE surface;
 	RFX_MESSAGE * message;
 
 	switch (xfi->codec)
 	{
 		case XF_CODEC_REMOTEFX:
 
-			message = rfx_process_message((RFX_CONTEXT *) xfi->rfx_context, bitmapData, bitmapDataLength);
+			if (xfi->image->bits_per_pixel != 32)
+				break;
+
+			surface.data = (uint8 *) xfi->image->data;
+			surface.width = xfi->image->width;
+			surface.height = xfi->image->height;
+			surface.stride = xfi->image->bytes_per_line;
+			surface.pixel_format = RFX_PIXEL_FORMAT_BGRA;
+
+			/* The server may still be reading the destination from a previous frame. */
+			xf_shm_wait(xfi, x, y, width, height);
 
-			/* Clip the updated region based on the union of rects, so that pixels outside of the region will not be drawn. */
-			XSetFunction(xfi->display, xfi->gc, GXcopy);
-			XSetFillStyle(xfi->display, xfi->gc, FillSolid);
-			XSetClipRectangles(xfi->display, xfi->gc, x, y, (XRectangle*)message->rects, message->num_rects, YXBanded);
+			/* The tiles are decoded into the image, clipped to the union of rects. */
+			message = rfx_process_message_surface((RFX_CONTEXT *) xfi->rfx_context,
+				bitmapData, bitmapDataLength, &surface, x, y);
 
-			/* Draw the tiles to backstore, each is 64x64. */
-			for (i = 0; i < message->num_tiles; i++)
+			/* Only the updated region goes to the backstore and from there to the window. */
+			for (i = 0, last = -1; i < message->num_rects; i++)
 			{
-				image = XCreateImage(xfi->display, xfi->visual, 24, ZPixmap, 0,
-					(char *) message->tiles[i]->data, 64, 64, 32, 0);
-				tx = message->tiles[i]->x + x;
-				ty = message->tiles[i]->y + y;
-				XPutImage(xfi->display, xfi->backstore, xfi->gc, image, 0, 0, tx, ty, 64, 64);
-				XFree(image);
+				if (message->rects[i].x + x < surface.width && message->rects[i].y + y < surface.height &&
+					message->rects[i].width > 0 && message->rects[i].height > 0)
+					last = i;
 			}
 
-			/* Copy the updated region from backstore to the window. */
-			for (i = 0; i < message->num_rects; i++)
+			for (i = 0; i <= last; i++)
 			{
 				tx = message->rects[i].x + x;
 				ty = message->rects[i].y + y;
-				XCopyArea(xfi->display, xfi->backstore, xfi->wnd, xfi->gc_default,
-					tx, ty, message->rects[i].width, message->rects[i].height, tx, ty);
+				width = message->rects[i].width;
+				height = message->rects[i].height;
+
+				if (tx + width > surface.width)
+					width = surface.width - tx;
+				if (ty + height > surface.height)
+					height = surface.height - ty;
+				if (width <= 0 || height <= 0)
+					continue;
+
+				xf_shm_put(xfi, tx, ty, width, height, i == last);
 			}
 			rfx_message_free(xfi->rfx_context, message);
 
-			XSetClipMask(xfi->display, xfi->gc, None);
-
 			break;
 
 		default:
@@ -104,6 +122,8 @@ xf_decode_data(xfInfo * xfi, uint8 * data, int data_size)
 	uint32 bitmapDataLength;
 	int destLeft;
 	int destTop;
+	int destRight;
+	int destBottom;
 	int size;
 
 	while (data_size > 0)
@@ -115,8 +135,11 @@ xf_decode_data(xfInfo * xfi, uint8 * data, int data_size)
 			case CMDTYPE_STREAM_SURFACE_BITS:
 				destLeft = GET_UINT16(data, 2);
 				destTop = GET_UINT16(data, 4);
+				destRight = GET_UINT16(data, 6);
+				destBottom = GET_UINT16(data, 8);
 				bitmapDataLength = GET_UINT32(data, 18);
-				xf_decode_frame(xfi, destLeft, destTop, data + 22, bitmapDataLength);
+				xf_decode_frame(xfi, destLeft, destTop, destRight - destLeft, destBottom - destTop,
+					data + 22, bitmapDataLength);
 				size = 22 + bitmapDataLength;
 				break;
 
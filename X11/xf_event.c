@@ -26,6 +26,7 @@
 #include "xf_types.h"
 #include "xf_event.h"
 #include "xf_keyboard.h"
+#include "xf_shm.h"
 
 static int
 xf_handle_event_Expose(xfInfo * xfi, XEvent * xevent)
@@ -318,7 +319,8 @@ xf_handle_event(xfInfo * xfi, XEvent * xevent)
 			rv = xf_handle_event_ClientMessage(xfi, xevent);
 			break;
 		default:
-			printf("xf_handle_event unknown event %d\n", xevent->type);
+			if (!xf_shm_handle_event(xfi, xevent))
+				printf("xf_handle_event unknown event %d\n", xevent->type);
 			break;
 	}
 	return rv;
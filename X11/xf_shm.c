@@ -0,0 +1,250 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   UI MIT-SHM
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+   xfi->image is a session sized client side image that RemoteFX tiles and
+   bitmaps are written to before they go to the backstore. With MIT-SHM it is
+   shared with the X server, so XShmPutImage only sends the rectangle instead
+   of the pixels. The server reads the segment asynchronously, so the last put
+   of each batch asks for a ShmCompletion event, and writers wait for it before
+   touching a part of the image that may still be in flight. Without the
+   extension, or when attaching fails (remote display), a regular image and
+   XPutImage are used.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include "xf_types.h"
+
+#ifdef HAVE_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif
+
+#include "xf_shm.h"
+
+#ifdef HAVE_XSHM
+
+static int xf_shm_error;
+
+static int
+xf_shm_error_handler(Display * display, XErrorEvent * event)
+{
+	xf_shm_error = 1;
+	return 0;
+}
+
+static int
+xf_shm_create_image(xfInfo * xfi, int width, int height)
+{
+	XErrorHandler handler;
+
+	if (!XShmQueryExtension(xfi->display))
+	{
+		printf("xf_shm_init: no shmem available.\n");
+		return 1;
+	}
+
+	xfi->image = XShmCreateImage(xfi->display, xfi->visual, xfi->depth, ZPixmap,
+		NULL, &xfi->shm_info, width, height);
+	if (xfi->image == NULL)
+		return 1;
+
+	xfi->shm_info.shmid = shmget(IPC_PRIVATE, xfi->image->bytes_per_line * height, IPC_CREAT | 0600);
+	if (xfi->shm_info.shmid == -1)
+	{
+		printf("xf_shm_init: shmget failed.\n");
+		XFree(xfi->image);
+		xfi->image = NULL;
+		return 1;
+	}
+
+	xfi->shm_info.shmaddr = shmat(xfi->shm_info.shmid, 0, 0);
+	xfi->shm_info.readOnly = False;
+
+	/* the segment is destroyed once both sides have detached */
+	shmctl(xfi->shm_info.shmid, IPC_RMID, NULL);
+
+	if (xfi->shm_info.shmaddr == (char *) -1)
+	{
+		printf("xf_shm_init: shmat failed.\n");
+		XFree(xfi->image);
+		xfi->image = NULL;
+		return 1;
+	}
+
+	xfi->image->data = xfi->shm_info.shmaddr;
+
+	/* a remote server may accept the extension and only fail the attach later */
+	xf_shm_error = 0;
+	handler = XSetErrorHandler(xf_shm_error_handler);
+	XShmAttach(xfi->display, &xfi->shm_info);
+	XSync(xfi->display, False);
+	XSetErrorHandler(handler);
+
+	if (xf_shm_error)
+	{
+		printf("xf_shm_init: XShmAttach failed.\n");
+		shmdt(xfi->shm_info.shmaddr);
+		XFree(xfi->image);
+		xfi->image = NULL;
+		return 1;
+	}
+
+	xfi->shm_event = XShmGetEventBase(xfi->display) + ShmCompletion;
+
+	return 0;
+}
+
+static Bool
+xf_shm_is_completion(Display * display, XEvent * xevent, XPointer arg)
+{
+	return (xevent->type == ((xfInfo *) arg)->shm_event);
+}
+
+#endif
+
+int
+xf_shm_init(xfInfo * xfi)
+{
+	int width = xfi->settings->width;
+	int height = xfi->settings->height;
+
+	xfi->shm_event = 0;
+	xfi->shm_pending = 0;
+
+#ifdef HAVE_XSHM
+	if (xf_shm_create_image(xfi, width, height) == 0)
+		return 0;
+#else
+	printf("xf_shm_init: MIT-SHM extension is disabled.\n");
+#endif
+
+	xfi->image = XCreateImage(xfi->display, xfi->visual, xfi->depth, ZPixmap, 0,
+		NULL, width, height, xfi->bitmap_pad, 0);
+	xfi->image->data = (char *) malloc(xfi->image->bytes_per_line * height);
+
+	return 1;
+}
+
+void
+xf_shm_uninit(xfInfo * xfi)
+{
+	if (xfi->image == NULL)
+		return;
+
+#ifdef HAVE_XSHM
+	if (xfi->shm_event != 0)
+	{
+		XShmDetach(xfi->display, &xfi->shm_info);
+		XFree(xfi->image);
+		shmdt(xfi->shm_info.shmaddr);
+		xfi->image = NULL;
+		return;
+	}
+#endif
+
+	XDestroyImage(xfi->image);
+	xfi->image = NULL;
+}
+
+/* block until the server no longer reads the given part of xfi->image */
+void
+xf_shm_wait(xfInfo * xfi, int x, int y, int width, int height)
+{
+#ifdef HAVE_XSHM
+	XEvent xevent;
+
+	while (xfi->shm_pending > 0 &&
+		x < xfi->shm_busy.x + xfi->shm_busy.width && x + width > xfi->shm_busy.x &&
+		y < xfi->shm_busy.y + xfi->shm_busy.height && y + height > xfi->shm_busy.y)
+	{
+		XIfEvent(xfi->display, &xevent, xf_shm_is_completion, (XPointer) xfi);
+		xf_shm_handle_event(xfi, &xevent);
+	}
+#endif
+}
+
+/*
+   Put a part of xfi->image to the backstore and the window. The last put of
+   a batch requests a completion event, which covers the earlier ones too since
+   the server handles requests in order.
+*/
+void
+xf_shm_put(xfInfo * xfi, int x, int y, int width, int height, int last)
+{
+#ifdef HAVE_XSHM
+	int right, bottom;
+
+	if (xfi->shm_event != 0)
+	{
+		XShmPutImage(xfi->display, xfi->backstore, xfi->gc_default, xfi->image,
+			x, y, x, y, width, height, last ? True : False);
+
+		if (xfi->shm_busy.width == 0)
+		{
+			xfi->shm_busy.x = x;
+			xfi->shm_busy.y = y;
+			xfi->shm_busy.width = width;
+			xfi->shm_busy.height = height;
+		}
+		else
+		{
+			right = xfi->shm_busy.x + xfi->shm_busy.width;
+			bottom = xfi->shm_busy.y + xfi->shm_busy.height;
+			right = (x + width > right ? x + width : right);
+			bottom = (y + height > bottom ? y + height : bottom);
+			xfi->shm_busy.x = (x < xfi->shm_busy.x ? x : xfi->shm_busy.x);
+			xfi->shm_busy.y = (y < xfi->shm_busy.y ? y : xfi->shm_busy.y);
+			xfi->shm_busy.width = right - xfi->shm_busy.x;
+			xfi->shm_busy.height = bottom - xfi->shm_busy.y;
+		}
+
+		if (last)
+			xfi->shm_pending++;
+	}
+	else
+#endif
+	{
+		XPutImage(xfi->display, xfi->backstore, xfi->gc_default, xfi->image,
+			x, y, x, y, width, height);
+	}
+
+	XCopyArea(xfi->display, xfi->backstore, xfi->wnd, xfi->gc_default,
+		x, y, width, height, x, y);
+}
+
+/* returns 1 if xevent was a completion event of one of our puts */
+int
+xf_shm_handle_event(xfInfo * xfi, XEvent * xevent)
+{
+	if (xfi->shm_event == 0 || xevent->type != xfi->shm_event)
+		return 0;
+
+	if (--(xfi->shm_pending) <= 0)
+	{
+		xfi->shm_pending = 0;
+		xfi->shm_busy.width = 0;
+		xfi->shm_busy.height = 0;
+	}
+
+	return 1;
+}
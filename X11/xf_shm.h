@@ -0,0 +1,34 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   UI MIT-SHM
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __XF_SHM_H
+#define __XF_SHM_H
+
+#include "xf_types.h"
+
+int
+xf_shm_init(xfInfo * xfi);
+void
+xf_shm_uninit(xfInfo * xfi);
+void
+xf_shm_wait(xfInfo * xfi, int x, int y, int width, int height);
+void
+xf_shm_put(xfInfo * xfi, int x, int y, int width, int height, int last);
+int
+xf_shm_handle_event(xfInfo * xfi, XEvent * xevent);
+
+#endif
@@ -31,6 +31,10 @@
 #include "config.h"
 #endif
 
+#ifdef HAVE_XSHM
+#include <X11/extensions/XShm.h>
+#endif
+
 #define SET_XFI(_inst, _xfi) (_inst)->param1 = _xfi
 #define GET_XFI(_inst) ((xfInfo *) ((_inst)->param1))
 
@@ -100,8 +104,18 @@ struct xf_info
 	char * xv_shmaddr;
 	uint32 * xv_pixfmts;
 
+	/* MIT-SHM stuff */
+	XImage * image; /* session sized, see xf_shm.c */
+	int shm_event;
+	int shm_pending;
+	XRectangle shm_busy;
+#ifdef HAVE_XSHM
+	XShmSegmentInfo shm_info;
+#endif
+
 	/* RemoteFX */
 	int codec;
+	int rfx_threads;
 	void * rfx_context;
 };
 typedef struct xf_info xfInfo;
@@ -37,6 +37,7 @@
 #include "xf_keyboard.h"
 #include "xf_win.h"
 #include "xf_decode.h"
+#include "xf_shm.h"
 #include "color.h"
 #include "gdi_palette.h"
 
@@ -225,34 +226,25 @@ l_ui_end_update(struct rdp_inst * inst)
 }
 
 static void
-l_ui_gdi_begin_update(struct rdp_inst * inst)
-{
-	GDI *gdi = GET_GDI(inst);
-	gdi->primary->hdc->hwnd->invalid->null = 1;
-}
-
-static void
-l_ui_gdi_end_update(struct rdp_inst * inst)
+l_ui_gdi_update_region(struct rdp_inst * inst, HGDI_RGN rects, int count)
 {
+	int i;
 	XImage * image;
 	GDI *gdi = GET_GDI(inst);
 	xfInfo * xfi = GET_XFI(inst);
 
-	if (gdi->primary->hdc->hwnd->invalid->null)
-		return;
-
 	image = XCreateImage(xfi->display, xfi->visual, xfi->depth, ZPixmap, 0,
 			(char *) gdi->primary_buffer, gdi->width, gdi->height, xfi->bitmap_pad, 0);
 
-	XPutImage(xfi->display, xfi->backstore, xfi->gc_default, image, 0, 0, 0, 0, gdi->width, gdi->height);
+	/* only the damaged rectangles are pushed to the backstore and the window */
+	for (i = 0; i < count; i++)
+	{
+		XPutImage(xfi->display, xfi->backstore, xfi->gc_default, image,
+				rects[i].x, rects[i].y, rects[i].x, rects[i].y, rects[i].w, rects[i].h);
 
-	XCopyArea(xfi->display, xfi->backstore, xfi->wnd, xfi->gc_default,
-			gdi->primary->hdc->hwnd->invalid->x,
-			gdi->primary->hdc->hwnd->invalid->y,
-			gdi->primary->hdc->hwnd->invalid->w,
-			gdi->primary->hdc->hwnd->invalid->h,
-			gdi->primary->hdc->hwnd->invalid->x,
-			gdi->primary->hdc->hwnd->invalid->y);
+		XCopyArea(xfi->display, xfi->backstore, xfi->wnd, xfi->gc_default,
+				rects[i].x, rects[i].y, rects[i].w, rects[i].h, rects[i].x, rects[i].y);
+	}
 
 	XFlush(xfi->display);
 
@@ -333,19 +325,36 @@ l_ui_create_bitmap(struct rdp_inst * inst, int width, int height, uint8 * data)
 static void
 l_ui_paint_bitmap(struct rdp_inst * inst, int x, int y, int cx, int cy, int width, int height, uint8 * data)
 {
+	int i;
+	int bpp;
+	uint8 * src;
+	uint8 * dst;
 	uint8 * cdata;
-	XImage * image;
 	xfInfo * xfi = GET_XFI(inst);
 
+	if (x < 0 || y < 0 || x >= xfi->image->width || y >= xfi->image->height)
+		return;
+
+	cx = (x + cx > xfi->image->width) ? xfi->image->width - x : cx;
+	cy = (y + cy > xfi->image->height) ? xfi->image->height - y : cy;
+
 	cdata = gdi_image_convert(data, NULL, width, height, inst->settings->server_depth, xfi->bpp, xfi->clrconv);
 
-	image = XCreateImage(xfi->display, xfi->visual, xfi->depth,
-			ZPixmap, 0, (char *) cdata, width, height, xfi->bitmap_pad, 0);
+	/* the bitmap goes through the session image, shared with the server if possible */
+	xf_shm_wait(xfi, x, y, cx, cy);
 
-	XPutImage(xfi->display, xfi->backstore, xfi->gc_default, image, 0, 0, x, y, cx, cy);
-	XCopyArea(xfi->display, xfi->backstore, xfi->wnd, xfi->gc_default, x, y, cx, cy, x, y);
+	bpp = xfi->image->bits_per_pixel / 8;
+	src = cdata;
+	dst = (uint8 *) xfi->image->data + y * xfi->image->bytes_per_line + x * bpp;
 
-	XFree(image);
+	for (i = 0; i < cy; i++)
+	{
+		memcpy(dst, src, cx * bpp);
+		src += width * bpp;
+		dst += xfi->image->bytes_per_line;
+	}
+
+	xf_shm_put(xfi, x, y, cx, cy, 1);
 
 	if (cdata != data)
 		free(cdata);
@@ -784,6 +793,74 @@ l_ui_reset_clip(struct rdp_inst * inst)
 	XSetClipMask(xfi->display, xfi->gc, None);
 }
 
+/* most fills of a display list sent in one request */
+#define XF_DRAW_LIST_RECTS	128
+
+static void
+l_ui_draw_list(struct rdp_inst * inst, RD_DRAW_CMD * cmds, int count)
+{
+	int i, n;
+	uint32 color;
+	RD_DRAW_CMD * cmd;
+	XRectangle rects[XF_DRAW_LIST_RECTS];
+	xfInfo * xfi = GET_XFI(inst);
+
+	for (i = 0; i < count; i++)
+	{
+		cmd = &cmds[i];
+
+		switch (cmd->type)
+		{
+			case RD_DRAW_SET_CLIP:
+				l_ui_set_clip(inst, cmd->x, cmd->y, cmd->cx, cmd->cy);
+				break;
+			case RD_DRAW_RESET_CLIP:
+				l_ui_reset_clip(inst);
+				break;
+			case RD_DRAW_RECT:
+				/* fills of one color that follow each other share a request */
+				for (n = 0; (n < XF_DRAW_LIST_RECTS) && (i + n < count); n++)
+				{
+					if ((cmds[i + n].type != RD_DRAW_RECT) || (cmds[i + n].u.color != cmd->u.color))
+						break;
+					rects[n].x = cmds[i + n].x;
+					rects[n].y = cmds[i + n].y;
+					rects[n].width = cmds[i + n].cx;
+					rects[n].height = cmds[i + n].cy;
+				}
+				color = gdi_color_convert(cmd->u.color, inst->settings->server_depth, xfi->bpp, xfi->clrconv);
+				XSetFunction(xfi->display, xfi->gc, GXcopy);
+				XSetFillStyle(xfi->display, xfi->gc, FillSolid);
+				XSetForeground(xfi->display, xfi->gc, color);
+				XFillRectangles(xfi->display, xfi->drw, xfi->gc, rects, n);
+				if (xfi->drw == xfi->backstore)
+				{
+					XFillRectangles(xfi->display, xfi->wnd, xfi->gc, rects, n);
+				}
+				i += n - 1;
+				break;
+			case RD_DRAW_DESTBLT:
+				l_ui_destblt(inst, cmd->opcode, cmd->x, cmd->y, cmd->cx, cmd->cy);
+				break;
+			case RD_DRAW_PATBLT:
+				l_ui_patblt(inst, cmd->opcode, cmd->x, cmd->y, cmd->cx, cmd->cy,
+					&cmd->u.pat.brush, cmd->u.pat.bgcolor, cmd->u.pat.fgcolor);
+				break;
+			case RD_DRAW_SCREENBLT:
+				l_ui_screenblt(inst, cmd->opcode, cmd->x, cmd->y, cmd->cx, cmd->cy,
+					cmd->u.blt.srcx, cmd->u.blt.srcy);
+				break;
+			case RD_DRAW_MEMBLT:
+				l_ui_memblt(inst, cmd->opcode, cmd->x, cmd->y, cmd->cx, cmd->cy,
+					cmd->u.blt.src, cmd->u.blt.srcx, cmd->u.blt.srcy);
+				break;
+			case RD_DRAW_LINE:
+				l_ui_line(inst, cmd->opcode, cmd->x, cmd->y, cmd->cx, cmd->cy, &cmd->u.pen);
+				break;
+		}
+	}
+}
+
 static void
 l_ui_resize_window(struct rdp_inst * inst)
 {
@@ -792,7 +869,8 @@ l_ui_resize_window(struct rdp_inst * inst)
 	if (xfi->settings->software_gdi == 1)
 	{
 		gdi_free(inst);
-		gdi_init(inst, CLRCONV_ALPHA | CLRBUF_32BPP);		
+		gdi_init(inst, CLRCONV_ALPHA | CLRBUF_32BPP);
+		GET_GDI(inst)->update_region = l_ui_gdi_update_region;
 	}
 	
 	printf("ui_resize_window:\n");
@@ -1104,6 +1182,7 @@ xf_register_callbacks(rdpInst * inst)
 	inst->ui_unimpl = l_ui_unimpl;
 	inst->ui_begin_update = l_ui_begin_update;
 	inst->ui_end_update = l_ui_end_update;
+	inst->ui_draw_list = l_ui_draw_list;
 	inst->ui_desktop_save = l_ui_desktop_save;
 	inst->ui_desktop_restore = l_ui_desktop_restore;
 	inst->ui_create_bitmap = l_ui_create_bitmap;
@@ -1432,8 +1511,13 @@ xf_post_connect(xfInfo * xfi)
 		gdi_init(xfi->inst, CLRCONV_ALPHA | CLRBUF_32BPP);
 		gdi = GET_GDI(xfi->inst);
 
-		xfi->inst->ui_begin_update = l_ui_gdi_begin_update;
-		xfi->inst->ui_end_update = l_ui_gdi_end_update;
+		gdi->update_region = l_ui_gdi_update_region;
+	}
+	else if (xfi->settings->pipelined)
+	{
+		/* X drawing from two threads would share the graphics contexts */
+		printf("xf_post_connect: pipelined mode needs --gdi sw, disabled\n");
+		xfi->settings->pipelined = 0;
 	}
 
 	return 0;
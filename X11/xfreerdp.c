@@ -40,6 +40,7 @@
 #include "xf_keyboard.h"
 #include "xf_event.h"
 #include "xf_video.h"
+#include "xf_shm.h"
 #include "xf_decode.h"
 
 #define MAX_PLUGIN_DATA 20
@@ -134,6 +135,11 @@ out_args(void)
 		"\t--plugin: load a virtual channel plugin\n"
 		"\t--no-osb: disable off screen bitmaps, default on\n"
 		"\t--rfx: ask for RemoteFX session\n"
+		"\t--rfx-threads: number of threads decoding RemoteFX tiles, default 1\n"
+		"\t--pipeline: receive and decode on separate threads (with --gdi sw)\n"
+		"\t--display-list: draw the orders of each update as one batch\n"
+		"\t--record: save the received PDUs to a file\n"
+		"\t--replay: decode PDUs saved with --record instead of connecting\n"
 #ifdef HAVE_XV
 		"\t--xv-port: choose XVideo adaptor port number.\n"
 #endif
@@ -393,6 +399,44 @@ process_params(xfInfo * xfi, int argc, char ** argv, int * pindex)
 			settings->performanceflags = PERF_FLAG_NONE;
 			xfi->codec = XF_CODEC_REMOTEFX;
 		}
+		else if (strcmp("--rfx-threads", argv[*pindex]) == 0)
+		{
+			*pindex = *pindex + 1;
+			if (*pindex == argc)
+			{
+				printf("missing number of RemoteFX threads\n");
+				exit(XF_EXIT_WRONG_PARAM);
+			}
+			xfi->rfx_threads = atoi(argv[*pindex]);
+		}
+		else if (strcmp("--pipeline", argv[*pindex]) == 0)
+		{
+			settings->pipelined = 1;
+		}
+		else if (strcmp("--display-list", argv[*pindex]) == 0)
+		{
+			settings->display_list = 1;
+		}
+		else if (strcmp("--record", argv[*pindex]) == 0)
+		{
+			*pindex = *pindex + 1;
+			if (*pindex == argc)
+			{
+				printf("missing file name\n");
+				exit(XF_EXIT_WRONG_PARAM);
+			}
+			snprintf(settings->record_file, sizeof(settings->record_file), "%s", argv[*pindex]);
+		}
+		else if (strcmp("--replay", argv[*pindex]) == 0)
+		{
+			*pindex = *pindex + 1;
+			if (*pindex == argc)
+			{
+				printf("missing file name\n");
+				exit(XF_EXIT_WRONG_PARAM);
+			}
+			snprintf(settings->replay_file, sizeof(settings->replay_file), "%s", argv[*pindex]);
+		}
 		else if (strcmp("-m", argv[*pindex]) == 0)
 		{
 			settings->mouse_motion = 0;
@@ -629,6 +673,33 @@ process_params(xfInfo * xfi, int argc, char ** argv, int * pindex)
 	exit(XF_EXIT_WRONG_PARAM);
 }
 
+/* Report what decoding a recording took, see --replay */
+static void
+out_replay_stats(rdpInst * inst)
+{
+	static const char * kinds[RD_PDU_KINDS] =
+	{
+		"orders", "bitmap", "palette", "pointer", "surfcmds", "channel", "other"
+	};
+	RD_REPLAY_STATS stats;
+	int index;
+
+	if (inst->rdp_get_replay_stats(inst, &stats) != 0)
+		return;
+
+	printf("%-10s %8s %10s %10s %8s\n", "pdu", "count", "bytes", "usec", "allocs");
+	for (index = 0; index < RD_PDU_KINDS; index++)
+	{
+		if (stats.pdus[index].count == 0)
+			continue;
+		printf("%-10s %8u %10u %10u %8u\n", kinds[index], stats.pdus[index].count,
+			stats.pdus[index].bytes, stats.pdus[index].usec, stats.pdus[index].allocs);
+	}
+	printf("%u frames in %.3f seconds, %.1f frames/sec%s\n", stats.frames,
+		stats.usec / 1000000.0, stats.usec ? stats.frames * 1000000.0 / stats.usec : 0.0,
+		stats.done ? "" : " (stopped before the end)");
+}
+
 static int
 run_xfreerdp(xfInfo * xfi)
 {
@@ -694,6 +765,7 @@ run_xfreerdp(xfInfo * xfi)
 		return XF_EXIT_CONN_FAILED;
 	}
 	xf_video_init(xfi);
+	xf_shm_init(xfi);
 	xf_decode_init(xfi);
 
 	/* program main loop */
@@ -802,8 +874,10 @@ run_xfreerdp(xfInfo * xfi)
 
 	/* cleanup */
 	xf_decode_uninit(xfi);
+	xf_shm_uninit(xfi);
 	xf_video_uninit(xfi);
 	freerdp_chanman_close(xfi->chan_man, inst);
+	out_replay_stats(inst);
 	inst->rdp_disconnect(inst);
 	freerdp_free(inst);
 	xf_uninit(xfi);
@@ -863,6 +937,8 @@ main(int argc, char ** argv)
 	char reason_msg[ERRINFO_BUFFER_SIZE];
 
 	setlocale(LC_CTYPE, "");
+	/* pipelined sessions draw cursors from their decode thread */
+	XInitThreads();
 	if (argc == 1)
 	{
 		out_args();
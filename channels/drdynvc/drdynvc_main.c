@@ -104,6 +104,11 @@ set_variable_uint(uint32 val, char * data, uint32 * pos)
 	return cb;
 }
 
+/* Each fragment is a header followed by a slice of the data. They are all
+   built in one buffer, copying the data once, and written from there. The
+   write of the last fragment frees the buffer when it completes, the ones
+   before it carry no user data. Should a fragment fail after others were
+   queued the buffer is left to them, the channel is going away then. */
 int
 drdynvc_write_data(drdynvcPlugin * plugin, uint32 ChannelId, char * data, uint32 data_size)
 {
@@ -111,57 +116,52 @@ drdynvc_write_data(drdynvcPlugin * plugin, uint32 ChannelId, char * data, uint32
 	uint32 t;
 	int cbChId;
 	int cbLen;
-	char * out_data = NULL;
+	char * out_data;
+	char * frag;
 	int error;
 	uint32 data_pos;
 
 	LLOGLN(10, ("drdynvc_write_data: ChannelId=%d size=%d", ChannelId, data_size));
 
-	out_data = (char *) malloc(CHANNEL_CHUNK_LENGTH);
-	memset(out_data, 0, CHANNEL_CHUNK_LENGTH);
-	pos = 1;
-	cbChId = set_variable_uint(ChannelId, out_data, &pos);
+	/* headers are at most 9 bytes, and all fragments but the last are full */
+	t = data_size / (CHANNEL_CHUNK_LENGTH - 9) + 1;
+	out_data = (char *) malloc(data_size + t * 9);
+	frag = out_data;
+	data_pos = 0;
 
-	if (data_size <= CHANNEL_CHUNK_LENGTH - pos)
+	do
 	{
-		SET_UINT8(out_data, 0, 0x30 | cbChId);
-		memcpy(out_data + pos, data, data_size);
-		hexdump(out_data, data_size + pos);
-		error = plugin->ep.pVirtualChannelWrite(plugin->open_handle,
-			out_data, data_size + pos, out_data);
-	}
-	else
-	{
-		/* Fragment the data */
-		cbLen = set_variable_uint(data_size, out_data, &pos);
-		SET_UINT8(out_data, 0, 0x20 | cbChId | (cbLen << 2));
-		data_pos = CHANNEL_CHUNK_LENGTH - pos;
-		memcpy(out_data + pos, data, data_pos);
-		hexdump(out_data, CHANNEL_CHUNK_LENGTH);
-		error = plugin->ep.pVirtualChannelWrite(plugin->open_handle,
-			out_data, CHANNEL_CHUNK_LENGTH, out_data);
+		pos = 1;
+		cbChId = set_variable_uint(ChannelId, frag, &pos);
 
-		while (error == CHANNEL_RC_OK && data_pos < data_size)
+		if (data_pos == 0 && data_size > CHANNEL_CHUNK_LENGTH - pos)
 		{
-			out_data = (char *) malloc(CHANNEL_CHUNK_LENGTH);
-			memset(out_data, 0, CHANNEL_CHUNK_LENGTH);
-			pos = 1;
-			cbChId = set_variable_uint(ChannelId, out_data, &pos);
-
-			SET_UINT8(out_data, 0, 0x30 | cbChId);
-			t = data_size - data_pos;
-			if (t > CHANNEL_CHUNK_LENGTH - pos)
-				t = CHANNEL_CHUNK_LENGTH - pos;
-			memcpy(out_data + pos, data + data_pos, t);
-			data_pos += t;
-			hexdump(out_data, t + pos);
-			error = plugin->ep.pVirtualChannelWrite(plugin->open_handle,
-				out_data, t + pos, out_data);
+			/* DYNVC_DATA_FIRST, with the total length */
+			cbLen = set_variable_uint(data_size, frag, &pos);
+			SET_UINT8(frag, 0, 0x20 | cbChId | (cbLen << 2));
 		}
+		else
+		{
+			SET_UINT8(frag, 0, 0x30 | cbChId);
+		}
+
+		t = data_size - data_pos;
+		if (t > CHANNEL_CHUNK_LENGTH - pos)
+			t = CHANNEL_CHUNK_LENGTH - pos;
+		memcpy(frag + pos, data + data_pos, t);
+		data_pos += t;
+		hexdump(frag, t + pos);
+		error = plugin->ep.pVirtualChannelWrite(plugin->open_handle,
+			frag, t + pos, (data_pos == data_size) ? out_data : NULL);
+		if (error != CHANNEL_RC_OK)
+			break;
+		frag += t + pos;
 	}
+	while (data_pos < data_size);
+
 	if (error != CHANNEL_RC_OK)
 	{
-		if (out_data)
+		if (frag == out_data)
 			free(out_data);
 		LLOGLN(0, ("drdynvc_write_data: "
 			"VirtualChannelWrite "
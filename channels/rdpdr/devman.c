@@ -23,6 +23,7 @@
 #include <string.h>
 
 #include "rdpdr_scard.h"
+#include "rdpdr_main.h"
 #include "config.h"
 #include "rdpdr_types.h"
 #include "rdpdr_constants.h"
@@ -42,11 +43,13 @@ devman_new(void* data)
 	devman->tail = NULL;
 	devman->count = 0;
 	devman->id_sequence = 1;
+	devman->plugin = NULL;
 
 	pDevmanEntryPoints->pDevmanRegisterService = devman_register_service;
 	pDevmanEntryPoints->pDevmanUnregisterService = devman_unregister_service;
 	pDevmanEntryPoints->pDevmanRegisterDevice = devman_register_device;
 	pDevmanEntryPoints->pDevmanUnregisterDevice = devman_unregister_device;
+	pDevmanEntryPoints->pDevmanCompleteIrp = devman_complete_irp;
 	pDevmanEntryPoints->pExtendedData = data;
 	devman->pDevmanEntryPoints = (void*)pDevmanEntryPoints;
 
@@ -206,6 +209,15 @@ devman_unregister_device(DEVMAN* devman, DEVICE* dev)
 	return 0;
 }
 
+/* called by services, from any thread, for the IRPs they returned
+   RD_STATUS_PENDING | 0xC0000000 for. The IRP stays owned by the service. */
+void
+devman_complete_irp(DEVMAN* devman, IRP* irp)
+{
+	if (devman->plugin != NULL)
+		rdpdr_complete_irp((rdpdrPlugin *) devman->plugin, irp);
+}
+
 void
 devman_rewind(DEVMAN* devman)
 {
@@ -26,6 +26,7 @@ typedef PSERVICE (*PDEVMAN_REGISTER_SERVICE)(PDEVMAN devman);
 typedef int (*PDEVMAN_UNREGISTER_SERVICE)(PDEVMAN devman, PSERVICE srv);
 typedef PDEVICE (*PDEVMAN_REGISTER_DEVICE)(PDEVMAN devman, PSERVICE srv, char* name);
 typedef int (*PDEVMAN_UNREGISTER_DEVICE)(PDEVMAN devman, PDEVICE dev);
+typedef void (*PDEVMAN_COMPLETE_IRP)(PDEVMAN devman, IRP * irp);
 
 struct _DEVMAN_ENTRY_POINTS
 {
@@ -33,6 +34,7 @@ struct _DEVMAN_ENTRY_POINTS
 	PDEVMAN_UNREGISTER_SERVICE pDevmanUnregisterService;
 	PDEVMAN_REGISTER_DEVICE pDevmanRegisterDevice;
 	PDEVMAN_UNREGISTER_DEVICE pDevmanUnregisterDevice;
+	PDEVMAN_COMPLETE_IRP pDevmanCompleteIrp;
 	void* pExtendedData; /* extended data field to pass initial parameters */
 };
 typedef struct _DEVMAN_ENTRY_POINTS DEVMAN_ENTRY_POINTS;
@@ -53,6 +55,8 @@ devman_register_device(DEVMAN* devman, SERVICE* srv, char* name);
 int
 devman_unregister_device(DEVMAN* devman, DEVICE* dev);
 void
+devman_complete_irp(DEVMAN* devman, IRP* irp);
+void
 devman_rewind(DEVMAN* devman);
 int
 devman_has_next(DEVMAN* devman);
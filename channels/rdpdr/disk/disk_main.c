@@ -30,6 +30,7 @@
 #include <errno.h>
 #include <fnmatch.h>
 #include <utime.h>
+#include <pthread.h>
 #include <freerdp/utils/stream.h>
 #include <freerdp/utils/memory.h>
 #include <freerdp/utils/unicode.h>
@@ -44,6 +45,70 @@
 #include "rdpdr_constants.h"
 #include "devman.h"
 
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+/*
+   Reads and writes are not served on the rdpdr thread. disk_read() and
+   disk_write() queue them to a pool of worker threads, which use pread()
+   and pwrite() so requests on the same file do not share a file offset,
+   and send the completions themselves as they finish, in any order.
+   Everything else is still done on the rdpdr thread.
+
+   The data of a request goes through a buffer of the pool of the device
+   when it fits, instead of a new allocation. A file closed while some of
+   its requests are queued or running is only freed by the last of them.
+
+   Directory queries enumerate a listing of the directory read at once,
+   with every entry stat()ed and its name converted to UTF-16 only then.
+   The listings of the directories queried last are cached by the device
+   and shared by the handles enumerating them, for a few seconds, or for
+   longer when inotify tells when they change. File information queries
+   take their stat from the cached listing of the parent directory, unless
+   the file was written through its handle. Changes made through the
+   device drop the listings they affect right away.
+*/
+
+#define DISK_FILE_BUCKETS	64	/* buckets of the table of open files */
+#define DISK_WORKERS		4	/* threads serving reads and writes of a device */
+#define DISK_BUFFER_SIZE	65536	/* size of the pooled request buffers */
+#define DISK_BUFFER_POOL	8	/* buffers kept for reuse by a device */
+#define DISK_DIR_CACHE_SIZE	16	/* directory listings cached by a device */
+#define DISK_DIR_CACHE_TTL	2	/* seconds a listing is used for */
+#define DISK_DIR_WATCH_TTL	30	/* seconds a listing watched by inotify is used for */
+
+/* how the pattern of a directory query is matched */
+#define DISK_MATCH_PATTERN	0
+#define DISK_MATCH_ALL		1
+#define DISK_MATCH_NAME		2
+
+struct _DISK_DIR_ENTRY
+{
+	char * name;
+	char * name16; /* name in UTF-16, as sent */
+	size_t name16_len;
+	uint32 attr;
+	int stat_failed;
+	struct stat st;
+};
+typedef struct _DISK_DIR_ENTRY DISK_DIR_ENTRY;
+
+struct _DISK_DIR
+{
+	char * path;
+	time_t expires;
+	int watch; /* inotify watch descriptor, -1 if not watched */
+	int refs; /* held by the cache and by the handles enumerating it */
+	int count;
+	DISK_DIR_ENTRY * entries;
+	int num_buckets;
+	int * buckets; /* first entry of each name hash, -1 if none */
+	int * chain; /* next entry with the same name hash */
+	struct _DISK_DIR * next;
+};
+typedef struct _DISK_DIR DISK_DIR;
+
 struct _FILE_INFO
 {
 	uint32 file_id;
@@ -55,9 +120,25 @@ struct _FILE_INFO
 	char * fullpath;
 	char * pattern;
 	int delete_pending;
+	int busy; /* reads and writes queued or running */
+	int closed; /* closed while busy, freed by the last of them */
+	int dirty; /* changed through this handle, cached stats are stale */
+	DISK_DIR * listing; /* listing enumerated by directory queries */
+	int index; /* next entry of the listing */
+	int match;
 };
 typedef struct _FILE_INFO FILE_INFO;
 
+struct _DISK_IO
+{
+	IRP irp;
+	FILE_INFO * finfo;
+	char * buffer;
+	uint32 size;
+	struct _DISK_IO * next;
+};
+typedef struct _DISK_IO DISK_IO;
+
 struct _DISK_DEVICE_INFO
 {
 	PDEVMAN devman;
@@ -66,10 +147,27 @@ struct _DISK_DEVICE_INFO
 	PDEVMAN_UNREGISTER_SERVICE DevmanUnregisterService;
 	PDEVMAN_REGISTER_DEVICE DevmanRegisterDevice;
 	PDEVMAN_UNREGISTER_DEVICE DevmanUnregisterDevice;
+	PDEVMAN_COMPLETE_IRP DevmanCompleteIrp;
 
 	char * path;
 
-	FILE_INFO * head;
+	/* open files, by file_id, only used on the rdpdr thread */
+	FILE_INFO * files[DISK_FILE_BUCKETS];
+
+	/* cached listings, most recently used first, only used on the rdpdr thread */
+	DISK_DIR * dirs;
+	int inotify;
+	UNICONV * uniconv;
+
+	/* the mutex guards the queue, the buffers and the busy files */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	DISK_IO * io_head;
+	DISK_IO * io_tail;
+	char * buffers[DISK_BUFFER_POOL];
+	int num_buffers;
+	int stop;
+	pthread_t workers[DISK_WORKERS];
 };
 typedef struct _DISK_DEVICE_INFO DISK_DEVICE_INFO;
 
@@ -257,7 +355,7 @@ disk_get_file_info(DEVICE * dev, uint32 file_id)
 	FILE_INFO * curr;
 
 	info = (DISK_DEVICE_INFO *) dev->info;
-	for (curr = info->head; curr; curr = curr->next)
+	for (curr = info->files[file_id % DISK_FILE_BUCKETS]; curr; curr = curr->next)
 	{
 		if (curr->file_id == file_id)
 		{
@@ -267,6 +365,286 @@ disk_get_file_info(DEVICE * dev, uint32 file_id)
 	return NULL;
 }
 
+static uint32
+disk_name_hash(const char * name)
+{
+	uint32 hash = 5381;
+
+	while (*name)
+		hash = hash * 33 + (uint8) *name++;
+	return hash;
+}
+
+static void
+disk_dir_release(DISK_DIR * dir)
+{
+	int i;
+
+	if (--dir->refs > 0)
+		return;
+
+	for (i = 0; i < dir->count; i++)
+	{
+		free(dir->entries[i].name);
+		xfree(dir->entries[i].name16);
+	}
+	free(dir->entries);
+	free(dir->buckets);
+	free(dir->chain);
+	free(dir->path);
+	free(dir);
+}
+
+static int
+disk_dir_find(DISK_DIR * dir, const char * name)
+{
+	int i;
+
+	for (i = dir->buckets[disk_name_hash(name) % dir->num_buckets]; i >= 0; i = dir->chain[i])
+	{
+		if (strcmp(dir->entries[i].name, name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+static DISK_DIR *
+disk_dir_read(DISK_DEVICE_INFO * info, const char * path)
+{
+	DIR * pdir;
+	DISK_DIR * dir;
+	DISK_DIR_ENTRY * entry;
+	struct dirent * pdirent;
+	char * p;
+	int p_size;
+	int size;
+	int len;
+	int i;
+	int h;
+
+	pdir = opendir(path);
+	if (pdir == NULL)
+		return NULL;
+
+	dir = (DISK_DIR *) malloc(sizeof(DISK_DIR));
+	memset(dir, 0, sizeof(DISK_DIR));
+	dir->path = strdup(path);
+	dir->watch = -1;
+	dir->refs = 1;
+
+#ifdef HAVE_SYS_INOTIFY_H
+	/* watched before it is read, so no change goes unnoticed */
+	if (info->inotify != -1)
+		dir->watch = inotify_add_watch(info->inotify, path, IN_CREATE | IN_DELETE |
+			IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+#endif
+
+	size = 64;
+	dir->entries = (DISK_DIR_ENTRY *) malloc(size * sizeof(DISK_DIR_ENTRY));
+	len = strlen(path);
+	p_size = len + 258;
+	p = malloc(p_size);
+
+	while ((pdirent = readdir(pdir)) != NULL)
+	{
+		if (dir->count == size)
+		{
+			size *= 2;
+			dir->entries = (DISK_DIR_ENTRY *) realloc(dir->entries, size * sizeof(DISK_DIR_ENTRY));
+		}
+		if (len + strlen(pdirent->d_name) + 2 > p_size)
+		{
+			p_size = len + strlen(pdirent->d_name) + 2;
+			p = realloc(p, p_size);
+		}
+
+		entry = &dir->entries[dir->count++];
+		entry->name = strdup(pdirent->d_name);
+		sprintf(p, "%s/%s", path, pdirent->d_name);
+		memset(&entry->st, 0, sizeof(struct stat));
+		entry->stat_failed = (stat(p, &entry->st) != 0);
+		if (entry->stat_failed)
+		{
+			LLOGLN(0, ("disk_dir_read: stat %s failed (%i)\n", p, errno));
+		}
+		entry->attr = get_file_attribute(pdirent->d_name, &entry->st);
+		entry->name16 = freerdp_uniconv_out(info->uniconv, pdirent->d_name, &entry->name16_len);
+	}
+	free(p);
+	closedir(pdir);
+
+	dir->num_buckets = dir->count + 1;
+	dir->buckets = (int *) malloc(dir->num_buckets * sizeof(int));
+	dir->chain = (int *) malloc((dir->count + 1) * sizeof(int));
+	for (i = 0; i < dir->num_buckets; i++)
+		dir->buckets[i] = -1;
+	for (i = 0; i < dir->count; i++)
+	{
+		h = disk_name_hash(dir->entries[i].name) % dir->num_buckets;
+		dir->chain[i] = dir->buckets[h];
+		dir->buckets[h] = i;
+	}
+
+	return dir;
+}
+
+static void
+disk_cache_drop(DISK_DEVICE_INFO * info, DISK_DIR * dir)
+{
+	DISK_DIR ** pdir;
+
+	for (pdir = &info->dirs; *pdir != dir; pdir = &(*pdir)->next)
+		;
+	*pdir = dir->next;
+
+#ifdef HAVE_SYS_INOTIFY_H
+	/* listings of the same directory by other paths share its watch */
+	if (dir->watch != -1)
+	{
+		DISK_DIR * other;
+
+		for (other = info->dirs; other; other = other->next)
+		{
+			if (other->watch == dir->watch)
+				break;
+		}
+		if (other == NULL)
+			inotify_rm_watch(info->inotify, dir->watch);
+	}
+#endif
+
+	disk_dir_release(dir);
+}
+
+/* drop the listings of watched directories that changed */
+static void
+disk_cache_check(DISK_DEVICE_INFO * info)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	uint32 buf[1024];
+	struct inotify_event * event;
+	DISK_DIR * dir;
+	DISK_DIR * next;
+	ssize_t len;
+	ssize_t i;
+
+	if (info->inotify == -1)
+		return;
+
+	while ((len = read(info->inotify, buf, sizeof(buf))) > 0)
+	{
+		for (i = 0; i < len; i += sizeof(struct inotify_event) + event->len)
+		{
+			event = (struct inotify_event *) ((char *) buf + i);
+			for (dir = info->dirs; dir; dir = next)
+			{
+				next = dir->next;
+				if (dir->watch == event->wd || (event->mask & IN_Q_OVERFLOW))
+					disk_cache_drop(info, dir);
+			}
+		}
+	}
+#endif
+}
+
+/* the listing of a directory, read and cached when it is not and fill is set */
+static DISK_DIR *
+disk_cache_get(DISK_DEVICE_INFO * info, const char * path, int fill)
+{
+	DISK_DIR ** pdir;
+	DISK_DIR * dir;
+	time_t now;
+	int count;
+
+	disk_cache_check(info);
+	now = time(NULL);
+
+	for (pdir = &info->dirs; *pdir; pdir = &(*pdir)->next)
+	{
+		dir = *pdir;
+		if (strcmp(dir->path, path) != 0)
+			continue;
+		if (now >= dir->expires)
+		{
+			disk_cache_drop(info, dir);
+			break;
+		}
+		*pdir = dir->next;
+		dir->next = info->dirs;
+		info->dirs = dir;
+		return dir;
+	}
+
+	if (!fill)
+		return NULL;
+
+	dir = disk_dir_read(info, path);
+	if (dir == NULL)
+		return NULL;
+	dir->expires = now + (dir->watch != -1 ? DISK_DIR_WATCH_TTL : DISK_DIR_CACHE_TTL);
+	dir->next = info->dirs;
+	info->dirs = dir;
+
+	for (count = 1, dir = info->dirs; dir->next; dir = dir->next)
+		count++;
+	if (count > DISK_DIR_CACHE_SIZE)
+		disk_cache_drop(info, dir);
+
+	return info->dirs;
+}
+
+/* drop the listings a change to a file or directory makes stale */
+static void
+disk_cache_changed(DISK_DEVICE_INFO * info, const char * fullpath)
+{
+	DISK_DIR * dir;
+	DISK_DIR * next;
+	char * p;
+	int len;
+
+	p = strrchr(fullpath, '/');
+	len = (p ? p - fullpath : 0);
+
+	for (dir = info->dirs; dir; dir = next)
+	{
+		next = dir->next;
+		if (strcmp(dir->path, fullpath) == 0 ||
+			(strncmp(dir->path, fullpath, len) == 0 && dir->path[len] == '\0'))
+			disk_cache_drop(info, dir);
+	}
+}
+
+/* stat a file from the cached listing of its directory when there is one */
+static int
+disk_cache_stat(DISK_DEVICE_INFO * info, FILE_INFO * finfo, struct stat * file_stat)
+{
+	DISK_DIR * dir;
+	char * parent;
+	char * p;
+	int i;
+
+	if (!finfo->dirty)
+	{
+		parent = strdup(finfo->fullpath);
+		p = strrchr(parent, '/');
+		if (p != NULL)
+		{
+			*p = '\0';
+			dir = disk_cache_get(info, parent, 0);
+			i = (dir ? disk_dir_find(dir, p + 1) : -1);
+			if (i >= 0 && !dir->entries[i].stat_failed)
+			{
+				memcpy(file_stat, &dir->entries[i].st, sizeof(struct stat));
+				free(parent);
+				return 0;
+			}
+		}
+		free(parent);
+	}
+
+	return stat(finfo->fullpath, file_stat);
+}
+
 static uint32
 disk_remove_dir(const char * path)
 {
@@ -329,50 +707,248 @@ disk_remove_dir(const char * path)
 	return ret;
 }
 
+static void
+disk_free_file_info(FILE_INFO * finfo)
+{
+	if (finfo->file != -1)
+		close(finfo->file);
+	if (finfo->dir)
+		closedir(finfo->dir);
+	if (finfo->delete_pending)
+	{
+		if (finfo->is_dir)
+		{
+			disk_remove_dir(finfo->fullpath);
+		}
+		else
+		{
+			unlink(finfo->fullpath);
+		}
+	}
+
+	if (finfo->fullpath)
+		free(finfo->fullpath);
+	if (finfo->pattern)
+		free(finfo->pattern);
+
+	free(finfo);
+}
+
 static void
 disk_remove_file(DEVICE * dev, uint32 file_id)
 {
 	DISK_DEVICE_INFO * info;
 	FILE_INFO * curr;
 	FILE_INFO * prev;
+	FILE_INFO ** bucket;
+	int busy;
 
 	info = (DISK_DEVICE_INFO *) dev->info;
-	for (prev = NULL, curr = info->head; curr; prev = curr, curr = curr->next)
+	bucket = &info->files[file_id % DISK_FILE_BUCKETS];
+	for (prev = NULL, curr = *bucket; curr; prev = curr, curr = curr->next)
 	{
 		if (curr->file_id == file_id)
 		{
 			LLOGLN(10, ("disk_remove_file: id=%d", curr->file_id));
 
-			if (curr->file != -1)
-				close(curr->file);
-			if (curr->dir)
-				closedir(curr->dir);
-			if (curr->delete_pending)
+			if (prev == NULL)
+				*bucket = curr->next;
+			else
+				prev->next = curr->next;
+
+			if (curr->listing)
 			{
-				if (curr->is_dir)
-				{
-					disk_remove_dir(curr->fullpath);
-				}
-				else
-				{
-					unlink(curr->fullpath);
-				}
+				disk_dir_release(curr->listing);
+				curr->listing = NULL;
 			}
+			if (curr->dirty || curr->delete_pending)
+				disk_cache_changed(info, curr->fullpath);
 
-			if (curr->fullpath)
-				free(curr->fullpath);
-			if (curr->pattern)
-				free(curr->pattern);
+			pthread_mutex_lock(&info->mutex);
+			busy = curr->busy;
+			curr->closed = 1;
+			pthread_mutex_unlock(&info->mutex);
 
-			if (prev == NULL)
-				info->head = curr->next;
-			else
-				prev->next  = curr->next;
+			if (!busy)
+				disk_free_file_info(curr);
+			break;
+		}
+	}
+}
 
-			free(curr);
+/* called with the mutex held */
+static char *
+disk_get_buffer(DISK_DEVICE_INFO * info, uint32 size)
+{
+	if (size > DISK_BUFFER_SIZE)
+		return (char *) malloc(size);
+	if (info->num_buffers > 0)
+		return info->buffers[--info->num_buffers];
+	return (char *) malloc(DISK_BUFFER_SIZE);
+}
+
+/* called with the mutex held */
+static void
+disk_put_buffer(DISK_DEVICE_INFO * info, char * buffer, uint32 size)
+{
+	if (size <= DISK_BUFFER_SIZE && info->num_buffers < DISK_BUFFER_POOL)
+		info->buffers[info->num_buffers++] = buffer;
+	else
+		free(buffer);
+}
+
+static void
+disk_io_free(DISK_DEVICE_INFO * info, DISK_IO * io)
+{
+	FILE_INFO * finfo;
+
+	finfo = io->finfo;
+	pthread_mutex_lock(&info->mutex);
+	disk_put_buffer(info, io->buffer, io->size);
+	finfo->busy--;
+	if (finfo->busy > 0 || !finfo->closed)
+		finfo = NULL;
+	pthread_mutex_unlock(&info->mutex);
+
+	if (finfo != NULL)
+		disk_free_file_info(finfo);
+	free(io);
+}
+
+/* hand a read or a write over to the workers, which complete it */
+static uint32
+disk_queue_io(IRP * irp, FILE_INFO * finfo, uint32 size)
+{
+	DISK_DEVICE_INFO * info;
+	DISK_IO * io;
+
+	info = (DISK_DEVICE_INFO *) irp->dev->info;
+	io = (DISK_IO *) malloc(sizeof(DISK_IO));
+	io->irp = *irp;
+	io->finfo = finfo;
+	io->size = size;
+	io->next = NULL;
+
+	pthread_mutex_lock(&info->mutex);
+	io->buffer = disk_get_buffer(info, size);
+	pthread_mutex_unlock(&info->mutex);
+
+	/* the request data goes away once the rdpdr thread is done with it */
+	if (irp->majorFunction == IRP_MJ_WRITE)
+	{
+		memcpy(io->buffer, irp->inputBuffer, size);
+		io->irp.inputBuffer = io->buffer;
+	}
+
+	pthread_mutex_lock(&info->mutex);
+	finfo->busy++;
+	if (info->io_tail == NULL)
+		info->io_head = io;
+	else
+		info->io_tail->next = io;
+	info->io_tail = io;
+	pthread_cond_signal(&info->cond);
+	pthread_mutex_unlock(&info->mutex);
+
+	return RD_STATUS_PENDING | 0xC0000000;
+}
+
+static void
+disk_io_read(DISK_IO * io)
+{
+	IRP * irp = &io->irp;
+	ssize_t r;
+
+	r = pread(io->finfo->file, io->buffer, irp->length, irp->offset);
+	if (r == -1)
+	{
+		irp->ioStatus = get_error_status();
+		irp->outputBufferLength = 0;
+	}
+	else
+	{
+		irp->ioStatus = RD_STATUS_SUCCESS;
+		irp->outputBuffer = io->buffer;
+		irp->outputBufferLength = r;
+	}
+	irp->outputResult = irp->outputBufferLength;
+}
+
+static void
+disk_io_write(DISK_IO * io)
+{
+	IRP * irp = &io->irp;
+	static char pad[1] = { 0 };
+	uint32 len;
+	ssize_t r;
+
+	irp->ioStatus = RD_STATUS_SUCCESS;
+	len = 0;
+	while (len < io->size)
+	{
+		r = pwrite(io->finfo->file, io->buffer + len, io->size - len, irp->offset + len);
+		if (r == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			irp->ioStatus = get_error_status();
+			break;
+		}
+		len += r;
+	}
+
+	if (irp->ioStatus == RD_STATUS_SUCCESS)
+	{
+		irp->outputResult = irp->length;
+		/* [MS-RDPEFS] says this is an optional padding, but unfortunately it's required! */
+		irp->outputBuffer = pad;
+		irp->outputBufferLength = 1;
+	}
+}
+
+static void *
+disk_io_thread(void * arg)
+{
+	DISK_DEVICE_INFO * info;
+	DISK_IO * io;
+	int stop;
+
+	info = (DISK_DEVICE_INFO *) arg;
+	while (1)
+	{
+		pthread_mutex_lock(&info->mutex);
+		while (info->io_head == NULL && !info->stop)
+			pthread_cond_wait(&info->cond, &info->mutex);
+		if (info->stop)
+		{
+			pthread_mutex_unlock(&info->mutex);
 			break;
 		}
+		io = info->io_head;
+		info->io_head = io->next;
+		if (info->io_head == NULL)
+			info->io_tail = NULL;
+		pthread_mutex_unlock(&info->mutex);
+
+		if (io->irp.majorFunction == IRP_MJ_READ)
+			disk_io_read(io);
+		else
+			disk_io_write(io);
+
+		LLOGLN(10, ("disk_io_thread: id=%d completion=%d status=0x%x",
+			io->irp.fileID, io->irp.completionID, io->irp.ioStatus));
+
+		/* once disk_free has started the channel is closed and nothing
+		   sends the completions any more, writing one could block forever */
+		pthread_mutex_lock(&info->mutex);
+		stop = info->stop;
+		pthread_mutex_unlock(&info->mutex);
+		if (!stop)
+			info->DevmanCompleteIrp(info->devman, &io->irp);
+		disk_io_free(info, io);
 	}
+
+	return NULL;
 }
 
 static uint32
@@ -395,11 +971,14 @@ disk_create(IRP * irp, const char * path)
 	{
 		finfo->fullpath = fullpath;
 		finfo->file_id = info->devman->id_sequence++;
-		finfo->next = info->head;
-		info->head = finfo;
+		finfo->next = info->files[finfo->file_id % DISK_FILE_BUCKETS];
+		info->files[finfo->file_id % DISK_FILE_BUCKETS] = finfo;
 
 		irp->fileID = finfo->file_id;
 		LLOGLN(10, ("disk_create: %s (id=%d)", path, finfo->file_id));
+
+		if (irp->createDisposition != FILE_OPEN)
+			disk_cache_changed(info, fullpath);
 	}
 	else
 	{
@@ -422,8 +1001,6 @@ static uint32
 disk_read(IRP * irp)
 {
 	FILE_INFO * finfo;
-	char * buf;
-	ssize_t r;
 
 	LLOGLN(10, ("disk_read: id=%d len=%d off=%lld", irp->fileID, irp->length, irp->offset));
 	finfo = disk_get_file_info(irp->dev, irp->fileID);
@@ -437,37 +1014,19 @@ disk_read(IRP * irp)
 	if (finfo->file == -1)
 		return RD_STATUS_INVALID_HANDLE;
 
-	if (lseek(finfo->file, irp->offset, SEEK_SET) == (off_t) - 1)
-		return get_error_status();
-
-	buf = malloc(irp->length);
-	memset(buf, 0, irp->length);
-	r = read(finfo->file, buf, irp->length);
-	if (r == -1)
-	{
-		free(buf);
-		return get_error_status();
-	}
-	else
-	{
-		irp->outputBuffer = buf;
-		irp->outputBufferLength = r;
-		return RD_STATUS_SUCCESS;
-	}
+	return disk_queue_io(irp, finfo, irp->length);
 }
 
 static uint32
 disk_write(IRP * irp)
 {
 	FILE_INFO * finfo;
-	ssize_t r;
-	uint32 len;
 
 	LLOGLN(10, ("disk_write: id=%d len=%d off=%lld", irp->fileID, irp->inputBufferLength, irp->offset));
 	finfo = disk_get_file_info(irp->dev, irp->fileID);
 	if (finfo == NULL)
 	{
-		LLOGLN(0, ("disk_read: invalid file id"));
+		LLOGLN(0, ("disk_write: invalid file id"));
 		return RD_STATUS_INVALID_HANDLE;
 	}
 	if (finfo->is_dir)
@@ -475,20 +1034,13 @@ disk_write(IRP * irp)
 	if (finfo->file == -1)
 		return RD_STATUS_INVALID_HANDLE;
 
-	if (lseek(finfo->file, irp->offset, SEEK_SET) == (off_t) - 1)
-		return get_error_status();
-
-	len = 0;
-	while (len < irp->inputBufferLength)
+	/* sizes and times in the listing of its directory are stale from now on */
+	if (!finfo->dirty)
 	{
-		r = write(finfo->file, irp->inputBuffer, irp->inputBufferLength);
-		if (r == -1)
-		{
-			return get_error_status();
-		}
-		len += r;
+		finfo->dirty = 1;
+		disk_cache_changed((DISK_DEVICE_INFO *) irp->dev->info, finfo->fullpath);
 	}
-	return RD_STATUS_SUCCESS;
+	return disk_queue_io(irp, finfo, irp->inputBufferLength);
 }
 
 static uint32
@@ -615,8 +1167,9 @@ disk_query_info(IRP * irp)
 
 	status = RD_STATUS_SUCCESS;
 
-	if (stat(finfo->fullpath, &file_stat) != 0)
+	if (disk_cache_stat((DISK_DEVICE_INFO *) irp->dev->info, finfo, &file_stat) != 0)
 	{
+		free(buf);
 		return RD_STATUS_NO_SUCH_FILE;
 	}
 
@@ -663,6 +1216,7 @@ disk_query_info(IRP * irp)
 static uint32
 disk_set_info(IRP * irp)
 {
+	DISK_DEVICE_INFO * info;
 	FILE_INFO *finfo;
 	uint32 status;
 	uint64 len;
@@ -673,7 +1227,6 @@ disk_set_info(IRP * irp)
 	int mode;
 	uint32 attr;
 	time_t t;
-	UNICONV * uniconv;
 
 	LLOGLN(10, ("disk_set_info: class=%d id=%d", irp->infoClass, irp->fileID));
 	finfo = disk_get_file_info(irp->dev, irp->fileID);
@@ -682,8 +1235,11 @@ disk_set_info(IRP * irp)
 		LLOGLN(0, ("disk_set_info: invalid file id"));
 		return RD_STATUS_INVALID_HANDLE;
 	}
+	info = (DISK_DEVICE_INFO *) irp->dev->info;
 
 	status = RD_STATUS_SUCCESS;
+	finfo->dirty = 1;
+	disk_cache_changed(info, finfo->fullpath);
 
 	switch (irp->infoClass)
 	{
@@ -730,12 +1286,11 @@ disk_set_info(IRP * irp)
 			//replaceIfExists = GET_UINT8(irp->inputBuffer, 0); /* ReplaceIfExists */
 			//rootDirectory = GET_UINT8(irp->inputBuffer, 1); /* RootDirectory */
 			len = GET_UINT32(irp->inputBuffer, 2);
-			uniconv = freerdp_uniconv_new();
-			buf = freerdp_uniconv_in(uniconv, (unsigned char*) (irp->inputBuffer + 6), len);
-			freerdp_uniconv_free(uniconv);
+			buf = freerdp_uniconv_in(info->uniconv, (unsigned char*) (irp->inputBuffer + 6), len);
 			fullpath = disk_get_fullpath(irp->dev, buf);
 			xfree(buf);
 			LLOGLN(10, ("disk_set_info: rename %s to %s", finfo->fullpath, fullpath));
+			disk_cache_changed(info, fullpath);
 			if (rename(finfo->fullpath, fullpath) == 0)
 			{
 				free(finfo->fullpath);
@@ -757,20 +1312,56 @@ disk_set_info(IRP * irp)
 	return status;
 }
 
+/* the fields FILE_DIRECTORY_INFORMATION shares with the classes extending it */
+static void
+disk_pack_directory_info(char * buf, DISK_DIR_ENTRY * entry)
+{
+	struct stat * file_stat = &entry->st;
+
+	SET_UINT32(buf, 0, 0); /* NextEntryOffset */
+	SET_UINT32(buf, 4, 0); /* FileIndex */
+	SET_UINT64(buf, 8, get_rdp_filetime(file_stat->st_ctime < file_stat->st_mtime ?
+		file_stat->st_ctime : file_stat->st_mtime)); /* CreationTime */
+	SET_UINT64(buf, 16, get_rdp_filetime(file_stat->st_atime)); /* LastAccessTime */
+	SET_UINT64(buf, 24, get_rdp_filetime(file_stat->st_mtime)); /* LastWriteTime */
+	SET_UINT64(buf, 32, get_rdp_filetime(file_stat->st_ctime)); /* ChangeTime */
+	SET_UINT64(buf, 40, file_stat->st_size); /* EndOfFile */
+	SET_UINT64(buf, 48, file_stat->st_size); /* AllocationSize */
+	SET_UINT32(buf, 56, entry->attr); /* FileAttributes */
+	SET_UINT32(buf, 60, entry->name16_len); /* FileNameLength */
+}
+
+static DISK_DIR_ENTRY *
+disk_next_entry(FILE_INFO * finfo)
+{
+	DISK_DIR * dir = finfo->listing;
+	DISK_DIR_ENTRY * entry;
+
+	if (dir == NULL)
+		return NULL;
+
+	while (finfo->index < dir->count)
+	{
+		entry = &dir->entries[finfo->index++];
+		if (finfo->match == DISK_MATCH_NAME)
+			finfo->index = dir->count;
+		if (finfo->match != DISK_MATCH_PATTERN || fnmatch(finfo->pattern, entry->name, 0) == 0)
+			return entry;
+	}
+	return NULL;
+}
+
 static uint32
 disk_query_directory(IRP * irp, uint8 initialQuery, const char * path)
 {
 	DISK_DEVICE_INFO * info;
 	FILE_INFO * finfo;
+	DISK_DIR_ENTRY * entry;
 	char * p;
 	uint32 status;
 	char * buf;
 	int size;
-	size_t len;
-	struct dirent * pdirent;
-	struct stat file_stat;
-	uint32 attr;
-	UNICONV * uniconv;
+	int i;
 
 	LLOGLN(10, ("disk_query_directory: class=%d id=%d init=%d path=%s", irp->infoClass, irp->fileID,
 		initialQuery, path));
@@ -790,119 +1381,79 @@ disk_query_directory(IRP * irp, uint8 initialQuery, const char * path)
 		p = (p ? p + 1 : (char *)path);
 		finfo->pattern = malloc(strlen(p) + 1);
 		strcpy(finfo->pattern, p);
-		rewinddir(finfo->dir);
+
+		if (finfo->listing)
+			disk_dir_release(finfo->listing);
+		finfo->listing = disk_cache_get(info, finfo->fullpath, 1);
+		if (finfo->listing == NULL)
+			return get_error_status();
+		finfo->listing->refs++;
+		finfo->index = 0;
+
+		/* Explorer looks single files up by name, they are found by hash */
+		if (finfo->pattern[0] == '\0' || strcmp(finfo->pattern, "*") == 0)
+		{
+			finfo->match = DISK_MATCH_ALL;
+		}
+		else if (strpbrk(finfo->pattern, "*?[") == NULL)
+		{
+			finfo->match = DISK_MATCH_NAME;
+			i = disk_dir_find(finfo->listing, finfo->pattern);
+			finfo->index = (i >= 0 ? i : finfo->listing->count);
+		}
+		else
+		{
+			finfo->match = DISK_MATCH_PATTERN;
+		}
 	}
 
 	status = RD_STATUS_SUCCESS;
 	buf = NULL;
 	size = 0;
 
-	pdirent = readdir(finfo->dir);
-	while (pdirent && finfo->pattern[0] && fnmatch(finfo->pattern, pdirent->d_name, 0) != 0)
-		pdirent = readdir(finfo->dir);
-	if (pdirent == NULL)
+	entry = disk_next_entry(finfo);
+	if (entry == NULL)
 	{
 		return RD_STATUS_NO_MORE_FILES;
 	}
 
-	memset(&file_stat, 0, sizeof(struct stat));
-	p = malloc(strlen(finfo->fullpath) + strlen(pdirent->d_name) + 2);
-	sprintf(p, "%s/%s", finfo->fullpath, pdirent->d_name);
-	if (stat(p, &file_stat) != 0)
-	{
-		LLOGLN(0, ("disk_query_directory: stat %s failed (%i)\n", p, errno));
-	}
-	free(p);
-
-	attr = get_file_attribute(pdirent->d_name, &file_stat);
-	uniconv = freerdp_uniconv_new();
-
 	switch (irp->infoClass)
 	{
 		case FileBothDirectoryInformation:
-			size = 93 + strlen(pdirent->d_name) * 2;
+			size = 93 + entry->name16_len;
 			buf = malloc(size);
-			memset(buf, 0, size);
-
-			SET_UINT32(buf, 0, 0); /* NextEntryOffset */
-			SET_UINT32(buf, 4, 0); /* FileIndex */
-			SET_UINT64(buf, 8, get_rdp_filetime(file_stat.st_ctime < file_stat.st_mtime ?
-				file_stat.st_ctime : file_stat.st_mtime)); /* CreationTime */
-			SET_UINT64(buf, 16, get_rdp_filetime(file_stat.st_atime)); /* LastAccessTime */
-			SET_UINT64(buf, 24, get_rdp_filetime(file_stat.st_mtime)); /* LastWriteTime */
-			SET_UINT64(buf, 32, get_rdp_filetime(file_stat.st_ctime)); /* ChangeTime */
-			SET_UINT64(buf, 40, file_stat.st_size); /* EndOfFile */
-			SET_UINT64(buf, 48, file_stat.st_size); /* AllocationSize */
-			SET_UINT32(buf, 56, attr); /* FileAttributes */
+			memset(buf, 0, 93);
+			disk_pack_directory_info(buf, entry);
 			SET_UINT32(buf, 64, 0); /* EaSize */
 			SET_UINT8(buf, 68, 0); /* ShortNameLength */
 			/* [MS-FSCC] has one byte padding here but RDP does not! */
 			//SET_UINT8(buf, 69, 0); /* Reserved */
 			/* ShortName 24  bytes */
-			p = freerdp_uniconv_out(uniconv, pdirent->d_name, &len);
-			memcpy(buf + 93, p, len);
-			xfree(p);
-			SET_UINT32(buf, 60, len); /* FileNameLength */
-			size = 93 + len;
+			memcpy(buf + 93, entry->name16, entry->name16_len);
 			break;
 
 		case FileFullDirectoryInformation:
-			size = 68 + strlen(pdirent->d_name) * 2;
+			size = 68 + entry->name16_len;
 			buf = malloc(size);
-			memset(buf, 0, size);
-
-			SET_UINT32(buf, 0, 0); /* NextEntryOffset */
-			SET_UINT32(buf, 4, 0); /* FileIndex */
-			SET_UINT64(buf, 8, get_rdp_filetime(file_stat.st_ctime < file_stat.st_mtime ?
-				file_stat.st_ctime : file_stat.st_mtime)); /* CreationTime */
-			SET_UINT64(buf, 16, get_rdp_filetime(file_stat.st_atime)); /* LastAccessTime */
-			SET_UINT64(buf, 24, get_rdp_filetime(file_stat.st_mtime)); /* LastWriteTime */
-			SET_UINT64(buf, 32, get_rdp_filetime(file_stat.st_ctime)); /* ChangeTime */
-			SET_UINT64(buf, 40, file_stat.st_size); /* EndOfFile */
-			SET_UINT64(buf, 48, file_stat.st_size); /* AllocationSize */
-			SET_UINT32(buf, 56, attr); /* FileAttributes */
+			disk_pack_directory_info(buf, entry);
 			SET_UINT32(buf, 64, 0); /* EaSize */
-			p = freerdp_uniconv_out(uniconv, pdirent->d_name, &len);
-			memcpy(buf + 68, p, len);
-			xfree(p);
-			SET_UINT32(buf, 60, len); /* FileNameLength */
-			size = 68 + len;
+			memcpy(buf + 68, entry->name16, entry->name16_len);
 			break;
 
 		case FileNamesInformation:
-			size = 12 + strlen(pdirent->d_name) * 2;
+			size = 12 + entry->name16_len;
 			buf = malloc(size);
-			memset(buf, 0, size);
-
 			SET_UINT32(buf, 0, 0); /* NextEntryOffset */
 			SET_UINT32(buf, 4, 0); /* FileIndex */
-			p = freerdp_uniconv_out(uniconv, pdirent->d_name, &len);
-			memcpy(buf + 12, p, len);
-			xfree(p);
-			SET_UINT32(buf, 8, len); /* FileNameLength */
-			size = 12 + len;
+			SET_UINT32(buf, 8, entry->name16_len); /* FileNameLength */
+			memcpy(buf + 12, entry->name16, entry->name16_len);
 			break;
 
 		case FileDirectoryInformation:
-			size = 64 + strlen(pdirent->d_name) * 2;
+			size = 64 + entry->name16_len;
 			buf = malloc(size);
-			memset(buf, 0, size);
-
-			SET_UINT32(buf, 0, 0); /* NextEntryOffset */
-			SET_UINT32(buf, 4, 0); /* FileIndex */
-			SET_UINT64(buf, 8, get_rdp_filetime(file_stat.st_ctime < file_stat.st_mtime ?
-				file_stat.st_ctime : file_stat.st_mtime)); /* CreationTime */
-			SET_UINT64(buf, 16, get_rdp_filetime(file_stat.st_atime)); /* LastAccessTime */
-			SET_UINT64(buf, 24, get_rdp_filetime(file_stat.st_mtime)); /* LastWriteTime */
-			SET_UINT64(buf, 32, get_rdp_filetime(file_stat.st_ctime)); /* ChangeTime */
-			SET_UINT64(buf, 40, file_stat.st_size); /* EndOfFile */
-			SET_UINT64(buf, 48, file_stat.st_size); /* AllocationSize */
-			SET_UINT32(buf, 56, attr); /* FileAttributes */
-			p = freerdp_uniconv_out(uniconv, pdirent->d_name, &len);
-			memcpy(buf + 64, p, len);
-			xfree(p);
-			SET_UINT32(buf, 60, len); /* FileNameLength */
-			size = 64 + len;
+			disk_pack_directory_info(buf, entry);
+			memcpy(buf + 64, entry->name16, entry->name16_len);
 			break;
 
 		default:
@@ -911,8 +1462,6 @@ disk_query_directory(IRP * irp, uint8 initialQuery, const char * path)
 			break;
 	}
 
-	freerdp_uniconv_free(uniconv);
-
 	irp->outputBuffer = buf;
 	irp->outputBufferLength = size;
 
@@ -939,13 +1488,43 @@ static uint32
 disk_free(DEVICE * dev)
 {
 	DISK_DEVICE_INFO * info;
+	DISK_IO * io;
+	int i;
 
 	LLOGLN(10, ("disk_free"));
 	info = (DISK_DEVICE_INFO *) dev->info;
-	while (info->head)
+
+	pthread_mutex_lock(&info->mutex);
+	info->stop = 1;
+	pthread_cond_broadcast(&info->cond);
+	pthread_mutex_unlock(&info->mutex);
+	for (i = 0; i < DISK_WORKERS; i++)
+		pthread_join(info->workers[i], NULL);
+
+	/* the channel is closed, requests not served yet are dropped */
+	while (info->io_head)
+	{
+		io = info->io_head;
+		info->io_head = io->next;
+		disk_io_free(info, io);
+	}
+
+	for (i = 0; i < DISK_FILE_BUCKETS; i++)
 	{
-		disk_remove_file(dev, info->head->file_id);
+		while (info->files[i])
+			disk_remove_file(dev, info->files[i]->file_id);
 	}
+
+	while (info->dirs)
+		disk_cache_drop(info, info->dirs);
+	if (info->inotify != -1)
+		close(info->inotify);
+	freerdp_uniconv_free(info->uniconv);
+
+	for (i = 0; i < info->num_buffers; i++)
+		free(info->buffers[i]);
+	pthread_cond_destroy(&info->cond);
+	pthread_mutex_destroy(&info->mutex);
 	free(info);
 	if (dev->data)
 	{
@@ -959,7 +1538,7 @@ static int
 disk_get_fd(IRP * irp)
 {
 	FILE_INFO * finfo = disk_get_file_info(irp->dev, irp->fileID);
-	return finfo->file;
+	return (finfo ? finfo->file : -1);
 }
 
 static SERVICE *
@@ -1013,8 +1592,22 @@ DeviceServiceEntry(PDEVMAN pDevman, PDEVMAN_ENTRY_POINTS pEntryPoints)
 			info->DevmanUnregisterService = pEntryPoints->pDevmanUnregisterService;
 			info->DevmanRegisterDevice = pEntryPoints->pDevmanRegisterDevice;
 			info->DevmanUnregisterDevice = pEntryPoints->pDevmanUnregisterDevice;
+			info->DevmanCompleteIrp = pEntryPoints->pDevmanCompleteIrp;
 			info->path = (char *) data->data[2];
 
+			info->uniconv = freerdp_uniconv_new();
+			info->inotify = -1;
+#ifdef HAVE_SYS_INOTIFY_H
+			info->inotify = inotify_init();
+			if (info->inotify != -1)
+				fcntl(info->inotify, F_SETFL, O_NONBLOCK);
+#endif
+
+			pthread_mutex_init(&info->mutex, NULL);
+			pthread_cond_init(&info->cond, NULL);
+			for (i = 0; i < DISK_WORKERS; i++)
+				pthread_create(&info->workers[i], NULL, disk_io_thread, info);
+
 			dev = info->DevmanRegisterDevice(pDevman, srv, (char*)data->data[1]);
 			dev->info = info;
 
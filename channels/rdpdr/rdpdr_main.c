@@ -526,14 +526,29 @@ rdpdr_check_fds(rdpdrPlugin * plugin)
 	return 1;
 }
 
+/* may be called by any thread, the IRP and its output buffer stay owned by the caller */
+void
+rdpdr_complete_irp(rdpdrPlugin * plugin, IRP * irp)
+{
+	char * out;
+	int out_size;
+	int error;
+
+	out = irp_output_device_io_completion(irp, &out_size);
+	error = plugin->ep.pVirtualChannelWrite(plugin->open_handle, out, out_size, out);
+	if (error != CHANNEL_RC_OK)
+	{
+		LLOGLN(0, ("rdpdr_complete_irp: "
+			"VirtualChannelWrite failed %d", error));
+		free(out);
+	}
+}
+
 static void
 rdpdr_process_irp(rdpdrPlugin * plugin, char* data, int data_size)
 {
 	IRP irp;
 	int deviceID;
-	char * out;
-	int out_size;
-	int error;
 
 	memset((void*)&irp, '\0', sizeof(IRP));
 
@@ -650,20 +665,14 @@ rdpdr_process_irp(rdpdrPlugin * plugin, char* data, int data_size)
 			rdpdr_abort_single_io(plugin, irp_file_descriptor(&irp), RDPDR_ABORT_IO_READ, RD_STATUS_CANCELLED);
 	}
 
-	if (irp.ioStatus == (RD_STATUS_PENDING | 0xC0000000)) /* smart card */
+	if (irp.ioStatus == (RD_STATUS_PENDING | 0xC0000000)) /* smart card, disk */
 	{
-		irp.ioStatus = RD_STATUS_PENDING; /* this is going to be handled by the smart card plugin */
-		LLOGLN(10, ("smart card irp must not be stored into plgugin->queue"));
+		irp.ioStatus = RD_STATUS_PENDING; /* this is going to be completed by the device service */
+		LLOGLN(10, ("irp completed by the service must not be stored into plugin->queue"));
 	}
 	else if (irp.ioStatus != RD_STATUS_PENDING)
 	{
-		out = irp_output_device_io_completion(&irp, &out_size);
-		error = plugin->ep.pVirtualChannelWrite(plugin->open_handle, out, out_size, out);
-		if (error != CHANNEL_RC_OK)
-		{
-			LLOGLN(0, ("rdpdr_process_irp: "
-				"VirtualChannelWrite failed %d", error));
-		}
+		rdpdr_complete_irp(plugin, &irp);
 		if (irp.outputBuffer)
 		{
 			free(irp.outputBuffer);
@@ -1125,6 +1134,7 @@ VirtualChannelEntry(PCHANNEL_ENTRY_POINTS pEntryPoints)
 	}
 
 	plugin->devman = devman_new(data);
+	plugin->devman->plugin = plugin;
 	devman_load_device_service(plugin->devman, "disk");
 	devman_load_device_service(plugin->devman, "printer");
 	devman_load_device_service(plugin->devman, "serial");
@@ -66,4 +66,7 @@ struct rdpdr_plugin
 	uint32 timeout_fd;
 };
 
+void
+rdpdr_complete_irp(rdpdrPlugin * plugin, IRP * irp);
+
 #endif /* __RDPDR_MAIN_H */
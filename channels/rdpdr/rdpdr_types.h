@@ -85,6 +85,7 @@ struct _DEVMAN
 	DEVICE* head; /* head device in linked list */
 	DEVICE* tail; /* tail device in linked list */
 	void* pDevmanEntryPoints; /* entry points for device services */
+	void* plugin; /* rdpdr plugin sending the completions of devman_complete_irp */
 };
 typedef DEVMAN * PDEVMAN;
 
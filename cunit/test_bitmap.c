@@ -0,0 +1,521 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   Bitmap Decompression Unit Tests
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+   The planar tests use a small encoder that only exists here. Each plane is
+   split into scanlines sent bottom-up, the first one as values and the rest
+   as sign-magnitude deltas against the line below it, cut into raw runs and
+   repeat runs the same way a server does.
+
+   The interleaved RLE tests use random sequences of orders instead, and
+   check that decoding straight into a surface gives the same pixels as
+   decoding into a buffer.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/utils/memory.h>
+#include "bitmap.h"
+
+#include "test_bitmap.h"
+
+#define PLANAR_RLE	0x10
+#define PLANAR_NA	0x20
+
+/* length of the run of value starting at v[x] */
+static int
+planar_run_length(uint8 * v, int x, int width, uint8 value)
+{
+	int n;
+
+	for (n = 0; x + n < width && v[x + n] == value; n++)
+		;
+	return n;
+}
+
+/* encode one scanline of values, returns the encoded length */
+static int
+planar_encode_line(uint8 * v, int width, uint8 * out)
+{
+	int x;
+	int c;
+	int r;
+	int n;
+	uint8 * org_out;
+
+	org_out = out;
+	x = 0;
+	while (x < width)
+	{
+		/* raw values up to the next run of three or more */
+		c = 0;
+		while (x + c < width && c < 15)
+		{
+			if (c > 0 && planar_run_length(v, x + c, width, v[x + c - 1]) >= 3)
+				break;
+			c++;
+		}
+		r = planar_run_length(v, x + c, width, v[x + c - 1]);
+		if (r < 3)
+			r = 0;
+		n = (r > 15) ? 15 : r;
+		*out++ = (c << 4) | n;
+		memcpy(out, v + x, c);
+		out += c;
+		x += c + n;
+		r -= n;
+		/* long repeats of the last value */
+		while (r >= 16)
+		{
+			n = (r > 47) ? 47 : r;
+			*out++ = ((n & 0xf) << 4) | (n >> 4);
+			x += n;
+			r -= n;
+		}
+		if (r >= 3)
+		{
+			*out++ = r;
+			x += r;
+		}
+	}
+	return (int) (out - org_out);
+}
+
+/* encode a plane given as width * height bytes in wire order */
+static int
+planar_encode_plane(uint8 * plane, int width, int height, uint8 * out)
+{
+	int x;
+	int y;
+	int len;
+	int d;
+	uint8 * line;
+
+	line = (uint8 *) xmalloc(width);
+	len = planar_encode_line(plane, width, out);
+	for (y = 1; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+		{
+			d = (signed char) (plane[y * width + x] - plane[(y - 1) * width + x]);
+			line[x] = (d >= 0) ? d * 2 : (-d) * 2 - 1;
+		}
+		len += planar_encode_line(line, width, out + len);
+	}
+	xfree(line);
+	return len;
+}
+
+/* pull channel (0 = b .. 3 = a) out of a top-down 32 bpp image, bottom-up */
+static void
+planar_split(uint8 * image, int width, int height, int channel, uint8 * plane)
+{
+	int x;
+	int y;
+
+	for (y = 0; y < height; y++)
+		for (x = 0; x < width; x++)
+			plane[y * width + x] = image[((height - 1 - y) * width + x) * 4 + channel];
+}
+
+/* encode an image, returns the stream length */
+static int
+planar_encode(uint8 * image, int width, int height, int header, uint8 * out)
+{
+	int i;
+	int len;
+	uint8 * plane;
+
+	plane = (uint8 *) xmalloc(width * height);
+	len = 0;
+	out[len++] = header;
+	for (i = (header & PLANAR_NA) ? 2 : 3; i >= 0; i--)
+	{
+		planar_split(image, width, height, i, plane);
+		if (header & PLANAR_RLE)
+		{
+			len += planar_encode_plane(plane, width, height, out + len);
+		}
+		else
+		{
+			memcpy(out + len, plane, width * height);
+			len += width * height;
+		}
+	}
+	if (!(header & PLANAR_RLE))
+		out[len++] = 0;
+	xfree(plane);
+	return len;
+}
+
+/* a mix of flat areas, gradients and noise */
+static void
+fill_image(uint8 * image, int width, int height, RD_BOOL opaque)
+{
+	int x;
+	int y;
+	uint8 * p;
+
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+		{
+			p = image + (y * width + x) * 4;
+			if ((x / 8 + y / 8) % 3 == 0)
+			{
+				p[0] = 0x20;
+				p[1] = 0x40;
+				p[2] = 0x80;
+			}
+			else if ((x / 8 + y / 8) % 3 == 1)
+			{
+				p[0] = x * 3;
+				p[1] = y * 5;
+				p[2] = x + y;
+			}
+			else
+			{
+				p[0] = rand();
+				p[1] = rand();
+				p[2] = rand();
+			}
+			p[3] = opaque ? 0xff : ((x < width / 2) ? 0xff : y * 7);
+		}
+	}
+}
+
+static int sizes[][2] =
+{
+	{ 1, 1 }, { 3, 2 }, { 15, 3 }, { 16, 16 }, { 37, 5 }, { 64, 64 }, { 100, 80 }, { 255, 3 }
+};
+
+static void
+test_planar_roundtrip(int header, RD_BOOL opaque)
+{
+	int i;
+	int len;
+	int width;
+	int height;
+	uint8 * image;
+	uint8 * stream;
+	uint8 * output;
+
+	for (i = 0; i < (int) (sizeof(sizes) / sizeof(sizes[0])); i++)
+	{
+		width = sizes[i][0];
+		height = sizes[i][1];
+		image = (uint8 *) xmalloc(width * height * 4);
+		stream = (uint8 *) xmalloc(width * height * 8 + 16);
+		output = (uint8 *) xmalloc(width * height * 4);
+		fill_image(image, width, height, opaque);
+		len = planar_encode(image, width, height, header, stream);
+		memset(output, 0, width * height * 4);
+		CU_ASSERT(bitmap_decompress(NULL, output, width, height, stream, len, 4) == True);
+		CU_ASSERT(memcmp(output, image, width * height * 4) == 0);
+		xfree(output);
+		xfree(stream);
+		xfree(image);
+	}
+}
+
+int init_bitmap_suite(void)
+{
+	srand(0x5eed);
+	return 0;
+}
+
+int clean_bitmap_suite(void)
+{
+	return 0;
+}
+
+int add_bitmap_suite(void)
+{
+	add_test_suite(bitmap);
+
+	add_test_function(bitmap_planar_rle);
+	add_test_function(bitmap_planar_no_alpha);
+	add_test_function(bitmap_planar_raw);
+	add_test_function(bitmap_planar_stride);
+	add_test_function(bitmap_planar_malformed);
+	add_test_function(bitmap_planar_benchmark);
+	add_test_function(bitmap_interleaved_dest);
+
+	return 0;
+}
+
+void test_bitmap_planar_rle(void)
+{
+	test_planar_roundtrip(PLANAR_RLE, False);
+}
+
+void test_bitmap_planar_no_alpha(void)
+{
+	test_planar_roundtrip(PLANAR_RLE | PLANAR_NA, True);
+}
+
+void test_bitmap_planar_raw(void)
+{
+	test_planar_roundtrip(0, False);
+	test_planar_roundtrip(PLANAR_NA, True);
+}
+
+void test_bitmap_planar_stride(void)
+{
+	int y;
+	int len;
+	int stride;
+	uint8 image[37 * 21 * 4];
+	uint8 stream[37 * 21 * 8];
+	uint8 * output;
+
+	fill_image(image, 37, 21, False);
+	len = planar_encode(image, 37, 21, PLANAR_RLE, stream);
+	stride = 40 * 4;
+	output = (uint8 *) xmalloc(stride * 21);
+
+	/* into a wider surface, the padding is left alone */
+	memset(output, 0xcc, stride * 21);
+	CU_ASSERT(bitmap_decompress_planar(output, stride, 37, 21, stream, len) == True);
+	for (y = 0; y < 21; y++)
+	{
+		CU_ASSERT(memcmp(output + y * stride, image + y * 37 * 4, 37 * 4) == 0);
+		CU_ASSERT(output[y * stride + 37 * 4] == 0xcc);
+	}
+
+	/* into a bottom-up surface */
+	memset(output, 0, stride * 21);
+	CU_ASSERT(bitmap_decompress_planar(output + 20 * stride, -stride, 37, 21, stream, len) == True);
+	for (y = 0; y < 21; y++)
+		CU_ASSERT(memcmp(output + (20 - y) * stride, image + y * 37 * 4, 37 * 4) == 0);
+
+	xfree(output);
+}
+
+void test_bitmap_planar_malformed(void)
+{
+	/* a run of 5 in a 4 pixel wide plane */
+	static uint8 overrun[] = { 0x10, 0x14, 0x01, 0x00, 0x00, 0x00, 0x00 };
+	/* colour loss level set */
+	static uint8 color_loss[] = { 0x13, 0x40, 0x01, 0x02, 0x03, 0x04 };
+	int i;
+	int len;
+	uint8 image[16 * 8 * 4];
+	uint8 stream[16 * 8 * 8];
+	uint8 output[16 * 8 * 4];
+
+	CU_ASSERT(bitmap_decompress_planar(output, 16, 4, 1, overrun, sizeof(overrun)) == False);
+	CU_ASSERT(bitmap_decompress_planar(output, 16, 4, 1, color_loss, sizeof(color_loss)) == False);
+
+	/* every truncation of a valid stream fails */
+	fill_image(image, 16, 8, False);
+	len = planar_encode(image, 16, 8, PLANAR_RLE, stream);
+	for (i = 0; i < len; i++)
+		CU_ASSERT(bitmap_decompress_planar(output, 16 * 4, 16, 8, stream, i) == False);
+
+	/* and so do trailing bytes */
+	stream[len] = 0;
+	CU_ASSERT(bitmap_decompress_planar(output, 16 * 4, 16, 8, stream, len + 1) == False);
+}
+
+void test_bitmap_planar_benchmark(void)
+{
+	int n;
+	int len;
+	double seconds;
+	uint8 * image;
+	uint8 * stream;
+	uint8 * output;
+	struct timeval start, stop;
+
+	/* 64x64 tiles are what bitmap updates use */
+	image = (uint8 *) xmalloc(64 * 64 * 4);
+	stream = (uint8 *) xmalloc(64 * 64 * 8);
+	output = (uint8 *) xmalloc(64 * 64 * 4);
+	fill_image(image, 64, 64, False);
+	len = planar_encode(image, 64, 64, PLANAR_RLE, stream);
+
+	gettimeofday(&start, NULL);
+
+	for (n = 0; n < 20000; n++)
+		bitmap_decompress_planar(output, 64 * 4, 64, 64, stream, len);
+
+	gettimeofday(&stop, NULL);
+
+	seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_usec - start.tv_usec) / 1000000.0;
+	printf("\nbitmap_decompress_planar: %.1f Mpixels/s\n",
+		seconds > 0 ? (64 * 64 * 20000.0) / (seconds * 1000000) : 0.0);
+
+	CU_ASSERT(memcmp(output, image, 64 * 64 * 4) == 0);
+
+	xfree(output);
+	xfree(stream);
+	xfree(image);
+}
+
+/* random interleaved RLE orders covering width * height pixels */
+static int
+rle_generate(int pixels, int Bpp, uint8 * out)
+{
+	int i;
+	int op;
+	int count;
+	uint8 * org_out;
+
+	org_out = out;
+	while (pixels > 0)
+	{
+		op = rand() % 5;
+		count = 1 + rand() % 31;
+		if (op == 2)
+		{
+			/* fill or mix, eight pixels and one mask byte per count */
+			if (pixels < 8)
+				op = 0;
+			else if (count * 8 > pixels)
+				count = pixels / 8;
+		}
+		if (op != 2 && count > pixels)
+			count = pixels;
+		*out++ = (op << 5) | count;
+		switch (op)
+		{
+			case 2:
+				for (i = 0; i < count; i++)
+					*out++ = rand();
+				count *= 8;
+				break;
+			case 3:
+				for (i = 0; i < Bpp; i++)
+					*out++ = rand();
+				break;
+			case 4:
+				for (i = 0; i < count * Bpp; i++)
+					*out++ = rand();
+				break;
+		}
+		pixels -= count;
+	}
+	return (int) (out - org_out);
+}
+
+/* converts a source pixel the way the table built below does */
+static uint32
+rle_convert(uint8 * p, int Bpp)
+{
+	switch (Bpp)
+	{
+		case 1:
+			return 0xff000000 | (p[0] * 0x010101);
+		case 2:
+			return (p[0] | (p[1] << 8)) * 7 + 1;
+		default:
+			return p[0] | (p[1] << 8) | (p[2] << 16);
+	}
+}
+
+void test_bitmap_interleaved_dest(void)
+{
+	int i;
+	int x;
+	int y;
+	int Bpp;
+	int len;
+	int stride;
+	int row_ok;
+	int outside_ok;
+	uint8 stream[37 * 13 * 8];
+	uint8 ref[37 * 13 * 3];
+	uint8 lines[2 * 37 * 3];
+	uint8 surface[50 * 16 * 4];
+	uint8 * p;
+	uint32 * colors;
+	RD_BITMAP_DEST dest;
+
+	colors = (uint32 *) xmalloc(65536 * sizeof(uint32));
+
+	for (Bpp = 1; Bpp <= 3; Bpp++)
+	{
+		len = rle_generate(37 * 13, Bpp, stream);
+		CU_ASSERT(bitmap_decompress(NULL, ref, 37, 13, stream, len, Bpp) == True);
+
+		/* same format, a 33x11 window at (2,3) of a 50 pixel wide surface */
+		stride = 50 * Bpp;
+		memset(surface, 0xa5, sizeof(surface));
+		dest.data = surface + 3 * stride + 2 * Bpp;
+		dest.stride = stride;
+		dest.width = 33;
+		dest.height = 11;
+		dest.bpp = Bpp * 8;
+		dest.colors = NULL;
+		CU_ASSERT(bitmap_decompress_dest(NULL, &dest, lines, 37, 13, stream, len, Bpp) == True);
+		row_ok = outside_ok = 1;
+		for (y = 0; y < 16; y++)
+		{
+			for (x = 0; x < 50 * Bpp; x++)
+			{
+				p = surface + y * stride + x;
+				if (y >= 3 && y < 14 && x >= 2 * Bpp && x < 35 * Bpp)
+					row_ok &= (*p == ref[(y - 3) * 37 * Bpp + x - 2 * Bpp]);
+				else
+					outside_ok &= (*p == 0xa5);
+			}
+		}
+		CU_ASSERT(row_ok);
+		CU_ASSERT(outside_ok);
+
+		/* converted to 32 bpp through a table, into a bottom-up surface */
+		for (i = 0; i < 65536; i++)
+		{
+			if (Bpp == 1)
+				colors[i] = 0xff000000 | ((i & 0xff) * 0x010101);
+			else if (Bpp == 2)
+				colors[i] = i * 7 + 1;
+			else
+				colors[i] = (i < 768) ? (i % 256) << (8 * (i / 256)) : 0;
+		}
+		memset(surface, 0, sizeof(surface));
+		dest.data = surface + 10 * 33 * 4;
+		dest.stride = -33 * 4;
+		dest.bpp = 32;
+		dest.colors = colors;
+		CU_ASSERT(bitmap_decompress_dest(NULL, &dest, lines, 37, 13, stream, len, Bpp) == True);
+		row_ok = 1;
+		for (y = 0; y < 11; y++)
+			for (x = 0; x < 33; x++)
+				row_ok &= (((uint32 *) surface)[(10 - y) * 33 + x] ==
+					rle_convert(ref + (y * 37 + x) * Bpp, Bpp));
+		CU_ASSERT(row_ok);
+
+		/* rows that are already decoded, as in uncompressed updates */
+		memset(surface, 0, sizeof(surface));
+		for (y = 0; y < 13; y++)
+			bitmap_store_row(&dest, ref + y * 37 * Bpp, y, Bpp);
+		row_ok = 1;
+		for (y = 0; y < 11; y++)
+			for (x = 0; x < 33; x++)
+				row_ok &= (((uint32 *) surface)[(10 - y) * 33 + x] ==
+					rle_convert(ref + (y * 37 + x) * Bpp, Bpp));
+		CU_ASSERT(row_ok);
+	}
+
+	xfree(colors);
+}
+
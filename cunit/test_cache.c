@@ -0,0 +1,162 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   Bitmap Cache Unit Tests
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+   The caches are set up without a session, cache 2 is made persistent by
+   giving it an empty index so it has a memory budget and evicts. Bitmap
+   handles are plain numbers, the ui only records which ones were destroyed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/utils/memory.h>
+#include "rdp.h"
+#include "cache.h"
+#include "pstcache.h"
+
+#include "test_cache.h"
+
+#define CELL_SIZE	(64 * 64 * 4)
+
+static int destroyed[16];
+static int num_destroyed;
+
+struct cache_test
+{
+	rdpInst inst;
+	rdpSet settings;
+	rdpRdp rdp;
+	rdpPcache pcache;
+	rdpCache * cache;
+};
+
+static void
+cache_ui_error(rdpInst * inst, const char * text)
+{
+}
+
+static void
+cache_ui_destroy_bitmap(rdpInst * inst, RD_HBITMAP bmp)
+{
+	if (num_destroyed < 16)
+		destroyed[num_destroyed] = (int) (long) bmp;
+	num_destroyed++;
+}
+
+/* a persistent cache 2 with room for the given number of 64x64 bitmaps */
+static void
+cache_test_new(struct cache_test * t, int cells)
+{
+	memset(t, 0, sizeof(struct cache_test));
+	t->settings.server_depth = 32;
+	t->settings.bitmap_cache_persist_enable = True;
+	t->settings.bitmap_cache_memory = cells * CELL_SIZE;
+	t->inst.ui_error = cache_ui_error;
+	t->inst.ui_destroy_bitmap = cache_ui_destroy_bitmap;
+	t->rdp.settings = &t->settings;
+	t->rdp.inst = &t->inst;
+	t->rdp.pcache = &t->pcache;
+	t->pcache.rdp = &t->rdp;
+	t->pcache.pstcache[2].index = (PSTCACHE_INDEX *) xmalloc(sizeof(PSTCACHE_INDEX));
+	memset(t->pcache.pstcache[2].index, 0, sizeof(PSTCACHE_INDEX));
+	t->cache = cache_new(&t->rdp);
+	t->rdp.cache = t->cache;
+	num_destroyed = 0;
+}
+
+static void
+cache_test_free(struct cache_test * t)
+{
+	cache_free(t->cache);
+	xfree(t->pcache.pstcache[2].index);
+}
+
+int init_cache_suite(void)
+{
+	return 0;
+}
+
+int clean_cache_suite(void)
+{
+	return 0;
+}
+
+int add_cache_suite(void)
+{
+	add_test_suite(cache);
+
+	add_test_function(cache_slru_protected);
+	add_test_function(cache_oversized);
+
+	return 0;
+}
+
+void test_cache_slru_protected(void)
+{
+	struct cache_test t;
+	RD_BITMAP_CACHE_STATS stats;
+	int i;
+
+	cache_test_new(&t, 4);
+
+	/* three bitmaps hit once fill the protected share of the budget */
+	for (i = 0; i < 3; i++)
+	{
+		cache_put_bitmap(t.cache, 2, i, (RD_HBITMAP) (long) (i + 1), CELL_SIZE);
+		CU_ASSERT(cache_get_bitmap(t.cache, 2, i) == (RD_HBITMAP) (long) (i + 1));
+	}
+	CU_ASSERT(num_destroyed == 0);
+
+	/* probation is empty apart from the new one, the oldest protected bitmap has to go */
+	cache_put_bitmap(t.cache, 2, 3, (RD_HBITMAP) 4, 2 * CELL_SIZE);
+	CU_ASSERT(num_destroyed == 1);
+	CU_ASSERT(destroyed[0] == 1);
+	CU_ASSERT(t.cache->bmpcache[2].cells[0].bitmap == NULL);
+	CU_ASSERT(cache_get_bitmap(t.cache, 2, 1) == (RD_HBITMAP) 2);
+	CU_ASSERT(cache_get_bitmap(t.cache, 2, 2) == (RD_HBITMAP) 3);
+	CU_ASSERT(cache_get_bitmap(t.cache, 2, 3) == (RD_HBITMAP) 4);
+
+	CU_ASSERT(cache_get_bitmap_stats(t.cache, 2, &stats));
+	CU_ASSERT(stats.evictions == 1);
+
+	cache_test_free(&t);
+}
+
+void test_cache_oversized(void)
+{
+	struct cache_test t;
+	int i;
+
+	cache_test_new(&t, 4);
+
+	for (i = 0; i < 4; i++)
+		cache_put_bitmap(t.cache, 2, i, (RD_HBITMAP) (long) (i + 1), CELL_SIZE);
+	cache_get_bitmap(t.cache, 2, 0);
+	CU_ASSERT(num_destroyed == 0);
+
+	/* a bitmap bigger than the whole budget pushes out everything else but stays */
+	cache_put_bitmap(t.cache, 2, 4, (RD_HBITMAP) 5, 5 * CELL_SIZE);
+	CU_ASSERT(num_destroyed == 4);
+	CU_ASSERT(destroyed[0] == 2);
+	CU_ASSERT(destroyed[3] == 1);
+	CU_ASSERT(t.cache->bmpcache[2].count == 1);
+	CU_ASSERT(cache_get_bitmap(t.cache, 2, 4) == (RD_HBITMAP) 5);
+
+	cache_test_free(&t);
+}
@@ -19,9 +19,12 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
 #include <freerdp/freerdp.h>
 #include "gdi.h"
 #include "color.h"
+#include "libgdi.h"
 #include "test_color.h"
 
 int init_color_suite(void)
@@ -44,6 +47,9 @@ int add_color_suite(void)
 	add_test_function(color_GetRGB16);
 	add_test_function(color_GetBGR_565);
 	add_test_function(color_GetBGR16);
+	add_test_function(color_image_convert_rect);
+	add_test_function(color_convert_simd);
+	add_test_function(color_convert_benchmark);
 
 	return 0;
 }
@@ -150,3 +156,241 @@ void test_color_GetBGR16(void)
 	CU_ASSERT(b == 0xEF);
 }
 
+static int convert_bpps[5] = { 8, 15, 16, 24, 32 };
+
+static void convert_fill(uint8* data, int size, int seed)
+{
+	int i;
+
+	srand(seed);
+
+	for (i = 0; i < size; i++)
+		data[i] = (uint8) rand();
+}
+
+static void convert_palette(RD_PALETTE* palette)
+{
+	int i;
+
+	palette->count = 256;
+	palette->entries = (RD_PALETTEENTRY*) malloc(256 * sizeof(RD_PALETTEENTRY));
+
+	for (i = 0; i < 256; i++)
+	{
+		palette->entries[i].red = i * 7;
+		palette->entries[i].green = i * 13;
+		palette->entries[i].blue = i * 29;
+	}
+}
+
+void test_color_image_convert_rect(void)
+{
+	int y;
+	int s, d, flags;
+	int srcBytes, dstBytes;
+	int srcStride, dstStride;
+	int errors;
+	uint8* src;
+	uint8* packed;
+	uint8* image;
+	uint8* rect;
+	CLRCONV clrconv;
+	RD_PALETTE palette;
+	int width = 37;
+	int height = 5;
+
+	/* converting into a part of a larger buffer gives the rows of a whole image conversion */
+	convert_palette(&palette);
+	clrconv.palette = &palette;
+
+	src = (uint8*) malloc(64 * height * 4);
+	packed = (uint8*) malloc(width * height * 4);
+	image = (uint8*) malloc(width * height * 4);
+	rect = (uint8*) malloc(64 * height * 4);
+	convert_fill(src, 64 * height * 4, 3);
+
+	errors = 0;
+
+	for (s = 0; s < 5; s++)
+	{
+		for (d = 0; d < 5; d++)
+		{
+			for (flags = 0; flags < 8; flags++)
+			{
+				clrconv.alpha = (flags & CLRCONV_ALPHA) ? 1 : 0;
+				clrconv.invert = (flags & CLRCONV_INVERT) ? 1 : 0;
+				clrconv.rgb555 = (flags & CLRCONV_RGB555) ? 1 : 0;
+
+				srcBytes = (convert_bpps[s] + 7) / 8;
+				dstBytes = (convert_bpps[d] + 7) / 8;
+				srcStride = 64 * srcBytes;
+				dstStride = 64 * dstBytes;
+
+				for (y = 0; y < height; y++)
+					memcpy(packed + y * width * srcBytes, src + y * srcStride, width * srcBytes);
+
+				memset(rect, 0x5A, 64 * height * 4);
+
+				if (gdi_image_convert_rect(src, srcStride, rect + dstBytes, dstStride,
+					width, height, convert_bpps[s], convert_bpps[d], &clrconv) != 0)
+				{
+					/* gdi_image_convert hands back the source when it can not convert */
+					if (gdi_image_convert(packed, image, width, height, convert_bpps[s], convert_bpps[d], &clrconv) != packed)
+						errors++;
+
+					continue;
+				}
+
+				gdi_image_convert(packed, image, width, height, convert_bpps[s], convert_bpps[d], &clrconv);
+
+				for (y = 0; y < height; y++)
+				{
+					if (memcmp(rect + y * dstStride + dstBytes, image + y * width * dstBytes, width * dstBytes) != 0)
+						errors++;
+
+					if (rect[y * dstStride] != 0x5A || rect[y * dstStride + (width + 1) * dstBytes] != 0x5A)
+						errors++;
+				}
+			}
+		}
+	}
+
+	CU_ASSERT(errors == 0);
+
+	free(src);
+	free(packed);
+	free(image);
+	free(rect);
+	free(palette.entries);
+}
+
+void test_color_convert_simd(void)
+{
+	int i;
+	int s, d, flags;
+	int width;
+	int errors;
+	uint8* src;
+	uint8* ref;
+	uint8* simd;
+	CLRCONV clrconv;
+	RD_PALETTE palette;
+
+	/* whatever routines GDI_INIT_SIMD installs for this CPU must match the C versions,
+	   for every row length around their block sizes */
+	convert_palette(&palette);
+	clrconv.palette = &palette;
+
+	src = (uint8*) malloc(80 * 3 * 4);
+	ref = (uint8*) malloc(80 * 3 * 4);
+	simd = (uint8*) malloc(80 * 3 * 4);
+	convert_fill(src, 80 * 3 * 4, 5);
+
+	errors = 0;
+
+	for (s = 0; s < 5; s++)
+	{
+		for (d = 0; d < 5; d++)
+		{
+			for (flags = 0; flags < 8; flags++)
+			{
+				clrconv.alpha = (flags & CLRCONV_ALPHA) ? 1 : 0;
+				clrconv.invert = (flags & CLRCONV_INVERT) ? 1 : 0;
+				clrconv.rgb555 = (flags & CLRCONV_RGB555) ? 1 : 0;
+
+				for (width = 1; width < 40; width++)
+				{
+					memset(ref, 0x5A, 80 * 3 * 4);
+					memset(simd, 0x5A, 80 * 3 * 4);
+
+					for (i = 0; i < GDI_CONVERSIONS; i++)
+						gdi_convert_set_row(i, NULL);
+
+					gdi_image_convert_rect(src + 1, 80 * 4, ref + 3, 80 * 4, width, 3,
+						convert_bpps[s], convert_bpps[d], &clrconv);
+
+					GDI_INIT_SIMD(NULL);
+
+					gdi_image_convert_rect(src + 1, 80 * 4, simd + 3, 80 * 4, width, 3,
+						convert_bpps[s], convert_bpps[d], &clrconv);
+
+					if (memcmp(ref, simd, 80 * 3 * 4) != 0)
+						errors++;
+				}
+			}
+		}
+	}
+
+	CU_ASSERT(errors == 0);
+
+	free(src);
+	free(ref);
+	free(simd);
+	free(palette.entries);
+}
+
+static double convert_rate(uint8* src, uint8* dst, int srcBpp, int dstBpp, HCLRCONV clrconv)
+{
+	int n;
+	double seconds;
+	struct timeval start, stop;
+
+	gettimeofday(&start, NULL);
+
+	for (n = 0; n < 5000; n++)
+		gdi_image_convert(src, dst, 64, 64, srcBpp, dstBpp, clrconv);
+
+	gettimeofday(&stop, NULL);
+
+	seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_usec - start.tv_usec) / 1000000.0;
+
+	return seconds > 0 ? (64 * 64 * 5000.0) / (seconds * 1000000) : 0.0;
+}
+
+void test_color_convert_benchmark(void)
+{
+	int i, k;
+	double c, simd;
+	uint8* src;
+	uint8* dst;
+	uint8* ref;
+	CLRCONV clrconv;
+	RD_PALETTE palette;
+	int pairs[6][2] = { { 16, 32 }, { 15, 16 }, { 32, 16 }, { 24, 32 }, { 8, 32 }, { 8, 16 } };
+
+	/* 64x64 tiles, as bitmap updates and cached bitmaps come */
+	convert_palette(&palette);
+	clrconv.palette = &palette;
+	clrconv.alpha = 0;
+	clrconv.invert = 0;
+	clrconv.rgb555 = 0;
+
+	src = (uint8*) malloc(64 * 64 * 4);
+	dst = (uint8*) malloc(64 * 64 * 4);
+	ref = (uint8*) malloc(64 * 64 * 4);
+	convert_fill(src, 64 * 64 * 4, 7);
+
+	printf("\n");
+
+	for (k = 0; k < 6; k++)
+	{
+		for (i = 0; i < GDI_CONVERSIONS; i++)
+			gdi_convert_set_row(i, NULL);
+
+		c = convert_rate(src, ref, pairs[k][0], pairs[k][1], &clrconv);
+
+		GDI_INIT_SIMD(NULL);
+
+		simd = convert_rate(src, dst, pairs[k][0], pairs[k][1], &clrconv);
+
+		printf("gdi_image_convert %d to %d bpp: %.1f Mpixels/s, %.1f with SIMD\n",
+			pairs[k][0], pairs[k][1], c, simd);
+
+		CU_ASSERT(memcmp(dst, ref, 64 * 64 * ((pairs[k][1] + 7) / 8)) == 0);
+	}
+
+	free(src);
+	free(dst);
+	free(ref);
+	free(palette.entries);
+}
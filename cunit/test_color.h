@@ -29,3 +29,6 @@ void test_color_GetRGB_565(void);
 void test_color_GetRGB16(void);
 void test_color_GetBGR_565(void);
 void test_color_GetBGR16(void);
+void test_color_image_convert_rect(void);
+void test_color_convert_simd(void);
+void test_color_convert_benchmark(void);
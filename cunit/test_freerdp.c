@@ -19,10 +19,14 @@
 
 #include "CUnit/Basic.h"
 
+#include "test_bitmap.h"
+#include "test_cache.h"
 #include "test_color.h"
 #include "test_libgdi.h"
 #include "test_librfx.h"
+#include "test_mppc.h"
 #include "test_ntlmssp.h"
+#include "test_replay.h"
 #include "test_freerdp.h"
 
 void dump_data(unsigned char * p, int len, int width, char* name)
@@ -61,16 +65,28 @@ int main(int argc, char* argv[])
 
 	if (argc < *pindex + 1)
 	{
+		add_bitmap_suite();
+		add_cache_suite();
 		add_color_suite();
 		add_libgdi_suite();
 		add_librfx_suite();
+		add_mppc_suite();
 		add_ntlmssp_suite();
+		add_replay_suite();
 	}
 	else
 	{
 		while (*pindex < argc)
 		{
-			if (strcmp("color", argv[*pindex]) == 0)
+			if (strcmp("bitmap", argv[*pindex]) == 0)
+			{
+				add_bitmap_suite();
+			}
+			else if (strcmp("cache", argv[*pindex]) == 0)
+			{
+				add_cache_suite();
+			}
+			else if (strcmp("color", argv[*pindex]) == 0)
 			{
 				add_color_suite();
 			}
@@ -82,10 +98,18 @@ int main(int argc, char* argv[])
 			{
 				add_librfx_suite();
 			}
+			else if (strcmp("mppc", argv[*pindex]) == 0)
+			{
+				add_mppc_suite();
+			}
 			else if (strcmp("ntlmssp", argv[*pindex]) == 0)
 			{
 				add_ntlmssp_suite();
 			}
+			else if (strcmp("replay", argv[*pindex]) == 0)
+			{
+				add_replay_suite();
+			}
 
 			*pindex = *pindex + 1;
 		}
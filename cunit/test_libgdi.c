@@ -33,6 +33,7 @@
 #include "gdi_palette.h"
 #include "gdi_drawing.h"
 #include "gdi_clipping.h"
+#include "gdi_glyph.h"
 
 #include "test_libgdi.h"
 
@@ -70,8 +71,13 @@ int add_libgdi_suite(void)
 	add_test_function(gdi_BitBlt_32bpp);
 	add_test_function(gdi_BitBlt_16bpp);
 	add_test_function(gdi_BitBlt_8bpp);
+	add_test_function(gdi_BitBlt_rop3);
+	add_test_function(gdi_BitBlt_overlap);
+	add_test_function(gdi_DrawGlyphRun);
+	add_test_function(gdi_atlas);
 	add_test_function(gdi_ClipCoords);
 	add_test_function(gdi_InvalidateRegion);
+	add_test_function(gdi_InvalidateRegion_rects);
 
 	return 0;
 }
@@ -2718,6 +2724,348 @@ void test_gdi_BitBlt_8bpp(void)
 	CU_ASSERT(CompareBitmaps(hBmpDst, hBmp_SPna) == 1)
 }
 
+/* a byte of the expected result, computed bit by bit from the operation code */
+static uint8 rop3_reference(uint8 code, uint8 d, uint8 s, uint8 p)
+{
+	int bit;
+	int index;
+	uint8 r = 0;
+
+	for (bit = 0; bit < 8; bit++)
+	{
+		index = (((p >> bit) & 1) << 2) | (((s >> bit) & 1) << 1) | ((d >> bit) & 1);
+		r |= ((code >> index) & 1) << bit;
+	}
+
+	return r;
+}
+
+static HGDI_BITMAP rop3_bitmap(int width, int height, int bytesPerPixel, int seed)
+{
+	int i;
+	uint8* data;
+
+	data = (uint8*) malloc(width * height * bytesPerPixel);
+
+	for (i = 0; i < width * height * bytesPerPixel; i++)
+		data[i] = (uint8) ((i * seed + (i >> 3) * 29 + seed) ^ (i >> 5));
+
+	return gdi_CreateBitmap(width, height, bytesPerPixel * 8, data);
+}
+
+void test_gdi_BitBlt_rop3(void)
+{
+	int x, y, b;
+	int code;
+	int size;
+	int offset;
+	int errors;
+	int bytesPerPixel;
+	uint8 d, s, p;
+	uint8 expected;
+	uint8* original;
+	HGDI_DC hdcSrc;
+	HGDI_DC hdcDst;
+	HGDI_BRUSH hBrush;
+	HGDI_BITMAP hBmpSrc;
+	HGDI_BITMAP hBmpDst;
+	HGDI_BITMAP hBmpPat;
+	int width = 21;
+	int height = 5;
+
+	/* every operation at every depth, over rows that are not a multiple of 4 bytes */
+	for (bytesPerPixel = 1; bytesPerPixel <= 4; bytesPerPixel *= 2)
+	{
+		hdcSrc = gdi_GetDC();
+		hdcSrc->bytesPerPixel = bytesPerPixel;
+		hdcSrc->bitsPerPixel = bytesPerPixel * 8;
+
+		hdcDst = gdi_GetDC();
+		hdcDst->bytesPerPixel = bytesPerPixel;
+		hdcDst->bitsPerPixel = bytesPerPixel * 8;
+		hdcDst->alpha = 0;
+		hdcDst->textColor = 0;
+
+		hBmpSrc = rop3_bitmap(width, height, bytesPerPixel, 7);
+		hBmpDst = rop3_bitmap(width, height, bytesPerPixel, 13);
+		hBmpPat = rop3_bitmap(8, 8, bytesPerPixel, 31);
+
+		gdi_SelectObject(hdcSrc, (HGDIOBJECT) hBmpSrc);
+		gdi_SelectObject(hdcDst, (HGDIOBJECT) hBmpDst);
+
+		hBrush = gdi_CreatePatternBrush(hBmpPat);
+		gdi_SelectObject(hdcDst, (HGDIOBJECT) hBrush);
+
+		size = width * height * bytesPerPixel;
+		original = (uint8*) malloc(size);
+		memcpy(original, hBmpDst->data, size);
+
+		errors = 0;
+
+		for (code = 0; code < 256; code++)
+		{
+			memcpy(hBmpDst->data, original, size);
+			gdi_BitBlt(hdcDst, 1, 1, width - 2, height - 2, hdcSrc, 2, 0, gdi_rop3_code(code));
+
+			for (y = 0; y < height; y++)
+			{
+				for (x = 0; x < width; x++)
+				{
+					for (b = 0; b < bytesPerPixel; b++)
+					{
+						offset = (y * width + x) * bytesPerPixel + b;
+						d = original[offset];
+						expected = d;
+
+						/* at 32 bpp only whole pixel operations change the alpha byte */
+						if (x < 1 || x >= width - 1 || y < 1 || y >= height - 1)
+							expected = d;
+						else if (b == 3 && code != 0x00 && code != 0xCC && code != 0xF0 && code != 0xFF)
+							expected = d;
+						else
+						{
+							s = hBmpSrc->data[((y - 1) * width + x + 1) * bytesPerPixel + b];
+							p = hBmpPat->data[(((y - 1) % 8) * 8 + (x - 1) % 8) * bytesPerPixel + b];
+
+							/* glyphs are drawn in the text color */
+							if (code == 0xE2)
+								p = 0;
+
+							expected = rop3_reference(code, d, s, p);
+						}
+
+						if (hBmpDst->data[offset] != expected)
+							errors++;
+					}
+				}
+			}
+		}
+
+		CU_ASSERT(errors == 0);
+
+		free(original);
+		gdi_DeleteObject((HGDIOBJECT) hBrush);
+		gdi_DeleteObject((HGDIOBJECT) hBmpSrc);
+		gdi_DeleteObject((HGDIOBJECT) hBmpDst);
+		gdi_DeleteDC(hdcSrc);
+		gdi_DeleteDC(hdcDst);
+	}
+}
+
+void test_gdi_BitBlt_overlap(void)
+{
+	int i;
+	int x, y, b;
+	int dx, dy;
+	int size;
+	int offset;
+	int errors;
+	uint8 d, s;
+	uint8 expected;
+	uint8* original;
+	HGDI_DC hdc;
+	HGDI_BITMAP hBmp;
+	int width = 1100;
+	int height = 6;
+	int moves[6][2] = { { 3, 0 }, { -3, 0 }, { 0, 1 }, { 0, -1 }, { 5, 2 }, { -5, -2 } };
+	uint8 codes[2] = { 0xCC, 0x66 }; /* SRCCOPY, SRCINVERT */
+
+	/* rows of more than GDI_ROP_CHUNK bytes moved within the same surface */
+	hdc = gdi_GetDC();
+	hdc->bytesPerPixel = 4;
+	hdc->bitsPerPixel = 32;
+
+	hBmp = rop3_bitmap(width, height, 4, 11);
+	gdi_SelectObject(hdc, (HGDIOBJECT) hBmp);
+
+	size = width * height * 4;
+	original = (uint8*) malloc(size);
+	memcpy(original, hBmp->data, size);
+
+	errors = 0;
+
+	for (i = 0; i < 12; i++)
+	{
+		dx = moves[i / 2][0];
+		dy = moves[i / 2][1];
+
+		memcpy(hBmp->data, original, size);
+		gdi_BitBlt(hdc, 10 + dx, 2 + dy, width - 20, 2, hdc, 10, 2, gdi_rop3_code(codes[i % 2]));
+
+		for (y = 0; y < height; y++)
+		{
+			for (x = 0; x < width; x++)
+			{
+				for (b = 0; b < 4; b++)
+				{
+					offset = (y * width + x) * 4 + b;
+					d = original[offset];
+					expected = d;
+
+					if (x >= 10 + dx && x < width - 10 + dx && y >= 2 + dy && y < 4 + dy &&
+						(b != 3 || codes[i % 2] == 0xCC))
+					{
+						s = original[((y - dy) * width + x - dx) * 4 + b];
+						expected = rop3_reference(codes[i % 2], d, s, 0);
+					}
+
+					if (hBmp->data[offset] != expected)
+						errors++;
+				}
+			}
+		}
+	}
+
+	CU_ASSERT(errors == 0);
+
+	free(original);
+	gdi_DeleteObject((HGDIOBJECT) hBmp);
+	gdi_DeleteDC(hdc);
+}
+
+static uint8* glyph_data(int width, int height, int seed)
+{
+	int i;
+	int size;
+	uint8* data;
+
+	size = ((width + 7) / 8) * height;
+	data = (uint8*) malloc(size);
+
+	for (i = 0; i < size; i++)
+		data[i] = (uint8) ((i * seed) ^ (i >> 2) ^ 0x5A);
+
+	return data;
+}
+
+void test_gdi_DrawGlyphRun(void)
+{
+	int i;
+	int size;
+	int bytesPerPixel;
+	uint8* data[3];
+	uint8* mask;
+	HGDI_DC hdcGlyph;
+	HGDI_DC hdcRun;
+	HGDI_DC hdcBlt;
+	HGDI_BITMAP hBmpGlyph;
+	HGDI_BITMAP hBmpRun;
+	HGDI_BITMAP hBmpBlt;
+	GDI_ATLAS* atlas;
+	RD_GLYPH_POS glyphs[3];
+	int sizes[3][2] = { { 11, 9 }, { 7, 16 }, { 70, 5 } };
+	int positions[3][2] = { { 3, 2 }, { 34, 12 }, { -5, 16 } };
+	int width = 40;
+	int height = 20;
+
+	/* glyphs drawn from the atlas match DSPDxax blits of the converted glyphs,
+	   including glyphs clipped by every edge of the surface */
+	for (bytesPerPixel = 1; bytesPerPixel <= 4; bytesPerPixel *= 2)
+	{
+		atlas = gdi_atlas_new();
+
+		hdcRun = gdi_GetDC();
+		hdcRun->bytesPerPixel = bytesPerPixel;
+		hdcRun->bitsPerPixel = bytesPerPixel * 8;
+		hdcRun->textColor = 0x00A0B0C0;
+
+		hdcBlt = gdi_GetDC();
+		hdcBlt->bytesPerPixel = bytesPerPixel;
+		hdcBlt->bitsPerPixel = bytesPerPixel * 8;
+		hdcBlt->textColor = 0x00A0B0C0;
+
+		hBmpRun = rop3_bitmap(width, height, bytesPerPixel, 5);
+		hBmpBlt = rop3_bitmap(width, height, bytesPerPixel, 5);
+		gdi_SelectObject(hdcRun, (HGDIOBJECT) hBmpRun);
+		gdi_SelectObject(hdcBlt, (HGDIOBJECT) hBmpBlt);
+
+		for (i = 0; i < 3; i++)
+		{
+			data[i] = glyph_data(sizes[i][0], sizes[i][1], i + 3);
+
+			glyphs[i].x = positions[i][0];
+			glyphs[i].y = positions[i][1];
+			glyphs[i].cx = sizes[i][0];
+			glyphs[i].cy = sizes[i][1];
+			glyphs[i].glyph = gdi_glyph_new(atlas, sizes[i][0], sizes[i][1], data[i]);
+
+			hdcGlyph = gdi_GetDC();
+			hdcGlyph->bytesPerPixel = 1;
+			hdcGlyph->bitsPerPixel = 1;
+			mask = gdi_glyph_convert(sizes[i][0], sizes[i][1], data[i]);
+			hBmpGlyph = gdi_CreateBitmap(sizes[i][0], sizes[i][1], 1, mask);
+			hBmpGlyph->bytesPerPixel = 1;
+			hBmpGlyph->bitsPerPixel = 1;
+			gdi_SelectObject(hdcGlyph, (HGDIOBJECT) hBmpGlyph);
+
+			gdi_BitBlt(hdcBlt, positions[i][0], positions[i][1], sizes[i][0], sizes[i][1], hdcGlyph, 0, 0, GDI_DSPDxax);
+
+			gdi_DeleteObject((HGDIOBJECT) hBmpGlyph);
+			gdi_DeleteDC(hdcGlyph);
+		}
+
+		gdi_DrawGlyphRun(hdcRun, glyphs, 3);
+
+		size = width * height * bytesPerPixel;
+		CU_ASSERT(memcmp(hBmpRun->data, hBmpBlt->data, size) == 0);
+
+		for (i = 0; i < 3; i++)
+		{
+			gdi_glyph_free((HGDI_GLYPH) glyphs[i].glyph);
+			free(data[i]);
+		}
+
+		gdi_atlas_free(atlas);
+		gdi_DeleteObject((HGDIOBJECT) hBmpRun);
+		gdi_DeleteObject((HGDIOBJECT) hBmpBlt);
+		gdi_DeleteDC(hdcRun);
+		gdi_DeleteDC(hdcBlt);
+	}
+}
+
+void test_gdi_atlas(void)
+{
+	int i;
+	uint8* data;
+	GDI_ATLAS* atlas;
+	HGDI_GLYPH large;
+	HGDI_GLYPH glyphs[256];
+
+	data = glyph_data(64, 80, 7);
+	atlas = gdi_atlas_new();
+
+	/* glyphs of a size class share pages */
+	for (i = 0; i < 256; i++)
+		glyphs[i] = gdi_glyph_new(atlas, 5 + (i % 4), 10 + (i % 6), data);
+
+	CU_ASSERT(gdi_atlas_get_pages(atlas) == 2);
+	CU_ASSERT(glyphs[1]->mask - glyphs[0]->mask == 128);
+
+	/* the cells of deleted glyphs are reused */
+	for (i = 0; i < 256; i += 2)
+		gdi_glyph_free(glyphs[i]);
+
+	for (i = 0; i < 256; i += 2)
+		glyphs[i] = gdi_glyph_new(atlas, 8, 16, data);
+
+	CU_ASSERT(gdi_atlas_get_pages(atlas) == 2);
+
+	/* large glyphs have pages of their own */
+	large = gdi_glyph_new(atlas, 64, 80, data);
+	CU_ASSERT(gdi_atlas_get_pages(atlas) == 3);
+	CU_ASSERT(large->mask[0] == ((data[0] & 0x80) ? 0xFF : 0));
+	gdi_glyph_free(large);
+	CU_ASSERT(gdi_atlas_get_pages(atlas) == 2);
+
+	/* an atlas freed while glyphs remain lives until the last of them */
+	gdi_atlas_free(atlas);
+
+	for (i = 0; i < 256; i++)
+		gdi_glyph_free(glyphs[i]);
+
+	free(data);
+}
+
 void test_gdi_ClipCoords(void)
 {
 	HGDI_DC hdc;
@@ -2859,6 +3207,7 @@ void test_gdi_InvalidateRegion(void)
 	gdi_SetNullClipRgn(hdc);
 
 	hdc->hwnd = (HGDI_WND) malloc(sizeof(GDI_WND));
+	memset(hdc->hwnd, 0, sizeof(GDI_WND));
 	hdc->hwnd->invalid = gdi_CreateRectRgn(0, 0, 0, 0);
 	hdc->hwnd->invalid->null = 1;
 	invalid = hdc->hwnd->invalid;
@@ -2980,3 +3329,86 @@ void test_gdi_InvalidateRegion(void)
 	gdi_InvalidateRegion(hdc, rgn1->x, rgn1->y, rgn1->w, rgn1->h);
 	CU_ASSERT(gdi_EqualRgn(invalid, rgn2) == 1);
 }
+
+void test_gdi_InvalidateRegion_rects(void)
+{
+	HGDI_DC hdc;
+	HGDI_WND hwnd;
+	HGDI_BITMAP bmp;
+
+	hdc = gdi_GetDC();
+	hdc->bytesPerPixel = 4;
+	hdc->bitsPerPixel = 32;
+	bmp = gdi_CreateBitmap(1024, 768, 4, NULL);
+	gdi_SelectObject(hdc, (HGDIOBJECT) bmp);
+	gdi_SetNullClipRgn(hdc);
+
+	hdc->hwnd = (HGDI_WND) malloc(sizeof(GDI_WND));
+	memset(hdc->hwnd, 0, sizeof(GDI_WND));
+	hdc->hwnd->invalid = gdi_CreateRectRgn(0, 0, 0, 0);
+	hdc->hwnd->invalid->null = 1;
+	hdc->hwnd->max_invalid = 4;
+	hwnd = hdc->hwnd;
+
+	/* two disjoint rectangles stay apart */
+	gdi_InvalidateRegion(hdc, 10, 10, 10, 10);
+	gdi_InvalidateRegion(hdc, 500, 500, 20, 20);
+	CU_ASSERT(hwnd->count == 2);
+	CU_ASSERT(hwnd->cinvalid[0].x == 10 && hwnd->cinvalid[0].y == 10);
+	CU_ASSERT(hwnd->cinvalid[0].w == 10 && hwnd->cinvalid[0].h == 10);
+	CU_ASSERT(hwnd->cinvalid[1].x == 500 && hwnd->cinvalid[1].y == 500);
+	CU_ASSERT(hwnd->cinvalid[1].w == 20 && hwnd->cinvalid[1].h == 20);
+
+	/* the bounding box is still maintained */
+	CU_ASSERT(hwnd->invalid->x == 10 && hwnd->invalid->y == 10);
+	CU_ASSERT(hwnd->invalid->w == 510 && hwnd->invalid->h == 510);
+
+	/* a rectangle already covered adds nothing */
+	gdi_InvalidateRegion(hdc, 12, 12, 4, 4);
+	CU_ASSERT(hwnd->count == 2);
+
+	/* overlapping rectangles of the same height coalesce */
+	gdi_ValidateRegion(hdc);
+	CU_ASSERT(hwnd->count == 0);
+	CU_ASSERT(hwnd->invalid->null == 1);
+	gdi_InvalidateRegion(hdc, 100, 100, 50, 50);
+	gdi_InvalidateRegion(hdc, 120, 100, 50, 50);
+	CU_ASSERT(hwnd->count == 1);
+	CU_ASSERT(hwnd->cinvalid[0].x == 100 && hwnd->cinvalid[0].y == 100);
+	CU_ASSERT(hwnd->cinvalid[0].w == 70 && hwnd->cinvalid[0].h == 50);
+
+	/* stacked rectangles with matching spans merge into one band */
+	gdi_InvalidateRegion(hdc, 100, 150, 70, 30);
+	CU_ASSERT(hwnd->count == 1);
+	CU_ASSERT(hwnd->cinvalid[0].h == 80);
+
+	/* a partial overlap splits into bands */
+	gdi_ValidateRegion(hdc);
+	gdi_InvalidateRegion(hdc, 0, 0, 100, 100);
+	gdi_InvalidateRegion(hdc, 50, 50, 100, 100);
+	CU_ASSERT(hwnd->count == 3);
+	CU_ASSERT(hwnd->cinvalid[0].x == 0 && hwnd->cinvalid[0].y == 0);
+	CU_ASSERT(hwnd->cinvalid[0].w == 100 && hwnd->cinvalid[0].h == 50);
+	CU_ASSERT(hwnd->cinvalid[1].x == 0 && hwnd->cinvalid[1].y == 50);
+	CU_ASSERT(hwnd->cinvalid[1].w == 150 && hwnd->cinvalid[1].h == 50);
+	CU_ASSERT(hwnd->cinvalid[2].x == 50 && hwnd->cinvalid[2].y == 100);
+	CU_ASSERT(hwnd->cinvalid[2].w == 100 && hwnd->cinvalid[2].h == 50);
+
+	/* rectangles are clipped to the surface */
+	gdi_ValidateRegion(hdc);
+	gdi_InvalidateRegion(hdc, 1000, 700, 100, 100);
+	CU_ASSERT(hwnd->count == 1);
+	CU_ASSERT(hwnd->cinvalid[0].w == 24 && hwnd->cinvalid[0].h == 68);
+
+	/* past the limit the list collapses to the bounding box */
+	gdi_ValidateRegion(hdc);
+	gdi_InvalidateRegion(hdc, 0, 0, 10, 10);
+	gdi_InvalidateRegion(hdc, 100, 100, 10, 10);
+	gdi_InvalidateRegion(hdc, 200, 200, 10, 10);
+	gdi_InvalidateRegion(hdc, 300, 300, 10, 10);
+	CU_ASSERT(hwnd->count == 4);
+	gdi_InvalidateRegion(hdc, 400, 400, 10, 10);
+	CU_ASSERT(hwnd->count == 1);
+	CU_ASSERT(hwnd->cinvalid[0].x == 0 && hwnd->cinvalid[0].y == 0);
+	CU_ASSERT(hwnd->cinvalid[0].w == 410 && hwnd->cinvalid[0].h == 410);
+}
@@ -43,5 +43,10 @@ void test_gdi_FillRect(void);
 void test_gdi_BitBlt_32bpp(void);
 void test_gdi_BitBlt_16bpp(void);
 void test_gdi_BitBlt_8bpp(void);
+void test_gdi_BitBlt_rop3(void);
+void test_gdi_BitBlt_overlap(void);
+void test_gdi_DrawGlyphRun(void);
+void test_gdi_atlas(void);
 void test_gdi_ClipCoords(void);
 void test_gdi_InvalidateRegion(void);
+void test_gdi_InvalidateRegion_rects(void);
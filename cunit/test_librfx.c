@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <freerdp/rfx.h>
+#include <freerdp/utils/stream.h>
 #include "rfx_bitstream.h"
 #include "rfx_rlgr.h"
 #include "rfx_differential.h"
@@ -171,12 +172,17 @@ int add_librfx_suite(void)
 	add_test_function(bitstream);
 	add_test_function(bitstream_enc);
 	add_test_function(rlgr);
+	add_test_function(rlgr_fast);
 	add_test_function(differential);
 	add_test_function(quantization);
 	add_test_function(dwt);
 	add_test_function(decode);
 	add_test_function(encode);
 	add_test_function(message);
+	add_test_function(message_threads);
+	add_test_function(message_malformed);
+	add_test_function(message_surface);
+	add_test_function(simd);
 
 	return 0;
 }
@@ -249,6 +255,56 @@ test_rlgr(void)
 	//dump_buffer(buffer, n);
 }
 
+static void
+compare_rlgr_decoders(RLGR_MODE mode, const uint8 * data, int size)
+{
+	int n, n_fast;
+	sint16 out[4096];
+	sint16 out_fast[4096];
+
+	memset(out, 0, sizeof(out));
+	memset(out_fast, 0, sizeof(out_fast));
+
+	n = rfx_rlgr_decode(mode, data, size, out, 4096);
+	n_fast = rfx_rlgr_decode_fast(mode, data, size, out_fast, 4096);
+
+	CU_ASSERT(n_fast == n);
+	CU_ASSERT(memcmp(out_fast, out, sizeof(out)) == 0);
+}
+
+void
+test_rlgr_fast(void)
+{
+	int i, j;
+	int size;
+	RLGR_MODE mode;
+	sint16 coefficients[4096];
+	uint8 encoded[4096 * 4];
+
+	compare_rlgr_decoders(RLGR3, y_data, sizeof(y_data));
+	compare_rlgr_decoders(RLGR3, cb_data, sizeof(cb_data));
+	compare_rlgr_decoders(RLGR3, cr_data, sizeof(cr_data));
+
+	/* truncated input must behave the same way as well */
+	for (i = 0; i < sizeof(y_data); i += 7)
+		compare_rlgr_decoders(RLGR3, y_data, i);
+
+	/* random coefficients with growing density through both modes */
+	srand(1);
+	for (i = 0; i < 16; i++)
+	{
+		mode = (i & 1) ? RLGR1 : RLGR3;
+
+		for (j = 0; j < 4096; j++)
+			coefficients[j] = (rand() % 16 < i) ? (rand() % 128) - 64 : 0;
+
+		memset(encoded, 0, sizeof(encoded));
+		size = rfx_rlgr_encode(mode, coefficients, 4096, encoded, sizeof(encoded));
+
+		compare_rlgr_decoders(mode, encoded, size);
+	}
+}
+
 void
 test_differential(void)
 {
@@ -397,3 +453,387 @@ test_message(void)
 	rfx_context_free(context);
 	free(rgb_data);
 }
+
+void
+test_message_threads(void)
+{
+	RFX_CONTEXT * context;
+	RFX_CONTEXT * context_threads;
+	uint8 buffer[1024000];
+	int size;
+	int i, j;
+	RFX_RECT rect = {0, 0, 300, 200};
+	RFX_MESSAGE * message;
+	RFX_MESSAGE * message_threads;
+
+	rgb_data = (uint8 *) malloc(300 * 200 * 3);
+	for (i = 0; i < 200 * 3; i++)
+		memcpy(rgb_data + i * 100 * 3, rgb_scanline_data, 100 * 3); /* three copies per row */
+
+	context = rfx_context_new();
+	context->mode = RLGR3;
+	context->width = 800;
+	context->height = 600;
+	rfx_context_set_pixel_format(context, RFX_PIXEL_FORMAT_RGB);
+
+	context_threads = rfx_context_new();
+	rfx_context_set_pixel_format(context_threads, RFX_PIXEL_FORMAT_RGB);
+	rfx_context_set_threads(context_threads, 4);
+
+	size = rfx_compose_message_header(context, buffer, sizeof(buffer));
+	rfx_message_free(context, rfx_process_message(context, buffer, size));
+	rfx_message_free(context_threads, rfx_process_message(context_threads, buffer, size));
+
+	size = rfx_compose_message_data(context, buffer, sizeof(buffer),
+		&rect, 1, rgb_data, 300, 200, 300 * 3);
+
+	for (i = 0; i < 10; i++)
+	{
+		message = rfx_process_message(context, buffer, size);
+		message_threads = rfx_process_message(context_threads, buffer, size);
+
+		CU_ASSERT(message->num_tiles == 20);
+		CU_ASSERT(message_threads->num_tiles == message->num_tiles);
+
+		for (j = 0; j < message->num_tiles; j++)
+		{
+			CU_ASSERT(message_threads->tiles[j]->x == message->tiles[j]->x);
+			CU_ASSERT(message_threads->tiles[j]->y == message->tiles[j]->y);
+			CU_ASSERT(memcmp(message_threads->tiles[j]->data, message->tiles[j]->data, 4096 * 3) == 0);
+		}
+
+		rfx_message_free(context, message);
+		rfx_message_free(context_threads, message_threads);
+	}
+
+	rfx_context_free(context);
+	rfx_context_free(context_threads);
+	free(rgb_data);
+}
+
+void
+test_message_malformed(void)
+{
+	RFX_CONTEXT * context;
+	uint8 buffer[1024000];
+	uint8 * copy;
+	int header_size;
+	int size;
+	int i;
+	RFX_RECT rect = {0, 0, 100, 80};
+	RFX_MESSAGE * message;
+
+	rgb_data = (uint8 *) malloc(100 * 80 * 3);
+	for (i = 0; i < 80; i++)
+		memcpy(rgb_data + i * 100 * 3, rgb_scanline_data, 100 * 3);
+
+	context = rfx_context_new();
+	context->mode = RLGR3;
+	context->width = 800;
+	context->height = 600;
+	rfx_context_set_pixel_format(context, RFX_PIXEL_FORMAT_RGB);
+
+	header_size = rfx_compose_message_header(context, buffer, sizeof(buffer));
+	size = rfx_compose_message_data(context, buffer + header_size, sizeof(buffer) - header_size,
+		&rect, 1, rgb_data, 100, 80, 100 * 3);
+	size += header_size;
+
+	/* every truncation must be parsed without reading past the end of the data */
+	for (i = 0; i < size; i++)
+	{
+		copy = (uint8 *) malloc(i + 1);
+		memcpy(copy, buffer, i);
+		message = rfx_process_message(context, copy, i);
+		CU_ASSERT(message->num_tiles <= 4);
+		rfx_message_free(context, message);
+		free(copy);
+	}
+
+	/* a corrupted tile length stops the tileset without decoding anything beyond it */
+	for (i = header_size; i < size - 6; i++)
+	{
+		if (GET_UINT16(buffer, i) == CBT_TILE)
+		{
+			SET_UINT32(buffer, i + 2, 0xFFFFFFFF);
+			break;
+		}
+	}
+	message = rfx_process_message(context, buffer, size);
+	CU_ASSERT(message->num_tiles == 0);
+	CU_ASSERT(message->num_rects == 1);
+	rfx_message_free(context, message);
+
+	rfx_context_free(context);
+	free(rgb_data);
+}
+
+/* decode into a surface and compare it with the tiles of the regular path, clipped by hand */
+static void
+compare_message_surface(RFX_CONTEXT * context, RFX_CONTEXT * context_surface, uint8 * buffer, int size)
+{
+	RFX_SURFACE surface;
+	RFX_MESSAGE * message;
+	RFX_MESSAGE * message_surface;
+	RFX_TILE * tile;
+	uint8 * expected;
+	int x = 8, y = 4;
+	int sx, sy;
+	int i, j;
+
+	surface.width = 280;
+	surface.height = 190;
+	surface.stride = surface.width * 4 + 16;
+	surface.pixel_format = RFX_PIXEL_FORMAT_BGRA;
+	surface.data = (uint8 *) malloc(surface.stride * surface.height);
+	memset(surface.data, 0xCD, surface.stride * surface.height);
+
+	expected = (uint8 *) malloc(surface.stride * surface.height);
+	memset(expected, 0xCD, surface.stride * surface.height);
+
+	message = rfx_process_message(context, buffer, size);
+	message_surface = rfx_process_message_surface(context_surface, buffer, size, &surface, x, y);
+
+	CU_ASSERT(message_surface->num_tiles == message->num_tiles);
+	CU_ASSERT(message_surface->num_rects == message->num_rects);
+
+	for (sy = 0; sy < surface.height; sy++)
+	{
+		for (sx = 0; sx < surface.width; sx++)
+		{
+			for (i = 0; i < message->num_rects; i++)
+			{
+				if (sx >= x + message->rects[i].x && sx < x + message->rects[i].x + message->rects[i].width &&
+					sy >= y + message->rects[i].y && sy < y + message->rects[i].y + message->rects[i].height)
+					break;
+			}
+			if (i == message->num_rects)
+				continue;
+
+			for (j = 0; j < message->num_tiles; j++)
+			{
+				tile = message->tiles[j];
+				if (sx - x >= tile->x && sx - x < tile->x + 64 && sy - y >= tile->y && sy - y < tile->y + 64)
+				{
+					memcpy(expected + sy * surface.stride + sx * 4,
+						tile->data + ((sy - y - tile->y) * 64 + (sx - x - tile->x)) * 4, 4);
+					break;
+				}
+			}
+		}
+	}
+
+	CU_ASSERT(memcmp(surface.data, expected, surface.stride * surface.height) == 0);
+
+	rfx_message_free(context, message);
+	rfx_message_free(context_surface, message_surface);
+	free(expected);
+	free(surface.data);
+}
+
+void
+test_message_surface(void)
+{
+	RFX_CONTEXT * context;
+	RFX_CONTEXT * context_threads;
+	uint8 buffer[1024000];
+	int size;
+	int i;
+	RFX_RECT rects[] = { {10, 5, 100, 70}, {130, 64, 150, 100}, {0, 128, 64, 64} };
+
+	rgb_data = (uint8 *) malloc(300 * 200 * 3);
+	for (i = 0; i < 200 * 3; i++)
+		memcpy(rgb_data + i * 100 * 3, rgb_scanline_data, 100 * 3); /* three copies per row */
+
+	context = rfx_context_new();
+	context->mode = RLGR3;
+	context->width = 800;
+	context->height = 600;
+	rfx_context_set_pixel_format(context, RFX_PIXEL_FORMAT_BGRA);
+
+	context_threads = rfx_context_new();
+	rfx_context_set_pixel_format(context_threads, RFX_PIXEL_FORMAT_RGB);
+	rfx_context_set_threads(context_threads, 4);
+
+	size = rfx_compose_message_header(context, buffer, sizeof(buffer));
+	rfx_message_free(context, rfx_process_message(context, buffer, size));
+	rfx_message_free(context_threads, rfx_process_message(context_threads, buffer, size));
+
+	size = rfx_compose_message_data(context, buffer, sizeof(buffer),
+		rects, 3, rgb_data, 300, 200, 300 * 3);
+
+	/* the surface format wins over the one of the context */
+	compare_message_surface(context, context, buffer, size);
+	compare_message_surface(context, context_threads, buffer, size);
+
+	rfx_context_free(context);
+	rfx_context_free(context_threads);
+	free(rgb_data);
+}
+
+static void
+fill_random(sint16 * buf, int count, int range)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		buf[i] = (rand() % (range * 2)) - range;
+}
+
+/* the fused conversion must give the same pixels as converting the planes and packing them */
+static void
+compare_YCbCr_to_pixels(RFX_CONTEXT * context, int range)
+{
+	int i, j;
+	int format;
+	int bpp;
+	int stride;
+	sint16 y[4096], cb[4096], cr[4096];
+	sint16 r[4096], g[4096], b[4096];
+	uint8 expected[4096 * 4];
+	uint8 * p;
+	uint8 * dst;
+	uint8 * dst_simd;
+
+	fill_random(y, 4096, range);
+	fill_random(cb, 4096, range);
+	fill_random(cr, 4096, range);
+	memcpy(r, y, sizeof(y));
+	memcpy(g, cb, sizeof(cb));
+	memcpy(b, cr, sizeof(cr));
+	rfx_decode_YCbCr_to_RGB(r, g, b);
+
+	for (format = RFX_PIXEL_FORMAT_BGRA; format <= RFX_PIXEL_FORMAT_RGB; format++)
+	{
+		bpp = (format == RFX_PIXEL_FORMAT_BGRA || format == RFX_PIXEL_FORMAT_RGBA) ? 4 : 3;
+
+		p = expected;
+		for (i = 0; i < 4096; i++)
+		{
+			switch (format)
+			{
+				case RFX_PIXEL_FORMAT_BGRA:
+					*p++ = b[i]; *p++ = g[i]; *p++ = r[i]; *p++ = 0xFF;
+					break;
+				case RFX_PIXEL_FORMAT_RGBA:
+					*p++ = r[i]; *p++ = g[i]; *p++ = b[i]; *p++ = 0xFF;
+					break;
+				case RFX_PIXEL_FORMAT_BGR:
+					*p++ = b[i]; *p++ = g[i]; *p++ = r[i];
+					break;
+				case RFX_PIXEL_FORMAT_RGB:
+					*p++ = r[i]; *p++ = g[i]; *p++ = b[i];
+					break;
+			}
+		}
+
+		/* write into a wider surface to check the stride, the padding must stay untouched */
+		stride = 64 * bpp + 12;
+		dst = (uint8 *) malloc(stride * 64);
+		dst_simd = (uint8 *) malloc(stride * 64);
+		memset(dst, 0x5A, stride * 64);
+		memset(dst_simd, 0x5A, stride * 64);
+
+		memcpy(context->y_r_buffer, y, sizeof(y));
+		memcpy(context->cb_g_buffer, cb, sizeof(cb));
+		memcpy(context->cr_b_buffer, cr, sizeof(cr));
+		rfx_decode_YCbCr_to_pixels(y, cb, cr, format, dst, stride);
+		context->decode_YCbCr_to_pixels(context->y_r_buffer, context->cb_g_buffer, context->cr_b_buffer,
+			format, dst_simd, stride);
+
+		for (j = 0; j < 64; j++)
+		{
+			CU_ASSERT(memcmp(dst + j * stride, expected + j * 64 * bpp, 64 * bpp) == 0);
+			CU_ASSERT(dst[j * stride + 64 * bpp] == 0x5A);
+		}
+		CU_ASSERT(memcmp(dst_simd, dst, stride * 64) == 0);
+
+		free(dst);
+		free(dst_simd);
+	}
+}
+
+void
+test_simd(void)
+{
+	int i, j;
+	RFX_CONTEXT * context;
+	sint16 * simd_buffer;
+	sint16 * simd_cb_g;
+	sint16 * simd_cr_b;
+	sint16 ref_buffer[4096];
+	sint16 ref_cb_g[4096];
+	sint16 ref_cr_b[4096];
+	sint16 ref_dwt[32 * 32 * 2 * 2];
+	uint32 quants[10];
+
+	/* whatever routines were installed for this CPU must match the C versions */
+	context = rfx_context_new();
+	simd_buffer = context->y_r_buffer;
+	simd_cb_g = context->cb_g_buffer;
+	simd_cr_b = context->cr_b_buffer;
+
+	srand(2);
+	for (i = 0; i < 8; i++)
+	{
+		fill_random(ref_buffer, 4096, 1024);
+		memcpy(simd_buffer, ref_buffer, sizeof(ref_buffer));
+		rfx_dwt_2d_decode(ref_buffer, ref_dwt);
+		context->dwt_2d_decode(simd_buffer, context->dwt_buffer);
+		CU_ASSERT(memcmp(simd_buffer, ref_buffer, sizeof(ref_buffer)) == 0);
+
+		fill_random(ref_buffer, 4096, 256);
+		memcpy(simd_buffer, ref_buffer, sizeof(ref_buffer));
+		rfx_quantization_encode(ref_buffer, test_quantization_values);
+		context->quantization_encode(simd_buffer, test_quantization_values);
+		CU_ASSERT(memcmp(simd_buffer, ref_buffer, sizeof(ref_buffer)) == 0);
+
+		/* every sub-band gets a different factor, including the ones below 6 */
+		quants[0] = 6 + i;
+		quants[1] = 5 + i;
+		quants[2] = 7 + (i & 3);
+		quants[3] = 8 + (i & 3);
+		quants[4] = 4 + i;
+		quants[5] = 9;
+		quants[6] = 10 - (i & 3);
+		quants[7] = 6 + (i & 1);
+		quants[8] = 7;
+		quants[9] = 11 - (i & 3);
+
+		fill_random(ref_buffer, 4096, 64);
+		memcpy(simd_buffer, ref_buffer, sizeof(ref_buffer));
+		rfx_quantization_decode(ref_buffer, quants);
+		context->quantization_decode(simd_buffer, quants);
+		CU_ASSERT(memcmp(simd_buffer, ref_buffer, sizeof(ref_buffer)) == 0);
+
+		fill_random(ref_buffer, 4096, 300);
+		fill_random(ref_cb_g, 4096, 300);
+		fill_random(ref_cr_b, 4096, 300);
+		memcpy(simd_buffer, ref_buffer, sizeof(ref_buffer));
+		memcpy(simd_cb_g, ref_cb_g, sizeof(ref_cb_g));
+		memcpy(simd_cr_b, ref_cr_b, sizeof(ref_cr_b));
+		rfx_decode_YCbCr_to_RGB(ref_buffer, ref_cb_g, ref_cr_b);
+		context->decode_YCbCr_to_RGB(simd_buffer, simd_cb_g, simd_cr_b);
+		CU_ASSERT(memcmp(simd_buffer, ref_buffer, sizeof(ref_buffer)) == 0);
+		CU_ASSERT(memcmp(simd_cb_g, ref_cb_g, sizeof(ref_cb_g)) == 0);
+		CU_ASSERT(memcmp(simd_cr_b, ref_cr_b, sizeof(ref_cr_b)) == 0);
+
+		compare_YCbCr_to_pixels(context, 300);
+
+		for (j = 0; j < 4096; j++)
+		{
+			ref_buffer[j] = rand() % 256;
+			ref_cb_g[j] = rand() % 256;
+			ref_cr_b[j] = rand() % 256;
+		}
+		memcpy(simd_buffer, ref_buffer, sizeof(ref_buffer));
+		memcpy(simd_cb_g, ref_cb_g, sizeof(ref_cb_g));
+		memcpy(simd_cr_b, ref_cr_b, sizeof(ref_cr_b));
+		rfx_encode_RGB_to_YCbCr(ref_buffer, ref_cb_g, ref_cr_b);
+		context->encode_RGB_to_YCbCr(simd_buffer, simd_cb_g, simd_cr_b);
+		CU_ASSERT(memcmp(simd_buffer, ref_buffer, sizeof(ref_buffer)) == 0);
+		CU_ASSERT(memcmp(simd_cb_g, ref_cb_g, sizeof(ref_cb_g)) == 0);
+		CU_ASSERT(memcmp(simd_cr_b, ref_cr_b, sizeof(ref_cr_b)) == 0);
+	}
+
+	rfx_context_free(context);
+}
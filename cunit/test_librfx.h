@@ -30,6 +30,8 @@ test_bitstream_enc(void);
 void
 test_rlgr(void);
 void
+test_rlgr_fast(void);
+void
 test_differential(void);
 void
 test_quantization(void);
@@ -41,4 +43,12 @@ void
 test_encode(void);
 void
 test_message(void);
+void
+test_message_threads(void);
+void
+test_message_malformed(void);
+void
+test_message_surface(void);
+void
+test_simd(void);
 
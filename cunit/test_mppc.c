@@ -0,0 +1,521 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   MPPC Bulk Decompression Unit Tests
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+   The round trip tests use a small greedy compressor that only exists here.
+   It produces RDP 4.0 (8 KB history) and RDP 5.0 (64 KB history) streams from
+   a corpus of text, runs, bitmap like rows and noise, sent in packets of
+   varying size and restarting the history at the front when it is full, the
+   same way a server does.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/utils/memory.h>
+#include "rdp.h"
+
+#include "test_mppc.h"
+
+#define CORPUS_SIZE	(512 * 1024)
+
+static uint8 * corpus;
+
+struct mppc_encoder
+{
+	RD_BOOL big;
+	int history_size;
+	int pos;
+	uint8 hist[RDP_MPPC_DICT_SIZE];
+	int head[4096];
+	int prev[RDP_MPPC_DICT_SIZE];
+
+	uint8 * out;
+	int out_len;
+	uint32 acc;
+	int acc_bits;
+};
+
+static void
+mppc_put_bits(struct mppc_encoder * enc, uint32 value, int nbits)
+{
+	while (nbits-- > 0)
+	{
+		enc->acc = (enc->acc << 1) | ((value >> nbits) & 1);
+		if (++enc->acc_bits == 8)
+		{
+			enc->out[enc->out_len++] = (uint8) enc->acc;
+			enc->acc = 0;
+			enc->acc_bits = 0;
+		}
+	}
+}
+
+static void
+mppc_put_literal(struct mppc_encoder * enc, uint8 c)
+{
+	if (c < 0x80)
+		mppc_put_bits(enc, c, 8);
+	else
+		mppc_put_bits(enc, 0x100 | (c & 0x7F), 9);
+}
+
+static void
+mppc_put_match(struct mppc_encoder * enc, int off, int len)
+{
+	int n;
+
+	if (enc->big)
+	{
+		if (off < 64)
+			mppc_put_bits(enc, (0x1F << 6) | off, 11);
+		else if (off < 320)
+			mppc_put_bits(enc, (0x1E << 8) | (off - 64), 13);
+		else if (off < 2368)
+			mppc_put_bits(enc, (0x0E << 11) | (off - 320), 15);
+		else
+			mppc_put_bits(enc, (0x06 << 16) | (off - 2368), 19);
+	}
+	else
+	{
+		if (off < 64)
+			mppc_put_bits(enc, (0x0F << 6) | off, 10);
+		else if (off < 320)
+			mppc_put_bits(enc, (0x0E << 8) | (off - 64), 12);
+		else
+			mppc_put_bits(enc, (0x06 << 13) | (off - 320), 16);
+	}
+
+	if (len == 3)
+	{
+		mppc_put_bits(enc, 0, 1);
+		return;
+	}
+
+	for (n = 1; len >= (1 << (n + 2)); n++)
+		;
+
+	mppc_put_bits(enc, ((1 << n) - 1) << 1, n + 1);
+	mppc_put_bits(enc, len - (1 << (n + 1)), n + 1);
+}
+
+static int
+mppc_hash(const uint8 * p)
+{
+	return ((p[0] << 4) ^ (p[1] << 2) ^ p[2]) & 4095;
+}
+
+/* compress a packet, returns the compression type flags */
+static uint8
+mppc_compress(struct mppc_encoder * enc, const uint8 * data, int len, uint8 * out, int * out_len)
+{
+	int i, k, depth;
+	int off, max_off, max_len;
+	int best_len, best_off;
+	int start;
+	uint8 ctype;
+
+	ctype = RDP_MPPC_COMPRESSED | (enc->big ? RDP_MPPC_BIG : 0);
+
+	if (enc->pos + len > enc->history_size)
+	{
+		/* only the current history is searched, nothing refers to the old one */
+		enc->pos = 0;
+		ctype |= RDP_MPPC_RESET;
+	}
+
+	if (enc->pos == 0)
+		memset(enc->head, 0xFF, sizeof(enc->head));
+
+	enc->out = out;
+	enc->out_len = 0;
+	enc->acc = 0;
+	enc->acc_bits = 0;
+
+	max_off = enc->big ? 65535 : 8191;
+	max_len = enc->big ? 65535 : 8191;
+
+	start = enc->pos;
+	memcpy(enc->hist + start, data, len);
+
+	for (i = start; i < start + len; )
+	{
+		best_len = 0;
+		best_off = 0;
+
+		if (i + 3 <= start + len)
+		{
+			k = enc->head[mppc_hash(enc->hist + i)];
+
+			for (depth = 0; k >= 0 && depth < 16; depth++, k = enc->prev[k])
+			{
+				int l = 0;
+
+				off = i - k;
+				if (off > max_off)
+					break;
+
+				while (i + l < start + len && l < max_len && enc->hist[k + l] == enc->hist[i + l])
+					l++;
+
+				if (l > best_len)
+				{
+					best_len = l;
+					best_off = off;
+				}
+			}
+		}
+
+		if (best_len >= 3)
+		{
+			mppc_put_match(enc, best_off, best_len);
+		}
+		else
+		{
+			mppc_put_literal(enc, enc->hist[i]);
+			best_len = 1;
+		}
+
+		for (k = i; k < i + best_len; k++)
+		{
+			if (k + 3 <= start + len)
+			{
+				int h = mppc_hash(enc->hist + k);
+				enc->prev[k] = enc->head[h];
+				enc->head[h] = k;
+			}
+		}
+
+		i += best_len;
+	}
+
+	/* pad with zero bits */
+	if (enc->acc_bits > 0)
+		mppc_put_bits(enc, 0, 8 - enc->acc_bits);
+
+	enc->pos += len;
+	*out_len = enc->out_len;
+
+	return ctype;
+}
+
+static rdpRdp *
+mppc_rdp_new(void)
+{
+	rdpRdp * rdp;
+
+	rdp = (rdpRdp *) xmalloc(sizeof(rdpRdp));
+	memset(rdp, 0, sizeof(rdpRdp));
+
+	return rdp;
+}
+
+static void
+fill_corpus(uint8 * buffer, int size)
+{
+	static const char * words[] =
+	{
+		"the ", "remote ", "desktop ", "protocol ", "bitmap ", "cache ", "order ",
+		"glyph ", "surface ", "\r\n", "update ", "channel ", "of ", "and "
+	};
+	int i, j, n, kind;
+	uint32 seed = 0x12345678;
+
+	for (i = 0; i < size; )
+	{
+		seed = seed * 1103515245 + 12345;
+		kind = (seed >> 16) % 5;
+		n = 64 + ((seed >> 8) % 4000);
+
+		if (i + n > size)
+			n = size - i;
+
+		for (j = 0; j < n; )
+		{
+			seed = seed * 1103515245 + 12345;
+
+			switch (kind)
+			{
+				case 0: /* text */
+					{
+						const char * w = words[(seed >> 16) % 14];
+						while (*w && j < n)
+							buffer[i + j++] = (uint8) *w++;
+					}
+					break;
+
+				case 1: /* run of a single byte, short and long matches at offset 1 */
+					buffer[i + j++] = 0xE0;
+					break;
+
+				case 2: /* rows of 16 bit pixels, matches at the row stride */
+					if (j >= 128)
+						buffer[i + j] = buffer[i + j - 128] ^ (((seed >> 16) & 31) == 0);
+					else
+						buffer[i + j] = (uint8) (j * 7);
+					j++;
+					break;
+
+				case 3: /* short repeating patterns, overlapping matches */
+					buffer[i + j] = (uint8) (0x80 + (j % (2 + (n % 6))));
+					j++;
+					break;
+
+				default: /* noise */
+					buffer[i + j++] = (uint8) (seed >> 16);
+					break;
+			}
+		}
+
+		i += n;
+	}
+}
+
+int init_mppc_suite(void)
+{
+	corpus = (uint8 *) xmalloc(CORPUS_SIZE);
+	fill_corpus(corpus, CORPUS_SIZE);
+	return 0;
+}
+
+int clean_mppc_suite(void)
+{
+	xfree(corpus);
+	return 0;
+}
+
+int add_mppc_suite(void)
+{
+	add_test_suite(mppc);
+
+	add_test_function(mppc_uncompressed);
+	add_test_function(mppc_vectors);
+	add_test_function(mppc_roundtrip_small);
+	add_test_function(mppc_roundtrip_big);
+	add_test_function(mppc_malformed);
+	add_test_function(mppc_benchmark);
+
+	return 0;
+}
+
+void test_mppc_uncompressed(void)
+{
+	uint32 roff, rlen;
+	rdpRdp * rdp = mppc_rdp_new();
+
+	CU_ASSERT(mppc_expand(rdp, corpus, 100, RDP_MPPC_BIG, &roff, &rlen) == 0);
+	CU_ASSERT(roff == 0 && rlen == 100);
+
+	xfree(rdp);
+}
+
+void test_mppc_vectors(void)
+{
+	/* "abc", then a copy of 6 bytes from 3 bytes back */
+	static uint8 small_abc[] = { 0x61, 0x62, 0x63, 0xF0, 0xE8 };
+	static uint8 big_abc[] = { 0x61, 0x62, 0x63, 0xF8, 0x74 };
+	/* a literal 0xFF and padding */
+	static uint8 literal_ff[] = { 0xBF, 0x80 };
+	uint32 roff, rlen;
+	rdpRdp * rdp = mppc_rdp_new();
+
+	CU_ASSERT(mppc_expand(rdp, small_abc, sizeof(small_abc),
+		RDP_MPPC_COMPRESSED | RDP_MPPC_FLUSH, &roff, &rlen) == 0);
+	CU_ASSERT(roff == 0 && rlen == 9);
+	CU_ASSERT(memcmp(rdp->mppc_dict.hist + roff, "abcabcabc", 9) == 0);
+
+	CU_ASSERT(mppc_expand(rdp, literal_ff, sizeof(literal_ff),
+		RDP_MPPC_COMPRESSED, &roff, &rlen) == 0);
+	CU_ASSERT(roff == 9 && rlen == 1);
+	CU_ASSERT(rdp->mppc_dict.hist[9] == 0xFF);
+
+	CU_ASSERT(mppc_expand(rdp, big_abc, sizeof(big_abc),
+		RDP_MPPC_COMPRESSED | RDP_MPPC_BIG | RDP_MPPC_RESET, &roff, &rlen) == 0);
+	CU_ASSERT(roff == 0 && rlen == 9);
+	CU_ASSERT(memcmp(rdp->mppc_dict.hist + roff, "abcabcabc", 9) == 0);
+
+	xfree(rdp);
+}
+
+static void
+test_mppc_roundtrip(RD_BOOL big, int max_packet)
+{
+	int i, len;
+	int clen, failed;
+	uint8 ctype;
+	uint8 * out;
+	uint32 roff, rlen;
+	uint32 seed = 42;
+	rdpRdp * rdp = mppc_rdp_new();
+	struct mppc_encoder * enc;
+
+	enc = (struct mppc_encoder *) xmalloc(sizeof(struct mppc_encoder));
+	memset(enc, 0, sizeof(struct mppc_encoder));
+	enc->big = big;
+	enc->history_size = big ? 65536 : 8192;
+
+	out = (uint8 *) xmalloc(max_packet * 2 + 16);
+	failed = 0;
+
+	for (i = 0; i < CORPUS_SIZE; i += len)
+	{
+		seed = seed * 1103515245 + 12345;
+		len = 1 + (seed >> 8) % max_packet;
+		if (i + len > CORPUS_SIZE)
+			len = CORPUS_SIZE - i;
+
+		ctype = mppc_compress(enc, corpus + i, len, out, &clen);
+		if (i == 0)
+			ctype |= RDP_MPPC_FLUSH;
+
+		if (mppc_expand(rdp, out, clen, ctype, &roff, &rlen) != 0 ||
+			rlen != len || memcmp(rdp->mppc_dict.hist + roff, corpus + i, len) != 0)
+		{
+			printf("\nmppc round trip failed at %d (%d bytes, %d compressed)\n", i, len, clen);
+			failed = 1;
+			break;
+		}
+	}
+
+	CU_ASSERT(failed == 0);
+
+	xfree(out);
+	xfree(enc);
+	xfree(rdp);
+}
+
+void test_mppc_roundtrip_small(void)
+{
+	test_mppc_roundtrip(False, 4096);
+}
+
+void test_mppc_roundtrip_big(void)
+{
+	test_mppc_roundtrip(True, 16384);
+}
+
+void test_mppc_malformed(void)
+{
+	/* more than 14 ones in the length of match prefix of a 64 KB stream */
+	static uint8 long_length[] = { 0x61, 0xF8, 0x7F, 0xFF, 0xF0, 0x00, 0x00, 0x00 };
+	/* a copy offset of 0 */
+	static uint8 zero_offset[] = { 0x61, 0xF8, 0x00 };
+	/* literal 0x80 cut off after its prefix */
+	static uint8 truncated[] = { 0x61, 0x80 };
+	/* literal 0xFF followed by non zero padding */
+	static uint8 padding[] = { 0xBF, 0x81 };
+	int i, clen;
+	uint8 ctype;
+	uint8 out[1024];
+	uint32 roff, rlen;
+	rdpRdp * rdp = mppc_rdp_new();
+	struct mppc_encoder * enc;
+
+	ctype = RDP_MPPC_COMPRESSED | RDP_MPPC_BIG | RDP_MPPC_FLUSH;
+	CU_ASSERT(mppc_expand(rdp, long_length, sizeof(long_length), ctype, &roff, &rlen) == -1);
+	CU_ASSERT(mppc_expand(rdp, zero_offset, sizeof(zero_offset), ctype, &roff, &rlen) == -1);
+	CU_ASSERT(mppc_expand(rdp, truncated, sizeof(truncated), ctype, &roff, &rlen) == -1);
+	CU_ASSERT(mppc_expand(rdp, padding, sizeof(padding), ctype, &roff, &rlen) == -1);
+
+	/* a match that doesn't fit in the history */
+	rdp->mppc_dict.roff = RDP_MPPC_DICT_SIZE - 4;
+	CU_ASSERT(mppc_expand(rdp, (uint8 *) "\xFC\x3A", 2,
+		RDP_MPPC_COMPRESSED | RDP_MPPC_BIG, &roff, &rlen) == -1);
+
+	/* every truncation of a valid packet either fails or decodes a prefix */
+	enc = (struct mppc_encoder *) xmalloc(sizeof(struct mppc_encoder));
+	memset(enc, 0, sizeof(struct mppc_encoder));
+	enc->big = True;
+	enc->history_size = 65536;
+	ctype = mppc_compress(enc, corpus, 600, out, &clen);
+
+	for (i = 0; i < clen; i++)
+	{
+		if (mppc_expand(rdp, out, i, ctype | RDP_MPPC_FLUSH, &roff, &rlen) == 0)
+			CU_ASSERT(rlen <= 600 && memcmp(rdp->mppc_dict.hist, corpus, rlen) == 0);
+	}
+
+	xfree(enc);
+	xfree(rdp);
+}
+
+void test_mppc_benchmark(void)
+{
+	int i, n, len;
+	int clen, total_clen;
+	int npackets;
+	double seconds;
+	uint8 * out;
+	uint8 * ctypes;
+	int * clens;
+	uint32 roff, rlen;
+	struct timeval start, stop;
+	rdpRdp * rdp = mppc_rdp_new();
+	struct mppc_encoder * enc;
+
+	/* the corpus in 8 KB packets, the usual size of a slow path update */
+	len = 8192;
+	npackets = CORPUS_SIZE / len;
+
+	enc = (struct mppc_encoder *) xmalloc(sizeof(struct mppc_encoder));
+	memset(enc, 0, sizeof(struct mppc_encoder));
+	enc->big = True;
+	enc->history_size = 65536;
+
+	out = (uint8 *) xmalloc(npackets * (len * 2 + 16));
+	ctypes = (uint8 *) xmalloc(npackets);
+	clens = (int *) xmalloc(npackets * sizeof(int));
+	total_clen = 0;
+
+	for (i = 0; i < npackets; i++)
+	{
+		ctypes[i] = mppc_compress(enc, corpus + i * len, len, out + total_clen, &clen);
+		clens[i] = clen;
+		total_clen += clen;
+	}
+
+	/* every pass starts over with an empty history */
+	ctypes[0] |= RDP_MPPC_FLUSH;
+
+	gettimeofday(&start, NULL);
+
+	for (n = 0; n < 20; n++)
+	{
+		clen = 0;
+		for (i = 0; i < npackets; i++)
+		{
+			mppc_expand(rdp, out + clen, clens[i], ctypes[i], &roff, &rlen);
+			clen += clens[i];
+		}
+	}
+
+	gettimeofday(&stop, NULL);
+
+	seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_usec - start.tv_usec) / 1000000.0;
+	printf("\nmppc_expand: %d bytes from %d, %.1f MB/s\n", CORPUS_SIZE, total_clen,
+		seconds > 0 ? (CORPUS_SIZE * 20.0) / (seconds * 1024 * 1024) : 0.0);
+
+	CU_ASSERT(memcmp(rdp->mppc_dict.hist + roff, corpus + (npackets - 1) * len, len) == 0);
+
+	xfree(clens);
+	xfree(ctypes);
+	xfree(out);
+	xfree(enc);
+	xfree(rdp);
+}
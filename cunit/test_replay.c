@@ -0,0 +1,453 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   Session Replay Unit Tests
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+   The replays run through the public interface with a headless software
+   GDI instance, the way xfreerdp --replay does without a window.
+
+   test_replay_file replays the recording named by the FREERDP_REPLAY
+   environment variable, made with xfreerdp --record, and prints what each
+   kind of PDU took. It does nothing when the variable is not set.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/rdpset.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/constants/core.h>
+#include <freerdp/constants/constants.h>
+#include "gdi.h"
+#include "orders.h"
+#include "record.h"
+
+#include "test_replay.h"
+
+#define REPLAY_FILE	"test_replay.rec"
+
+static int channel_bytes;
+static int rect_calls;
+static int clip_calls;
+static void (* gdi_ui_rect)(rdpInst * inst, int x, int y, int cx, int cy, uint32 color);
+static void (* gdi_ui_set_clip)(rdpInst * inst, int x, int y, int cx, int cy);
+
+static void
+replay_ui_text(rdpInst * inst, const char * text)
+{
+}
+
+static uint32
+replay_ui_get_toggle_keys_state(rdpInst * inst)
+{
+	return 0;
+}
+
+static void
+replay_ui_bell(rdpInst * inst)
+{
+}
+
+static void
+replay_ui_resize_window(rdpInst * inst)
+{
+	gdi_free(inst);
+	gdi_init(inst, CLRCONV_ALPHA | CLRBUF_32BPP);
+}
+
+static RD_HCURSOR
+replay_ui_create_cursor(rdpInst * inst, unsigned int x, unsigned int y,
+	int width, int height, uint8 * andmask, uint8 * xormask, int bpp)
+{
+	return NULL;
+}
+
+static void
+replay_ui_cursor(rdpInst * inst, RD_HCURSOR cursor)
+{
+}
+
+static void
+replay_ui_no_cursor(rdpInst * inst)
+{
+}
+
+static void
+replay_ui_move_pointer(rdpInst * inst, int x, int y)
+{
+}
+
+static void
+replay_ui_channel_data(rdpInst * inst, int chan_id, char * data, int data_size,
+	int flags, int total_size)
+{
+	channel_bytes += data_size;
+}
+
+static void
+replay_ui_rect(rdpInst * inst, int x, int y, int cx, int cy, uint32 color)
+{
+	rect_calls++;
+	gdi_ui_rect(inst, x, y, cx, cy, color);
+}
+
+static void
+replay_ui_set_clip(rdpInst * inst, int x, int y, int cx, int cy)
+{
+	clip_calls++;
+	gdi_ui_set_clip(inst, x, y, cx, cy);
+}
+
+/* a headless session decoding the given recording */
+static rdpInst *
+replay_new(rdpSet * settings, const char * filename)
+{
+	rdpInst * inst;
+
+	memset(settings, 0, sizeof(rdpSet));
+	settings->width = 64;
+	settings->height = 64;
+	settings->server_depth = 32;
+	snprintf(settings->replay_file, sizeof(settings->replay_file), "%s", filename);
+
+	inst = freerdp_new(settings);
+	gdi_init(inst, CLRCONV_ALPHA | CLRBUF_32BPP);
+	inst->ui_error = replay_ui_text;
+	inst->ui_warning = replay_ui_text;
+	inst->ui_unimpl = replay_ui_text;
+	inst->ui_get_toggle_keys_state = replay_ui_get_toggle_keys_state;
+	inst->ui_bell = replay_ui_bell;
+	inst->ui_resize_window = replay_ui_resize_window;
+	inst->ui_create_cursor = replay_ui_create_cursor;
+	inst->ui_set_cursor = replay_ui_cursor;
+	inst->ui_destroy_cursor = replay_ui_cursor;
+	inst->ui_set_null_cursor = replay_ui_no_cursor;
+	inst->ui_set_default_cursor = replay_ui_no_cursor;
+	inst->ui_move_pointer = replay_ui_move_pointer;
+	inst->ui_channel_data = replay_ui_channel_data;
+
+	return inst;
+}
+
+static void
+replay_free(rdpInst * inst)
+{
+	inst->rdp_disconnect(inst);
+	gdi_free(inst);
+	freerdp_free(inst);
+}
+
+/* a fast-path update with one destination blt order */
+static void
+write_destblt(rdpRecord * rec, int x, int y, int cx, int cy, uint8 opcode)
+{
+	STREAM s;
+
+	s = stream_new(64);
+	out_uint8(s, FASTPATH_UPDATETYPE_ORDERS);
+	out_uint16_le(s, 2 + 12);
+	out_uint16_le(s, 1); /* numberOrders */
+	out_uint8(s, RDP_ORDER_CTL_STANDARD | RDP_ORDER_CTL_TYPE_CHANGE);
+	out_uint8(s, RDP_ORDER_DSTBLT);
+	out_uint8(s, 0x1f); /* all fields present */
+	out_uint16_le(s, x);
+	out_uint16_le(s, y);
+	out_uint16_le(s, cx);
+	out_uint16_le(s, cy);
+	out_uint8(s, opcode);
+	s->end = s->p;
+	s->p = s->data;
+
+	record_write(rec, SEC_RECV_FAST_PATH, 0, s);
+	stream_delete(s);
+}
+
+static void
+write_channel_data(rdpRecord * rec, int length)
+{
+	STREAM s;
+
+	s = stream_new(8 + length);
+	out_uint32_le(s, length);
+	out_uint32_le(s, 3); /* CHANNEL_FLAG_FIRST | CHANNEL_FLAG_LAST */
+	memset(s->p, 0x5a, length);
+	s->p += length;
+	s->end = s->p;
+	s->p = s->data;
+
+	record_write(rec, SEC_RECV_IOCHANNEL, MCS_GLOBAL_CHANNEL + 1, s);
+	stream_delete(s);
+}
+
+/* a fast-path update with white opaque rectangles of 16x8 side by side
+   from the top left corner, all clipped to 32x32 */
+static void
+write_opaquerects(rdpRecord * rec, int count)
+{
+	STREAM s;
+	int i;
+
+	s = stream_new(64 + count * 24);
+	out_uint8(s, FASTPATH_UPDATETYPE_ORDERS);
+	out_uint16_le(s, 2 + 9 + count * 12);
+	out_uint16_le(s, count); /* numberOrders */
+	for (i = 0; i < count; i++)
+	{
+		if (i == 0)
+		{
+			out_uint8(s, RDP_ORDER_CTL_STANDARD | RDP_ORDER_CTL_TYPE_CHANGE | RDP_ORDER_CTL_BOUNDS);
+			out_uint8(s, RDP_ORDER_OPAQUERECT);
+			out_uint8(s, 0x7f); /* all fields present */
+			out_uint8(s, 0x0f); /* all bounds present */
+			out_uint16_le(s, 0);
+			out_uint16_le(s, 0);
+			out_uint16_le(s, 31);
+			out_uint16_le(s, 31);
+		}
+		else
+		{
+			/* same bounds as the order before */
+			out_uint8(s, RDP_ORDER_CTL_STANDARD | RDP_ORDER_CTL_BOUNDS | RDP_ORDER_CTL_ZERO_BOUNDS_DELTA);
+			out_uint8(s, 0x7f);
+		}
+		out_uint16_le(s, i * 16);
+		out_uint16_le(s, 0);
+		out_uint16_le(s, 16);
+		out_uint16_le(s, 8);
+		out_uint8(s, 0xff);
+		out_uint8(s, 0xff);
+		out_uint8(s, 0xff);
+	}
+	s->end = s->p;
+	s->p = s->data;
+
+	record_write(rec, SEC_RECV_FAST_PATH, 0, s);
+	stream_delete(s);
+}
+
+/* pixels of the primary surface that are not all of the given color */
+static int
+count_other_pixels(rdpInst * inst, int x, int y, int cx, int cy, uint8 color)
+{
+	GDI * gdi = GET_GDI(inst);
+	uint8 * p;
+	int count;
+	int i, j;
+
+	count = 0;
+	for (j = y; j < y + cy; j++)
+	{
+		for (i = x; i < x + cx; i++)
+		{
+			p = gdi->primary_buffer + (j * gdi->width + i) * 4;
+			if (p[0] != color || p[1] != color || p[2] != color)
+				count++;
+		}
+	}
+	return count;
+}
+
+int init_replay_suite(void)
+{
+	return 0;
+}
+
+int clean_replay_suite(void)
+{
+	remove(REPLAY_FILE);
+	return 0;
+}
+
+int add_replay_suite(void)
+{
+	add_test_suite(replay);
+
+	add_test_function(replay_orders);
+	add_test_function(replay_damaged);
+	add_test_function(replay_display_list);
+	add_test_function(replay_file);
+
+	return 0;
+}
+
+void test_replay_orders(void)
+{
+	rdpRecord * rec;
+	rdpInst * inst;
+	rdpSet settings;
+	RD_REPLAY_STATS stats;
+
+	rec = record_new(REPLAY_FILE, True);
+	CU_ASSERT_FATAL(rec != NULL);
+	write_destblt(rec, 8, 8, 16, 16, 0xff); /* WHITENESS */
+	write_channel_data(rec, 100);
+	write_destblt(rec, 12, 12, 4, 4, 0x00); /* BLACKNESS */
+	record_free(rec);
+
+	channel_bytes = 0;
+	inst = replay_new(&settings, REPLAY_FILE);
+	CU_ASSERT(inst->rdp_connect(inst) == 0);
+
+	while (inst->rdp_check_fds(inst) == 0)
+		;
+
+	CU_ASSERT(count_other_pixels(inst, 8, 8, 16, 4, 0xff) == 0);
+	CU_ASSERT(count_other_pixels(inst, 8, 12, 4, 4, 0xff) == 0);
+	CU_ASSERT(count_other_pixels(inst, 12, 12, 4, 4, 0x00) == 0);
+	CU_ASSERT(count_other_pixels(inst, 16, 12, 8, 4, 0xff) == 0);
+	CU_ASSERT(count_other_pixels(inst, 8, 16, 16, 8, 0xff) == 0);
+	CU_ASSERT(channel_bytes == 100);
+
+	CU_ASSERT(inst->rdp_get_replay_stats(inst, &stats) == 0);
+	CU_ASSERT(stats.done == 1);
+	CU_ASSERT(stats.frames == 2);
+	CU_ASSERT(stats.pdus[RD_PDU_ORDERS].count == 2);
+	CU_ASSERT(stats.pdus[RD_PDU_ORDERS].bytes == 2 * 17);
+	CU_ASSERT(stats.pdus[RD_PDU_CHANNEL].count == 1);
+	CU_ASSERT(stats.pdus[RD_PDU_CHANNEL].bytes == 108);
+	CU_ASSERT(stats.pdus[RD_PDU_BITMAP].count == 0);
+	CU_ASSERT(stats.pdus[RD_PDU_OTHER].count == 0);
+
+	replay_free(inst);
+}
+
+void test_replay_damaged(void)
+{
+	FILE * fp;
+	rdpRecord * rec;
+	rdpInst * inst;
+	rdpSet settings;
+	RD_REPLAY_STATS stats;
+
+	/* not a recording */
+	fp = fopen(REPLAY_FILE, "wb");
+	CU_ASSERT_FATAL(fp != NULL);
+	fputs("not a recording", fp);
+	fclose(fp);
+	CU_ASSERT(record_new(REPLAY_FILE, False) == NULL);
+
+	inst = replay_new(&settings, REPLAY_FILE);
+	CU_ASSERT(inst->rdp_connect(inst) != 0);
+	CU_ASSERT(inst->rdp_get_replay_stats(inst, &stats) != 0);
+	gdi_free(inst);
+	freerdp_free(inst);
+
+	/* the second PDU is cut short, the first one is still replayed */
+	rec = record_new(REPLAY_FILE, True);
+	CU_ASSERT_FATAL(rec != NULL);
+	write_destblt(rec, 0, 0, 64, 64, 0xff);
+	write_destblt(rec, 0, 0, 64, 64, 0x00);
+	record_free(rec);
+
+	CU_ASSERT(truncate(REPLAY_FILE, RECORD_MAGIC_LENGTH + 2 * (12 + 17) - 3) == 0);
+
+	inst = replay_new(&settings, REPLAY_FILE);
+	CU_ASSERT(inst->rdp_connect(inst) == 0);
+
+	while (inst->rdp_check_fds(inst) == 0)
+		;
+
+	CU_ASSERT(count_other_pixels(inst, 0, 0, 64, 64, 0xff) == 0);
+	CU_ASSERT(inst->rdp_get_replay_stats(inst, &stats) == 0);
+	CU_ASSERT(stats.done == 1);
+	CU_ASSERT(stats.frames == 1);
+	CU_ASSERT(stats.pdus[RD_PDU_ORDERS].count == 1);
+
+	replay_free(inst);
+}
+
+void test_replay_display_list(void)
+{
+	rdpRecord * rec;
+	rdpInst * inst;
+	rdpSet settings;
+	int display_list;
+
+	rec = record_new(REPLAY_FILE, True);
+	CU_ASSERT_FATAL(rec != NULL);
+	write_destblt(rec, 0, 0, 64, 64, 0x00); /* BLACKNESS */
+	write_opaquerects(rec, 3);
+	record_free(rec);
+
+	for (display_list = 0; display_list < 2; display_list++)
+	{
+		inst = replay_new(&settings, REPLAY_FILE);
+		settings.display_list = display_list;
+		gdi_ui_rect = inst->ui_rect;
+		gdi_ui_set_clip = inst->ui_set_clip;
+		inst->ui_rect = replay_ui_rect;
+		inst->ui_set_clip = replay_ui_set_clip;
+		rect_calls = 0;
+		clip_calls = 0;
+		CU_ASSERT(inst->rdp_connect(inst) == 0);
+
+		while (inst->rdp_check_fds(inst) == 0)
+			;
+
+		/* the third rectangle is outside of the clip */
+		CU_ASSERT(count_other_pixels(inst, 0, 0, 32, 8, 0xff) == 0);
+		CU_ASSERT(count_other_pixels(inst, 32, 0, 32, 64, 0x00) == 0);
+		CU_ASSERT(count_other_pixels(inst, 0, 8, 32, 56, 0x00) == 0);
+
+		/* one clip and one fill for the whole update */
+		CU_ASSERT(rect_calls == (display_list ? 1 : 3));
+		CU_ASSERT(clip_calls == (display_list ? 1 : 3));
+
+		replay_free(inst);
+	}
+}
+
+void test_replay_file(void)
+{
+	static const char * kinds[RD_PDU_KINDS] =
+	{
+		"orders", "bitmap", "palette", "pointer", "surfcmds", "channel", "other"
+	};
+	char * filename;
+	rdpInst * inst;
+	rdpSet settings;
+	RD_REPLAY_STATS stats;
+	int index;
+
+	filename = getenv("FREERDP_REPLAY");
+	if (filename == NULL)
+		return;
+
+	inst = replay_new(&settings, filename);
+	settings.width = 1024;
+	settings.height = 768;
+	replay_ui_resize_window(inst);
+	CU_ASSERT_FATAL(inst->rdp_connect(inst) == 0);
+
+	while (inst->rdp_check_fds(inst) == 0)
+		;
+
+	CU_ASSERT(inst->rdp_get_replay_stats(inst, &stats) == 0);
+	CU_ASSERT(stats.done == 1);
+
+	printf("\n%-10s %8s %10s %10s %8s\n", "pdu", "count", "bytes", "usec", "allocs");
+	for (index = 0; index < RD_PDU_KINDS; index++)
+	{
+		printf("%-10s %8u %10u %10u %8u\n", kinds[index], stats.pdus[index].count,
+			stats.pdus[index].bytes, stats.pdus[index].usec, stats.pdus[index].allocs);
+	}
+	printf("%u frames, %.1f frames/sec\n", stats.frames,
+		stats.usec ? stats.frames * 1000000.0 / stats.usec : 0.0);
+
+	replay_free(inst);
+}
@@ -51,27 +51,20 @@ l_ui_unimpl(struct rdp_inst * inst, const char * text)
 /* GDI callbacks registered in libfreerdp */
 
 static void
-l_ui_gdi_begin_update(struct rdp_inst * inst)
-{
-	GDI *gdi = GET_GDI(inst);
-	gdi->primary->hdc->hwnd->invalid->null = 1;
-}
-
-static void
-l_ui_gdi_end_update(struct rdp_inst * inst)
+l_ui_gdi_update_region(struct rdp_inst * inst, HGDI_RGN rects, int count)
 {
+	int i;
 	dfbInfo *dfbi = GET_DFBI(inst);
-	GDI *gdi = GET_GDI(inst);
-
-	if (gdi->primary->hdc->hwnd->invalid->null)
-		return;
 
-	dfbi->update_rect.x = gdi->primary->hdc->hwnd->invalid->x;
-	dfbi->update_rect.y = gdi->primary->hdc->hwnd->invalid->y;
-	dfbi->update_rect.w = gdi->primary->hdc->hwnd->invalid->w;
-	dfbi->update_rect.h = gdi->primary->hdc->hwnd->invalid->h;
+	for (i = 0; i < count; i++)
+	{
+		dfbi->update_rect.x = rects[i].x;
+		dfbi->update_rect.y = rects[i].y;
+		dfbi->update_rect.w = rects[i].w;
+		dfbi->update_rect.h = rects[i].h;
 
-	dfbi->primary->Blit(dfbi->primary, dfbi->surface, &(dfbi->update_rect), dfbi->update_rect.x, dfbi->update_rect.y);
+		dfbi->primary->Blit(dfbi->primary, dfbi->surface, &(dfbi->update_rect), dfbi->update_rect.x, dfbi->update_rect.y);
+	}
 }
 
 static void
@@ -556,8 +549,7 @@ dfb_post_connect(rdpInst * inst)
 		dfbi->dsc.preallocated[0].pitch = gdi->width * gdi->bytesPerPixel;
 		dfbi->dfb->CreateSurface(dfbi->dfb, &(dfbi->dsc), &(dfbi->surface));
 
-		inst->ui_begin_update = l_ui_gdi_begin_update;
-		inst->ui_end_update = l_ui_gdi_end_update;
+		gdi->update_region = l_ui_gdi_update_region;
 	}
 	else
 	{
@@ -53,6 +53,7 @@
 #define BMPCACHE2_C1_CELLS	0x78
 #define BMPCACHE2_C2_CELLS	0x150
 #define BMPCACHE2_NUM_PSTCELLS	0x9f6
+#define BMPCACHE2_MAX_CELLS	0x7fff	/* cache indices are 15 bits, 0x7fff is the waiting list */
 
 /* User Data Header Types */
 #define CS_CORE         0xC001
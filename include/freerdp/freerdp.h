@@ -25,7 +25,7 @@
 #include "constants/ui.h"
 #include "rdpext.h"
 
-#define FREERDP_INTERFACE_VERSION 4
+#define FREERDP_INTERFACE_VERSION 10
 
 #if defined _WIN32 || defined __CYGWIN__
   #ifdef FREERDP_EXPORTS
@@ -82,12 +82,16 @@ struct rdp_inst
 	void (*rdp_suppress_output)(rdpInst * inst, int allow_display_updates);
 	void (* rdp_disconnect)(rdpInst * inst);
 	int (* rdp_send_frame_ack)(rdpInst * inst, int frame_id);
+	int (* rdp_get_bitmap_cache_stats)(rdpInst * inst, int cache_id, RD_BITMAP_CACHE_STATS * stats);
+	int (* rdp_get_network_stats)(rdpInst * inst, RD_NETWORK_STATS * stats);
+	int (* rdp_get_replay_stats)(rdpInst * inst, RD_REPLAY_STATS * stats);
 	/* calls from library to ui */
 	void (* ui_error)(rdpInst * inst, const char * text);
 	void (* ui_warning)(rdpInst * inst, const char * text);
 	void (* ui_unimpl)(rdpInst * inst, const char * text);
 	void (* ui_begin_update)(rdpInst * inst);
 	void (* ui_end_update)(rdpInst * inst);
+	void (* ui_draw_list)(rdpInst * inst, RD_DRAW_CMD * cmds, int count);
 	void (* ui_desktop_save)(rdpInst * inst, int offset, int x, int y,
 		int cx, int cy);
 	void (* ui_desktop_restore)(rdpInst * inst, int offset, int x, int y,
@@ -96,6 +100,9 @@ struct rdp_inst
 	void (* ui_paint_bitmap)(rdpInst * inst, int x, int y, int cx, int cy, int width,
 		int height, uint8 * data);
 	void (* ui_destroy_bitmap)(rdpInst * inst, RD_HBITMAP bmp);
+	int (* ui_begin_paint_bitmap)(rdpInst * inst, int x, int y, int cx, int cy, int bpp,
+		RD_BITMAP_DEST * dest);
+	void (* ui_end_paint_bitmap)(rdpInst * inst, int x, int y, int cx, int cy);
 	void (* ui_line)(rdpInst * inst, uint8 opcode, int startx, int starty, int endx,
 		int endy, RD_PEN * pen);
 	void (* ui_rect)(rdpInst * inst, int x, int y, int cx, int cy, uint32 color);
@@ -108,6 +115,7 @@ struct rdp_inst
 	void (* ui_start_draw_glyphs)(rdpInst * inst, uint32 bgcolor, uint32 fgcolor);
 	void (* ui_draw_glyph)(rdpInst * inst, int x, int y, int cx, int cy,
 		RD_HGLYPH glyph);
+	void (* ui_draw_glyph_run)(rdpInst * inst, RD_GLYPH_POS * glyphs, int count);
 	void (* ui_end_draw_glyphs)(rdpInst * inst, int x, int y, int cx, int cy);
 	uint32 (* ui_get_toggle_keys_state)(rdpInst * inst);
 	void (* ui_bell)(rdpInst * inst);
@@ -73,6 +73,8 @@ struct rdp_set
 	int bitmap_cache;
 	int bitmap_cache_persist_enable;
 	int bitmap_cache_precache;
+	int bitmap_cache_cells[3]; /* cells per cache id, 0 for the protocol default */
+	int bitmap_cache_memory; /* bytes kept in memory for persistent caches, 0 for the default */
 	int bitmap_compression;
 	int performanceflags;
 	int desktop_save;
@@ -89,6 +91,10 @@ struct rdp_set
 	int use_frame_ack;
 	int num_channels;
 	int software_gdi;
+	int pipelined; /* receive, decode and present on separate threads */
+	int display_list; /* batch the drawing orders of each update */
+	char record_file[256]; /* received PDUs are saved here when set */
+	char replay_file[256]; /* PDUs are read from here instead of a server when set */
 	struct rdp_chan channels[16];
 	struct rdp_ext_set extensions[16];
 	int num_monitors;
@@ -105,6 +105,15 @@ struct _RFX_POOL
 };
 typedef struct _RFX_POOL RFX_POOL;
 
+/* bump allocator for per-frame data, reset once all messages are freed */
+struct _RFX_ARENA
+{
+	int size;
+	int used;
+	uint8 * block;
+};
+typedef struct _RFX_ARENA RFX_ARENA;
+
 struct _RFX_MESSAGE
 {
 	/*
@@ -121,9 +130,30 @@ struct _RFX_MESSAGE
 	 */
 	uint16 num_tiles;
 	RFX_TILE** tiles;
+
+	/* quantization values referenced by the tiles, 10 per entry */
+	uint8 num_quants;
+	uint32 * quants;
 };
 typedef struct _RFX_MESSAGE RFX_MESSAGE;
 
+/*
+ * A caller owned destination for rfx_process_message_surface(), usually the
+ * client framebuffer. Tiles are decoded straight into it, clipped to the
+ * message rects and to the surface bounds.
+ */
+struct _RFX_SURFACE
+{
+	uint8 * data;
+	int width;
+	int height;
+	int stride;
+	RFX_PIXEL_FORMAT pixel_format;
+};
+typedef struct _RFX_SURFACE RFX_SURFACE;
+
+typedef struct _RFX_WORKERS RFX_WORKERS;
+
 struct _RFX_CONTEXT
 {
 	uint16 flags;
@@ -148,21 +178,30 @@ struct _RFX_CONTEXT
 	/* pre-allocated buffers */
 
 	RFX_POOL* pool; /* memory pool */
+	RFX_ARENA* arena; /* messages, rects, quants and tile arrays of the current frame */
+	int num_messages; /* messages not yet returned with rfx_message_free() */
 
-	sint16 y_r_mem[4096+8]; /* 4096 = 64x64 (+ 8x2 = 16 for mem align) */
-	sint16 cb_g_mem[4096+8]; /* 4096 = 64x64 (+ 8x2 = 16 for mem align) */
-	sint16 cr_b_mem[4096+8]; /* 4096 = 64x64 (+ 8x2 = 16 for mem align) */
+	sint16 y_r_mem[4096+16]; /* 4096 = 64x64 (+ 16x2 = 32 for mem align) */
+	sint16 cb_g_mem[4096+16]; /* 4096 = 64x64 (+ 16x2 = 32 for mem align) */
+	sint16 cr_b_mem[4096+16]; /* 4096 = 64x64 (+ 16x2 = 32 for mem align) */
  
  	sint16 * y_r_buffer;
 	sint16 * cb_g_buffer;
 	sint16 * cr_b_buffer;
  
-	sint16 dwt_mem[32*32*2*2 + 8]; /* maximum sub-band width is 32 */
+	sint16 dwt_mem[32*32*2*2 + 16]; /* maximum sub-band width is 32 */
 
 	sint16 * dwt_buffer;
 
+	/* parallel tile decoding, see rfx_context_set_threads() */
+	int num_threads;
+	RFX_WORKERS * workers;
+
 	/* routines */
+	int (* rlgr_decode)(RLGR_MODE mode, const uint8 * data, int data_size, sint16 * buffer, int buffer_size);
 	void (* decode_YCbCr_to_RGB)(sint16 * y_r_buf, sint16 * cb_g_buf, sint16 * cr_b_buf);
+	void (* decode_YCbCr_to_pixels)(sint16 * y_buf, sint16 * cb_buf, sint16 * cr_buf,
+		RFX_PIXEL_FORMAT pixel_format, uint8 * dst_buf, int dst_stride);
 	void (* encode_RGB_to_YCbCr)(sint16 * y_r_buf, sint16 * cb_g_buf, sint16 * cr_b_buf);
 	void (* quantization_decode)(sint16 * buffer, const uint32 * quantization_values);
 	void (* quantization_encode)(sint16 * buffer, const uint32 * quantization_values);
@@ -177,7 +216,6 @@ struct _RFX_CONTEXT
 	PROFILER_DEFINE(prof_rfx_quantization_decode);
 	PROFILER_DEFINE(prof_rfx_dwt_2d_decode);
 	PROFILER_DEFINE(prof_rfx_decode_YCbCr_to_RGB);
-	PROFILER_DEFINE(prof_rfx_decode_format_RGB);
 
 	PROFILER_DEFINE(prof_rfx_encode_rgb);
 	PROFILER_DEFINE(prof_rfx_encode_component);
@@ -193,8 +231,11 @@ typedef struct _RFX_CONTEXT RFX_CONTEXT;
 RFX_CONTEXT* rfx_context_new(void);
 void rfx_context_free(RFX_CONTEXT * context);
 void rfx_context_set_pixel_format(RFX_CONTEXT * context, RFX_PIXEL_FORMAT pixel_format);
+void rfx_context_set_threads(RFX_CONTEXT * context, int num_threads);
 
 RFX_MESSAGE* rfx_process_message(RFX_CONTEXT * context, uint8 * data, int size);
+RFX_MESSAGE* rfx_process_message_surface(RFX_CONTEXT * context, uint8 * data, int size,
+	RFX_SURFACE * surface, int x, int y);
 void rfx_message_free(RFX_CONTEXT * context, RFX_MESSAGE * message);
 
 int rfx_compose_message_header(RFX_CONTEXT * context, uint8 * buffer, int buffer_size);
@@ -95,6 +95,126 @@ typedef struct _RD_RECT
 }
 RD_RECT;
 
+/* a glyph of a text order and where to draw it, see ui_draw_glyph_run */
+typedef struct _RD_GLYPH_POS
+{
+	sint16 x, y;
+	uint16 cx, cy;
+	RD_HGLYPH glyph;
+}
+RD_GLYPH_POS;
+
+/* counters of one bitmap cache, see rdp_get_bitmap_cache_stats */
+typedef struct _RD_BITMAP_CACHE_STATS
+{
+	uint32 cells; /* cells advertised to the server */
+	uint32 count; /* bitmaps held */
+	uint32 size; /* bytes held */
+	uint32 max_size; /* memory budget in bytes, 0 if the cache never evicts */
+	uint32 hits;
+	uint32 misses;
+	uint32 evictions;
+}
+RD_BITMAP_CACHE_STATS;
+
+/* receive path counters, see rdp_get_network_stats */
+typedef struct _RD_NETWORK_STATS
+{
+	uint32 pdus; /* PDUs received */
+	uint32 bytes; /* bytes received */
+	uint32 reads; /* read system calls (recv or SSL_read) */
+	uint32 waits; /* waits for the socket to become readable */
+	uint32 buffered; /* reads served from the receive buffer only */
+}
+RD_NETWORK_STATS;
+
+/* kinds of PDUs told apart by rdp_get_replay_stats */
+enum RD_PDU_KIND
+{
+	RD_PDU_ORDERS,
+	RD_PDU_BITMAP,
+	RD_PDU_PALETTE,
+	RD_PDU_POINTER,
+	RD_PDU_SURFCMDS,
+	RD_PDU_CHANNEL,
+	RD_PDU_OTHER,
+	RD_PDU_KINDS
+};
+
+typedef struct _RD_PDU_STATS
+{
+	uint32 count; /* PDUs replayed */
+	uint32 bytes; /* payload bytes */
+	uint32 usec; /* time spent processing them */
+	uint32 allocs; /* xmalloc and xrealloc calls while processing them */
+}
+RD_PDU_STATS;
+
+/* counters of a replayed recording, see rdp_get_replay_stats */
+typedef struct _RD_REPLAY_STATS
+{
+	RD_PDU_STATS pdus[RD_PDU_KINDS];
+	uint32 frames; /* updates ended */
+	uint32 usec; /* time spent processing all PDUs */
+	uint32 done; /* the end of the recording has been reached */
+}
+RD_REPLAY_STATS;
+
+/* kinds of commands in a display list, see ui_draw_list */
+enum RD_DRAW_TYPE
+{
+	RD_DRAW_SET_CLIP,
+	RD_DRAW_RESET_CLIP,
+	RD_DRAW_RECT,
+	RD_DRAW_DESTBLT,
+	RD_DRAW_PATBLT,
+	RD_DRAW_SCREENBLT,
+	RD_DRAW_MEMBLT,
+	RD_DRAW_LINE
+};
+
+/* a drawing call of a display list. x, y, cx and cy are the rectangle of
+   clips, fills and blts, lines are drawn from x, y to cx, cy. */
+typedef struct _RD_DRAW_CMD
+{
+	uint8 type;
+	uint8 opcode; /* rop3, rop2 for lines */
+	sint16 x, y, cx, cy;
+	union
+	{
+		uint32 color; /* RD_DRAW_RECT */
+		struct
+		{
+			RD_BRUSH brush;
+			uint32 bgcolor;
+			uint32 fgcolor;
+		} pat; /* RD_DRAW_PATBLT */
+		struct
+		{
+			RD_HBITMAP src; /* NULL for RD_DRAW_SCREENBLT */
+			sint16 srcx, srcy;
+		} blt; /* RD_DRAW_SCREENBLT and RD_DRAW_MEMBLT */
+		RD_PEN pen; /* RD_DRAW_LINE */
+	} u;
+}
+RD_DRAW_CMD;
+
+/* destination of a bitmap update decoded straight into a surface, see
+   ui_begin_paint_bitmap. colors maps a source pixel to a destination pixel:
+   indexed by the pixel for 8, 15 and 16 bpp, and for 24 bpp three tables of
+   256 entries, one per byte, that are or'ed together. It is NULL when the
+   destination has the same format as the source. */
+typedef struct _RD_BITMAP_DEST
+{
+	uint8 * data; /* top left pixel of the destination rectangle */
+	int stride; /* bytes from one row to the next, negative when bottom-up */
+	int width; /* pixels stored per row */
+	int height; /* rows stored */
+	int bpp; /* destination bits per pixel, 8, 16 or 32 */
+	uint32 * colors;
+}
+RD_BITMAP_DEST;
+
 typedef struct _RD_EVENT RD_EVENT;
 
 typedef void (*RD_EVENT_CALLBACK) (RD_EVENT * event);
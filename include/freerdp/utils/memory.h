@@ -26,5 +26,6 @@ void* xmalloc(size_t size);
 void* xrealloc(void * oldmem, size_t size);
 void xfree(void * mem);
 char* xstrdup(const char * s);
+unsigned long xmalloc_count(void);
 
 #endif /* __MEMORY_UTILS_H */
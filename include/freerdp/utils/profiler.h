@@ -57,7 +57,7 @@ void profiler_print_footer();
 #define PROFILER_PRINT(prof)		profiler_print(prof)
 #define PROFILER_PRINT_FOOTER		profiler_print_footer()
 #else
-#define IF_PROFILER
+#define IF_PROFILER(then)
 #define PROFILER_DEFINE(prof)		void *prof
 #define PROFILER_CREATE
 #define PROFILER_FREE
@@ -23,3 +23,4 @@ int wait_obj_is_set(struct wait_obj * obj);
 int wait_obj_set(struct wait_obj * obj);
 int wait_obj_clear(struct wait_obj * obj);
 int wait_obj_select(struct wait_obj ** listobj, int numobj, int * listr, int numr, int timeout);
+int wait_obj_get_fds(struct wait_obj * obj, void ** fds, int * count);
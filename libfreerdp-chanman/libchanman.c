@@ -30,6 +30,12 @@
    Since the plugin's VirtualChannelEntry function is called
    from the main thread, MyVirtualChannelInit has to be called
    from the main thread.
+
+   Writes from any thread are queued and sent from the main thread.
+   The queue holds up to CHANMAN_WRITE_QUEUE_SIZE writes of all the
+   channels together, in the order they were made. A writer only waits
+   when it is full. Each wakeup of the main thread sends all the writes
+   queued so far.
 */
 
 #include <stdio.h>
@@ -115,6 +121,9 @@ static int g_open_handle_sequence;
 static MUTEX g_mutex_init;
 static MUTEX g_mutex_list;
 
+/* writes queued for the main thread before writers have to wait */
+#define CHANMAN_WRITE_QUEUE_SIZE 64
+
 /* The channel manager stuff */
 struct lib_data
 {
@@ -133,6 +142,14 @@ struct chan_data
 	PCHANNEL_OPEN_EVENT_FN open_event_proc;
 };
 
+struct sync_data
+{
+	void * data;
+	uint32 data_length;
+	void * user_data;
+	int index;
+};
+
 struct rdp_chan_man
 {
 	/* Only the main thread alters these arrays, before any
@@ -158,7 +175,7 @@ struct rdp_chan_man
 	/* used for locating the chan_man for a given instance */
 	rdpInst * inst;
 
-	/* used for sync write */
+	/* used for sync write, sem counts the free entries of the queue */
 	SEMAPHORE sem;
 #ifdef _WIN32
 	HANDLE chan_event;
@@ -166,10 +183,10 @@ struct rdp_chan_man
 	int pipe_fd[2];
 #endif
 
-	void * sync_data;
-	uint32 sync_data_length;
-	void * sync_user_data;
-	int sync_index;
+	MUTEX sync_mutex; /* lock for the queue below */
+	struct sync_data sync_queue[CHANMAN_WRITE_QUEUE_SIZE];
+	int sync_head; /* next write to send */
+	int sync_count; /* writes queued */
 
 	/* used for sync event */
 	SEMAPHORE sem_event;
@@ -527,6 +544,7 @@ MyVirtualChannelWrite(uint32 openHandle, void * pData, uint32 dataLength,
 {
 	rdpChanMan * chan_man;
 	struct chan_data * lchan;
+	struct sync_data * sync;
 	int index;
 
 	chan_man = freerdp_chanman_find_by_open_handle(openHandle, &index);
@@ -556,17 +574,23 @@ MyVirtualChannelWrite(uint32 openHandle, void * pData, uint32 dataLength,
 		DEBUG_CHANMAN("MyVirtualChannelWrite: error not open");
 		return CHANNEL_RC_NOT_OPEN;
 	}
-	SEMAPHORE_WAIT(chan_man->sem); /* lock chan_man->sync* vars */
+	SEMAPHORE_WAIT(chan_man->sem); /* wait for a free entry in the queue */
+	MUTEX_LOCK(chan_man->sync_mutex);
 	if (!chan_man->is_connected)
 	{
+		MUTEX_UNLOCK(chan_man->sync_mutex);
 		SEMAPHORE_POST(chan_man->sem);
 		DEBUG_CHANMAN("MyVirtualChannelWrite: error not connected");
 		return CHANNEL_RC_NOT_CONNECTED;
 	}
-	chan_man->sync_data = pData;
-	chan_man->sync_data_length = dataLength;
-	chan_man->sync_user_data = pUserData;
-	chan_man->sync_index = index;
+	sync = chan_man->sync_queue +
+		(chan_man->sync_head + chan_man->sync_count) % CHANMAN_WRITE_QUEUE_SIZE;
+	sync->data = pData;
+	sync->data_length = dataLength;
+	sync->user_data = pUserData;
+	sync->index = index;
+	chan_man->sync_count++;
+	MUTEX_UNLOCK(chan_man->sync_mutex);
 	/* set the event */
 	freerdp_chanman_set_ev(chan_man);
 	return CHANNEL_RC_OK;
@@ -653,7 +677,8 @@ freerdp_chanman_new(void)
 	chan_man = (rdpChanMan *) malloc(sizeof(rdpChanMan));
 	memset(chan_man, 0, sizeof(rdpChanMan));
 
-	SEMAPHORE_INIT(chan_man->sem,1); /* start at 1 */
+	SEMAPHORE_INIT(chan_man->sem, CHANMAN_WRITE_QUEUE_SIZE); /* queue is empty */
+	MUTEX_INIT(chan_man->sync_mutex);
 	SEMAPHORE_INIT(chan_man->sem_event, 1); /* start at 1 */
 #ifdef _WIN32
 	chan_man->chan_event = CreateEvent(NULL, TRUE, FALSE, NULL);
@@ -686,6 +711,7 @@ freerdp_chanman_free(rdpChanMan * chan_man)
 
 	SEMAPHORE_DESTROY(chan_man->sem);
 	SEMAPHORE_DESTROY(chan_man->sem_event);
+	MUTEX_DESTROY(chan_man->sync_mutex);
 #ifdef _WIN32
 	if (chan_man->chan_event)
 	{
@@ -927,41 +953,42 @@ freerdp_chanman_data(rdpInst * inst, int chan_id, char * data, int data_size,
 	return 0;
 }
 
-/* called only from main thread */
+/* called only from main thread, sends every queued write */
 static void
 freerdp_chanman_process_sync(rdpChanMan * chan_man, rdpInst * inst)
 {
-	void * ldata;
-	uint32 ldata_len;
-	void * luser_data;
+	struct sync_data lsync;
 	int lindex;
 	struct chan_data * lchan_data;
 	struct rdp_chan * lrdp_chan;
 
-	if (chan_man->sync_data == NULL)
-		return;
-
-	ldata = chan_man->sync_data;
-	ldata_len = chan_man->sync_data_length;
-	luser_data = chan_man->sync_user_data;
-	lindex = chan_man->sync_index;
-	chan_man->sync_data = NULL;
-	chan_man->sync_data_length = 0;
-	chan_man->sync_user_data = NULL;
-	chan_man->sync_index = 0;
-	SEMAPHORE_POST(chan_man->sem); /* release chan_man->sync* vars */
-	lchan_data = chan_man->chans + lindex;
-	lrdp_chan = freerdp_chanman_find_rdp_chan_by_name(chan_man, inst->settings,
-		lchan_data->name, &lindex);
-	if (lrdp_chan != 0)
-	{
-		inst->rdp_channel_data(inst, lrdp_chan->chan_id, ldata, ldata_len);
-	}
-	if (lchan_data->open_event_proc != 0)
+	while (1)
 	{
-		lchan_data->open_event_proc(lchan_data->open_handle,
-			CHANNEL_EVENT_WRITE_COMPLETE,
-			luser_data, sizeof(void *), sizeof(void *), 0);
+		MUTEX_LOCK(chan_man->sync_mutex);
+		if (chan_man->sync_count == 0)
+		{
+			MUTEX_UNLOCK(chan_man->sync_mutex);
+			break;
+		}
+		lsync = chan_man->sync_queue[chan_man->sync_head];
+		chan_man->sync_head = (chan_man->sync_head + 1) % CHANMAN_WRITE_QUEUE_SIZE;
+		chan_man->sync_count--;
+		MUTEX_UNLOCK(chan_man->sync_mutex);
+		SEMAPHORE_POST(chan_man->sem); /* release the queue entry */
+
+		lchan_data = chan_man->chans + lsync.index;
+		lrdp_chan = freerdp_chanman_find_rdp_chan_by_name(chan_man, inst->settings,
+			lchan_data->name, &lindex);
+		if (lrdp_chan != 0)
+		{
+			inst->rdp_channel_data(inst, lrdp_chan->chan_id, lsync.data, lsync.data_length);
+		}
+		if (lchan_data->open_event_proc != 0)
+		{
+			lchan_data->open_event_proc(lchan_data->open_handle,
+				CHANNEL_EVENT_WRITE_COMPLETE,
+				lsync.user_data, sizeof(void *), sizeof(void *), 0);
+		}
 	}
 }
 
@@ -1029,7 +1056,13 @@ freerdp_chanman_close(rdpChanMan * chan_man, rdpInst * inst)
 	struct lib_data * llib;
 
 	DEBUG_CHANMAN("freerdp_chanman_close:");
+	MUTEX_LOCK(chan_man->sync_mutex);
 	chan_man->is_connected = 0;
+	MUTEX_UNLOCK(chan_man->sync_mutex);
+	/* wake the threads waiting for a queue entry or for the event, each one
+	   sees it is not connected any more and passes the wake up on */
+	SEMAPHORE_POST(chan_man->sem);
+	SEMAPHORE_POST(chan_man->sem_event);
 	freerdp_chanman_check_fds(chan_man, inst);
 	/* tell all libraries we are shutting down */
 	for (index = 0; index < chan_man->num_libs; index++)
@@ -25,6 +25,12 @@
 /* *INDENT-OFF* */
 
 #include "frdp.h"
+#include "bitmap.h"
+#include <freerdp/utils/memory.h>
+
+#ifdef WITH_SSE
+#include <emmintrin.h>
+#endif
 
 #define CVAL(p)   (*(p++))
 #ifdef NEED_ALIGN
@@ -62,9 +68,72 @@
 	} \
 }
 
+/* store the first dest->width pixels of a decoded scanline in row "row" of
+   the destination, converting through dest->colors */
+void
+bitmap_store_row(RD_BITMAP_DEST * dest, uint8 * src, int row, int Bpp)
+{
+	int x;
+	uint8 * out;
+	uint16 * out16;
+	uint32 * out32;
+	uint16 pixel;
+	uint32 * colors;
+
+	if ((row < 0) || (row >= dest->height))
+		return;
+	out = dest->data + row * dest->stride;
+	colors = dest->colors;
+	if (colors == NULL)
+	{
+		memcpy(out, src, dest->width * Bpp);
+		return;
+	}
+	out16 = (uint16 *) out;
+	out32 = (uint32 *) out;
+	switch ((dest->bpp << 2) | Bpp)
+	{
+		case (8 << 2) | 1:
+			for (x = 0; x < dest->width; x++)
+				out[x] = colors[src[x]];
+			break;
+		case (16 << 2) | 1:
+			for (x = 0; x < dest->width; x++)
+				out16[x] = colors[src[x]];
+			break;
+		case (32 << 2) | 1:
+			for (x = 0; x < dest->width; x++)
+				out32[x] = colors[src[x]];
+			break;
+		case (16 << 2) | 2:
+			for (x = 0; x < dest->width; x++)
+			{
+				memcpy(&pixel, src + x * 2, 2);
+				out16[x] = colors[pixel];
+			}
+			break;
+		case (32 << 2) | 2:
+			for (x = 0; x < dest->width; x++)
+			{
+				memcpy(&pixel, src + x * 2, 2);
+				out32[x] = colors[pixel];
+			}
+			break;
+		case (32 << 2) | 3:
+			/* one table per byte of the source pixel */
+			for (x = 0; x < dest->width; x++)
+			{
+				out32[x] = colors[src[0]] | colors[256 + src[1]] | colors[512 + src[2]];
+				src += 3;
+			}
+			break;
+	}
+}
+
 /* 1 byte bitmap decompress */
 static RD_BOOL
-bitmap_decompress1(void * inst, uint8 * output, int width, int height, uint8 * input, int size)
+bitmap_decompress1(void * inst, uint8 * output, int width, int height, uint8 * input, int size,
+	RD_BITMAP_DEST * dest)
 {
 	uint8 *end = input + size;
 	uint8 *prevline = NULL, *line = NULL;
@@ -161,12 +230,14 @@ bitmap_decompress1(void * inst, uint8 * output, int width, int height, uint8 * i
 		{
 			if (x >= width)
 			{
+				if (dest && line)
+					bitmap_store_row(dest, (uint8 *) line, height, 1);
 				if (height <= 0)
 					return False;
 				x = 0;
 				height--;
 				prevline = line;
-				line = output + height * width;
+				line = output + (dest ? (height & 1) : height) * width;
 			}
 			switch (opcode)
 			{
@@ -257,12 +328,15 @@ bitmap_decompress1(void * inst, uint8 * output, int width, int height, uint8 * i
 			}
 		}
 	}
+	if (dest && line)
+		bitmap_store_row(dest, (uint8 *) line, height, 1);
 	return True;
 }
 
 /* 2 byte bitmap decompress */
 static RD_BOOL
-bitmap_decompress2(void * inst, uint8 * output, int width, int height, uint8 * input, int size)
+bitmap_decompress2(void * inst, uint8 * output, int width, int height, uint8 * input, int size,
+	RD_BITMAP_DEST * dest)
 {
 	uint8 *end = input + size;
 	uint16 *prevline = NULL, *line = NULL;
@@ -359,12 +433,14 @@ bitmap_decompress2(void * inst, uint8 * output, int width, int height, uint8 * i
 		{
 			if (x >= width)
 			{
+				if (dest && line)
+					bitmap_store_row(dest, (uint8 *) line, height, 2);
 				if (height <= 0)
 					return False;
 				x = 0;
 				height--;
 				prevline = line;
-				line = ((uint16 *) output) + height * width;
+				line = ((uint16 *) output) + (dest ? (height & 1) : height) * width;
 			}
 			switch (opcode)
 			{
@@ -456,12 +532,15 @@ bitmap_decompress2(void * inst, uint8 * output, int width, int height, uint8 * i
 			}
 		}
 	}
+	if (dest && line)
+		bitmap_store_row(dest, (uint8 *) line, height, 2);
 	return True;
 }
 
 /* 3 byte bitmap decompress */
 static RD_BOOL
-bitmap_decompress3(void * inst, uint8 * output, int width, int height, uint8 * input, int size)
+bitmap_decompress3(void * inst, uint8 * output, int width, int height, uint8 * input, int size,
+	RD_BITMAP_DEST * dest)
 {
 	uint8 *end = input + size;
 	uint8 *prevline = NULL, *line = NULL;
@@ -565,12 +644,14 @@ bitmap_decompress3(void * inst, uint8 * output, int width, int height, uint8 * i
 		{
 			if (x >= width)
 			{
+				if (dest && line)
+					bitmap_store_row(dest, (uint8 *) line, height, 3);
 				if (height <= 0)
 					return False;
 				x = 0;
 				height--;
 				prevline = line;
-				line = output + height * (width * 3);
+				line = output + (dest ? (height & 1) : height) * (width * 3);
 			}
 			switch (opcode)
 			{
@@ -742,141 +823,309 @@ bitmap_decompress3(void * inst, uint8 * output, int width, int height, uint8 * i
 			}
 		}
 	}
+	if (dest && line)
+		bitmap_store_row(dest, (uint8 *) line, height, 3);
 	return True;
 }
 
-/* decompress a color plane */
+/* planar codec format header bits */
+#define PLANAR_HEADER_CLL_MASK	0x07
+#define PLANAR_HEADER_CS	0x08
+#define PLANAR_HEADER_RLE	0x10
+#define PLANAR_HEADER_NA	0x20
+
+/* bitmaps up to this many pixels decode their planes on the stack */
+#define PLANAR_STACK_PIXELS	(64 * 64)
+
+/* add the previous scanline to a line of deltas, bytes wrap like the
+   original per pixel code did */
+static void
+planar_add_line(uint8 * line, uint8 * last_line, int width)
+{
+	int x;
+
+	x = 0;
+#ifdef WITH_SSE
+	for (; x + 16 <= width; x += 16)
+	{
+		__m128i a = _mm_loadu_si128((__m128i *) (line + x));
+		__m128i b = _mm_loadu_si128((__m128i *) (last_line + x));
+		_mm_storeu_si128((__m128i *) (line + x), _mm_add_epi8(a, b));
+	}
+#endif
+	for (; x < width; x++)
+	{
+		line[x] += last_line[x];
+	}
+}
+
+/* decode one RLE colour plane into width * height bytes, scanlines are kept
+   in wire order (bottom-up), returns the bytes consumed or -1 */
 static int
-process_plane(uint8 * in, int width, int height, uint8 * out, int size)
+planar_decode_plane(uint8 * in, int size, int width, int height, uint8 * plane)
 {
-	int indexw;
-	int indexh;
+	int i;
+	int x;
+	int y;
 	int code;
 	int collen;
 	int replen;
-	int color;
-	int x;
 	int revcode;
+	uint8 color;
+	uint8 * line;
 	uint8 * last_line;
-	uint8 * this_line;
 	uint8 * org_in;
-	uint8 * org_out;
+	uint8 * end;
 
 	org_in = in;
-	org_out = out;
-	last_line = 0;
-	indexh = 0;
-	while (indexh < height)
+	end = in + size;
+	last_line = NULL;
+	for (y = 0; y < height; y++)
 	{
-		out = (org_out + width * height * 4) - ((indexh + 1) * width * 4);
+		line = plane + y * width;
 		color = 0;
-		this_line = out;
-		indexw = 0;
-		if (last_line == 0)
+		x = 0;
+		/* the first scanline holds absolute values, the others hold deltas
+		   against the line before; both are expanded the same way and the
+		   previous line is added afterwards in one pass */
+		while (x < width)
 		{
-			while (indexw < width)
+			if (in >= end)
 			{
-				code = CVAL(in);
-				replen = code & 0xf;
-				collen = (code >> 4) & 0xf;
-				revcode = (replen << 4) | collen;
-				if ((revcode <= 47) && (revcode >= 16))
-				{
-					replen = revcode;
-					collen = 0;
-				}
-				while (collen > 0)
-				{
-					color = CVAL(in);
-					*out = color;
-					out += 4;
-					indexw++;
-					collen--;
-				}
-				while (replen > 0)
-				{
-					*out = color;
-					out += 4;
-					indexw++;
-					replen--;
-				}
+				return -1;
 			}
-		}
-		else
-		{
-			while (indexw < width)
+			code = CVAL(in);
+			replen = code & 0xf;
+			collen = (code >> 4) & 0xf;
+			revcode = (replen << 4) | collen;
+			if ((revcode <= 47) && (revcode >= 16))
+			{
+				replen = revcode;
+				collen = 0;
+			}
+			if ((x + collen + replen > width) || (collen > end - in))
+			{
+				return -1;
+			}
+			if (collen > 0)
 			{
-				code = CVAL(in);
-				replen = code & 0xf;
-				collen = (code >> 4) & 0xf;
-				revcode = (replen << 4) | collen;
-				if ((revcode <= 47) && (revcode >= 16))
+				if (last_line == NULL)
 				{
-					replen = revcode;
-					collen = 0;
+					memcpy(line + x, in, collen);
 				}
-				while (collen > 0)
+				else
 				{
-					x = CVAL(in);
-					if (x & 1)
+					/* deltas are sign-magnitude with the sign in bit 0 */
+					for (i = 0; i < collen; i++)
 					{
-						x = x >> 1;
-						x = x + 1;
-						color = -x;
+						line[x + i] = (in[i] >> 1) ^ -(in[i] & 1);
 					}
-					else
-					{
-						x = x >> 1;
-						color = x;
-					}
-					x = last_line[indexw * 4] + color;
-					*out = x;
-					out += 4;
-					indexw++;
-					collen--;
-				}
-				while (replen > 0)
-				{
-					x = last_line[indexw * 4] + color;
-					*out = x;
-					out += 4;
-					indexw++;
-					replen--;
 				}
+				in += collen;
+				x += collen;
+				color = line[x - 1];
+			}
+			if (replen > 0)
+			{
+				memset(line + x, color, replen);
+				x += replen;
 			}
 		}
-		indexh++;
-		last_line = this_line;
+		if (last_line != NULL)
+		{
+			planar_add_line(line, last_line, width);
+		}
+		last_line = line;
 	}
 	return (int) (in - org_in);
 }
 
-/* 4 byte bitmap decompress */
-static RD_BOOL
-bitmap_decompress4(uint8 * output, int width, int height, uint8 * input, int size)
+/* merge the four planes into 32 bpp pixels, wire scanline y lands in
+   row height - 1 - y of dst, alpha is opaque when a is NULL */
+static void
+planar_interleave(uint8 * dst, int dst_stride, int width, int height,
+	uint8 * a, uint8 * r, uint8 * g, uint8 * b)
 {
+	int x;
+	int y;
+	uint8 * out;
+	uint8 * pa;
+	uint8 * pr;
+	uint8 * pg;
+	uint8 * pb;
+#ifdef WITH_SSE
+	__m128i va;
+	__m128i vr;
+	__m128i vg;
+	__m128i vb;
+	__m128i bg;
+	__m128i ra;
+#endif
+
+	for (y = 0; y < height; y++)
+	{
+		out = dst + (height - 1 - y) * dst_stride;
+		pa = (a != NULL) ? a + y * width : NULL;
+		pr = r + y * width;
+		pg = g + y * width;
+		pb = b + y * width;
+		x = 0;
+#ifdef WITH_SSE
+		va = _mm_set1_epi8((char) 0xff);
+		for (; x + 16 <= width; x += 16)
+		{
+			if (pa != NULL)
+			{
+				va = _mm_loadu_si128((__m128i *) (pa + x));
+			}
+			vr = _mm_loadu_si128((__m128i *) (pr + x));
+			vg = _mm_loadu_si128((__m128i *) (pg + x));
+			vb = _mm_loadu_si128((__m128i *) (pb + x));
+			bg = _mm_unpacklo_epi8(vb, vg);
+			ra = _mm_unpacklo_epi8(vr, va);
+			_mm_storeu_si128((__m128i *) (out + x * 4), _mm_unpacklo_epi16(bg, ra));
+			_mm_storeu_si128((__m128i *) (out + x * 4 + 16), _mm_unpackhi_epi16(bg, ra));
+			bg = _mm_unpackhi_epi8(vb, vg);
+			ra = _mm_unpackhi_epi8(vr, va);
+			_mm_storeu_si128((__m128i *) (out + x * 4 + 32), _mm_unpacklo_epi16(bg, ra));
+			_mm_storeu_si128((__m128i *) (out + x * 4 + 48), _mm_unpackhi_epi16(bg, ra));
+		}
+#endif
+		for (; x < width; x++)
+		{
+			out[x * 4 + 0] = pb[x];
+			out[x * 4 + 1] = pg[x];
+			out[x * 4 + 2] = pr[x];
+			out[x * 4 + 3] = (pa != NULL) ? pa[x] : 0xff;
+		}
+	}
+}
+
+/* planar codec decompress into a 32 bpp surface with the given stride */
+RD_BOOL
+bitmap_decompress_planar(uint8 * dst, int dst_stride, int width, int height, uint8 * input, int size)
+{
+	int i;
 	int code;
+	int count;
+	int nplanes;
+	int plane_size;
 	int bytes_pro;
 	int total_pro;
+	uint8 stack_planes[4 * PLANAR_STACK_PIXELS];
+	uint8 * buffer;
+	uint8 * planes[4];
+	RD_BOOL rv;
 
+	if ((size < 1) || (width <= 0) || (height <= 0))
+	{
+		return False;
+	}
 	code = CVAL(input);
-	if (code != 0x10)
+	if (code & (PLANAR_HEADER_CLL_MASK | PLANAR_HEADER_CS))
 	{
+		/* colour loss and chroma subsampling are never negotiated */
 		return False;
 	}
+	nplanes = (code & PLANAR_HEADER_NA) ? 3 : 4;
+	plane_size = width * height;
 	total_pro = 1;
-	bytes_pro = process_plane(input, width, height, output + 3, size - total_pro);
-	total_pro += bytes_pro;
-	input += bytes_pro;
-	bytes_pro = process_plane(input, width, height, output + 2, size - total_pro);
-	total_pro += bytes_pro;
-	input += bytes_pro;
-	bytes_pro = process_plane(input, width, height, output + 1, size - total_pro);
-	total_pro += bytes_pro;
-	input += bytes_pro;
-	bytes_pro = process_plane(input, width, height, output + 0, size - total_pro);
-	total_pro += bytes_pro;
-	return size == total_pro;
+	planes[0] = NULL;
+	buffer = NULL;
+	rv = False;
+
+	if (!(code & PLANAR_HEADER_RLE))
+	{
+		/* raw planes are used where they lie, followed by one pad byte */
+		if (size - total_pro < nplanes * plane_size)
+		{
+			return False;
+		}
+		for (i = 4 - nplanes; i < 4; i++)
+		{
+			planes[i] = input;
+			input += plane_size;
+		}
+		total_pro += nplanes * plane_size;
+		if (size - total_pro > 1)
+		{
+			return False;
+		}
+		planar_interleave(dst, dst_stride, width, height, planes[0], planes[1], planes[2], planes[3]);
+		return True;
+	}
+
+	if (plane_size <= PLANAR_STACK_PIXELS)
+	{
+		buffer = stack_planes;
+	}
+	else
+	{
+		buffer = (uint8 *) xmalloc(nplanes * plane_size);
+		if (buffer == NULL)
+		{
+			return False;
+		}
+	}
+	count = 0;
+	for (i = 4 - nplanes; i < 4; i++)
+	{
+		planes[i] = buffer + count * plane_size;
+		count++;
+		bytes_pro = planar_decode_plane(input, size - total_pro, width, height, planes[i]);
+		if (bytes_pro < 0)
+		{
+			goto out;
+		}
+		total_pro += bytes_pro;
+		input += bytes_pro;
+	}
+	if (size == total_pro)
+	{
+		planar_interleave(dst, dst_stride, width, height, planes[0], planes[1], planes[2], planes[3]);
+		rv = True;
+	}
+out:
+	if (buffer != stack_planes)
+	{
+		xfree(buffer);
+	}
+	return rv;
+}
+
+/* 4 byte bitmap decompress */
+static RD_BOOL
+bitmap_decompress4(uint8 * output, int width, int height, uint8 * input, int size)
+{
+	return bitmap_decompress_planar(output, width * 4, width, height, input, size);
+}
+
+/* decompress an interleaved RLE bitmap straight into a surface, scanlines
+   are expanded in their own format into lines, scratch space for two of
+   them, since fills and mixes refer to the line before, and each one is
+   stored as soon as it is complete */
+RD_BOOL
+bitmap_decompress_dest(void * inst, RD_BITMAP_DEST * dest, uint8 * lines, int width, int height,
+	uint8 * input, int size, int Bpp)
+{
+	RD_BOOL rv = False;
+
+	switch (Bpp)
+	{
+		case 1:
+			rv = bitmap_decompress1(inst, lines, width, height, input, size, dest);
+			break;
+		case 2:
+			rv = bitmap_decompress2(inst, lines, width, height, input, size, dest);
+			break;
+		case 3:
+			rv = bitmap_decompress3(inst, lines, width, height, input, size, dest);
+			break;
+		default:
+			ui_unimpl(inst, "Bpp %d\n", Bpp);
+			break;
+	}
+	return rv;
 }
 
 /* main decompress function */
@@ -888,13 +1137,13 @@ bitmap_decompress(void * inst, uint8 * output, int width, int height, uint8 * in
 	switch (Bpp)
 	{
 		case 1:
-			rv = bitmap_decompress1(inst, output, width, height, input, size);
+			rv = bitmap_decompress1(inst, output, width, height, input, size, NULL);
 			break;
 		case 2:
-			rv = bitmap_decompress2(inst, output, width, height, input, size);
+			rv = bitmap_decompress2(inst, output, width, height, input, size, NULL);
 			break;
 		case 3:
-			rv = bitmap_decompress3(inst, output, width, height, input, size);
+			rv = bitmap_decompress3(inst, output, width, height, input, size, NULL);
 			break;
 		case 4:
 			rv = bitmap_decompress4(output, width, height, input, size);
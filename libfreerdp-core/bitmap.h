@@ -24,5 +24,12 @@
 
 RD_BOOL
 bitmap_decompress(void * inst, uint8 * output, int width, int height, uint8 * input, int size, int Bpp);
+RD_BOOL
+bitmap_decompress_dest(void * inst, RD_BITMAP_DEST * dest, uint8 * lines, int width, int height,
+	uint8 * input, int size, int Bpp);
+void
+bitmap_store_row(RD_BITMAP_DEST * dest, uint8 * src, int row, int Bpp);
+RD_BOOL
+bitmap_decompress_planar(uint8 * dst, int dst_stride, int width, int height, uint8 * input, int size);
 
 #endif
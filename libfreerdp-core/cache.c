@@ -22,171 +22,268 @@
 #include "rdp.h"
 #include "orders.h"
 #include "pstcache.h"
+#include <freerdp/rdpset.h>
 
 #include "cache.h"
 
 #define NUM_ELEMENTS(array) (sizeof(array) / sizeof(array[0]))
-#define IS_PERSISTENT(id) (cache->rdp->pcache->pstcache_fd[id] > 0)
-#define TO_TOP -1
-#define NOT_SET -1
-#define IS_SET(idx) (idx >= 0)
+#define IS_PERSISTENT(id) pstcache_is_persistent(cache->rdp->pcache, id)
+
+#define PROBATION	0
+#define PROTECTED	1
+
+/* share of the memory budget that bitmaps hit at least twice may use */
+#define PROTECTED_SHARE(size) ((size) / 4 * 3)
+
+/* the cell counts of the capability sets, used unless set in the settings */
+static const int bmpcache_rev1_cells[3] = { 0x258, 0x12c, 0x106 };
+static const int bmpcache_rev2_cells[3] = { BMPCACHE2_C0_CELLS, BMPCACHE2_C1_CELLS, BMPCACHE2_C2_CELLS };
+
+static void
+bmpcache_list_init(struct bmpcache_entry * head)
+{
+	head->prev = head;
+	head->next = head;
+}
+
+static void
+bmpcache_list_unlink(struct bmpcache * bc, struct bmpcache_entry * entry)
+{
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+	entry->prev = entry->next = NULL;
+	bc->list_size[entry->segment] -= entry->size;
+}
+
+/* append at the most recently used end */
+static void
+bmpcache_list_append(struct bmpcache * bc, int segment, struct bmpcache_entry * entry)
+{
+	struct bmpcache_entry * head = &bc->lists[segment];
+
+	entry->segment = segment;
+	entry->prev = head->prev;
+	entry->next = head;
+	head->prev->next = entry;
+	head->prev = entry;
+	bc->list_size[segment] += entry->size;
+}
+
+static struct bmpcache_entry *
+bmpcache_list_first(struct bmpcache * bc, int segment)
+{
+	struct bmpcache_entry * head = &bc->lists[segment];
+
+	return (head->next != head ? head->next : NULL);
+}
+
+/* least recently used entry of a segment other than keep */
+static struct bmpcache_entry *
+bmpcache_list_oldest(struct bmpcache * bc, int segment, struct bmpcache_entry * keep)
+{
+	struct bmpcache_entry * head = &bc->lists[segment];
+	struct bmpcache_entry * entry;
+
+	entry = bmpcache_list_first(bc, segment);
+	if (entry != NULL && entry == keep)
+		entry = (keep->next != head ? keep->next : NULL);
+	return entry;
+}
+
+/* plain LRU, everything lives in the probation list */
+static void
+bmpcache_lru_insert(struct bmpcache * bc, struct bmpcache_entry * entry)
+{
+	bmpcache_list_append(bc, PROBATION, entry);
+}
+
+static void
+bmpcache_lru_hit(struct bmpcache * bc, struct bmpcache_entry * entry)
+{
+	bmpcache_list_unlink(bc, entry);
+	bmpcache_list_append(bc, PROBATION, entry);
+}
+
+static struct bmpcache_entry *
+bmpcache_lru_victim(struct bmpcache * bc, struct bmpcache_entry * keep)
+{
+	return bmpcache_list_oldest(bc, PROBATION, keep);
+}
 
 /*
- * TODO: Test for optimal value of BUMP_COUNT. TO_TOP gives lowest cpu utilisation but using
- * a positive value will hopefully result in less frequently used bitmaps having a greater chance
- * of being evicted from the cache, and therby reducing the need to load bitmaps from disk.
- * (Jeroen)
+ * Segmented LRU: new bitmaps start on probation and move to the protected
+ * list on their first hit, so bitmaps used only once are evicted before the
+ * ones that keep coming back. The protected list is limited to a share of
+ * the budget, its least recently used entries fall back to probation.
  */
-#define BUMP_COUNT 40
-
-/* Setup the bitmap cache lru/mru linked list */
-void
-cache_rebuild_bmpcache_linked_list(rdpCache * cache, uint8 id, sint16 * idx, int count)
+static void
+bmpcache_slru_hit(struct bmpcache * bc, struct bmpcache_entry * entry)
 {
-	int n = count, c = 0;
-	sint16 n_idx;
+	struct bmpcache_entry * demoted;
+
+	bmpcache_list_unlink(bc, entry);
+	bmpcache_list_append(bc, PROTECTED, entry);
 
-	/* find top, skip evicted bitmaps */
-	while (--n >= 0 && cache->bmpcache[id][idx[n]].bitmap == NULL);
-	if (n < 0)
+	while (bc->max_size > 0 && bc->list_size[PROTECTED] > PROTECTED_SHARE(bc->max_size))
 	{
-		cache->bmpcache_mru[id] = cache->bmpcache_lru[id] = NOT_SET;
-		return;
+		demoted = bmpcache_list_first(bc, PROTECTED);
+		if (demoted == entry)
+			break;
+
+		bmpcache_list_unlink(bc, demoted);
+		bmpcache_list_append(bc, PROBATION, demoted);
 	}
+}
 
-	cache->bmpcache_mru[id] = idx[n];
-	cache->bmpcache[id][idx[n]].next = NOT_SET;
-	n_idx = idx[n];
-	c++;
+static struct bmpcache_entry *
+bmpcache_slru_victim(struct bmpcache * bc, struct bmpcache_entry * keep)
+{
+	struct bmpcache_entry * entry;
 
-	/* link list */
-	while (n >= 0)
-	{
-		/* skip evicted bitmaps */
-		while (--n >= 0 && cache->bmpcache[id][idx[n]].bitmap == NULL);
+	entry = bmpcache_list_oldest(bc, PROBATION, keep);
+	return (entry != NULL ? entry : bmpcache_list_oldest(bc, PROTECTED, keep));
+}
 
-		if (n < 0)
-			break;
+static const struct bmpcache_policy bmpcache_policy_lru =
+{
+	"lru", bmpcache_lru_insert, bmpcache_lru_hit, bmpcache_lru_victim
+};
 
-		cache->bmpcache[id][n_idx].previous = idx[n];
-		cache->bmpcache[id][idx[n]].next = n_idx;
-		n_idx = idx[n];
-		c++;
-	}
+static const struct bmpcache_policy bmpcache_policy_slru =
+{
+	"slru", bmpcache_lru_insert, bmpcache_slru_hit, bmpcache_slru_victim
+};
 
-	cache->bmpcache[id][n_idx].previous = NOT_SET;
-	cache->bmpcache_lru[id] = n_idx;
+static struct bmpcache *
+cache_get_bmpcache(rdpCache * cache, uint8 id, uint16 idx)
+{
+	if (id < NUM_ELEMENTS(cache->bmpcache) && idx < cache->bmpcache[id].num_cells)
+		return &cache->bmpcache[id];
 
-	if (c != cache->bmpcache_count[id])
-	{
-		ui_error(cache->rdp->inst, "Oops. %d in bitmap cache linked list, %d in ui "
-			 "cache...\n", c, cache->bmpcache_count[id]);
-	}
+	return NULL;
+}
+
+/* Drop a bitmap from its cell, the caller destroys the bitmap */
+static void
+cache_remove_bitmap(struct bmpcache * bc, struct bmpcache_entry * entry)
+{
+	bmpcache_list_unlink(bc, entry);
+	bc->count--;
+	bc->size -= entry->size;
+	entry->bitmap = NULL;
+	entry->size = 0;
+}
+
+/* Number of cells of a bitmap cache as advertised in the capabilities */
+int
+cache_get_bitmap_cells(rdpCache * cache, uint8 id)
+{
+	if (id >= NUM_ELEMENTS(cache->bmpcache))
+		return 0;
+
+	if (IS_PERSISTENT(id))
+		return BMPCACHE2_NUM_PSTCELLS;
+
+	if (cache->rdp->settings->bitmap_cache_cells[id] > 0)
+		return MIN(cache->rdp->settings->bitmap_cache_cells[id], BMPCACHE2_MAX_CELLS);
+
+	if (cache->rdp->settings->rdp_version >= 5)
+		return bmpcache_rev2_cells[id];
+
+	return bmpcache_rev1_cells[id];
 }
 
-/* Move a bitmap to a new position in the linked list. */
+/* Setup the bitmap cache lru/mru linked list from indices sorted by age, oldest first */
 void
-cache_bump_bitmap(rdpCache * cache, uint8 id, uint16 idx, int bump)
+cache_rebuild_bmpcache_linked_list(rdpCache * cache, uint8 id, sint16 * idx, int count)
 {
-	int p_idx, n_idx, n;
+	int n;
+	struct bmpcache * bc;
+	struct bmpcache_entry * entry;
 
-	if (!IS_PERSISTENT(id))
+	if (id >= NUM_ELEMENTS(cache->bmpcache))
 		return;
 
-	if (cache->bmpcache_mru[id] == idx)
-		return;
+	bc = &cache->bmpcache[id];
 
-	DEBUG_CACHE("bump bitmap: id=%d, idx=%d, bump=%d", id, idx, bump);
+	for (n = 0; n < count; n++)
+	{
+		if (idx[n] < 0 || idx[n] >= bc->num_cells)
+			continue;
 
-	n_idx = cache->bmpcache[id][idx].next;
-	p_idx = cache->bmpcache[id][idx].previous;
+		entry = &bc->cells[idx[n]];
+		if (entry->bitmap == NULL)
+			continue;
 
-	if (IS_SET(n_idx))
-	{
-		/* remove */
-		--(cache->bmpcache_count[id]);
-		if (IS_SET(p_idx))
-			cache->bmpcache[id][p_idx].next = n_idx;
-		else
-			cache->bmpcache_lru[id] = n_idx;
-		if (IS_SET(n_idx))
-			cache->bmpcache[id][n_idx].previous = p_idx;
-		else
-			cache->bmpcache_mru[id] = p_idx;
-	}
-	else
-	{
-		p_idx = NOT_SET;
-		n_idx = cache->bmpcache_lru[id];
+		bmpcache_list_unlink(bc, entry);
+		bmpcache_list_append(bc, entry->segment, entry);
 	}
+}
 
-	if (bump >= 0)
-	{
-		for (n = 0; n < bump && IS_SET(n_idx); n++)
-		{
-			p_idx = n_idx;
-			n_idx = cache->bmpcache[id][p_idx].next;
-		}
-	}
-	else
-	{
-		p_idx = cache->bmpcache_mru[id];
-		n_idx = NOT_SET;
-	}
+/* Tell the eviction policy a bitmap has been used */
+void
+cache_bump_bitmap(rdpCache * cache, uint8 id, uint16 idx)
+{
+	struct bmpcache * bc;
 
-	/* insert */
-	++(cache->bmpcache_count[id]);
-	cache->bmpcache[id][idx].previous = p_idx;
-	cache->bmpcache[id][idx].next = n_idx;
+	bc = cache_get_bmpcache(cache, id, idx);
+	if (bc == NULL || bc->cells[idx].bitmap == NULL)
+		return;
 
-	if (p_idx >= 0)
-		cache->bmpcache[id][p_idx].next = idx;
-	else
-		cache->bmpcache_lru[id] = idx;
+	DEBUG_CACHE("bump bitmap: id=%d, idx=%d", id, idx);
 
-	if (n_idx >= 0)
-		cache->bmpcache[id][n_idx].previous = idx;
-	else
-		cache->bmpcache_mru[id] = idx;
+	bc->policy->hit(bc, &bc->cells[idx]);
 }
 
-/* Evict the least-recently used bitmap from the cache */
-void
-cache_evict_bitmap(rdpCache * cache, uint8 id)
+/* Evict the bitmap chosen by the eviction policy from the cache, never the one at keep */
+RD_BOOL
+cache_evict_bitmap(rdpCache * cache, uint8 id, struct bmpcache_entry * keep)
 {
 	uint16 idx;
-	int n_idx;
-
-	if (!IS_PERSISTENT(id))
-		return;
+	RD_HBITMAP bitmap;
+	struct bmpcache * bc;
+	struct bmpcache_entry * entry;
 
-	idx = cache->bmpcache_lru[id];
-	n_idx = cache->bmpcache[id][idx].next;
+	if (id >= NUM_ELEMENTS(cache->bmpcache) || !IS_PERSISTENT(id))
+		return False;
 
-	ui_destroy_bitmap(cache->rdp->inst, cache->bmpcache[id][idx].bitmap);
-	--(cache->bmpcache_count[id]);
-	cache->bmpcache[id][idx].bitmap = 0;
+	bc = &cache->bmpcache[id];
+	entry = bc->policy->victim(bc, keep);
+	if (entry == NULL)
+		return False;
 
-	cache->bmpcache_lru[id] = n_idx;
-	cache->bmpcache[id][n_idx].previous = NOT_SET;
+	idx = entry - bc->cells;
+	bitmap = entry->bitmap;
+	DEBUG_CACHE("evict bitmap: id=%d, idx=%d, policy=%s", id, idx, bc->policy->name);
+	cache_remove_bitmap(bc, entry);
+	bc->stats.evictions++;
 
+	ui_destroy_bitmap(cache->rdp->inst, bitmap);
 	pstcache_touch_bitmap(cache->rdp->pcache, id, idx, 0);
+	return True;
 }
 
 /* Retrieve a bitmap from the cache */
 RD_HBITMAP
 cache_get_bitmap(rdpCache * cache, uint8 id, uint16 idx)
 {
-	if ((id < NUM_ELEMENTS(cache->bmpcache)) && (idx < NUM_ELEMENTS(cache->bmpcache[0])))
+	struct bmpcache * bc;
+
+	bc = cache_get_bmpcache(cache, id, idx);
+	if (bc != NULL)
 	{
-		if (cache->bmpcache[id][idx].bitmap ||
-		    pstcache_load_bitmap(cache->rdp->pcache, id, idx))
+		if (bc->cells[idx].bitmap != NULL)
 		{
-			if (IS_PERSISTENT(id))
-				cache_bump_bitmap(cache, id, idx, BUMP_COUNT);
-
-			return cache->bmpcache[id][idx].bitmap;
+			bc->stats.hits++;
+			bc->policy->hit(bc, &bc->cells[idx]);
+			return bc->cells[idx].bitmap;
 		}
+
+		bc->stats.misses++;
+
+		/* loading puts the bitmap back into the cache */
+		if (pstcache_load_bitmap(cache->rdp->pcache, id, idx))
+			return bc->cells[idx].bitmap;
 	}
 	else if ((id < NUM_ELEMENTS(cache->volatile_bc)) && (idx == 0x7fff))
 	{
@@ -200,28 +297,43 @@ cache_get_bitmap(rdpCache * cache, uint8 id, uint16 idx)
 	return NULL;
 }
 
-/* Store a bitmap in the cache */
+/* Store a bitmap of size bytes in the cache */
 void
-cache_put_bitmap(rdpCache * cache, uint8 id, uint16 idx, RD_HBITMAP bitmap)
+cache_put_bitmap(rdpCache * cache, uint8 id, uint16 idx, RD_HBITMAP bitmap, int size)
 {
 	RD_HBITMAP old;
+	struct bmpcache * bc;
+	struct bmpcache_entry * entry;
 
-	if ((id < NUM_ELEMENTS(cache->bmpcache)) && (idx < NUM_ELEMENTS(cache->bmpcache[0])))
+	bc = cache_get_bmpcache(cache, id, idx);
+	if (bc != NULL)
 	{
-		old = cache->bmpcache[id][idx].bitmap;
+		entry = &bc->cells[idx];
+		old = entry->bitmap;
 		if (old != NULL)
+		{
+			cache_remove_bitmap(bc, entry);
 			ui_destroy_bitmap(cache->rdp->inst, old);
-		cache->bmpcache[id][idx].bitmap = bitmap;
+		}
+
+		if (bitmap == NULL)
+			return;
 
+		entry->bitmap = bitmap;
+		entry->size = size;
+		bc->count++;
+		bc->size += size;
+		bc->policy->insert(bc, entry);
+
+		/* only bitmaps that can be reloaded from disk may be dropped,
+		   the new one stays even if it does not fit on its own */
 		if (IS_PERSISTENT(id))
 		{
-			if (old == NULL)
-				cache->bmpcache[id][idx].previous =
-				cache->bmpcache[id][idx].next = NOT_SET;
-
-			cache_bump_bitmap(cache, id, idx, TO_TOP);
-			if (cache->bmpcache_count[id] > BMPCACHE2_C2_CELLS)
-				cache_evict_bitmap(cache, id);
+			while (bc->size > bc->max_size && bc->count > 1)
+			{
+				if (!cache_evict_bitmap(cache, id, entry))
+					break;
+			}
 		}
 	}
 	else if ((id < NUM_ELEMENTS(cache->volatile_bc)) && (idx == 0x7fff))
@@ -241,22 +353,45 @@ cache_put_bitmap(rdpCache * cache, uint8 id, uint16 idx, RD_HBITMAP bitmap)
 	}
 }
 
+/* Copy the counters of a bitmap cache */
+RD_BOOL
+cache_get_bitmap_stats(rdpCache * cache, uint8 id, RD_BITMAP_CACHE_STATS * stats)
+{
+	struct bmpcache * bc;
+
+	if (id >= NUM_ELEMENTS(cache->bmpcache))
+		return False;
+
+	bc = &cache->bmpcache[id];
+	memcpy(stats, &bc->stats, sizeof(RD_BITMAP_CACHE_STATS));
+	stats->cells = cache_get_bitmap_cells(cache, id);
+	stats->count = bc->count;
+	stats->size = bc->size;
+	stats->max_size = (IS_PERSISTENT(id) ? bc->max_size : 0);
+
+	return True;
+}
+
 /* Updates the persistent bitmap cache MRU information on exit */
 void
 cache_save_state(rdpCache * cache)
 {
 	uint32 id = 0, t = 0;
-	int idx;
+	int segment;
+	struct bmpcache * bc;
+	struct bmpcache_entry * entry;
 
 	for (id = 0; id < NUM_ELEMENTS(cache->bmpcache); id++)
 		if (IS_PERSISTENT(id))
 		{
 			DEBUG_CACHE("Saving cache state for bitmap cache %d...", id);
-			idx = cache->bmpcache_lru[id];
-			while (idx >= 0)
+			bc = &cache->bmpcache[id];
+
+			/* least recently used first, protected entries count as more recent */
+			for (segment = PROBATION; segment <= PROTECTED; segment++)
 			{
-				pstcache_touch_bitmap(cache->rdp->pcache, id, idx, ++t);
-				idx = cache->bmpcache[id][idx].next;
+				for (entry = bc->lists[segment].next; entry != &bc->lists[segment]; entry = entry->next)
+					pstcache_touch_bitmap(cache->rdp->pcache, id, entry - bc->cells, ++t);
 			}
 			DEBUG_CACHE(" %d stamps written.", t);
 		}
@@ -403,19 +538,41 @@ cache_put_brush_data(rdpCache * cache, uint8 color_code, uint8 idx, RD_BRUSHDATA
 rdpCache *
 cache_new(struct rdp_rdp * rdp)
 {
+	int id;
 	rdpCache * self;
+	struct bmpcache * bc;
 
 	self = (rdpCache *) xmalloc(sizeof(rdpCache));
 	if (self != NULL)
 	{
 		memset(self, 0, sizeof(rdpCache));
 		self->rdp = rdp;
-		self->bmpcache_lru[0] = NOT_SET;
-		self->bmpcache_lru[1] = NOT_SET;
-		self->bmpcache_lru[2] = NOT_SET;
-		self->bmpcache_mru[0] = NOT_SET;
-		self->bmpcache_mru[1] = NOT_SET;
-		self->bmpcache_mru[2] = NOT_SET;
+
+		for (id = 0; id < NUM_ELEMENTS(self->bmpcache); id++)
+		{
+			bc = &self->bmpcache[id];
+			bc->num_cells = cache_get_bitmap_cells(self, id);
+
+			bc->policy = &bmpcache_policy_lru;
+
+			/* whether the cache is persistent is only decided when the capabilities are sent */
+			if (id == 2 && rdp->settings->bitmap_cache_persist_enable)
+			{
+				bc->num_cells = MAX(bc->num_cells, BMPCACHE2_NUM_PSTCELLS);
+				bc->policy = &bmpcache_policy_slru; /* the only one that evicts */
+			}
+
+			bc->cells = (struct bmpcache_entry *) xmalloc(sizeof(struct bmpcache_entry) * bc->num_cells);
+			memset(bc->cells, 0, sizeof(struct bmpcache_entry) * bc->num_cells);
+			bmpcache_list_init(&bc->lists[PROBATION]);
+			bmpcache_list_init(&bc->lists[PROTECTED]);
+
+			/* by default as much memory as the old fixed number of 64x64 cells used */
+			if (rdp->settings->bitmap_cache_memory > 0)
+				bc->max_size = rdp->settings->bitmap_cache_memory;
+			else
+				bc->max_size = BMPCACHE2_C2_CELLS * 64 * 64 * ((rdp->settings->server_depth + 7) / 8);
+		}
 	}
 	return self;
 }
@@ -461,12 +618,13 @@ cache_free(rdpCache * cache)
 
 			for (cache_id = 0; cache_id < NUM_ELEMENTS(cache->bmpcache); cache_id++)
 			{
-				for (cache_idx = 0; cache_idx < NUM_ELEMENTS(cache->bmpcache[0]); cache_idx++)
+				for (cache_idx = 0; cache_idx < cache->bmpcache[cache_id].num_cells; cache_idx++)
 				{
-					bmp = cache->bmpcache[cache_id][cache_idx].bitmap;
+					bmp = cache->bmpcache[cache_id].cells[cache_idx].bitmap;
 					if (bmp != NULL)
 						ui_destroy_bitmap(cache->rdp->inst, bmp);
 				}
+				xfree(cache->bmpcache[cache_id].cells);
 			}
 			for (cache_id = 0; cache_id < NUM_ELEMENTS(cache->volatile_bc); cache_id++)
 			{
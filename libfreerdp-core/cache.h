@@ -25,22 +25,52 @@
 #include <freerdp/utils/memory.h>
 #include <freerdp/utils/datablob.h>
 
+/* a cached bitmap, linked into one of the lists of its cache while it holds a bitmap */
 struct bmpcache_entry
 {
 	RD_HBITMAP bitmap;
-	sint16 previous;
-	sint16 next;
+	int size; /* bytes charged to the memory budget */
+	int segment; /* list the entry is on, see struct bmpcache */
+	struct bmpcache_entry * prev;
+	struct bmpcache_entry * next;
+};
+
+struct bmpcache;
+
+/* decides where entries go on insert and hit, and which one is evicted */
+struct bmpcache_policy
+{
+	const char * name;
+	void (* insert)(struct bmpcache * bc, struct bmpcache_entry * entry);
+	void (* hit)(struct bmpcache * bc, struct bmpcache_entry * entry);
+	struct bmpcache_entry * (* victim)(struct bmpcache * bc, struct bmpcache_entry * keep);
+};
+
+/*
+ * One bitmap cache id. Cells are indexed by the cache index chosen by the
+ * server, so lookups are a bounds check and an array access. Entries holding
+ * a bitmap are on one of two circular lists with sentinel heads, head.next
+ * being the least recently used entry.
+ */
+struct bmpcache
+{
+	int num_cells;
+	struct bmpcache_entry * cells;
+	const struct bmpcache_policy * policy;
+	struct bmpcache_entry lists[2]; /* probation and protected segments */
+	int list_size[2];
+	int count;
+	int size;
+	int max_size; /* memory budget in bytes, only persistent caches can evict */
+	RD_BITMAP_CACHE_STATS stats;
 };
 
 struct rdp_cache
 {
 	struct rdp_rdp * rdp;
-	struct bmpcache_entry bmpcache[3][0xa00];
+	struct bmpcache bmpcache[3];
 	RD_HBITMAP volatile_bc[3];
 	RD_HBITMAP drawing_surface[100];
-	int bmpcache_lru[3];
-	int bmpcache_mru[3];
-	int bmpcache_count[3];
 	FONTGLYPH fontcache[12][256];
 	DATABLOB textcache[256];
 	RD_HCURSOR cursorcache[0x20];
@@ -48,16 +78,20 @@ struct rdp_cache
 };
 typedef struct rdp_cache rdpCache;
 
+int
+cache_get_bitmap_cells(rdpCache * cache, uint8 id);
 void
 cache_rebuild_bmpcache_linked_list(rdpCache * cache, uint8 id, sint16 * idx, int count);
 void
-cache_bump_bitmap(rdpCache * cache, uint8 id, uint16 idx, int bump);
-void
-cache_evict_bitmap(rdpCache * cache, uint8 id);
+cache_bump_bitmap(rdpCache * cache, uint8 id, uint16 idx);
+RD_BOOL
+cache_evict_bitmap(rdpCache * cache, uint8 id, struct bmpcache_entry * keep);
 RD_HBITMAP
 cache_get_bitmap(rdpCache * cache, uint8 id, uint16 idx);
 void
-cache_put_bitmap(rdpCache * cache, uint8 id, uint16 idx, RD_HBITMAP bitmap);
+cache_put_bitmap(rdpCache * cache, uint8 id, uint16 idx, RD_HBITMAP bitmap, int size);
+RD_BOOL
+cache_get_bitmap_stats(rdpCache * cache, uint8 id, RD_BITMAP_CACHE_STATS * stats);
 void
 cache_save_state(rdpCache * cache);
 FONTGLYPH *
@@ -19,6 +19,7 @@
 
 #include "frdp.h"
 #include "rdp.h"
+#include "cache.h"
 #include "pstcache.h"
 #include "stream.h"
 #include "surface.h"
@@ -299,13 +300,13 @@ void rdp_out_bitmapcache_capset(rdpRdp * rdp, STREAM s)
 	header = rdp_skip_capset_header(s);
 	Bpp = (rdp->settings->server_depth + 7) / 8; /* bytes per pixel */
 	out_uint8s(s, 24); /* pad */
-	out_uint16_le(s, 0x258); /* Cache1Entries */
+	out_uint16_le(s, cache_get_bitmap_cells(rdp->cache, 0)); /* Cache1Entries */
 	size = 0x100 * Bpp;
 	out_uint16_le(s, size); /* Cache1MaximumCellSize */
-	out_uint16_le(s, 0x12c); /* Cache2Entries */
+	out_uint16_le(s, cache_get_bitmap_cells(rdp->cache, 1)); /* Cache2Entries */
 	size = 0x400 * Bpp;
 	out_uint16_le(s, size); /* Cache2MaximumCellSize */
-	out_uint16_le(s, 0x106); /* Cache3Entries */
+	out_uint16_le(s, cache_get_bitmap_cells(rdp->cache, 2)); /* Cache3Entries */
 	size = 0x1000 * Bpp;
 	out_uint16_le(s, size); /* Cache3MaximumCellSize */
 	rdp_out_capset_header(s, header, CAPSET_TYPE_BITMAPCACHE);
@@ -332,15 +333,15 @@ void rdp_out_bitmapcache_rev2_capset(rdpRdp * rdp, STREAM s)
 	out_uint8(s, 3); /* numCellCaches */
 
 	/* max cell size for cache 0 is 16x16, 1 = 32x32, 2 = 64x64, etc */
-	out_uint32_le(s, BMPCACHE2_C0_CELLS);
-	out_uint32_le(s, BMPCACHE2_C1_CELLS);
+	out_uint32_le(s, cache_get_bitmap_cells(rdp->cache, 0));
+	out_uint32_le(s, cache_get_bitmap_cells(rdp->cache, 1));
 	if (pstcache_init(rdp->pcache, 2))
 	{
-		out_uint32_le(s, BMPCACHE2_NUM_PSTCELLS | BMPCACHE2_FLAG_PERSIST);
+		out_uint32_le(s, cache_get_bitmap_cells(rdp->cache, 2) | BMPCACHE2_FLAG_PERSIST);
 	}
 	else
 	{
-		out_uint32_le(s, BMPCACHE2_C2_CELLS);
+		out_uint32_le(s, cache_get_bitmap_cells(rdp->cache, 2));
 	}
 	out_uint8s(s, 20);	/* other bitmap caches not used */
 	rdp_out_capset_header(s, header, CAPSET_TYPE_BITMAPCACHE_REV2);
@@ -1101,7 +1102,9 @@ void rdp_process_multifragmentupdate_capset(rdpRdp * rdp, STREAM s)
 
 	rdp->got_multifragmentupdate_caps = 1;
 	in_uint32_le(s, rdp->multifragmentupdate_request_size);
-	rdp->fragment_data = stream_new(rdp->multifragmentupdate_request_size);
+	/* start small, the buffer grows towards the negotiated size as fragments arrive */
+	rdp->fragment_data = stream_new(MIN(rdp->multifragmentupdate_request_size, RDP_FRAGMENT_INITIAL_SIZE));
+	rdp->fragment_dropped = 0;
 }
 
 static int
@@ -64,9 +64,10 @@ vchan_send(rdpChannels * chan, int mcs_id, char * data, int total_length)
 		s = sec_init(chan->mcs->net->sec, sec_flags, length + 8);
 		out_uint32_le(s, total_length);
 		out_uint32_le(s, chan_flags);
-		out_uint8p(s, data + sent, length);
 		s_mark_end(s);
-		sec_send_to_channel(chan->mcs->net->sec, s, sec_flags, mcs_id);
+		/* the chunk is sent from where it is unless it has to be encrypted */
+		sec_send_to_channel_gather(chan->mcs->net->sec, s, sec_flags, mcs_id,
+			(uint8 *) data + sent, length);
 		sent += length;
 		chan_flags = 0;
 	}
@@ -559,6 +559,13 @@ tls_read(rdpTls * tls, char* b, int length)
 	return 0;
 }
 
+/* Number of decrypted bytes that can be read without touching the socket */
+int
+tls_pending(rdpTls * tls)
+{
+	return SSL_pending(tls->ssl);
+}
+
 CryptoCert
 tls_get_certificate(rdpTls * tls)
 {
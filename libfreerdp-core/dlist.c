@@ -0,0 +1,245 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   Display list of primary drawing orders
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+   With settings->display_list set, the fills, blts and lines of an update
+   are appended to a display list instead of being drawn one by one, and the
+   whole list is handed to the client at once by ui_draw_list.
+
+   The clip rectangle is part of the list. It is only changed when an order
+   has other bounds than the one before it, and it is reset once, at the end
+   of the list, rather than after every bounded order. A solid fill that
+   shares a whole side with the fill appended just before it, in the same
+   color and clip, grows that fill instead of adding a command.
+
+   Commands hold bitmaps and brush data of the caches, so the list is
+   flushed before any secondary order and before drawing anything that does
+   not go through it.
+*/
+
+#include "frdp.h"
+#include <freerdp/utils/memory.h>
+
+#include "dlist.h"
+
+static RD_DRAW_CMD *
+dlist_append(rdpDisplayList * dl, uint8 type, int x, int y, int cx, int cy)
+{
+	RD_DRAW_CMD * cmd;
+
+	if (dl->count == dl->size)
+	{
+		dl->size *= 2;
+		dl->cmds = (RD_DRAW_CMD *) xrealloc(dl->cmds, dl->size * sizeof(RD_DRAW_CMD));
+	}
+
+	cmd = &dl->cmds[dl->count++];
+	cmd->type = type;
+	cmd->opcode = 0;
+	cmd->x = x;
+	cmd->y = y;
+	cmd->cx = cx;
+	cmd->cy = cy;
+
+	return cmd;
+}
+
+/* Grow the last command over a rectangle it shares a whole side with */
+static RD_BOOL
+dlist_merge(RD_DRAW_CMD * last, int x, int y, int cx, int cy)
+{
+	if (cx <= 0 || cy <= 0)
+		return False;
+
+	if (last->y == y && last->cy == cy)
+	{
+		if (last->x + last->cx == x)
+		{
+			last->cx += cx;
+			return True;
+		}
+		if (x + cx == last->x)
+		{
+			last->x = x;
+			last->cx += cx;
+			return True;
+		}
+	}
+	else if (last->x == x && last->cx == cx)
+	{
+		if (last->y + last->cy == y)
+		{
+			last->cy += cy;
+			return True;
+		}
+		if (y + cy == last->y)
+		{
+			last->y = y;
+			last->cy += cy;
+			return True;
+		}
+	}
+
+	return False;
+}
+
+rdpDisplayList *
+dlist_new(void)
+{
+	rdpDisplayList * dl;
+
+	dl = (rdpDisplayList *) xmalloc(sizeof(rdpDisplayList));
+	if (dl != NULL)
+	{
+		memset(dl, 0, sizeof(rdpDisplayList));
+		dl->size = DLIST_INITIAL_SIZE;
+		dl->cmds = (RD_DRAW_CMD *) xmalloc(dl->size * sizeof(RD_DRAW_CMD));
+	}
+	return dl;
+}
+
+void
+dlist_free(rdpDisplayList * dl)
+{
+	if (dl != NULL)
+	{
+		xfree(dl->cmds);
+		xfree(dl);
+	}
+}
+
+void
+dlist_set_clip(rdpDisplayList * dl, int x, int y, int cx, int cy)
+{
+	if (dl->clipped && dl->clip.x == x && dl->clip.y == y &&
+		dl->clip.width == cx && dl->clip.height == cy)
+		return;
+
+	dl->clipped = True;
+	dl->clip.x = x;
+	dl->clip.y = y;
+	dl->clip.width = cx;
+	dl->clip.height = cy;
+
+	dlist_append(dl, RD_DRAW_SET_CLIP, x, y, cx, cy);
+}
+
+void
+dlist_reset_clip(rdpDisplayList * dl)
+{
+	if (!dl->clipped)
+		return;
+
+	dl->clipped = False;
+	dlist_append(dl, RD_DRAW_RESET_CLIP, 0, 0, 0, 0);
+}
+
+void
+dlist_rect(rdpDisplayList * dl, int x, int y, int cx, int cy, uint32 color)
+{
+	RD_DRAW_CMD * last;
+
+	if (dl->count > 0)
+	{
+		last = &dl->cmds[dl->count - 1];
+
+		if (last->type == RD_DRAW_RECT && last->u.color == color &&
+			dlist_merge(last, x, y, cx, cy))
+			return;
+	}
+
+	dlist_append(dl, RD_DRAW_RECT, x, y, cx, cy)->u.color = color;
+}
+
+void
+dlist_destblt(rdpDisplayList * dl, uint8 opcode, int x, int y, int cx, int cy)
+{
+	dlist_append(dl, RD_DRAW_DESTBLT, x, y, cx, cy)->opcode = opcode;
+}
+
+void
+dlist_patblt(rdpDisplayList * dl, uint8 opcode, int x, int y, int cx, int cy,
+	RD_BRUSH * brush, uint32 bgcolor, uint32 fgcolor)
+{
+	RD_DRAW_CMD * cmd;
+
+	/* patterns are aligned to the brush origin, only solid fills are grown */
+	if (dl->count > 0 && brush->style == 0)
+	{
+		cmd = &dl->cmds[dl->count - 1];
+
+		if (cmd->type == RD_DRAW_PATBLT && cmd->opcode == opcode &&
+			cmd->u.pat.brush.style == 0 && cmd->u.pat.fgcolor == fgcolor &&
+			cmd->u.pat.bgcolor == bgcolor && dlist_merge(cmd, x, y, cx, cy))
+			return;
+	}
+
+	cmd = dlist_append(dl, RD_DRAW_PATBLT, x, y, cx, cy);
+	cmd->opcode = opcode;
+	memcpy(&cmd->u.pat.brush, brush, sizeof(RD_BRUSH));
+	cmd->u.pat.bgcolor = bgcolor;
+	cmd->u.pat.fgcolor = fgcolor;
+}
+
+void
+dlist_screenblt(rdpDisplayList * dl, uint8 opcode, int x, int y, int cx, int cy,
+	int srcx, int srcy)
+{
+	RD_DRAW_CMD * cmd;
+
+	cmd = dlist_append(dl, RD_DRAW_SCREENBLT, x, y, cx, cy);
+	cmd->opcode = opcode;
+	cmd->u.blt.src = NULL;
+	cmd->u.blt.srcx = srcx;
+	cmd->u.blt.srcy = srcy;
+}
+
+void
+dlist_memblt(rdpDisplayList * dl, uint8 opcode, int x, int y, int cx, int cy,
+	RD_HBITMAP src, int srcx, int srcy)
+{
+	RD_DRAW_CMD * cmd;
+
+	cmd = dlist_append(dl, RD_DRAW_MEMBLT, x, y, cx, cy);
+	cmd->opcode = opcode;
+	cmd->u.blt.src = src;
+	cmd->u.blt.srcx = srcx;
+	cmd->u.blt.srcy = srcy;
+}
+
+void
+dlist_line(rdpDisplayList * dl, uint8 opcode, int startx, int starty, int endx, int endy,
+	RD_PEN * pen)
+{
+	RD_DRAW_CMD * cmd;
+
+	cmd = dlist_append(dl, RD_DRAW_LINE, startx, starty, endx, endy);
+	cmd->opcode = opcode;
+	memcpy(&cmd->u.pen, pen, sizeof(RD_PEN));
+}
+
+/* Draw the commands recorded so far and leave the client without a clip */
+void
+dlist_flush(rdpDisplayList * dl, rdpInst * inst)
+{
+	dlist_reset_clip(dl);
+
+	if (dl->count > 0)
+		ui_draw_list(inst, dl->cmds, dl->count);
+
+	dl->count = 0;
+}
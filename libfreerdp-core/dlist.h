@@ -0,0 +1,63 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   Display list of primary drawing orders
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __DLIST_H
+#define __DLIST_H
+
+#include <freerdp/types/ui.h>
+
+/* commands a display list has room for when created */
+#define DLIST_INITIAL_SIZE	256
+
+struct rdp_display_list
+{
+	RD_DRAW_CMD * cmds;
+	int count;
+	int size;
+	RD_BOOL clipped; /* a clip rectangle is set after the last command */
+	RD_RECT clip;
+};
+typedef struct rdp_display_list rdpDisplayList;
+
+rdpDisplayList *
+dlist_new(void);
+void
+dlist_free(rdpDisplayList * dl);
+void
+dlist_set_clip(rdpDisplayList * dl, int x, int y, int cx, int cy);
+void
+dlist_reset_clip(rdpDisplayList * dl);
+void
+dlist_rect(rdpDisplayList * dl, int x, int y, int cx, int cy, uint32 color);
+void
+dlist_destblt(rdpDisplayList * dl, uint8 opcode, int x, int y, int cx, int cy);
+void
+dlist_patblt(rdpDisplayList * dl, uint8 opcode, int x, int y, int cx, int cy,
+	RD_BRUSH * brush, uint32 bgcolor, uint32 fgcolor);
+void
+dlist_screenblt(rdpDisplayList * dl, uint8 opcode, int x, int y, int cx, int cy,
+	int srcx, int srcy);
+void
+dlist_memblt(rdpDisplayList * dl, uint8 opcode, int x, int y, int cx, int cy,
+	RD_HBITMAP src, int srcx, int srcy);
+void
+dlist_line(rdpDisplayList * dl, uint8 opcode, int startx, int starty, int endx, int endy,
+	RD_PEN * pen);
+void
+dlist_flush(rdpDisplayList * dl, rdpInst * inst);
+
+#endif
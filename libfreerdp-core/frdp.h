@@ -55,20 +55,6 @@ void
 ui_unimpl(rdpInst * inst, char * format, ...);
 int
 load_license(unsigned char ** data);
-RD_BOOL
-rd_lock_file(int fd, int start, int len);
-int
-rd_lseek_file(int fd, int offset);
-int
-rd_write_file(int fd, void * ptr, int len);
-RD_BOOL
-rd_pstcache_mkdir(void);
-void
-rd_close_file(int fd);
-int
-rd_read_file(int fd, void * ptr, int len);
-int
-rd_open_file(char * filename);
 void
 generate_random(uint8 * random);
 void
@@ -78,6 +64,8 @@ ui_begin_update(rdpInst * inst);
 void
 ui_end_update(rdpInst * inst);
 void
+ui_draw_list(rdpInst * inst, RD_DRAW_CMD * cmds, int count);
+void
 ui_line(rdpInst * inst, uint8 opcode, int startx, int starty, int endx, int endy, RD_PEN * pen);
 void
 ui_rect(rdpInst * inst, int x, int y, int cx, int cy, uint32 color);
@@ -94,6 +82,8 @@ ui_start_draw_glyphs(rdpInst * inst, uint32 bgcolor, uint32 fgcolor);
 void
 ui_draw_glyph(rdpInst * inst, int x, int y, int cx, int cy, RD_HGLYPH glyph);
 void
+ui_draw_glyph_run(rdpInst * inst, RD_GLYPH_POS * glyphs, int count);
+void
 ui_end_draw_glyphs(rdpInst * inst, int x, int y, int cx, int cy);
 void
 ui_desktop_save(rdpInst * inst, uint32 offset, int x, int y, int cx, int cy);
@@ -143,6 +133,10 @@ RD_HBITMAP
 ui_create_bitmap(rdpInst * inst, int width, int height, uint8 * data);
 void
 ui_paint_bitmap(rdpInst * inst, int x, int y, int cx, int cy, int width, int height, uint8 * data);
+int
+ui_begin_paint_bitmap(rdpInst * inst, int x, int y, int cx, int cy, int bpp, RD_BITMAP_DEST * dest);
+void
+ui_end_paint_bitmap(rdpInst * inst, int x, int y, int cx, int cy);
 void
 ui_destroy_bitmap(rdpInst * inst, RD_HBITMAP bmp);
 RD_HPALETTE
@@ -23,8 +23,12 @@
 #include "mcs.h"
 #include "iso.h"
 #include "tcp.h"
+#include "network.h"
+#include "pipeline.h"
+#include "record.h"
 #include "chan.h"
 #include "ext.h"
+#include "cache.h"
 #include <freerdp/freerdp.h>
 #include <freerdp/utils/memory.h>
 #include <freerdp/utils/hexdump.h>
@@ -97,47 +101,6 @@ load_license(unsigned char ** data)
 	return 0;
 }
 
-RD_BOOL
-rd_lock_file(int fd, int start, int len)
-{
-	return 0;
-}
-
-int
-rd_lseek_file(int fd, int offset)
-{
-	return 0;
-}
-
-int
-rd_write_file(int fd, void * ptr, int len)
-{
-	return 0;
-}
-
-RD_BOOL
-rd_pstcache_mkdir(void)
-{
-	return 0;
-}
-
-void
-rd_close_file(int fd)
-{
-}
-
-int
-rd_read_file(int fd, void * ptr, int len)
-{
-	return 0;
-}
-
-int
-rd_open_file(char * filename)
-{
-	return 0;
-}
-
 void
 generate_random(uint8 * random)
 {
@@ -159,15 +122,79 @@ save_license(unsigned char * data, int length)
 void
 ui_begin_update(rdpInst * inst)
 {
+	/* pipelined sessions begin and end updates when presenting */
+	if (RDP_FROM_INST(inst)->pipeline != NULL)
+		return;
+
 	inst->ui_begin_update(inst);
 }
 
 void
 ui_end_update(rdpInst * inst)
 {
+	rdpRdp * rdp = RDP_FROM_INST(inst);
+
+	if (rdp->pipeline != NULL)
+	{
+		pipeline_end_update(rdp->pipeline);
+		return;
+	}
+
+	if (rdp->replay != NULL)
+		record_end_update(rdp->replay);
+
 	inst->ui_end_update(inst);
 }
 
+void
+ui_draw_list(rdpInst * inst, RD_DRAW_CMD * cmds, int count)
+{
+	int i;
+	RD_DRAW_CMD * cmd;
+
+	if (inst->ui_draw_list != NULL)
+	{
+		inst->ui_draw_list(inst, cmds, count);
+		return;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		cmd = &cmds[i];
+
+		switch (cmd->type)
+		{
+			case RD_DRAW_SET_CLIP:
+				inst->ui_set_clip(inst, cmd->x, cmd->y, cmd->cx, cmd->cy);
+				break;
+			case RD_DRAW_RESET_CLIP:
+				inst->ui_reset_clip(inst);
+				break;
+			case RD_DRAW_RECT:
+				inst->ui_rect(inst, cmd->x, cmd->y, cmd->cx, cmd->cy, cmd->u.color);
+				break;
+			case RD_DRAW_DESTBLT:
+				inst->ui_destblt(inst, cmd->opcode, cmd->x, cmd->y, cmd->cx, cmd->cy);
+				break;
+			case RD_DRAW_PATBLT:
+				inst->ui_patblt(inst, cmd->opcode, cmd->x, cmd->y, cmd->cx, cmd->cy,
+					&cmd->u.pat.brush, cmd->u.pat.bgcolor, cmd->u.pat.fgcolor);
+				break;
+			case RD_DRAW_SCREENBLT:
+				inst->ui_screenblt(inst, cmd->opcode, cmd->x, cmd->y, cmd->cx, cmd->cy,
+					cmd->u.blt.srcx, cmd->u.blt.srcy);
+				break;
+			case RD_DRAW_MEMBLT:
+				inst->ui_memblt(inst, cmd->opcode, cmd->x, cmd->y, cmd->cx, cmd->cy,
+					cmd->u.blt.src, cmd->u.blt.srcx, cmd->u.blt.srcy);
+				break;
+			case RD_DRAW_LINE:
+				inst->ui_line(inst, cmd->opcode, cmd->x, cmd->y, cmd->cx, cmd->cy, &cmd->u.pen);
+				break;
+		}
+	}
+}
+
 void
 ui_line(rdpInst * inst, uint8 opcode, int startx, int starty, int endx, int endy, RD_PEN * pen)
 {
@@ -211,6 +238,21 @@ ui_draw_glyph(rdpInst * inst, int x, int y, int cx, int cy, RD_HGLYPH glyph)
 	inst->ui_draw_glyph(inst, x, y, cx, cy, glyph);
 }
 
+void
+ui_draw_glyph_run(rdpInst * inst, RD_GLYPH_POS * glyphs, int count)
+{
+	int i;
+
+	if (inst->ui_draw_glyph_run != NULL)
+	{
+		inst->ui_draw_glyph_run(inst, glyphs, count);
+		return;
+	}
+
+	for (i = 0; i < count; i++)
+		inst->ui_draw_glyph(inst, glyphs[i].x, glyphs[i].y, glyphs[i].cx, glyphs[i].cy, glyphs[i].glyph);
+}
+
 void
 ui_end_draw_glyphs(rdpInst * inst, int x, int y, int cx, int cy)
 {
@@ -353,6 +395,20 @@ ui_paint_bitmap(rdpInst * inst, int x, int y, int cx, int cy, int width, int hei
 	inst->ui_paint_bitmap(inst, x, y, cx, cy, width,  height, data);
 }
 
+int
+ui_begin_paint_bitmap(rdpInst * inst, int x, int y, int cx, int cy, int bpp, RD_BITMAP_DEST * dest)
+{
+	if (inst->ui_begin_paint_bitmap == NULL)
+		return 0;
+	return inst->ui_begin_paint_bitmap(inst, x, y, cx, cy, bpp, dest);
+}
+
+void
+ui_end_paint_bitmap(rdpInst * inst, int x, int y, int cx, int cy)
+{
+	inst->ui_end_paint_bitmap(inst, x, y, cx, cy);
+}
+
 void
 ui_destroy_bitmap(rdpInst * inst, RD_HBITMAP bmp)
 {
@@ -434,6 +490,26 @@ l_rdp_connect(rdpInst * inst)
 		rdp->settings->channels[index].chan_id = MCS_GLOBAL_CHANNEL + 1 + index;
 	}
 	ext_pre_connect(rdp->ext);
+	if (rdp->settings->replay_file[0] != 0)
+	{
+		/* the recorded PDUs stand in for the server */
+		rdp->replay = record_new(rdp->settings->replay_file, False);
+		if (rdp->replay == NULL)
+		{
+			ui_error(inst, "cannot replay %s\n", rdp->settings->replay_file);
+			return 1;
+		}
+		rdp->net->discard = 1;
+		rdp->settings->encryption = 0;
+		ext_post_connect(rdp->ext);
+		return 0;
+	}
+	if (rdp->settings->record_file[0] != 0)
+	{
+		rdp->record = record_new(rdp->settings->record_file, True);
+		if (rdp->record == NULL)
+			ui_warning(inst, "cannot record to %s\n", rdp->settings->record_file);
+	}
 	if (rdp_connect(rdp))
 	{
 		ext_post_connect(rdp->ext);
@@ -442,6 +518,24 @@ l_rdp_connect(rdpInst * inst)
 	return 1;
 }
 
+/* Hand the session over to the network and decode threads if asked to.
+   Done when the ui first waits for data, once the client has set up. */
+static RD_BOOL
+l_rdp_start_pipeline(rdpRdp * rdp)
+{
+	if (rdp->pipeline == NULL && rdp->settings->pipelined && rdp->replay == NULL)
+	{
+		rdp->pipeline = pipeline_new(rdp);
+		if (rdp->pipeline == NULL)
+		{
+			ui_warning(rdp->inst, "pipelined mode unavailable, decoding on the ui thread\n");
+			rdp->settings->pipelined = 0;
+		}
+	}
+
+	return (rdp->pipeline != NULL);
+}
+
 static int
 l_rdp_get_fds(rdpInst * inst, void ** read_fds, int * read_count,
 	void ** write_fds, int * write_count)
@@ -449,6 +543,16 @@ l_rdp_get_fds(rdpInst * inst, void ** read_fds, int * read_count,
 	rdpRdp * rdp;
 
 	rdp = RDP_FROM_INST(inst);
+	if (l_rdp_start_pipeline(rdp))
+		return pipeline_get_fds(rdp->pipeline, read_fds, read_count);
+#ifndef _WIN32
+	if (rdp->replay != NULL)
+	{
+		read_fds[*read_count] = (void *)(long) record_get_fd(rdp->replay);
+		(*read_count)++;
+		return 0;
+	}
+#endif
 #ifdef _WIN32
 	read_fds[*read_count] = (void *) (rdp->net->tcp->wsa_event);
 #else
@@ -471,14 +575,35 @@ l_rdp_check_fds(rdpInst * inst)
 	WSAResetEvent(rdp->net->tcp->wsa_event);
 #endif
 	rv = 0;
-	if (tcp_can_recv(rdp->net->tcp->sockfd, 0))
+	if (l_rdp_start_pipeline(rdp))
 	{
-		if (!rdp_loop(rdp, &deactivated))
+		if (!pipeline_check(rdp->pipeline))
 		{
+			/* a redirection reconnects on this thread and starts over */
+			pipeline_free(rdp->pipeline);
 			rv = 1;
 		}
 	}
-	if ((rv != 0) && rdp->redirect)
+	else if (rdp->replay != NULL)
+	{
+		/* one recorded PDU per call, the ui keeps being served */
+		if (!rdp_loop(rdp, &deactivated))
+			rv = 1;
+	}
+	else if (network_pending(rdp->net) || tcp_can_recv(rdp->net->tcp->sockfd, 0))
+	{
+		/* the socket is not readable for PDUs that have already been received */
+		do
+		{
+			if (!rdp_loop(rdp, &deactivated))
+			{
+				rv = 1;
+				break;
+			}
+		}
+		while (network_pending(rdp->net));
+	}
+	if ((rv != 0) && rdp->redirect && (rdp->replay == NULL))
 	{
 		rdp->redirect = False;
 		if (rdp_reconnect(rdp))
@@ -563,6 +688,36 @@ l_rdp_send_frame_ack(rdpInst * inst, int frame_id)
 	return 0;
 }
 
+static int
+l_rdp_get_bitmap_cache_stats(rdpInst * inst, int cache_id, RD_BITMAP_CACHE_STATS * stats)
+{
+	rdpRdp * rdp;
+	rdp = RDP_FROM_INST(inst);
+	if (cache_id < 0 || !cache_get_bitmap_stats(rdp->cache, cache_id, stats))
+		return 1;
+	return 0;
+}
+
+static int
+l_rdp_get_network_stats(rdpInst * inst, RD_NETWORK_STATS * stats)
+{
+	rdpRdp * rdp;
+	rdp = RDP_FROM_INST(inst);
+	memcpy(stats, &(rdp->net->stats), sizeof(RD_NETWORK_STATS));
+	return 0;
+}
+
+static int
+l_rdp_get_replay_stats(rdpInst * inst, RD_REPLAY_STATS * stats)
+{
+	rdpRdp * rdp;
+	rdp = RDP_FROM_INST(inst);
+	if (rdp->replay == NULL)
+		return 1;
+	record_get_stats(rdp->replay, stats);
+	return 0;
+}
+
 FREERDP_API RD_BOOL
 freerdp_global_init(void)
 {
@@ -581,6 +736,7 @@ freerdp_new(rdpSet * settings)
 	rdpInst * inst;
 
 	inst = (rdpInst *) xmalloc(sizeof(rdpInst));
+	memset(inst, 0, sizeof(rdpInst));
 	inst->version = FREERDP_INTERFACE_VERSION;
 	inst->size = sizeof(rdpInst);
 	inst->settings = settings;
@@ -595,6 +751,9 @@ freerdp_new(rdpSet * settings)
 	inst->rdp_suppress_output = l_rdp_suppress_output;
 	inst->rdp_disconnect = l_rdp_disconnect;
 	inst->rdp_send_frame_ack = l_rdp_send_frame_ack;
+	inst->rdp_get_bitmap_cache_stats = l_rdp_get_bitmap_cache_stats;
+	inst->rdp_get_network_stats = l_rdp_get_network_stats;
+	inst->rdp_get_replay_stats = l_rdp_get_replay_stats;
 	inst->rdp = (void *) rdp_new(settings, inst);
 	inst->disc_reason = 0;
 	return inst;
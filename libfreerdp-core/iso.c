@@ -286,11 +286,18 @@ iso_fp_init(rdpIso * iso, int length)
 /* Send an ISO data PDU */
 void
 iso_send(rdpIso * iso, STREAM s)
+{
+	iso_send_gather(iso, s, NULL, 0);
+}
+
+/* Send an X.224 data PDU made of the stream and the data that follows it */
+void
+iso_send_gather(rdpIso * iso, STREAM s, uint8 * data, int data_length)
 {
 	uint16 length;
 
 	s_pop_layer(s, iso_hdr);
-	length = s->end - s->p;
+	length = s->end - s->p + data_length;
 
 	out_uint8(s, 3);		/* version */
 	out_uint8(s, 0);		/* reserved */
@@ -300,7 +307,7 @@ iso_send(rdpIso * iso, STREAM s)
 	out_uint8(s, X224_TPDU_DATA);	/* code */
 	out_uint8(s, 0x80);		/* eot */
 
-	network_send(iso->net, s);
+	network_send_gather(iso->net, s, data, data_length);
 }
 
 /* Send an fast path data PDU */
@@ -50,6 +50,8 @@ iso_fp_init(rdpIso * iso, int length);
 void
 iso_send(rdpIso * iso, STREAM s);
 void
+iso_send_gather(rdpIso * iso, STREAM s, uint8 * data, int length);
+void
 iso_fp_send(rdpIso * iso, STREAM s, uint32 flags);
 void
 x224_send_connection_request(rdpIso * iso);
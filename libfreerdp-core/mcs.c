@@ -266,11 +266,18 @@ mcs_fp_init(rdpMcs * mcs, int length)
 /* Send an MCS transport data packet to a specific channel */
 void
 mcs_send_to_channel(rdpMcs * mcs, STREAM s, uint16 channel)
+{
+	mcs_send_to_channel_gather(mcs, s, channel, NULL, 0);
+}
+
+/* Send an MCS transport data packet made of the stream and the data that follows it */
+void
+mcs_send_to_channel_gather(rdpMcs * mcs, STREAM s, uint16 channel, uint8 * data, int data_length)
 {
 	uint16 length;
 
 	s_pop_layer(s, mcs_hdr);
-	length = s->end - s->p - 8;
+	length = s->end - s->p - 8 + data_length;
 	length |= 0x8000;
 
 	out_uint8(s, (T125_DOMAINMCSPDU_SendDataRequest << 2));
@@ -279,7 +286,7 @@ mcs_send_to_channel(rdpMcs * mcs, STREAM s, uint16 channel)
 	out_uint8(s, 0x70);	/* flags */
 	out_uint16_be(s, length);
 
-	iso_send(mcs->iso, s);
+	iso_send_gather(mcs->iso, s, data, data_length);
 }
 
 /* Send an MCS transport data packet to the global channel */
@@ -40,6 +40,8 @@ mcs_fp_init(rdpMcs * mcs, int length);
 void
 mcs_send_to_channel(rdpMcs * mcs, STREAM s, uint16 channel);
 void
+mcs_send_to_channel_gather(rdpMcs * mcs, STREAM s, uint16 channel, uint8 * data, int length);
+void
 mcs_send(rdpMcs * mcs, STREAM s);
 void
 mcs_fp_send(rdpMcs * mcs, STREAM s, uint32 flags);
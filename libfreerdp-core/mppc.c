@@ -52,14 +52,137 @@
 /* more information is available in         */
 /* http://www.ietf.org/ietf/IPR/hifn-ipr-draft-friend-tls-lzs-compression.txt */
 
+/* Implementation: */
+
+/* the compressed stream is read MSB first  */
+/* through a 64 bit bit buffer that is      */
+/* refilled a whole word at a time, so a    */
+/* complete token (at most 49 bits) can     */
+/* always be decoded without checking for   */
+/* more input. The prefixes of copy offsets */
+/* and match lengths are decoded with       */
+/* tables, matches are copied 8 bytes at a  */
+/* time when source and destination don't   */
+/* overlap within a word.                   */
+
+#define MPPC_RANGE16(_v) _v, _v, _v, _v, _v, _v, _v, _v, _v, _v, _v, _v, _v, _v, _v, _v
+
+/* number of leading one bits of a byte */
+static const uint8 mppc_leading_ones[256] =
+{
+	MPPC_RANGE16(0), MPPC_RANGE16(0), MPPC_RANGE16(0), MPPC_RANGE16(0),
+	MPPC_RANGE16(0), MPPC_RANGE16(0), MPPC_RANGE16(0), MPPC_RANGE16(0),
+	MPPC_RANGE16(1), MPPC_RANGE16(1), MPPC_RANGE16(1), MPPC_RANGE16(1),
+	MPPC_RANGE16(2), MPPC_RANGE16(2),
+	MPPC_RANGE16(3),
+	4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 7, 8
+};
+
+/* copy offset encoding, indexed by the 3 bits following the leading 11 */
+struct mppc_offset_code
+{
+	uint8 prefix_bits;
+	uint8 value_bits;
+	uint16 base;
+};
+
+/* RDP 5.0, 64 KB history */
+static const struct mppc_offset_code mppc_offset_codes_big[8] =
+{
+	{ 3, 16, 2368 }, { 3, 16, 2368 }, { 3, 16, 2368 }, { 3, 16, 2368 },	/* 110 */
+	{ 4, 11, 320 }, { 4, 11, 320 },						/* 1110 */
+	{ 5, 8, 64 },								/* 11110 */
+	{ 5, 6, 0 }								/* 11111 */
+};
+
+/* RDP 4.0, 8 KB history */
+static const struct mppc_offset_code mppc_offset_codes_small[8] =
+{
+	{ 3, 13, 320 }, { 3, 13, 320 }, { 3, 13, 320 }, { 3, 13, 320 },		/* 110 */
+	{ 4, 8, 64 }, { 4, 8, 64 },						/* 1110 */
+	{ 4, 6, 0 }, { 4, 6, 0 }						/* 1111 */
+};
+
+#define MPPC_LOAD_BE64(_p) \
+	(((uint64) (_p)[0] << 56) | ((uint64) (_p)[1] << 48) | \
+	 ((uint64) (_p)[2] << 40) | ((uint64) (_p)[3] << 32) | \
+	 ((uint64) (_p)[4] << 24) | ((uint64) (_p)[5] << 16) | \
+	 ((uint64) (_p)[6] << 8) | (uint64) (_p)[7])
+
+/* top up the bit buffer to at least 57 bits, unless the input runs out */
+#define MPPC_REFILL() \
+	if (end - src >= 8) \
+	{ \
+		bits |= MPPC_LOAD_BE64(src) >> nbits; \
+		src += (63 - nbits) >> 3; \
+		nbits |= 56; \
+	} \
+	else \
+	{ \
+		while (nbits <= 56 && src < end) \
+		{ \
+			bits |= (uint64) (*src++) << (56 - nbits); \
+			nbits += 8; \
+		} \
+	}
+
+/* copy a match of len bytes from off bytes back within the history */
+static void
+mppc_copy_match(uint8 * dict, int next_offset, int off, int len, int mask)
+{
+	int k;
+	uint8 * dst;
+	uint8 * src;
+
+	k = (next_offset - off) & mask;
+	dst = dict + next_offset;
+
+	if (k + len > mask + 1 || k >= next_offset)
+	{
+		/* the match wraps around the end of the history */
+		while (len-- > 0)
+		{
+			*dst++ = dict[k];
+			k = (k + 1) & mask;
+		}
+		return;
+	}
+
+	src = dict + k;
+
+	if (off >= 8)
+	{
+		/* a word never reads bytes it is about to write */
+		while (len >= 8)
+		{
+			memcpy(dst, src, 8);
+			dst += 8;
+			src += 8;
+			len -= 8;
+		}
+	}
+	else if (off == 1)
+	{
+		memset(dst, *src, len);
+		return;
+	}
+
+	while (len-- > 0)
+		*dst++ = *src++;
+}
+
 int
 mppc_expand(rdpRdp * rdp, uint8 * data, uint32 clen, uint8 ctype, uint32 * roff, uint32 * rlen)
 {
-	int k, walker_len = 0, walker;
-	uint32 i = 0;
-	int next_offset, match_off;
-	int match_len;
-	int old_offset, match_bits;
+	uint64 bits;
+	int nbits, used;
+	int n, mask, max_ones;
+	int next_offset, old_offset;
+	int match_off, match_len;
+	const uint8 * src;
+	const uint8 * end;
+	const struct mppc_offset_code * offset_codes;
+	const struct mppc_offset_code * code;
 	RD_BOOL big = ctype & RDP_MPPC_BIG ? True : False;
 
 	uint8 *dict = rdp->mppc_dict.hist;
@@ -82,290 +205,97 @@ mppc_expand(rdpRdp * rdp, uint8 * data, uint32 clen, uint8 ctype, uint32 * roff,
 		rdp->mppc_dict.roff = 0;
 	}
 
-	*roff = 0;
-	*rlen = 0;
-
-	walker = rdp->mppc_dict.roff;
-
-	next_offset = walker;
+	next_offset = rdp->mppc_dict.roff;
 	old_offset = next_offset;
 	*roff = old_offset;
+	*rlen = 0;
+
 	if (clen == 0)
 		return 0;
-	clen += i;
 
-	do
+	if (big)
 	{
-		if (walker_len == 0)
-		{
-			if (i >= clen)
-				break;
-			walker = data[i++] << 24;
-			walker_len = 8;
-		}
-		if (walker >= 0)
-		{
-			if (walker_len < 8)
-			{
-				if (i >= clen)
-				{
-					if (walker != 0)
-						return -1;
-					break;
-				}
-				walker |= (data[i++] & 0xff) << (24 - walker_len);
-				walker_len += 8;
-			}
-			if (next_offset >= RDP_MPPC_DICT_SIZE)
-				return -1;
-			dict[next_offset++] = (((uint32) walker) >> ((uint32) 24));
-			walker <<= 8;
-			walker_len -= 8;
-			continue;
-		}
-		walker <<= 1;
-		/* fetch next 8-bits */
-		if (--walker_len == 0)
-		{
-			if (i >= clen)
-				return -1;
-			walker = data[i++] << 24;
-			walker_len = 8;
-		}
-		/* literal decoding */
-		if (walker >= 0)
+		offset_codes = mppc_offset_codes_big;
+		mask = 65535;
+		max_ones = 14;
+	}
+	else
+	{
+		offset_codes = mppc_offset_codes_small;
+		mask = 8191;
+		max_ones = 11;
+	}
+
+	src = data;
+	end = data + clen;
+	bits = 0;
+	nbits = 0;
+
+	while (1)
+	{
+		/* a copy takes at most 49 bits, literals 9 */
+		if (nbits < 49)
 		{
-			if (walker_len < 8)
+			MPPC_REFILL();
+
+			if (nbits < 8)
 			{
-				if (i >= clen)
+				/* the input has been consumed, what is left is padding */
+				if (bits != 0)
 					return -1;
-				walker |= (data[i++] & 0xff) << (24 - walker_len);
-				walker_len += 8;
+				break;
 			}
-			if (next_offset >= RDP_MPPC_DICT_SIZE)
-				return -1;
-			dict[next_offset++] = (uint8) (walker >> 24 | 0x80);
-			walker <<= 8;
-			walker_len -= 8;
-			continue;
 		}
 
-		/* decode offset  */
-		/* length pair    */
-		walker <<= 1;
-		if (--walker_len < (big ? 3 : 2))
+		if ((bits >> 62) != 3)
 		{
-			if (i >= clen)
+			/* literal: 0 followed by 7 bits, or 10 followed by the low 7 bits of 0x80 and above */
+			n = (int) (bits >> 63);
+			used = 8 + n;
+			if (used > nbits || next_offset >= RDP_MPPC_DICT_SIZE)
 				return -1;
-			walker |= (data[i++] & 0xff) << (24 - walker_len);
-			walker_len += 8;
+			dict[next_offset++] = (uint8) (((bits << n) >> 56) | (n << 7));
+			bits <<= used;
+			nbits -= used;
+			continue;
 		}
 
-		if (big)
+		/* copy offset, the prefix includes the leading 11 */
+		code = &offset_codes[(bits >> 59) & 7];
+		used = code->prefix_bits + code->value_bits;
+		match_off = code->base + (int) ((bits << code->prefix_bits) >> (64 - code->value_bits));
+
+		/* length of match: n ones, a zero and n + 1 bits of the value, 3 is a single 0 */
+		n = mppc_leading_ones[(uint8) (bits >> (56 - used))];
+		if (n == 8)
+			n += mppc_leading_ones[(uint8) (bits >> (48 - used))];
+
+		if (n == 0)
 		{
-			/* offset decoding where offset len is:
-			   -63: 11111 followed by the lower 6 bits of the value
-			   64-319: 11110 followed by the lower 8 bits of the value ( value - 64 )
-			   320-2367: 1110 followed by lower 11 bits of the value ( value - 320 )
-			   2368-65535: 110 followed by lower 16 bits of the value ( value - 2368 )
-			 */
-			switch (((uint32) walker) >> ((uint32) 29))
-			{
-				case 7:	/* - 63 */
-					for (; walker_len < 9; walker_len += 8)
-					{
-						if (i >= clen)
-							return -1;
-						walker |= (data[i++] & 0xff) << (24 - walker_len);
-					}
-					walker <<= 3;
-					match_off = ((uint32) walker) >> ((uint32) 26);
-					walker <<= 6;
-					walker_len -= 9;
-					break;
-
-				case 6:	/* 64 - 319 */
-					for (; walker_len < 11; walker_len += 8)
-					{
-						if (i >= clen)
-							return -1;
-						walker |= (data[i++] & 0xff) << (24 - walker_len);
-					}
-
-					walker <<= 3;
-					match_off = (((uint32) walker) >> ((uint32) 24)) + 64;
-					walker <<= 8;
-					walker_len -= 11;
-					break;
-
-				case 5:
-				case 4:	/* 320 - 2367 */
-					for (; walker_len < 13; walker_len += 8)
-					{
-						if (i >= clen)
-							return -1;
-						walker |= (data[i++] & 0xff) << (24 - walker_len);
-					}
-
-					walker <<= 2;
-					match_off = (((uint32) walker) >> ((uint32) 21)) + 320;
-					walker <<= 11;
-					walker_len -= 13;
-					break;
-
-				default:	/* 2368 - 65535 */
-					for (; walker_len < 17; walker_len += 8)
-					{
-						if (i >= clen)
-							return -1;
-						walker |= (data[i++] & 0xff) << (24 - walker_len);
-					}
-
-					walker <<= 1;
-					match_off = (((uint32) walker) >> ((uint32) 16)) + 2368;
-					walker <<= 16;
-					walker_len -= 17;
-					break;
-			}
+			match_len = 3;
+			used += 1;
 		}
 		else
 		{
-			/* offset decoding where offset len is:
-			   -63: 1111 followed by the lower 6 bits of the value
-			   64-319: 1110 followed by the lower 8 bits of the value ( value - 64 )
-			   320-8191: 110 followed by the lower 13 bits of the value ( value - 320 )
-			 */
-			switch (((uint32) walker) >> ((uint32) 30))
-			{
-				case 3:	/* - 63 */
-					if (walker_len < 8)
-					{
-						if (i >= clen)
-							return -1;
-						walker |= (data[i++] & 0xff) << (24 - walker_len);
-						walker_len += 8;
-					}
-					walker <<= 2;
-					match_off = ((uint32) walker) >> ((uint32) 26);
-					walker <<= 6;
-					walker_len -= 8;
-					break;
-
-				case 2:	/* 64 - 319 */
-					for (; walker_len < 10; walker_len += 8)
-					{
-						if (i >= clen)
-							return -1;
-						walker |= (data[i++] & 0xff) << (24 - walker_len);
-					}
-
-					walker <<= 2;
-					match_off = (((uint32) walker) >> ((uint32) 24)) + 64;
-					walker <<= 8;
-					walker_len -= 10;
-					break;
-
-				default:	/* 320 - 8191 */
-					for (; walker_len < 14; walker_len += 8)
-					{
-						if (i >= clen)
-							return -1;
-						walker |= (data[i++] & 0xff) << (24 - walker_len);
-					}
-
-					match_off = (walker >> 18) + 320;
-					walker <<= 14;
-					walker_len -= 14;
-					break;
-			}
-		}
-		if (walker_len == 0)
-		{
-			if (i >= clen)
+			if (n > max_ones)
 				return -1;
-			walker = data[i++] << 24;
-			walker_len = 8;
+			used += n + 1;
+			match_len = (1 << (n + 1)) | (int) ((bits << used) >> (64 - (n + 1)));
+			used += n + 1;
 		}
 
-		/* decode length of match */
-		match_len = 0;
-		if (walker >= 0)
-		{		/* special case - length of 3 is in bit 0 */
-			match_len = 3;
-			walker <<= 1;
-			walker_len--;
-		}
-		else
-		{
-			/* this is how it works len of:
-			   4-7: 10 followed by 2 bits of the value
-			   8-15: 110 followed by 3 bits of the value
-			   16-31: 1110 followed by 4 bits of the value
-			   32-63: .... and so forth
-			   64-127:
-			   128-255:
-			   256-511:
-			   512-1023:
-			   1024-2047:
-			   2048-4095:
-			   4096-8191:
-
-			   i.e. 4097 is encoded as: 111111111110 000000000001
-			   meaning 4096 + 1...
-			 */
-			match_bits = big ? 14 : 11;	/* 11 or 14 bits of value at most */
-			do
-			{
-				walker <<= 1;
-				if (--walker_len == 0)
-				{
-					if (i >= clen)
-						return -1;
-					walker = data[i++] << 24;
-					walker_len = 8;
-				}
-				if (walker >= 0)
-					break;
-				if (--match_bits == 0)
-				{
-					return -1;
-				}
-			}
-			while (1);
-			match_len = (big ? 16 : 13) - match_bits;
-			walker <<= 1;
-			if (--walker_len < match_len)
-			{
-				for (; walker_len < match_len; walker_len += 8)
-				{
-					if (i >= clen)
-					{
-						return -1;
-					}
-					walker |= (data[i++] & 0xff) << (24 - walker_len);
-				}
-			}
+		if (used > nbits)
+			return -1;
 
-			match_bits = match_len;
-			match_len =
-				((walker >> (32 - match_bits)) & (~(-1 << match_bits))) | (1 <<
-											   match_bits);
-			walker <<= match_bits;
-			walker_len -= match_bits;
-		}
-		if (next_offset + match_len >= RDP_MPPC_DICT_SIZE)
-		{
+		bits <<= used;
+		nbits -= used;
+
+		if (match_off == 0 || next_offset + match_len > RDP_MPPC_DICT_SIZE)
 			return -1;
-		}
-		/* memory areas can overlap - meaning we can't use memXXX functions */
-		k = (next_offset - match_off) & (big ? 65535 : 8191);
-		do
-		{
-			dict[next_offset++] = dict[k++];
-		}
-		while (--match_len != 0);
+
+		mppc_copy_match(dict, next_offset, match_off, match_len, mask);
+		next_offset += match_len;
 	}
-	while (1);
 
 	/* store history offset */
 	rdp->mppc_dict.roff = next_offset;
@@ -22,6 +22,16 @@
 
 #include "network.h"
 
+/*
+   Received data goes through a per connection buffer. Each read asks the
+   socket (or TLS, which returns at most one record) for as much as fits, so
+   the TPKT or fast-path header and the body of a PDU, and usually several
+   small PDUs, come from a single system call. Reads larger than the buffer
+   bypass it.
+*/
+
+#define NETWORK_RECV_BUFFER_SIZE	0x10000
+
 /* Initialize and return STREAM.
  * The stream will have room for at least min_size.
  * The tcp layers out stream will be used. */
@@ -30,6 +40,22 @@ STREAM
 network_stream_init(rdpNetwork * net, uint32 min_size)
 {
 	STREAM result = &(net->out);
+#ifndef _WIN32
+	int index;
+
+	/* threads other than the ui thread encode into their own stream */
+	if (net->threaded)
+	{
+		for (index = 0; index < net->num_threads; index++)
+		{
+			if (pthread_equal(net->threads[index], pthread_self()))
+			{
+				result = &(net->thread_out[index]);
+				break;
+			}
+		}
+	}
+#endif
 
 	if (min_size > result->size)
 	{
@@ -214,21 +240,85 @@ network_disconnect(rdpNetwork * net)
 		tls_disconnect(net->tls);
 #endif
 	tcp_disconnect(net->tcp);
+
+	/* anything left belongs to the old connection */
+	net->recv_start = net->recv_end = 0;
 }
 
 void
 network_send(rdpNetwork * net, STREAM s)
 {
+	network_send_gather(net, s, NULL, 0);
+}
+
+/* Send the stream followed by length bytes of data that are not in it.
+   The stream must have room for them after its end, they are copied there
+   for TLS, which would copy them into a single record anyway. */
+void
+network_send_gather(rdpNetwork * net, STREAM s, uint8 * data, int length)
+{
+	if (net->discard)
+		return;
+
+	network_lock(net);
 #ifndef DISABLE_TLS
 	if (net->tls_connected)
 	{
+		if (length > 0)
+		{
+			memcpy(s->end, data, length);
+			s->end += length;
+		}
 		tls_write(net->tls, (char*) s->data, s->end - s->data);
 	}
 	else
 #endif
+	if (length > 0)
+	{
+		tcp_write_gather(net->tcp, (char*) s->data, s->end - s->data, (char*) data, length);
+	}
+	else
 	{
 		tcp_write(net->tcp, (char*) s->data, s->end - s->data);
 	}
+	network_unlock(net);
+}
+
+static int
+network_read(rdpNetwork * net, uint8 * b, int length)
+{
+	int rcvd;
+
+#ifndef DISABLE_TLS
+	if (net->tls_connected)
+	{
+#ifndef _WIN32
+		/* a TLS session is not safe for concurrent reads and writes, wait
+		   for data without the lock so that other threads can keep sending */
+		if (net->threaded)
+		{
+			while (!tls_pending(net->tls) && !tcp_can_recv(net->tcp->sockfd, 100))
+			{
+				if (net->cancel || !tcp_socket_ok(net->tcp->sockfd))
+					return -1;
+			}
+		}
+#endif
+		network_lock(net);
+		rcvd = tls_read(net->tls, (char*) b, length);
+		network_unlock(net);
+		net->stats.reads++;
+	}
+	else
+#endif
+	{
+		rcvd = tcp_read(net->tcp, (char*) b, length);
+	}
+
+	if (rcvd > 0)
+		net->stats.bytes += rcvd;
+
+	return rcvd;
 }
 
 STREAM
@@ -241,6 +331,8 @@ network_recv(rdpNetwork * net, STREAM s, uint32 length)
 
 	if (s == NULL)
 	{
+		net->stats.pdus++;
+
 		/* read into "new" stream */
 		if (length > net->in.size)
 		{
@@ -266,22 +358,36 @@ network_recv(rdpNetwork * net, STREAM s, uint32 length)
 		}
 	}
 
+	if (length <= (uint32) (net->recv_end - net->recv_start))
+		net->stats.buffered++;
+
 	while (length > 0)
 	{
-#ifndef DISABLE_TLS
-		if (net->tls_connected)
+		if (net->recv_start == net->recv_end)
 		{
-			rcvd = tls_read(net->tls, (char*) s->end, length);
-		}
-		else
-#endif
-		{
-			rcvd = tcp_read(net->tcp, (char*) s->end, length);
-		}
+			net->recv_start = net->recv_end = 0;
+
+			if (length >= NETWORK_RECV_BUFFER_SIZE)
+			{
+				rcvd = network_read(net, s->end, length);
+				if (rcvd < 0)
+					return NULL;
 
-		if (rcvd < 0)
-			return NULL;
+				s->end += rcvd;
+				length -= rcvd;
+				continue;
+			}
+
+			rcvd = network_read(net, net->recv_buffer, NETWORK_RECV_BUFFER_SIZE);
+			if (rcvd < 0)
+				return NULL;
+
+			net->recv_end = rcvd;
+		}
 
+		rcvd = MIN(length, (uint32) (net->recv_end - net->recv_start));
+		memcpy(s->end, net->recv_buffer + net->recv_start, rcvd);
+		net->recv_start += rcvd;
 		s->end += rcvd;
 		length -= rcvd;
 	}
@@ -289,6 +395,75 @@ network_recv(rdpNetwork * net, STREAM s, uint32 length)
 	return s;
 }
 
+/* Returns True if received data is waiting to be processed */
+RD_BOOL
+network_pending(rdpNetwork * net)
+{
+	return (net->recv_start != net->recv_end);
+}
+
+/* Prepare for sending from the ui thread and up to NETWORK_MAX_THREADS
+   others. Encryption and transport writes are serialized by the lock. */
+void
+network_set_threaded(rdpNetwork * net)
+{
+#ifndef _WIN32
+	pthread_mutexattr_t attr;
+
+	if (net->threaded)
+		return;
+
+	/* sec_send holds the lock across encryption and network_send */
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&net->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	net->num_threads = 0;
+	net->threaded = 1;
+#endif
+}
+
+/* Give the calling thread its own output stream, call from the thread itself */
+void
+network_attach_thread(rdpNetwork * net)
+{
+#ifndef _WIN32
+	STREAM s;
+
+	network_lock(net);
+	if (net->num_threads < NETWORK_MAX_THREADS)
+	{
+		s = &(net->thread_out[net->num_threads]);
+		if (s->data == NULL)
+		{
+			s->size = 4096;
+			s->data = (uint8 *) xmalloc(s->size);
+		}
+		net->threads[net->num_threads++] = pthread_self();
+	}
+	network_unlock(net);
+#endif
+}
+
+void
+network_lock(rdpNetwork * net)
+{
+#ifndef _WIN32
+	if (net->threaded)
+		pthread_mutex_lock(&net->lock);
+#endif
+}
+
+void
+network_unlock(rdpNetwork * net)
+{
+#ifndef _WIN32
+	if (net->threaded)
+		pthread_mutex_unlock(&net->lock);
+#endif
+}
+
 rdpNetwork*
 network_new(rdpRdp * rdp)
 {
@@ -313,6 +488,8 @@ network_new(rdpRdp * rdp)
 
 		self->out.size = 4096;
 		self->out.data = (uint8 *) xmalloc(self->out.size);
+
+		self->recv_buffer = (uint8 *) xmalloc(NETWORK_RECV_BUFFER_SIZE);
 	}
 
 	return self;
@@ -323,8 +500,18 @@ network_free(rdpNetwork * net)
 {
 	if (net != NULL)
 	{
+#ifndef _WIN32
+		int index;
+
+		for (index = 0; index < NETWORK_MAX_THREADS; index++)
+			xfree(net->thread_out[index].data);
+
+		if (net->threaded)
+			pthread_mutex_destroy(&net->lock);
+#endif
 		xfree(net->in.data);
 		xfree(net->out.data);
+		xfree(net->recv_buffer);
 
 		if (net->tcp != NULL)
 			tcp_free(net->tcp);
@@ -23,6 +23,10 @@
 #include <freerdp/freerdp.h>
 #include <freerdp/types/ui.h>
 
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
 #include "tcp.h"
 #include "tls.h"
 #include "iso.h"
@@ -33,6 +37,9 @@
 #include "credssp.h"
 #include "license.h"
 
+/* most threads that may send on a pipelined connection, besides the ui thread */
+#define NETWORK_MAX_THREADS	2
+
 struct rdp_network
 {
 	int port;
@@ -50,6 +57,23 @@ struct rdp_network
 	struct rdp_mcs * mcs;
 	struct rdp_credssp * credssp;
 	struct rdp_license * license;
+
+	/* data received ahead of what the layers above have asked for */
+	uint8 * recv_buffer;
+	int recv_start;
+	int recv_end;
+	RD_NETWORK_STATS stats;
+	int discard; /* a recording is being replayed, nothing is sent */
+
+#ifndef _WIN32
+	/* pipelined sessions send from several threads, see network_set_threaded */
+	int threaded;
+	int cancel; /* makes threaded reads that are waiting for data fail */
+	pthread_mutex_t lock;
+	int num_threads;
+	pthread_t threads[NETWORK_MAX_THREADS];
+	struct stream thread_out[NETWORK_MAX_THREADS];
+#endif
 };
 typedef struct rdp_network rdpNetwork;
 
@@ -62,8 +86,20 @@ network_disconnect(rdpNetwork * net);
 
 void
 network_send(rdpNetwork * net, STREAM s);
+void
+network_send_gather(rdpNetwork * net, STREAM s, uint8 * data, int length);
 STREAM
 network_recv(rdpNetwork * net, STREAM s, uint32 length);
+RD_BOOL
+network_pending(rdpNetwork * net);
+void
+network_set_threaded(rdpNetwork * net);
+void
+network_attach_thread(rdpNetwork * net);
+void
+network_lock(rdpNetwork * net);
+void
+network_unlock(rdpNetwork * net);
 
 rdpNetwork*
 network_new(rdpRdp * rdp);
@@ -22,6 +22,7 @@
 #include "pstcache.h"
 #include "cache.h"
 #include "bitmap.h"
+#include "dlist.h"
 #include <freerdp/rdpset.h>
 
 #include "orders.h"
@@ -248,7 +249,10 @@ process_dstblt(rdpOrders * orders, STREAM s, DSTBLT_ORDER * os, uint32 present,
 	DEBUG_ORDERS("DESTBLT(op=0x%x,x=%d,y=%d,cx=%d,cy=%d)",
 	      os->opcode, os->x, os->y, os->cx, os->cy);
 
-	ui_destblt(orders->rdp->inst, os->opcode, os->x, os->y, os->cx, os->cy);
+	if (orders->dlist != NULL)
+		dlist_destblt(orders->dlist, os->opcode, os->x, os->y, os->cx, os->cy);
+	else
+		ui_destblt(orders->rdp->inst, os->opcode, os->x, os->y, os->cx, os->cy);
 }
 
 /* Process a pattern blt order */
@@ -285,8 +289,12 @@ process_patblt(rdpOrders * orders, STREAM s, PATBLT_ORDER * os, uint32 present,
 
 	setup_brush(orders, &brush, &os->brush);
 
-	ui_patblt(orders->rdp->inst, os->opcode, os->x, os->y, os->cx, os->cy,
-		  &brush, os->bgcolor, os->fgcolor);
+	if (orders->dlist != NULL)
+		dlist_patblt(orders->dlist, os->opcode, os->x, os->y, os->cx, os->cy,
+			&brush, os->bgcolor, os->fgcolor);
+	else
+		ui_patblt(orders->rdp->inst, os->opcode, os->x, os->y, os->cx, os->cy,
+			  &brush, os->bgcolor, os->fgcolor);
 }
 
 /* Process a multi pattern blt order */
@@ -377,8 +385,12 @@ process_multipatblt(rdpOrders * orders, STREAM s, MULTIPATBLT_ORDER * os, uint32
 
 		flags <<= 4;
 
-		ui_patblt(orders->rdp->inst, os->opcode, rects[next].l, rects[next].t,
-			rects[next].w, rects[next].h, &brush, os->bgcolor, os->fgcolor);
+		if (orders->dlist != NULL)
+			dlist_patblt(orders->dlist, os->opcode, rects[next].l, rects[next].t,
+				rects[next].w, rects[next].h, &brush, os->bgcolor, os->fgcolor);
+		else
+			ui_patblt(orders->rdp->inst, os->opcode, rects[next].l, rects[next].t,
+				rects[next].w, rects[next].h, &brush, os->bgcolor, os->fgcolor);
 	}
 }
 
@@ -410,8 +422,12 @@ process_scrblt(rdpOrders * orders, STREAM s, SCRBLT_ORDER * os, uint32 present,
 	DEBUG_ORDERS("SCRBLT(op=0x%x,x=%d,y=%d,cx=%d,cy=%d,srcx=%d,srcy=%d)",
 	       os->opcode, os->x, os->y, os->cx, os->cy, os->srcx, os->srcy);
 
-	ui_screenblt(orders->rdp->inst, os->opcode, os->x, os->y, os->cx, os->cy,
-		     os->srcx, os->srcy);
+	if (orders->dlist != NULL)
+		dlist_screenblt(orders->dlist, os->opcode, os->x, os->y, os->cx, os->cy,
+			os->srcx, os->srcy);
+	else
+		ui_screenblt(orders->rdp->inst, os->opcode, os->x, os->y, os->cx, os->cy,
+			     os->srcx, os->srcy);
 }
 
 /* Process a lineto order */
@@ -450,8 +466,12 @@ process_lineto(rdpOrders * orders, STREAM s, LINETO_ORDER * os, uint32 present,
 		return;
 	}
 
-	ui_line(orders->rdp->inst, os->opcode, os->startx, os->starty, os->endx,
-		os->endy, &os->pen);
+	if (orders->dlist != NULL)
+		dlist_line(orders->dlist, os->opcode, os->startx, os->starty, os->endx,
+			os->endy, &os->pen);
+	else
+		ui_line(orders->rdp->inst, os->opcode, os->startx, os->starty, os->endx,
+			os->endy, &os->pen);
 }
 
 /* Process an opaque rectangle order */
@@ -492,7 +512,10 @@ process_opaquerect(rdpOrders * orders, STREAM s, OPAQUERECT_ORDER * os, uint32 p
 
 	DEBUG_ORDERS("OPAQUERECT(x=%d,y=%d,cx=%d,cy=%d,fg=0x%x)", os->x, os->y, os->cx, os->cy, os->color);
 
-	ui_rect(orders->rdp->inst, os->x, os->y, os->cx, os->cy, os->color);
+	if (orders->dlist != NULL)
+		dlist_rect(orders->dlist, os->x, os->y, os->cx, os->cy, os->color);
+	else
+		ui_rect(orders->rdp->inst, os->x, os->y, os->cx, os->cy, os->color);
 }
 
 /* Process a multi opaque rectangle order */
@@ -588,8 +611,12 @@ process_multiopaquerect(rdpOrders * orders, STREAM s, MULTIOPAQUERECT_ORDER * os
 
 		flags <<= 4;
 
-		ui_rect(orders->rdp->inst, rects[next].l, rects[next].t,
-			rects[next].w, rects[next].h, os->color);
+		if (orders->dlist != NULL)
+			dlist_rect(orders->dlist, rects[next].l, rects[next].t,
+				rects[next].w, rects[next].h, os->color);
+		else
+			ui_rect(orders->rdp->inst, rects[next].l, rects[next].t,
+				rects[next].w, rects[next].h, os->color);
 	}
 }
 
@@ -674,8 +701,12 @@ process_memblt(rdpOrders * orders, STREAM s, MEMBLT_ORDER * os, uint32 present,
 	if (bitmap == NULL)
 		return;
 
-	ui_memblt(orders->rdp->inst, os->opcode, os->x, os->y, os->cx, os->cy,
-		  bitmap, os->srcx, os->srcy);
+	if (orders->dlist != NULL)
+		dlist_memblt(orders->dlist, os->opcode, os->x, os->y, os->cx, os->cy,
+			bitmap, os->srcx, os->srcy);
+	else
+		ui_memblt(orders->rdp->inst, os->opcode, os->x, os->y, os->cx, os->cy,
+			  bitmap, os->srcx, os->srcy);
 }
 
 /* Process a mem3blt order */
@@ -1059,11 +1090,21 @@ process_ellipse_cb(rdpOrders * orders, STREAM s, ELLIPSE_CB_ORDER * os, uint32 p
 		   os->right - os->left, os->bottom - os->top, &brush, os->bgcolor, os->fgcolor);
 }
 
+static void
+flush_glyph_run(rdpOrders * orders)
+{
+	if (orders->glyph_run_count > 0)
+		ui_draw_glyph_run(orders->rdp->inst, orders->glyph_run, orders->glyph_run_count);
+
+	orders->glyph_run_count = 0;
+}
+
 static void
 do_glyph(rdpOrders * orders, uint8 * ttext, int * index, int * x, int * y, uint8 flags, uint8 font)
 {
 	int xyoffset, lindex = *index, lx = *x, ly = *y, gx, gy;
 	FONTGLYPH * glyph;
+	RD_GLYPH_POS * pos;
 
 	glyph = cache_get_font(orders->rdp->cache, font, ttext[lindex]);
 	if (!(flags & TEXT2_IMPLICIT_X))
@@ -1089,8 +1130,16 @@ do_glyph(rdpOrders * orders, uint8 * ttext, int * index, int * x, int * y, uint8
 	{
 		gx = lx + glyph->offset;
 		gy = ly + glyph->baseline;
-		ui_draw_glyph(orders->rdp->inst, gx, gy, glyph->width, glyph->height,
-			      glyph->pixmap);
+
+		if (orders->glyph_run_count == MAX_GLYPH_RUN)
+			flush_glyph_run(orders);
+
+		pos = &orders->glyph_run[orders->glyph_run_count++];
+		pos->x = gx;
+		pos->y = gy;
+		pos->cx = glyph->width;
+		pos->cy = glyph->height;
+		pos->glyph = glyph->pixmap;
 		if (flags & TEXT2_IMPLICIT_X)
 			lx += glyph->width;
 	}
@@ -1192,6 +1241,7 @@ draw_text(rdpOrders * orders, uint8 font, uint8 flags, uint8 opcode, int mixmode
 				break;
 		}
 	}
+	flush_glyph_run(orders);
 	if (boxcx > 1)
 	{
 		ui_end_draw_glyphs(orders->rdp->inst, boxx, boxy, boxcx, boxcy);
@@ -1592,7 +1642,7 @@ process_cache_bitmap_uncompressed(rdpOrders * orders, STREAM s)
 	}
 
 	bitmap = ui_create_bitmap(orders->rdp->inst, width, height, inverted);
-	cache_put_bitmap(orders->rdp->cache, cache_id, cache_idx, bitmap);
+	cache_put_bitmap(orders->rdp->cache, cache_id, cache_idx, bitmap, size);
 }
 
 /* Process a bitmap cache order */
@@ -1651,7 +1701,7 @@ process_cache_bitmap_compressed(rdpOrders * orders, STREAM s, uint16 flags)
 	if (bitmap_decompress(orders->rdp->inst, bmpdata, width, height, data, size, Bpp))
 	{
 		bitmap = ui_create_bitmap(orders->rdp->inst, width, height, bmpdata);
-		cache_put_bitmap(orders->rdp->cache, cache_id, cache_idx, bitmap);
+		cache_put_bitmap(orders->rdp->cache, cache_id, cache_idx, bitmap, buffer_size);
 	}
 	else
 	{
@@ -1735,7 +1785,7 @@ process_cache_bitmap_rev2(rdpOrders * orders, STREAM s, uint16 flags, RD_BOOL co
 
 	if (bitmap)
 	{
-		cache_put_bitmap(orders->rdp->cache, cache_id, cache_idx, bitmap);
+		cache_put_bitmap(orders->rdp->cache, cache_id, cache_idx, bitmap, size);
 		if (flags & PERSIST)
 			pstcache_save_bitmap(orders->rdp->pcache, cache_id, cache_idx, bitmap_id,
 					     width, height, width * height * Bpp, bmpdata);
@@ -1955,13 +2005,13 @@ process_create_offscr_bitmap(rdpOrders * orders, STREAM s)
 			in_uint16_le(s, free_idx);
 			bitmap = cache_get_bitmap(orders->rdp->cache, 255, free_idx);
 			ui_destroy_surface(orders->rdp->inst, bitmap);
-			cache_put_bitmap(orders->rdp->cache, 255, free_idx, NULL);
+			cache_put_bitmap(orders->rdp->cache, 255, free_idx, NULL, 0);
 		}
 	}
 	idx &= ~0x8000;
 	bitmap = cache_get_bitmap(orders->rdp->cache, 255, idx);
 	bitmap = ui_create_surface(orders->rdp->inst, width, height, bitmap);
-	cache_put_bitmap(orders->rdp->cache, 255, idx, bitmap);
+	cache_put_bitmap(orders->rdp->cache, 255, idx, bitmap, 0);
 }
 
 /* Process a non-standard order */
@@ -2045,6 +2095,27 @@ process_secondary_order(rdpOrders * orders, STREAM s)
 	s->p = next_order;
 }
 
+/* Primary orders that can be held in a display list */
+static RD_BOOL
+order_in_display_list(uint8 order_type)
+{
+	switch (order_type)
+	{
+		case RDP_ORDER_DSTBLT:
+		case RDP_ORDER_PATBLT:
+		case RDP_ORDER_MULTIPATBLT:
+		case RDP_ORDER_SCRBLT:
+		case RDP_ORDER_LINETO:
+		case RDP_ORDER_OPAQUERECT:
+		case RDP_ORDER_MULTIOPAQUERECT:
+		case RDP_ORDER_MEMBLT:
+			return True;
+
+		default:
+			return False;
+	}
+}
+
 /* Process an order PDU */
 void
 process_orders(rdpOrders * orders, STREAM s, uint16 num_orders)
@@ -2054,6 +2125,10 @@ process_orders(rdpOrders * orders, STREAM s, uint16 num_orders)
 	uint8 order_flags;
 	int size, processed = 0;
 	RD_BOOL delta;
+	RD_BOOL listed;
+
+	if (orders->dlist == NULL && orders->rdp->settings->display_list)
+		orders->dlist = dlist_new();
 
 	while (processed < num_orders)
 	{
@@ -2061,10 +2136,13 @@ process_orders(rdpOrders * orders, STREAM s, uint16 num_orders)
 
 		if (!(order_flags & RDP_ORDER_CTL_STANDARD))
 		{
+			/* the list may use the surfaces and caches these change */
+			orders_flush(orders);
 			process_alternate_secondary_order(orders, s, order_flags);
 		}
 		else if (order_flags & RDP_ORDER_CTL_SECONDARY)
 		{
+			orders_flush(orders);
 			process_secondary_order(orders, s);
 		}
 		else
@@ -2099,16 +2177,31 @@ process_orders(rdpOrders * orders, STREAM s, uint16 num_orders)
 
 			rdp_in_present(s, &present, order_flags, size);
 
+			listed = (orders->dlist != NULL) && order_in_display_list(os->order_type);
+
+			if (!listed)
+				orders_flush(orders);
+
 			if (order_flags & RDP_ORDER_CTL_BOUNDS)
 			{
 				if (!(order_flags & RDP_ORDER_CTL_ZERO_BOUNDS_DELTA))
 					rdp_parse_bounds(s, &os->bounds);
 
-				ui_set_clip(orders->rdp->inst, os->bounds.left,
-					    os->bounds.top,
-					    os->bounds.right -
-					    os->bounds.left + 1,
-					    os->bounds.bottom - os->bounds.top + 1);
+				if (listed)
+					dlist_set_clip(orders->dlist, os->bounds.left,
+						os->bounds.top,
+						os->bounds.right - os->bounds.left + 1,
+						os->bounds.bottom - os->bounds.top + 1);
+				else
+					ui_set_clip(orders->rdp->inst, os->bounds.left,
+						    os->bounds.top,
+						    os->bounds.right -
+						    os->bounds.left + 1,
+						    os->bounds.bottom - os->bounds.top + 1);
+			}
+			else if (listed)
+			{
+				dlist_reset_clip(orders->dlist);
 			}
 
 			delta = order_flags & RDP_ORDER_CTL_DELTA_COORDINATES;
@@ -2192,7 +2285,8 @@ process_orders(rdpOrders * orders, STREAM s, uint16 num_orders)
 					return;
 			}
 
-			if (order_flags & RDP_ORDER_CTL_BOUNDS)
+			/* listed orders keep their clip until the next one changes it */
+			if ((order_flags & RDP_ORDER_CTL_BOUNDS) && !listed)
 				ui_reset_clip(orders->rdp->inst);
 		}
 
@@ -2206,11 +2300,21 @@ reset_order_state(rdpOrders * orders)
 {
 	RDP_ORDER_STATE * os = (RDP_ORDER_STATE *) (orders->order_state);
 
+	orders_flush(orders);
 	memset(os, 0, sizeof(RDP_ORDER_STATE));
 	os->order_type = RDP_ORDER_PATBLT;
 	ui_set_surface(orders->rdp->inst, NULL);
 }
 
+/* Draw the orders held in the display list, at the end of an update or
+   before anything is drawn without it */
+void
+orders_flush(rdpOrders * orders)
+{
+	if (orders->dlist != NULL)
+		dlist_flush(orders->dlist, orders->rdp->inst);
+}
+
 rdpOrders *
 orders_new(struct rdp_rdp * rdp)
 {
@@ -2239,6 +2343,7 @@ orders_free(rdpOrders * orders)
 	{
 		xfree(orders->order_state);
 		xfree(orders->buffer);
+		dlist_free(orders->dlist);
 		xfree(orders);
 	}
 }
@@ -47,12 +47,18 @@ typedef struct _RECTANGLE
 	sint16 l, t, w, h;
 } RECTANGLE;
 
+/* glyphs of a text order drawn by one call of ui_draw_glyph_run */
+#define MAX_GLYPH_RUN 256
+
 struct rdp_orders
 {
 	struct rdp_rdp *rdp;
 	void *order_state;
 	void *buffer;
 	size_t buffer_size;
+	RD_GLYPH_POS glyph_run[MAX_GLYPH_RUN];
+	int glyph_run_count;
+	struct rdp_display_list *dlist; /* NULL unless settings->display_list */
 };
 typedef struct rdp_orders rdpOrders;
 
@@ -512,6 +518,7 @@ RDP_CACHE_COLOR_TABLE_ORDER;
 
 void process_orders(rdpOrders * orders, STREAM s, uint16 num_orders);
 void reset_order_state(rdpOrders * orders);
+void orders_flush(rdpOrders * orders);
 rdpOrders *orders_new(struct rdp_rdp *rdp);
 void orders_free(rdpOrders * orders);
 
@@ -0,0 +1,398 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   Pipelined receive, decode and present
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+   A pipelined session splits the work of rdp_check_fds over three threads.
+
+   The network thread reads and decrypts PDUs with sec_recv. Licensing and
+   virtual channel data are handled there as before, everything else is
+   copied into a bounded queue. When the queue is full the network thread
+   stops reading, which pushes back on the server through TCP.
+
+   The decode thread runs rdp_loop on the queued PDUs in the order they were
+   received, so orders, caches and bitmap updates see exactly the sequence
+   they would see on a single thread. It draws into the client surface and
+   marks it dirty at the end of every update instead of presenting it.
+
+   The ui thread only presents. The surface belongs to the decode thread
+   while it works on a PDU; pipeline_check waits for the next PDU boundary,
+   keeps the decode thread from starting another PDU, and calls the end and
+   begin update callbacks of the client, which push the damage collected
+   since the last present.
+*/
+
+#include "frdp.h"
+#include "rdp.h"
+#include "stream.h"
+#include "network.h"
+#include "security.h"
+#include <freerdp/freerdp.h>
+#include <freerdp/utils/memory.h>
+#include <freerdp/utils/wait_obj.h>
+
+#include "pipeline.h"
+
+#ifndef _WIN32
+
+#include <pthread.h>
+
+struct rdp_pipeline
+{
+	rdpRdp * rdp;
+	pthread_t net_thread;
+	pthread_t decode_thread;
+	int decode_started;
+	struct wait_obj * present_event;
+
+	/* everything below is protected by mutex */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int terminate;
+	int net_done;
+	int decode_done;
+
+	/* received PDUs, oldest first */
+	STREAM queue[PIPELINE_QUEUE_SIZE];
+	secRecvType types[PIPELINE_QUEUE_SIZE];
+	int head;
+	int count;
+
+	/* streams to reuse, the queue plus the one being decoded and filled */
+	STREAM free_streams[PIPELINE_QUEUE_SIZE + 2];
+	int num_free;
+	STREAM current;
+
+	/* the surface belongs to the decode thread unless presenting */
+	int decoding;
+	int presenting;
+	int dirty;
+};
+
+/* Copy the payload of a received PDU into the queue, False when stopping */
+static RD_BOOL
+pipeline_push(rdpPipeline * pl, STREAM s, secRecvType type)
+{
+	STREAM copy;
+	int length;
+
+	pthread_mutex_lock(&pl->mutex);
+	while ((pl->count == PIPELINE_QUEUE_SIZE) && !pl->terminate)
+		pthread_cond_wait(&pl->cond, &pl->mutex);
+
+	if (pl->terminate)
+	{
+		pthread_mutex_unlock(&pl->mutex);
+		return False;
+	}
+
+	copy = (pl->num_free > 0) ? pl->free_streams[--pl->num_free] : NULL;
+	pthread_mutex_unlock(&pl->mutex);
+
+	length = (int) (s->end - s->p);
+
+	if (copy == NULL)
+		copy = stream_new(length);
+	else
+		stream_init(copy, length);
+
+	memcpy(copy->data, s->p, length);
+	copy->end = copy->data + length;
+	copy->rdp_hdr = copy->data;
+
+	pthread_mutex_lock(&pl->mutex);
+	pl->queue[(pl->head + pl->count) % PIPELINE_QUEUE_SIZE] = copy;
+	pl->types[(pl->head + pl->count) % PIPELINE_QUEUE_SIZE] = type;
+	pl->count++;
+	pthread_cond_broadcast(&pl->cond);
+	pthread_mutex_unlock(&pl->mutex);
+
+	return True;
+}
+
+static void *
+pipeline_net_thread(void * arg)
+{
+	rdpPipeline * pl = (rdpPipeline *) arg;
+	rdpRdp * rdp = pl->rdp;
+	secRecvType type;
+	STREAM s;
+
+	network_attach_thread(rdp->net);
+
+	while ((s = sec_recv(rdp->sec, &type)) != NULL)
+	{
+		/* already passed on to the channels by sec_recv */
+		if (type == SEC_RECV_IOCHANNEL)
+			continue;
+
+		if (!pipeline_push(pl, s, type))
+			break;
+	}
+
+	pthread_mutex_lock(&pl->mutex);
+	pl->net_done = 1;
+	pthread_cond_broadcast(&pl->cond);
+	pthread_mutex_unlock(&pl->mutex);
+
+	return NULL;
+}
+
+static void *
+pipeline_decode_thread(void * arg)
+{
+	rdpPipeline * pl = (rdpPipeline *) arg;
+	rdpRdp * rdp = pl->rdp;
+	RD_BOOL deactivated;
+
+	network_attach_thread(rdp->net);
+
+	while (rdp_loop(rdp, &deactivated))
+		;
+
+	pthread_mutex_lock(&pl->mutex);
+	pl->decoding = 0;
+	pl->decode_done = 1;
+	pthread_cond_broadcast(&pl->cond);
+	pthread_mutex_unlock(&pl->mutex);
+
+	/* let the ui thread notice that the session is over */
+	wait_obj_set(pl->present_event);
+
+	return NULL;
+}
+
+/* Next PDU for rdp_recv, called on the decode thread. Blocks while the ui
+   thread is presenting or nothing has been received, NULL at the end. */
+STREAM
+pipeline_recv(rdpPipeline * pl, secRecvType * type)
+{
+	STREAM s;
+
+	pthread_mutex_lock(&pl->mutex);
+
+	/* rdp_recv is done with the previous one */
+	if (pl->current != NULL)
+	{
+		pl->free_streams[pl->num_free++] = pl->current;
+		pl->current = NULL;
+	}
+
+	pl->decoding = 0;
+	pthread_cond_broadcast(&pl->cond);
+
+	while (!pl->terminate && (pl->presenting || ((pl->count == 0) && !pl->net_done)))
+		pthread_cond_wait(&pl->cond, &pl->mutex);
+
+	if (pl->terminate || (pl->count == 0))
+	{
+		pthread_mutex_unlock(&pl->mutex);
+		return NULL;
+	}
+
+	s = pl->queue[pl->head];
+	*type = pl->types[pl->head];
+	pl->head = (pl->head + 1) % PIPELINE_QUEUE_SIZE;
+	pl->count--;
+
+	pl->current = s;
+	pl->decoding = 1;
+	pthread_cond_broadcast(&pl->cond);
+	pthread_mutex_unlock(&pl->mutex);
+
+	return s;
+}
+
+/* Called on the decode thread in place of the end update callback */
+void
+pipeline_end_update(rdpPipeline * pl)
+{
+	pthread_mutex_lock(&pl->mutex);
+	pl->dirty = 1;
+	pthread_mutex_unlock(&pl->mutex);
+
+	wait_obj_set(pl->present_event);
+}
+
+int
+pipeline_get_fds(rdpPipeline * pl, void ** read_fds, int * read_count)
+{
+	return wait_obj_get_fds(pl->present_event, read_fds, read_count);
+}
+
+/* Present what has been decoded so far, called on the ui thread.
+   Returns False once the decode thread has stopped. */
+RD_BOOL
+pipeline_check(rdpPipeline * pl)
+{
+	rdpInst * inst = pl->rdp->inst;
+	int dirty;
+	int done;
+
+	if (!wait_obj_is_set(pl->present_event))
+		return True;
+
+	wait_obj_clear(pl->present_event);
+
+	pthread_mutex_lock(&pl->mutex);
+	pl->presenting = 1;
+	while (pl->decoding)
+		pthread_cond_wait(&pl->cond, &pl->mutex);
+	dirty = pl->dirty;
+	done = pl->decode_done;
+	pl->dirty = 0;
+	pthread_mutex_unlock(&pl->mutex);
+
+	if (dirty)
+	{
+		inst->ui_end_update(inst);
+		inst->ui_begin_update(inst);
+	}
+
+	pthread_mutex_lock(&pl->mutex);
+	pl->presenting = 0;
+	pthread_cond_broadcast(&pl->cond);
+	pthread_mutex_unlock(&pl->mutex);
+
+	return !done;
+}
+
+rdpPipeline *
+pipeline_new(rdpRdp * rdp)
+{
+	rdpPipeline * self;
+
+	self = (rdpPipeline *) xmalloc(sizeof(rdpPipeline));
+	if (self == NULL)
+		return NULL;
+
+	memset(self, 0, sizeof(rdpPipeline));
+	self->rdp = rdp;
+	self->present_event = wait_obj_new("rdp_present");
+	if (self->present_event == NULL)
+	{
+		xfree(self);
+		return NULL;
+	}
+
+	pthread_mutex_init(&self->mutex, NULL);
+	pthread_cond_init(&self->cond, NULL);
+
+	network_set_threaded(rdp->net);
+	rdp->net->cancel = 0;
+
+	/* rdp_recv reads from the queue from now on */
+	rdp->pipeline = self;
+
+	if (pthread_create(&self->net_thread, NULL, pipeline_net_thread, self) != 0)
+	{
+		rdp->pipeline = NULL;
+		pthread_cond_destroy(&self->cond);
+		pthread_mutex_destroy(&self->mutex);
+		wait_obj_free(self->present_event);
+		xfree(self);
+		return NULL;
+	}
+
+	if (pthread_create(&self->decode_thread, NULL, pipeline_decode_thread, self) == 0)
+	{
+		self->decode_started = 1;
+	}
+	else
+	{
+		/* nothing will be decoded, end the session */
+		self->decode_done = 1;
+		wait_obj_set(self->present_event);
+	}
+
+	return self;
+}
+
+void
+pipeline_free(rdpPipeline * pl)
+{
+	int index;
+
+	if (pl == NULL)
+		return;
+
+	pthread_mutex_lock(&pl->mutex);
+	pl->terminate = 1;
+	pthread_cond_broadcast(&pl->cond);
+	pthread_mutex_unlock(&pl->mutex);
+
+	/* wakes the network thread up if it is waiting for data */
+	pl->rdp->net->cancel = 1;
+
+	pthread_join(pl->net_thread, NULL);
+	if (pl->decode_started)
+		pthread_join(pl->decode_thread, NULL);
+
+	/* rdp_recv must not look at the queued streams again */
+	pl->rdp->pipeline = NULL;
+	pl->rdp->rdp_s = NULL;
+
+	for (index = 0; index < pl->count; index++)
+		stream_delete(pl->queue[(pl->head + index) % PIPELINE_QUEUE_SIZE]);
+	for (index = 0; index < pl->num_free; index++)
+		stream_delete(pl->free_streams[index]);
+	stream_delete(pl->current);
+
+	pthread_cond_destroy(&pl->cond);
+	pthread_mutex_destroy(&pl->mutex);
+	wait_obj_free(pl->present_event);
+	xfree(pl);
+}
+
+#else
+
+/* no threads on this platform, sessions always run on the ui thread */
+
+rdpPipeline *
+pipeline_new(rdpRdp * rdp)
+{
+	return NULL;
+}
+
+void
+pipeline_free(rdpPipeline * pl)
+{
+}
+
+STREAM
+pipeline_recv(rdpPipeline * pl, secRecvType * type)
+{
+	return NULL;
+}
+
+void
+pipeline_end_update(rdpPipeline * pl)
+{
+}
+
+int
+pipeline_get_fds(rdpPipeline * pl, void ** read_fds, int * read_count)
+{
+	return 0;
+}
+
+RD_BOOL
+pipeline_check(rdpPipeline * pl)
+{
+	return False;
+}
+
+#endif
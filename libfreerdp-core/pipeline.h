@@ -0,0 +1,42 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   Pipelined receive, decode and present
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __PIPELINE_H
+#define __PIPELINE_H
+
+#include "rdp.h"
+#include "security.h"
+
+/* received PDUs waiting for the decode thread before the network thread blocks */
+#define PIPELINE_QUEUE_SIZE	64
+
+typedef struct rdp_pipeline rdpPipeline;
+
+rdpPipeline *
+pipeline_new(rdpRdp * rdp);
+void
+pipeline_free(rdpPipeline * pl);
+STREAM
+pipeline_recv(rdpPipeline * pl, secRecvType * type);
+void
+pipeline_end_update(rdpPipeline * pl);
+int
+pipeline_get_fds(rdpPipeline * pl, void ** read_fds, int * read_count);
+RD_BOOL
+pipeline_check(rdpPipeline * pl);
+
+#endif
@@ -22,35 +22,228 @@
 #include "cache.h"
 #include <freerdp/rdpset.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
 #include "pstcache.h"
 
+/*
+   Every persistent cache is kept in two files that are mapped into memory.
+   The index file holds a small header and the cell headers (key, size and MRU
+   stamp) of all cells, the cell file holds the bitmap data at fixed offsets.
+   Enumerating the keys at connect time only touches the index, loading a cell
+   hands out a pointer into the mapping and stamp updates are plain stores that
+   the kernel writes back lazily.
+*/
+
 #define MAX_CELL_SIZE		0x1000	/* pixels */
 
-#define IS_PERSISTENT(id) (id < 8 && pcache->pstcache_fd[id] > 0)
+#define PSTCACHE_MAGIC		0x43545350	/* "PSTC" */
+#define PSTCACHE_VERSION	1
+
+#define NUM_ELEMENTS(array) (sizeof(array) / sizeof(array[0]))
+#define IS_PERSISTENT(id) (id < 8 && pcache->pstcache[id].index != NULL)
+
+#ifndef _WIN32
+
+/* Get the path of a cache file in ~/.freerdp/cache, creating the directories */
+static RD_BOOL
+pstcache_get_filename(char * filename, int size, uint8 cache_id, int Bpp, const char * ext)
+{
+	char * home;
+	struct stat st;
+
+	home = getenv("HOME");
+	if (home == NULL)
+		return False;
+
+	snprintf(filename, size, "%s/.freerdp", home);
+	if (stat(filename, &st) != 0 && mkdir(filename, 0700) != 0)
+		return False;
+
+	snprintf(filename, size, "%s/.freerdp/cache", home);
+	if (stat(filename, &st) != 0 && mkdir(filename, 0700) != 0)
+		return False;
+
+	snprintf(filename, size, "%s/.freerdp/cache/pstcache_%d_%d.%s", home, cache_id, Bpp, ext);
+	return True;
+}
+
+/* Open a cache file and map size bytes of it, the file is resized if needed */
+static void *
+pstcache_map_file(const char * filename, size_t size, int * fd, RD_BOOL * created)
+{
+	void * map;
+	struct stat st;
+
+	*fd = open(filename, O_RDWR | O_CREAT, 0600);
+	if (*fd == -1)
+		return NULL;
+
+	if (fstat(*fd, &st) != 0)
+		goto fail;
+
+	*created = (st.st_size != size);
+	if (*created)
+	{
+		if (ftruncate(*fd, 0) != 0 || ftruncate(*fd, size) != 0)
+			goto fail;
+	}
+
+	/* stores into a mapping get SIGBUS when the disk is full, so reserve the
+	   blocks now, this also fills the holes of files left sparse before */
+	if (posix_fallocate(*fd, 0, size) != 0)
+		goto fail;
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+	if (map == MAP_FAILED)
+		goto fail;
+
+	return map;
+
+fail:
+	close(*fd);
+	*fd = -1;
+	return NULL;
+}
+
+/* Take an exclusive lock on a cache file, so two sessions don't share it */
+static RD_BOOL
+pstcache_lock_file(int fd)
+{
+	return (flock(fd, LOCK_EX | LOCK_NB) == 0);
+}
+
+static void
+pstcache_close(rdpPcache * pcache, uint8 cache_id)
+{
+	PSTCACHE_FILE * pstcache = &pcache->pstcache[cache_id];
+
+	if (pstcache->index != NULL)
+	{
+		/* the stamps are only stores, start writing them back now */
+		msync(pstcache->index, sizeof(PSTCACHE_INDEX), MS_ASYNC);
+		munmap(pstcache->index, sizeof(PSTCACHE_INDEX));
+		pstcache->index = NULL;
+	}
+
+	if (pstcache->cells != NULL)
+	{
+		munmap(pstcache->cells, (size_t) pstcache->cell_size * BMPCACHE2_NUM_PSTCELLS);
+		pstcache->cells = NULL;
+	}
+
+	if (pstcache->index_fd != -1)
+		close(pstcache->index_fd);
+	if (pstcache->cells_fd != -1)
+		close(pstcache->cells_fd);
+
+	pstcache->index_fd = -1;
+	pstcache->cells_fd = -1;
+}
+
+static RD_BOOL
+pstcache_open(rdpPcache * pcache, uint8 cache_id)
+{
+	char filename[512];
+	RD_BOOL created;
+	PSTCACHE_INDEX * index;
+	PSTCACHE_FILE * pstcache = &pcache->pstcache[cache_id];
+
+	pstcache->cell_size = pcache->pstcache_Bpp * MAX_CELL_SIZE;
+
+	if (!pstcache_get_filename(filename, sizeof(filename), cache_id, pcache->pstcache_Bpp, "idx"))
+	{
+		DEBUG_CACHE("failed to get/make cache directory!");
+		return False;
+	}
+	DEBUG_CACHE("persistent bitmap cache index: %s", filename);
+
+	index = (PSTCACHE_INDEX *) pstcache_map_file(filename, sizeof(PSTCACHE_INDEX),
+		&pstcache->index_fd, &created);
+	if (index == NULL)
+		return False;
+	pstcache->index = index;
+
+	if (!pstcache_lock_file(pstcache->index_fd))
+	{
+		ui_warning(pcache->rdp->inst, "Persistent bitmap caching is disabled. (The file is already in use)\n");
+		pstcache_close(pcache, cache_id);
+		return False;
+	}
+
+	if (created || index->magic != PSTCACHE_MAGIC || index->version != PSTCACHE_VERSION ||
+		index->Bpp != pcache->pstcache_Bpp || index->num_cells != BMPCACHE2_NUM_PSTCELLS ||
+		index->cell_size != pstcache->cell_size)
+	{
+		DEBUG_CACHE("resetting persistent bitmap cache %d", cache_id);
+		memset(index, 0, sizeof(PSTCACHE_INDEX));
+		index->magic = PSTCACHE_MAGIC;
+		index->version = PSTCACHE_VERSION;
+		index->Bpp = pcache->pstcache_Bpp;
+		index->num_cells = BMPCACHE2_NUM_PSTCELLS;
+		index->cell_size = pstcache->cell_size;
+	}
+
+	pstcache_get_filename(filename, sizeof(filename), cache_id, pcache->pstcache_Bpp, "dat");
+	pstcache->cells = (uint8 *) pstcache_map_file(filename,
+		(size_t) pstcache->cell_size * BMPCACHE2_NUM_PSTCELLS, &pstcache->cells_fd, &created);
+	if (pstcache->cells == NULL)
+	{
+		pstcache_close(pcache, cache_id);
+		return False;
+	}
+
+	/* the cell data is gone, so are the cells */
+	if (created)
+		memset(index->cells, 0, sizeof(index->cells));
+
+	return True;
+}
+
+#else
+
+static void
+pstcache_close(rdpPcache * pcache, uint8 cache_id)
+{
+}
+
+static RD_BOOL
+pstcache_open(rdpPcache * pcache, uint8 cache_id)
+{
+	return False;
+}
+
+#endif
+
+RD_BOOL
+pstcache_is_persistent(rdpPcache * pcache, uint8 cache_id)
+{
+	return IS_PERSISTENT(cache_id);
+}
 
 /* Update mru stamp/index for a bitmap */
 void
 pstcache_touch_bitmap(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx, uint32 stamp)
 {
-	int fd;
-
 	if (!IS_PERSISTENT(cache_id) || cache_idx >= BMPCACHE2_NUM_PSTCELLS)
 		return;
 
-	fd = pcache->pstcache_fd[cache_id];
-	rd_lseek_file(fd, 12 + cache_idx *
-			(pcache->pstcache_Bpp * MAX_CELL_SIZE + sizeof(CELLHEADER)));
-	rd_write_file(fd, &stamp, sizeof(stamp));
+	pcache->pstcache[cache_id].index->cells[cache_idx].stamp = stamp;
 }
 
 /* Load a bitmap from the persistent cache */
 RD_BOOL
 pstcache_load_bitmap(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx)
 {
-	uint8 *celldata;
-	int fd;
-	CELLHEADER cellhdr;
+	CELLHEADER * cellhdr;
 	RD_HBITMAP bitmap;
+	PSTCACHE_FILE * pstcache;
 
 	if (!(pcache->rdp->settings->bitmap_cache_persist_enable))
 		return False;
@@ -58,19 +251,20 @@ pstcache_load_bitmap(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx)
 	if (!IS_PERSISTENT(cache_id) || cache_idx >= BMPCACHE2_NUM_PSTCELLS)
 		return False;
 
-	fd = pcache->pstcache_fd[cache_id];
-	rd_lseek_file(fd, cache_idx *
-			(pcache->pstcache_Bpp * MAX_CELL_SIZE + sizeof(CELLHEADER)));
-	rd_read_file(fd, &cellhdr, sizeof(CELLHEADER));
-	celldata = (uint8 *) xmalloc(cellhdr.length);
-	rd_read_file(fd, celldata, cellhdr.length);
+	pstcache = &pcache->pstcache[cache_id];
+	cellhdr = &pstcache->index->cells[cache_idx];
+
+	if (memcmp(cellhdr->key, pcache->zero_key, sizeof(HASH_KEY)) == 0 ||
+		cellhdr->length > pstcache->cell_size ||
+		cellhdr->width * cellhdr->height * pcache->pstcache_Bpp > cellhdr->length)
+		return False;
 
-	bitmap = ui_create_bitmap(pcache->rdp->inst, cellhdr.width, cellhdr.height, celldata);
+	bitmap = ui_create_bitmap(pcache->rdp->inst, cellhdr->width, cellhdr->height,
+		pstcache->cells + cache_idx * pstcache->cell_size);
 	DEBUG_CACHE("Load bitmap from disk: id=%d, idx=%d, bmp=0x%x)",
 			cache_id, cache_idx, (unsigned int) bitmap);
-	cache_put_bitmap(pcache->rdp->cache, cache_id, cache_idx, bitmap);
+	cache_put_bitmap(pcache->rdp->cache, cache_id, cache_idx, bitmap, cellhdr->length);
 
-	xfree(celldata);
 	return True;
 }
 
@@ -79,36 +273,39 @@ RD_BOOL
 pstcache_save_bitmap(rdpPcache * pcache, uint8 cache_id, uint16 cache_idx, uint8 * key,
 		     uint8 width, uint8 height, uint16 length, uint8 * data)
 {
-	int fd;
-	CELLHEADER cellhdr;
+	CELLHEADER * cellhdr;
+	PSTCACHE_FILE * pstcache;
 
 	if (!IS_PERSISTENT(cache_id) || cache_idx >= BMPCACHE2_NUM_PSTCELLS)
 		return False;
 
-	memcpy(cellhdr.key, key, sizeof(HASH_KEY));
-	cellhdr.width = width;
-	cellhdr.height = height;
-	cellhdr.length = length;
-	cellhdr.stamp = 0;
+	pstcache = &pcache->pstcache[cache_id];
+	if (length > pstcache->cell_size)
+		return False;
 
-	fd = pcache->pstcache_fd[cache_id];
-	rd_lseek_file(fd, cache_idx *
-			(pcache->pstcache_Bpp * MAX_CELL_SIZE + sizeof(CELLHEADER)));
-	rd_write_file(fd, &cellhdr, sizeof(CELLHEADER));
-	rd_write_file(fd, data, length);
+	cellhdr = &pstcache->index->cells[cache_idx];
+
+	/* the key goes in last, a cell is only valid with a key */
+	memset(cellhdr->key, 0, sizeof(HASH_KEY));
+	memcpy(pstcache->cells + cache_idx * pstcache->cell_size, data, length);
+	cellhdr->width = width;
+	cellhdr->height = height;
+	cellhdr->length = length;
+	cellhdr->stamp = 0;
+	memcpy(cellhdr->key, key, sizeof(HASH_KEY));
 
 	return True;
 }
 
-/* List the bitmap keys from the persistent cache file */
+/* List the bitmap keys from the persistent cache index */
 int
 pstcache_enumerate(rdpPcache * pcache, uint8 id, HASH_KEY * keylist)
 {
-	int fd, n;
+	int n;
 	uint16 idx;
 	sint16 mru_idx[0xa00];
 	uint32 mru_stamp[0xa00];
-	CELLHEADER cellhdr;
+	CELLHEADER * cellhdr;
 
 	if (!(pcache->rdp->settings->bitmap_cache &&
 	      pcache->rdp->settings->bitmap_cache_persist_enable &&
@@ -122,30 +319,26 @@ pstcache_enumerate(rdpPcache * pcache, uint8 id, HASH_KEY * keylist)
 	DEBUG_CACHE("Persistent bitmap cache enumeration... ");
 	for (idx = 0; idx < BMPCACHE2_NUM_PSTCELLS; idx++)
 	{
-		fd = pcache->pstcache_fd[id];
-		rd_lseek_file(fd, idx *
-			(pcache->pstcache_Bpp * MAX_CELL_SIZE + sizeof(CELLHEADER)));
-		if (rd_read_file(fd, &cellhdr, sizeof(CELLHEADER)) <= 0)
-			break;
+		cellhdr = &pcache->pstcache[id].index->cells[idx];
 
-		if (memcmp(cellhdr.key, pcache->zero_key, sizeof(HASH_KEY)) != 0)
+		if (memcmp(cellhdr->key, pcache->zero_key, sizeof(HASH_KEY)) != 0)
 		{
-			memcpy(keylist[idx], cellhdr.key, sizeof(HASH_KEY));
+			memcpy(keylist[idx], cellhdr->key, sizeof(HASH_KEY));
 
 			/* Pre-cache (not possible for 8 bit color depth cause it needs a colormap) */
-			if (pcache->rdp->settings->bitmap_cache_precache && cellhdr.stamp &&
+			if (pcache->rdp->settings->bitmap_cache_precache && cellhdr->stamp &&
 			    pcache->rdp->settings->server_depth > 8)
 				pstcache_load_bitmap(pcache, id, idx);
 
 			/* Sort by stamp */
-			for (n = idx; n > 0 && cellhdr.stamp < mru_stamp[n - 1]; n--)
+			for (n = idx; n > 0 && cellhdr->stamp < mru_stamp[n - 1]; n--)
 			{
 				mru_idx[n] = mru_idx[n - 1];
 				mru_stamp[n] = mru_stamp[n - 1];
 			}
 
 			mru_idx[n] = idx;
-			mru_stamp[n] = cellhdr.stamp;
+			mru_stamp[n] = cellhdr->stamp;
 		}
 		else
 		{
@@ -164,46 +357,34 @@ pstcache_enumerate(rdpPcache * pcache, uint8 id, HASH_KEY * keylist)
 RD_BOOL
 pstcache_init(rdpPcache * pcache, uint8 cache_id)
 {
-	int fd;
-	char filename[256];
+	int Bpp;
 
-	if (pcache->pstcache_enumerated)
-		return True;
-
-	pcache->pstcache_fd[cache_id] = 0;
+	if (cache_id >= NUM_ELEMENTS(pcache->pstcache))
+		return False;
 
 	if (!(pcache->rdp->settings->bitmap_cache &&
 	      pcache->rdp->settings->bitmap_cache_persist_enable))
 		return False;
 
-	if (!rd_pstcache_mkdir())
-	{
-		DEBUG_CACHE("failed to get/make cache directory!");
-		return False;
-	}
-
-	pcache->pstcache_Bpp = (pcache->rdp->settings->server_depth + 7) / 8;
-	sprintf(filename, "cache/pstcache_%d_%d", cache_id, pcache->pstcache_Bpp);
-	DEBUG_CACHE("persistent bitmap cache file: %s", filename);
+	/* already mapped by an earlier capability exchange */
+	Bpp = (pcache->rdp->settings->server_depth + 7) / 8;
+	if (IS_PERSISTENT(cache_id) && pcache->pstcache_Bpp == Bpp)
+		return True;
 
-	fd = rd_open_file(filename);
-	if (fd == -1)
-		return False;
+	pstcache_close(pcache, cache_id);
 
-	if (!rd_lock_file(fd, 0, 0))
-	{
-		ui_warning(pcache->rdp->inst, "Persistent bitmap caching is disabled. (The file is already in use)\n");
-		rd_close_file(fd);
+	/* The server disconnects if the bitmap cache content is sent more than once */
+	if (pcache->pstcache_enumerated)
 		return False;
-	}
 
-	pcache->pstcache_fd[cache_id] = fd;
-	return True;
+	pcache->pstcache_Bpp = Bpp;
+	return pstcache_open(pcache, cache_id);
 }
 
 rdpPcache *
 pcache_new(struct rdp_rdp * rdp)
 {
+	int i;
 	rdpPcache * self;
 
 	self = (rdpPcache *) xmalloc(sizeof(rdpPcache));
@@ -211,6 +392,11 @@ pcache_new(struct rdp_rdp * rdp)
 	{
 		memset(self, 0, sizeof(rdpPcache));
 		self->rdp = rdp;
+		for (i = 0; i < NUM_ELEMENTS(self->pstcache); i++)
+		{
+			self->pstcache[i].index_fd = -1;
+			self->pstcache[i].cells_fd = -1;
+		}
 	}
 	return self;
 }
@@ -218,8 +404,12 @@ pcache_new(struct rdp_rdp * rdp)
 void
 pcache_free(rdpPcache * pcache)
 {
+	int i;
+
 	if (pcache != NULL)
 	{
+		for (i = 0; i < NUM_ELEMENTS(pcache->pstcache); i++)
+			pstcache_close(pcache, i);
 		xfree(pcache);
 	}
 }
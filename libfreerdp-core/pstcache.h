@@ -31,11 +31,32 @@ typedef struct _PSTCACHE_CELLHEADER
 	uint32 stamp;
 } CELLHEADER;
 
+/* Persistent bitmap cache index file, one header per cell */
+typedef struct _PSTCACHE_INDEX
+{
+	uint32 magic;
+	uint16 version;
+	uint16 Bpp;
+	uint32 num_cells;
+	uint32 cell_size;
+	CELLHEADER cells[BMPCACHE2_NUM_PSTCELLS];
+} PSTCACHE_INDEX;
+
+/* An open persistent bitmap cache, the index and the cell file are mapped */
+typedef struct _PSTCACHE_FILE
+{
+	int index_fd;
+	int cells_fd;
+	PSTCACHE_INDEX * index;
+	uint8 * cells;
+	int cell_size;
+} PSTCACHE_FILE;
+
 struct rdp_pcache
 {
 	struct rdp_rdp * rdp;
 	int pstcache_Bpp;
-	int pstcache_fd[8];
+	PSTCACHE_FILE pstcache[8];
 	RD_BOOL pstcache_enumerated;
 	uint8 zero_key[8];
 };
@@ -52,6 +73,8 @@ int
 pstcache_enumerate(rdpPcache * pcache, uint8 id, HASH_KEY * keylist);
 RD_BOOL
 pstcache_init(rdpPcache * pcache, uint8 cache_id);
+RD_BOOL
+pstcache_is_persistent(rdpPcache * pcache, uint8 cache_id);
 rdpPcache *
 pcache_new(struct rdp_rdp * rdp);
 void
@@ -36,6 +36,9 @@
 #include "ext.h"
 #include "surface.h"
 #include "network.h"
+#include "pipeline.h"
+#include "record.h"
+#include "chan.h"
 #include <freerdp/freerdp.h>
 #include <freerdp/utils/hexdump.h>
 
@@ -67,13 +70,25 @@ rdp_recv(rdpRdp * rdp, enum RDP_PDU_TYPE * type, uint16 * source)
 {
 	uint16 totalLength;
 	uint16 pduType;
+	uint16 channel;
 	secRecvType sec_type;
 
 	*type = RDP_PDU_NULL;
 	*source = 0;
 	if ((rdp->rdp_s == NULL) || (rdp->next_packet >= rdp->rdp_s->end))
 	{
-		rdp->rdp_s = sec_recv(rdp->sec, &sec_type);
+		if (rdp->replay != NULL)
+		{
+			rdp->rdp_s = record_read(rdp->replay, &sec_type, &channel);
+
+			/* channel data is passed on as sec_recv would have done */
+			if ((rdp->rdp_s != NULL) && (sec_type == SEC_RECV_IOCHANNEL))
+				vchan_process(rdp->net->mcs->chan, rdp->rdp_s, channel);
+		}
+		else if (rdp->pipeline != NULL)
+			rdp->rdp_s = pipeline_recv(rdp->pipeline, &sec_type);
+		else
+			rdp->rdp_s = sec_recv(rdp->sec, &sec_type);
 
 		if (rdp->rdp_s == NULL)
 			return NULL;
@@ -946,12 +961,18 @@ process_demand_active(rdpRdp * rdp, STREAM s, uint16 serverChannelId)
 	rdp_send_control(rdp, RDP_CTL_COOPERATE);
 	rdp_send_control(rdp, RDP_CTL_REQUEST_CONTROL);
 	s = rdp_recv(rdp, &type, &source);	/* RDP_PDU_SYNCHRONIZE */
+	if (s == NULL)
+		return;
 	ASSERT(type == RDP_PDU_DATA);
 	process_data_pdu(rdp, s);
 	s = rdp_recv(rdp, &type, &source);	/* RDP_CTL_COOPERATE */
+	if (s == NULL)
+		return;
 	ASSERT(type == RDP_PDU_DATA);
 	process_data_pdu(rdp, s);
 	s = rdp_recv(rdp, &type, &source);	/* RDP_CTL_GRANTED_CONTROL */
+	if (s == NULL)
+		return;
 	ASSERT(type == RDP_PDU_DATA);
 	process_data_pdu(rdp, s);
 
@@ -970,6 +991,8 @@ process_demand_active(rdpRdp * rdp, STREAM s, uint16 serverChannelId)
 	}
 
 	s = rdp_recv(rdp, &type, &source);	/* RDP_DATA_PDU_FONTMAP */
+	if (s == NULL)
+		return;
 	ASSERT(type == RDP_PDU_DATA);
 	process_data_pdu(rdp, s);
 	reset_order_state(rdp->orders);
@@ -1115,11 +1138,14 @@ void
 process_bitmap_updates(rdpRdp * rdp, STREAM s)
 {
 	int i;
+	int y;
 	size_t buffer_size;
 	uint16 num_updates;
 	uint16 left, top, right, bottom, width, height;
 	uint16 cx, cy, bpp, Bpp, compress, bufsize, size;
 	uint8 *data, *bmpdata;
+	RD_BITMAP_DEST dest;
+	RD_BOOL direct;
 
 	in_uint16_le(s, num_updates);
 
@@ -1142,17 +1168,32 @@ process_bitmap_updates(rdpRdp * rdp, STREAM s)
 		DEBUG_RDP("BITMAP_UPDATE(l=%d,t=%d,r=%d,b=%d,w=%d,h=%d,Bpp=%d,cmp=%d)",
 		       left, top, right, bottom, width, height, Bpp, compress);
 
-		buffer_size = width * height * Bpp;
-
-		if (buffer_size > rdp->buffer_size)
-		{
-			rdp->buffer = xrealloc(rdp->buffer, buffer_size);
-			rdp->buffer_size = buffer_size;
-		}
+		/* when the ui hands out its surface the rows are stored there as
+		   they are decoded, only two scanlines are needed in between */
+		direct = (Bpp < 4) && (cx <= width) && (cy <= height) &&
+			ui_begin_paint_bitmap(rdp->inst, left, top, cx, cy, bpp, &dest);
 
 		if (!compress)
 		{
-			int y;
+			if (direct)
+			{
+				for (y = 0; y < height; y++)
+				{
+					in_uint8p(s, data, width * Bpp);
+					bitmap_store_row(&dest, data, height - y - 1, Bpp);
+				}
+				ui_end_paint_bitmap(rdp->inst, left, top, cx, cy);
+				continue;
+			}
+
+			buffer_size = width * height * Bpp;
+
+			if (buffer_size > rdp->buffer_size)
+			{
+				rdp->buffer = xrealloc(rdp->buffer, buffer_size);
+				rdp->buffer_size = buffer_size;
+			}
+
 			bmpdata = (uint8 *) rdp->buffer;
 			for (y = 0; y < height; y++)
 			{
@@ -1175,7 +1216,7 @@ process_bitmap_updates(rdpRdp * rdp, STREAM s)
 		}
 		in_uint8p(s, data, size);
 
-		buffer_size = width * height * Bpp;
+		buffer_size = width * (direct ? 2 : height) * Bpp;
 
 		if (buffer_size > rdp->buffer_size)
 		{
@@ -1185,7 +1226,15 @@ process_bitmap_updates(rdpRdp * rdp, STREAM s)
 
 		bmpdata = (uint8 *) rdp->buffer;
 
-		if (bitmap_decompress(rdp->inst, bmpdata, width, height, data, size, Bpp))
+		if (direct)
+		{
+			if (!bitmap_decompress_dest(rdp->inst, &dest, bmpdata, width, height, data, size, Bpp))
+			{
+				DEBUG_RDP("Failed to decompress data");
+			}
+			ui_end_paint_bitmap(rdp->inst, left, top, cx, cy);
+		}
+		else if (bitmap_decompress(rdp->inst, bmpdata, width, height, data, size, Bpp))
 		{
 			ui_paint_bitmap(rdp->inst, left, top, cx, cy, width, height, bmpdata);
 		}
@@ -1268,6 +1317,7 @@ process_update_pdu(rdpRdp * rdp, STREAM s)
 			ui_unimpl(rdp->inst, "Unknown update pdu type 0x%x\n", update_type);
 			break;
 	}
+	orders_flush(rdp->orders);
 	ui_end_update(rdp->inst);
 }
 
@@ -1305,15 +1355,14 @@ process_data_pdu(rdpRdp * rdp, STREAM s)
 		if (uncompressedLength > RDP_MPPC_DICT_SIZE)
 			ui_error(rdp->inst, "error decompressed packet size exceeds max\n");
 		if (mppc_expand(rdp, s->p, compressedLength, compressedType, &roff, &rlen) == -1)
+		{
 			ui_error(rdp->inst, "error while decompressing packet\n");
-		/* allocate memory and copy the uncompressed data into the temporary stream */
-		data_s->data = (uint8 *) xrealloc(data_s->data, rlen);
-		memcpy(data_s->data, rdp->mppc_dict.hist + roff, rlen);
+			return False;
+		}
+		/* parse the output in place, it is contiguous in the history buffer
+		   and stays untouched until the next packet is expanded */
 		ASSERT(rlen == uncompressedLength);
-		data_s->size = rlen;
-		data_s->end = data_s->data + data_s->size;
-		data_s->p = data_s->data;
-		data_s->rdp_hdr = data_s->p;
+		stream_attach(data_s, rdp->mppc_dict.hist + roff, rlen);
 		data_s_end = data_s->p + rlen;
 	}
 	else
@@ -1468,6 +1517,32 @@ process_redirect_pdu(rdpRdp * rdp, STREAM s)
 	in_uint8s(s, length - (s->p - s_start));
 }
 
+/* Append a fast-path fragment to the reassembly buffer, growing it as needed
+   but never beyond the size negotiated in the multifragment update capability */
+static RD_BOOL
+rdp_append_fragment(rdpRdp * rdp, uint8 * data, int length)
+{
+	STREAM fd_s;
+	size_t used;
+
+	fd_s = rdp->fragment_data;
+	if (fd_s == NULL)
+	{
+		return False;
+	}
+	used = fd_s->p - fd_s->data;
+	if (used + length > (size_t) rdp->multifragmentupdate_request_size)
+	{
+		return False;
+	}
+	if (stream_extend(fd_s, used + length) != 0)
+	{
+		return False;
+	}
+	out_uint8a(fd_s, data, length);
+	return True;
+}
+
 /* process fast path */
 static void
 process_fp(rdpRdp * rdp, STREAM s)
@@ -1484,10 +1559,11 @@ process_fp(rdpRdp * rdp, STREAM s)
 	uint8 * next;
 	uint32 roff;
 	uint32 rlen;
-	STREAM ns;
+	struct stream us;
 	STREAM ts;
 	STREAM fd_s;
 
+	memset(&us, 0, sizeof(us));
 	ui_begin_update(rdp->inst);
 	for ( ; s->p < s->end; s->p = next)
 	{
@@ -1495,6 +1571,9 @@ process_fp(rdpRdp * rdp, STREAM s)
 		frag_bits = (type & 0x30) >> 4;
 		comp_bits = (type & 0xc0) >> 6;
 		type = type & 0xf;
+		/* drawing orders of the update before anything else it draws */
+		if (type != FASTPATH_UPDATETYPE_ORDERS)
+			orders_flush(rdp->orders);
 		if (comp_bits & FASTPATH_OUTPUT_COMPRESSION_USED)
 		{
 			in_uint8(s, ctype);
@@ -1506,26 +1585,28 @@ process_fp(rdpRdp * rdp, STREAM s)
 			in_uint16_le(s, length);
 		}
 		rdp->next_packet = next = s->p + length;
+		if (next > s->end)
+		{
+			ui_error(rdp->inst, "fast-path update length %d exceeds packet\n", length);
+			break;
+		}
+		/* every update is parsed in place through a view bounded to its own
+		   payload, either in the received packet or in the MPPC history */
 		if (ctype & RDP_MPPC_COMPRESSED)
 		{
-			ns = &(rdp->mppc_dict.ns);
 			if (mppc_expand(rdp, s->p, length, ctype, &roff, &rlen) == -1)
 			{
-				ui_error(rdp->inst, "error while decompressing packet");
+				ui_error(rdp->inst, "error while decompressing packet\n");
 				continue;
 			}
-			ns->data = (uint8 *) xrealloc(ns->data, rlen);
-			memcpy(ns->data, rdp->mppc_dict.hist + roff, rlen);
-			ns->size = rlen;
-			ns->end = ns->data + ns->size;
-			ns->p = ns->data;
-			ns->rdp_hdr = ns->p;
+			ts = &(rdp->mppc_dict.ns);
+			stream_attach(ts, rdp->mppc_dict.hist + roff, rlen);
 			length = rlen;
-			ts = ns;
 		}
 		else
 		{
-			ts = s;
+			ts = &us;
+			stream_attach(ts, s->p, length);
 		}
 		if (frag_bits != 0)
 		{
@@ -1533,29 +1614,38 @@ process_fp(rdpRdp * rdp, STREAM s)
 				(rdp->settings->ui_decode_flags & 2))
 			{
 				/* ui supports fragmented decoding */
-				size = (int) (ts->end - ts->p);
-				if (ui_decode(rdp->inst, ts->p, size) == 0)
+				if (ui_decode(rdp->inst, ts->p, length) == 0)
 				{
 					continue;
 				}
 			}
-			fd_s = rdp->fragment_data;
-			switch (frag_bits)
+			if (frag_bits == FASTPATH_FRAGMENT_FIRST)
 			{
-				case FASTPATH_FRAGMENT_LAST:
-					out_uint8a(fd_s, ts->p, length);
-					fd_s->end = fd_s->p;
-					fd_s->p = fd_s->data;
-					ts = fd_s;
-					break;
-				case FASTPATH_FRAGMENT_FIRST:
-					fd_s->p = fd_s->data;
-					out_uint8a(fd_s, ts->p, length);
-					continue;
-				case FASTPATH_FRAGMENT_NEXT:
-					out_uint8a(fd_s, ts->p, length);
-					continue;
+				if (rdp->fragment_data != NULL)
+				{
+					rdp->fragment_data->p = rdp->fragment_data->data;
+				}
+				rdp->fragment_dropped = 0;
+			}
+			if (rdp->fragment_dropped)
+			{
+				continue;
+			}
+			if (!rdp_append_fragment(rdp, ts->p, length))
+			{
+				ui_error(rdp->inst, "fast-path fragment exceeds %d bytes, dropping update\n",
+					rdp->multifragmentupdate_request_size);
+				rdp->fragment_dropped = 1;
+				continue;
 			}
+			if (frag_bits != FASTPATH_FRAGMENT_LAST)
+			{
+				continue;
+			}
+			fd_s = rdp->fragment_data;
+			ts = &us;
+			stream_attach(ts, fd_s->data, fd_s->p - fd_s->data);
+			fd_s->p = fd_s->data;
 		}
 		switch (type)
 		{
@@ -1608,6 +1698,7 @@ process_fp(rdpRdp * rdp, STREAM s)
 				break;
 		}
 	}
+	orders_flush(rdp->orders);
 	ui_end_update(rdp->inst);
 }
 
@@ -1739,6 +1830,7 @@ rdp_reconnect(rdpRdp * rdp)
 void
 rdp_disconnect(rdpRdp * rdp)
 {
+	pipeline_free(rdp->pipeline);
 	sec_disconnect(rdp->sec);
 }
 
@@ -1775,8 +1867,13 @@ rdp_free(rdpRdp * rdp)
 
 	if (rdp != NULL)
 	{
+		pipeline_free(rdp->pipeline);
+		record_free(rdp->record);
+		record_free(rdp->replay);
 		freerdp_uniconv_free(rdp->uniconv);
 		ext_free(rdp->ext);
+		if (rdp->cache != NULL)
+			cache_save_state(rdp->cache);
 		cache_free(rdp->cache);
 		pcache_free(rdp->pcache);
 		orders_free(rdp->orders);
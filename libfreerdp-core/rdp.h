@@ -27,6 +27,9 @@
 #include <freerdp/utils/unicode.h>
 #include <freerdp/constants/constants.h>
 
+/* initial size of the fast-path fragment reassembly buffer */
+#define RDP_FRAGMENT_INITIAL_SIZE	0x10000
+
 typedef struct _systemTime
 {
 	uint16 wYear;
@@ -72,6 +75,9 @@ struct rdp_rdp
 	struct rdp_cache * cache;
 	struct rdp_app * app;
 	struct rdp_ext * ext;
+	struct rdp_pipeline * pipeline;
+	struct rdp_record * record; /* received PDUs are saved here */
+	struct rdp_record * replay; /* PDUs are read from here instead of the network */
 	/* Session Directory redirection */
 	int redirect;
 	uint32 redirect_session_id;
@@ -105,6 +111,7 @@ struct rdp_rdp
 	int got_multifragmentupdate_caps;
 	int multifragmentupdate_request_size;
 	STREAM fragment_data;
+	int fragment_dropped;
 	/* bitmap codecs */
 	int got_bitmap_codecs_caps;
 	STREAM out_codec_caps[MAX_BITMAP_CODECS];
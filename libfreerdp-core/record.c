@@ -0,0 +1,308 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   Session recording and replay
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+   A recording holds the PDUs returned by sec_recv, decrypted and in the
+   order they were received, so that a session can be decoded again without
+   a server. Licensing is handled inside sec_recv and is not recorded.
+
+   After RECORD_MAGIC every PDU is stored as a 12 byte little endian header
+   followed by its payload:
+
+     uint8  type     secRecvType
+     uint8  pad
+     uint16 channel  MCS channel of virtual channel data
+     uint32 time     milliseconds since the recording was started
+     uint32 length   payload bytes that follow
+
+   When replaying, the time spent between two reads is what it took to
+   process the previous PDU, which is added to the counters of its kind.
+*/
+
+#include <stdio.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/time.h>
+#endif
+#include "frdp.h"
+#include "stream.h"
+#include <freerdp/constants/core.h>
+#include <freerdp/constants/pdu.h>
+#include <freerdp/utils/memory.h>
+
+#include "record.h"
+
+#define RECORD_HEADER_LENGTH	12
+
+struct rdp_record
+{
+	FILE * fp;
+	RD_BOOL write;
+	uint64 start;
+
+	/* replay */
+	STREAM s;
+	int kind; /* of the PDU being processed, -1 before the first one */
+	uint64 kind_start;
+	unsigned long kind_allocs;
+	RD_REPLAY_STATS stats;
+};
+
+static uint64
+record_get_usec(void)
+{
+#ifdef _WIN32
+	return (uint64) GetTickCount() * 1000;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+/* Tell what a PDU carries from its first update, without parsing it */
+static int
+record_get_kind(secRecvType type, uint8 * data, int length)
+{
+	int code;
+
+	if (type == SEC_RECV_IOCHANNEL)
+		return RD_PDU_CHANNEL;
+
+	if (type == SEC_RECV_FAST_PATH)
+	{
+		if (length < 1)
+			return RD_PDU_OTHER;
+
+		code = data[0] & 0x0f;
+		switch (code)
+		{
+			case FASTPATH_UPDATETYPE_ORDERS:
+				return RD_PDU_ORDERS;
+			case FASTPATH_UPDATETYPE_BITMAP:
+				return RD_PDU_BITMAP;
+			case FASTPATH_UPDATETYPE_PALETTE:
+				return RD_PDU_PALETTE;
+			case FASTPATH_UPDATETYPE_SURFCMDS:
+				return RD_PDU_SURFCMDS;
+			case FASTPATH_UPDATETYPE_PTR_NULL:
+			case FASTPATH_UPDATETYPE_PTR_DEFAULT:
+			case FASTPATH_UPDATETYPE_PTR_POSITION:
+			case FASTPATH_UPDATETYPE_COLOR:
+			case FASTPATH_UPDATETYPE_CACHED:
+			case FASTPATH_UPDATETYPE_POINTER:
+				return RD_PDU_POINTER;
+		}
+		return RD_PDU_OTHER;
+	}
+
+	/* share control header, share data header, then the update type.
+	   Compressed data PDUs can not be looked into. */
+	if ((type != SEC_RECV_SHARE_CONTROL) || (length < 20))
+		return RD_PDU_OTHER;
+	if ((data[2] & 0x0f) != RDP_PDU_DATA || (data[15] & RDP_MPPC_COMPRESSED))
+		return RD_PDU_OTHER;
+
+	if (data[14] == RDP_DATA_PDU_POINTER)
+		return RD_PDU_POINTER;
+	if (data[14] != RDP_DATA_PDU_UPDATE)
+		return RD_PDU_OTHER;
+
+	switch (data[18] | (data[19] << 8))
+	{
+		case RDP_UPDATE_ORDERS:
+			return RD_PDU_ORDERS;
+		case RDP_UPDATE_BITMAP:
+			return RD_PDU_BITMAP;
+		case RDP_UPDATE_PALETTE:
+			return RD_PDU_PALETTE;
+	}
+	return RD_PDU_OTHER;
+}
+
+/* Save the rest of a received PDU, from s->p to s->end */
+void
+record_write(rdpRecord * rec, secRecvType type, uint16 channel, STREAM s)
+{
+	uint8 header[RECORD_HEADER_LENGTH];
+	uint32 time;
+	uint32 length;
+
+	if (rec->fp == NULL)
+		return;
+
+	time = (uint32) ((record_get_usec() - rec->start) / 1000);
+	length = (uint32) (s->end - s->p);
+
+	header[0] = (uint8) type;
+	header[1] = 0;
+	header[2] = channel & 0xff;
+	header[3] = channel >> 8;
+	header[4] = time & 0xff;
+	header[5] = (time >> 8) & 0xff;
+	header[6] = (time >> 16) & 0xff;
+	header[7] = time >> 24;
+	header[8] = length & 0xff;
+	header[9] = (length >> 8) & 0xff;
+	header[10] = (length >> 16) & 0xff;
+	header[11] = length >> 24;
+
+	if ((fwrite(header, 1, RECORD_HEADER_LENGTH, rec->fp) != RECORD_HEADER_LENGTH) ||
+		(fwrite(s->p, 1, length, rec->fp) != length))
+	{
+		/* keep the session going, the recording ends here */
+		perror("record_write");
+		fclose(rec->fp);
+		rec->fp = NULL;
+	}
+}
+
+/* Next recorded PDU, valid until the following call. NULL at the end. */
+STREAM
+record_read(rdpRecord * rec, secRecvType * type, uint16 * channel)
+{
+	uint8 header[RECORD_HEADER_LENGTH];
+	uint32 length;
+	uint64 now;
+	unsigned long allocs;
+	RD_PDU_STATS * pdus;
+
+	now = record_get_usec();
+	allocs = xmalloc_count();
+
+	/* what the previous PDU took */
+	if (rec->kind >= 0)
+	{
+		pdus = &(rec->stats.pdus[rec->kind]);
+		pdus->usec += (uint32) (now - rec->kind_start);
+		pdus->allocs += allocs - rec->kind_allocs;
+		rec->stats.usec += (uint32) (now - rec->kind_start);
+		rec->kind = -1;
+	}
+
+	if ((rec->fp == NULL) || rec->write ||
+		(fread(header, 1, RECORD_HEADER_LENGTH, rec->fp) != RECORD_HEADER_LENGTH))
+	{
+		rec->stats.done = 1;
+		return NULL;
+	}
+
+	*type = (secRecvType) header[0];
+	*channel = header[2] | (header[3] << 8);
+	length = header[8] | (header[9] << 8) | (header[10] << 16) | ((uint32) header[11] << 24);
+
+	if ((*type > SEC_RECV_FAST_PATH) || (*type == SEC_RECV_LICENSE) ||
+		stream_init(rec->s, length) ||
+		(fread(rec->s->data, 1, length, rec->fp) != length))
+	{
+		printf("record_read: truncated or damaged recording\n");
+		rec->stats.done = 1;
+		return NULL;
+	}
+
+	rec->s->end = rec->s->data + length;
+	rec->s->rdp_hdr = rec->s->data;
+
+	rec->kind = record_get_kind(*type, rec->s->data, length);
+	rec->stats.pdus[rec->kind].count++;
+	rec->stats.pdus[rec->kind].bytes += length;
+
+	/* the time spent reading is not part of the PDU */
+	rec->kind_start = record_get_usec();
+	rec->kind_allocs = xmalloc_count();
+
+	return rec->s;
+}
+
+/* Replays are read with stdio, the file can always be read */
+int
+record_get_fd(rdpRecord * rec)
+{
+#ifdef _WIN32
+	return _fileno(rec->fp);
+#else
+	return fileno(rec->fp);
+#endif
+}
+
+/* Count the frames drawn by a replay */
+void
+record_end_update(rdpRecord * rec)
+{
+	rec->stats.frames++;
+}
+
+void
+record_get_stats(rdpRecord * rec, RD_REPLAY_STATS * stats)
+{
+	memcpy(stats, &(rec->stats), sizeof(RD_REPLAY_STATS));
+}
+
+/* Open a recording for writing or for replay */
+rdpRecord *
+record_new(const char * filename, RD_BOOL write)
+{
+	rdpRecord * self;
+	char magic[RECORD_MAGIC_LENGTH];
+
+	self = (rdpRecord *) xmalloc(sizeof(rdpRecord));
+	if (self == NULL)
+		return NULL;
+
+	memset(self, 0, sizeof(rdpRecord));
+	self->write = write;
+	self->kind = -1;
+	self->start = record_get_usec();
+
+	self->fp = fopen(filename, write ? "wb" : "rb");
+	if (self->fp == NULL)
+	{
+		xfree(self);
+		return NULL;
+	}
+
+	if (write)
+	{
+		if (fwrite(RECORD_MAGIC, 1, RECORD_MAGIC_LENGTH, self->fp) == RECORD_MAGIC_LENGTH)
+			return self;
+	}
+	else if ((fread(magic, 1, RECORD_MAGIC_LENGTH, self->fp) == RECORD_MAGIC_LENGTH) &&
+		(memcmp(magic, RECORD_MAGIC, RECORD_MAGIC_LENGTH) == 0))
+	{
+		self->s = stream_new(0);
+		if (self->s != NULL)
+			return self;
+	}
+
+	fclose(self->fp);
+	xfree(self);
+	return NULL;
+}
+
+void
+record_free(rdpRecord * rec)
+{
+	if (rec == NULL)
+		return;
+
+	if (rec->fp != NULL)
+		fclose(rec->fp);
+	stream_delete(rec->s);
+	xfree(rec);
+}
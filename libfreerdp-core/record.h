@@ -0,0 +1,47 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   Session recording and replay
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __RECORD_H
+#define __RECORD_H
+
+#include "frdp.h"
+#include "stream.h"
+#include "security.h"
+#include <freerdp/types/ui.h>
+
+/* first bytes of a recording, the last one is the version of the format */
+#define RECORD_MAGIC	"FRDPREC1"
+#define RECORD_MAGIC_LENGTH	8
+
+typedef struct rdp_record rdpRecord;
+
+rdpRecord *
+record_new(const char * filename, RD_BOOL write);
+void
+record_free(rdpRecord * rec);
+void
+record_write(rdpRecord * rec, secRecvType type, uint16 channel, STREAM s);
+STREAM
+record_read(rdpRecord * rec, secRecvType * type, uint16 * channel);
+int
+record_get_fd(rdpRecord * rec);
+void
+record_end_update(rdpRecord * rec);
+void
+record_get_stats(rdpRecord * rec, RD_REPLAY_STATS * stats);
+
+#endif
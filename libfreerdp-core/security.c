@@ -24,6 +24,7 @@
 #include "rdp.h"
 #include "iso.h"
 #include "tcp.h"
+#include "record.h"
 #include <freerdp/rdpset.h>
 #include <freerdp/utils/memory.h>
 
@@ -309,10 +310,31 @@ sec_fp_init(rdpSec * sec, uint32 flags, int maxlen)
 /* Transmit secure transport packet over specified channel */
 void
 sec_send_to_channel(rdpSec * sec, STREAM s, uint32 flags, uint16 channel)
+{
+	sec_send_to_channel_gather(sec, s, flags, channel, NULL, 0);
+}
+
+/* Transmit secure transport packet made of the stream and the data that
+   follows it, which the stream has room for. The data is only copied into
+   the stream when it has to be encrypted. */
+void
+sec_send_to_channel_gather(rdpSec * sec, STREAM s, uint32 flags, uint16 channel,
+	uint8 * data, int length)
 {
 	int datalen;
+
+	if ((flags & SEC_ENCRYPT) && (length > 0))
+	{
+		memcpy(s->end, data, length);
+		s->end += length;
+		length = 0;
+	}
+
 	s_pop_layer(s, sec_hdr);
 
+	/* the encryption state must advance in the order packets are written */
+	network_lock(sec->net);
+
 	if (flags)
 	{
 		/* Basic Security Header */
@@ -334,7 +356,8 @@ sec_send_to_channel(rdpSec * sec, STREAM s, uint32 flags, uint16 channel)
 		}
 	}
 
-	mcs_send_to_channel(sec->net->mcs, s, channel);
+	mcs_send_to_channel_gather(sec->net->mcs, s, channel, data, length);
+	network_unlock(sec->net);
 }
 
 /* Transmit secure transport packet */
@@ -351,6 +374,7 @@ sec_fp_send(rdpSec * sec, STREAM s, uint32 flags)
 {
 	int datalen;
 	s_pop_layer(s, sec_hdr);
+	network_lock(sec->net);
 	if (flags & SEC_ENCRYPT)
 	{
 		datalen = ((int) (s->end - s->p)) - 8;
@@ -358,6 +382,7 @@ sec_fp_send(rdpSec * sec, STREAM s, uint32 flags)
 		sec_encrypt(sec, s->p + 8, datalen);
 	}
 	mcs_fp_send(sec->net->mcs, s, flags);
+	network_unlock(sec->net);
 }
 
 /* Transfer the client random to the server */
@@ -593,6 +618,8 @@ sec_recv(rdpSec * sec, secRecvType * type)
 				in_uint8s(s, 8);	/* dataSignature */ /* TODO: Check signature! */
 				sec_decrypt(sec, s->p, s->end - s->p);
 			}
+			if (sec->rdp->record != NULL)
+				record_write(sec->rdp->record, *type, channel, s);
 			return s;
 		}
 		if (iso_type != ISO_RECV_X224)
@@ -621,17 +648,23 @@ sec_recv(rdpSec * sec, secRecvType * type)
 			if (sec_flags & SEC_REDIRECTION_PKT)
 			{
 				*type = SEC_RECV_REDIRECT;
+				if (sec->rdp->record != NULL)
+					record_write(sec->rdp->record, *type, channel, s);
 				return s;
 			}
 		}
 
 		if (channel != MCS_GLOBAL_CHANNEL)
 		{
-			vchan_process(sec->net->mcs->chan, s, channel);
 			*type = SEC_RECV_IOCHANNEL;
+			if (sec->rdp->record != NULL)
+				record_write(sec->rdp->record, *type, channel, s);
+			vchan_process(sec->net->mcs->chan, s, channel);
 			return s;
 		}
 		*type = SEC_RECV_SHARE_CONTROL;
+		if (sec->rdp->record != NULL)
+			record_write(sec->rdp->record, *type, channel, s);
 		return s;
 	}
 
@@ -86,6 +86,9 @@ sec_fp_init(rdpSec * sec, uint32 flags, int maxlen);
 void
 sec_send_to_channel(rdpSec * sec, STREAM s, uint32 flags, uint16 channel);
 void
+sec_send_to_channel_gather(rdpSec * sec, STREAM s, uint32 flags, uint16 channel,
+	uint8 * data, int length);
+void
 sec_send(rdpSec * sec, STREAM s, uint32 flags);
 void
 sec_fp_send(rdpSec * sec, STREAM s, uint32 flags);
@@ -79,3 +79,42 @@ stream_delete(struct stream * st)
 	}
 	return 0;
 }
+
+/* Point st at size bytes of data owned by someone else, nothing is copied.
+   The stream must not be passed to stream_init or stream_delete afterwards. */
+void
+stream_attach(struct stream * st, uint8 * data, size_t size)
+{
+	st->data = data;
+	st->p = data;
+	st->end = data + size;
+	st->size = size;
+	st->rdp_hdr = data;
+}
+
+/* Make room for at least size bytes, keeping the contents and the current
+   position. The allocation at least doubles so appends are amortized. */
+int
+stream_extend(struct stream * st, size_t size)
+{
+	size_t new_size;
+	size_t offset;
+	uint8 * data;
+
+	if (size <= st->size)
+	{
+		return 0;
+	}
+	new_size = MAX(size, st->size * 2);
+	offset = st->p - st->data;
+	data = (uint8 *) xrealloc(st->data, new_size);
+	if (data == NULL)
+	{
+		return 1;
+	}
+	st->data = data;
+	st->p = data + offset;
+	st->end = data + new_size;
+	st->size = new_size;
+	return 0;
+}
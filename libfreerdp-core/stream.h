@@ -128,5 +128,9 @@ struct stream *
 stream_new(int size);
 int
 stream_delete(struct stream * st);
+void
+stream_attach(struct stream * st, uint8 * data, size_t size);
+int
+stream_extend(struct stream * st, size_t size);
 
 #endif /* __STREAM_H */
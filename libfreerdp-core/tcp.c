@@ -27,6 +27,7 @@
 #include <arpa/inet.h>		/* inet_addr */
 #include <errno.h>		/* errno */
 #include <fcntl.h>		/* fcntl F_GETFL F_SETFL O_NONBLOCK */
+#include <sys/uio.h>		/* iovec */
 #endif
 
 #include "frdp.h"
@@ -60,7 +61,7 @@
 
 /*****************************************************************************/
 /* returns boolean */
-static RD_BOOL
+RD_BOOL
 tcp_socket_ok(int sck)
 {
 #if defined(_WIN32)
@@ -158,36 +159,101 @@ tcp_write(rdpTcp * tcp, char* b, int length)
 	}
 }
 
+/* Send head and data one after the other without joining them first */
+void
+tcp_write_gather(rdpTcp * tcp, char * head, int head_length, char * data, int length)
+{
+#ifdef _WIN32
+	tcp_write(tcp, head, head_length);
+	tcp_write(tcp, data, length);
+#else
+	int sent;
+	struct iovec iov[2];
+	struct msghdr msg;
+
+	iov[0].iov_base = head;
+	iov[0].iov_len = head_length;
+	iov[1].iov_base = data;
+	iov[1].iov_len = length;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+
+	while (iov[0].iov_len + iov[1].iov_len > 0)
+	{
+		sent = sendmsg(tcp->sockfd, &msg, MSG_NOSIGNAL);
+		if (sent <= 0)
+		{
+			if (sent == -1 && TCP_BLOCKS)
+			{
+				tcp_can_send(tcp->sockfd, 100);
+				continue;
+			}
+			ui_error(tcp->net->rdp->inst, "send: %s\n", TCP_STRERROR);
+			return;
+		}
+		if (sent >= (int) iov[0].iov_len)
+		{
+			sent -= iov[0].iov_len;
+			iov[0].iov_len = 0;
+			iov[1].iov_base = (char *) iov[1].iov_base + sent;
+			iov[1].iov_len -= sent;
+		}
+		else
+		{
+			iov[0].iov_base = (char *) iov[0].iov_base + sent;
+			iov[0].iov_len -= sent;
+		}
+	}
+#endif
+}
+
+/* Read up to length bytes, waiting only if nothing has been received yet */
 int
 tcp_read(rdpTcp * tcp, char* b, int length)
 {
 	int rcvd = 0;
 
-	if (!ui_select(tcp->net->sec->rdp->inst, tcp->sockfd))
-		return -1; /* user quit */
+	while (1)
+	{
+		rcvd = recv(tcp->sockfd, b, length, 0);
+		tcp->net->stats.reads++;
 
-	rcvd = recv(tcp->sockfd, b, length, 0);
+		if (rcvd > 0)
+			return rcvd;
 
-	if (rcvd < 0)
-	{
-		if (rcvd == -1 && TCP_BLOCKS)
+		if (rcvd == 0)
 		{
-			tcp_can_recv(tcp->sockfd, 1);
-			rcvd = 0;
+			ui_error(tcp->net->rdp->inst, "Connection closed\n");
+			return -1;
 		}
-		else
+
+		if (!TCP_BLOCKS)
 		{
 			ui_error(tcp->net->rdp->inst, "recv: %s\n", TCP_STRERROR);
 			return -1;
 		}
-	}
-	else if (rcvd == 0)
-	{
-		ui_error(tcp->net->rdp->inst, "Connection closed\n");
-			return -1;
-	}
 
-	return rcvd;
+		/* the socket is drained, let the ui run while waiting for more */
+		tcp->net->stats.waits++;
+
+#ifndef _WIN32
+		/* on a pipelined connection this is the network thread, not the ui */
+		if (tcp->net->threaded)
+		{
+			if (tcp->net->cancel)
+				return -1;
+
+			tcp_can_recv(tcp->sockfd, 100);
+			continue;
+		}
+#endif
+
+		if (!ui_select(tcp->net->sec->rdp->inst, tcp->sockfd))
+			return -1; /* user quit */
+
+		tcp_can_recv(tcp->sockfd, 1);
+	}
 }
 
 /* Establish a connection on the TCP layer */
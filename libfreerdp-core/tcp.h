@@ -38,9 +38,13 @@ typedef struct rdp_tcp rdpTcp;
 
 void
 tcp_write(rdpTcp * tcp, char* b, int length);
+void
+tcp_write_gather(rdpTcp * tcp, char * head, int head_length, char * data, int length);
 int
 tcp_read(rdpTcp * tcp, char* b, int length);
 
+RD_BOOL
+tcp_socket_ok(int sck);
 RD_BOOL
 tcp_can_send(int sck, int millis);
 RD_BOOL
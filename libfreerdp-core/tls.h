@@ -39,6 +39,8 @@ int
 tls_write(rdpTls * tls, char * b, int length);
 int
 tls_read(rdpTls * tls, char * b, int length);
+int
+tls_pending(rdpTls * tls);
 CryptoCert
 tls_get_certificate(rdpTls * tls);
 
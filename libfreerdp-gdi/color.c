@@ -261,380 +261,367 @@ uint32 gdi_color_convert(uint32 srcColor, int srcBpp, int dstBpp, HCLRCONV clrco
 		return gdi_color_convert_rgb(srcColor, srcBpp, dstBpp, clrconv);
 }
 
-uint8* gdi_image_convert_8bpp(uint8* srcData, uint8* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
+static void gdi_convert_row_lut16(uint8* dst, const uint8* src, int width, const uint32* lut)
 {
 	int i;
-	uint8 red;
-	uint8 green;
-	uint8 blue;
-	uint32 pixel;
-	uint8 *src8;
-	uint16 *dst16;
-	uint32 *dst32;
-
-	if (dstBpp == 8)
-	{
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height);
+	uint16* dst16 = (uint16*) dst;
 
-		memcpy(dstData, srcData, width * height);
-		return dstData;
-	}
-	else if (dstBpp == 15 || (dstBpp == 16 && clrconv->rgb555))
+	for (i = 0; i < width; i++)
+		dst16[i] = (uint16) lut[src[i]];
+}
+
+static void gdi_convert_row_lut32(uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	int i;
+	uint32* dst32 = (uint32*) dst;
+
+	for (i = 0; i < width; i++)
+		dst32[i] = lut[src[i]];
+}
+
+static void gdi_convert_row_555_565(uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	int i;
+	uint8 red, green, blue;
+	uint16* src16 = (uint16*) src;
+	uint16* dst16 = (uint16*) dst;
+
+	for (i = 0; i < width; i++)
 	{
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 2);
-		
-		dst16 = (uint16 *) dstData;
-		for (i = width * height; i > 0; i--)
-		{
-			pixel = *srcData;
-			srcData++;
-			red = clrconv->palette->entries[pixel].red;
-			green = clrconv->palette->entries[pixel].green;
-			blue = clrconv->palette->entries[pixel].blue;
-			pixel = RGB15(red, green, blue);
-			*dst16 = pixel;
-			dst16++;
-		}
-		return dstData;
+		GetRGB_555(red, green, blue, src16[i]);
+		RGB_555_565(red, green, blue);
+		dst16[i] = RGB565(red, green, blue);
 	}
-	else if (dstBpp == 16)
+}
+
+static void gdi_convert_row_565_555(uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	int i;
+	uint8 red, green, blue;
+	uint16* src16 = (uint16*) src;
+	uint16* dst16 = (uint16*) dst;
+
+	for (i = 0; i < width; i++)
 	{
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 2);
-		
-		dst16 = (uint16 *) dstData;
-		for (i = width * height; i > 0; i--)
-		{
-			pixel = *srcData;
-			srcData++;
-			red = clrconv->palette->entries[pixel].red;
-			green = clrconv->palette->entries[pixel].green;
-			blue = clrconv->palette->entries[pixel].blue;
-			pixel = RGB16(red, green, blue);
-			*dst16 = pixel;
-			dst16++;
-		}
-		return dstData;
+		GetRGB_565(red, green, blue, src16[i]);
+		RGB_565_555(red, green, blue);
+		dst16[i] = RGB555(red, green, blue);
 	}
-	else if (dstBpp == 32)
+}
+
+static void gdi_convert_row_565_888(uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	int i;
+	uint8 red, green, blue;
+	uint16* src16 = (uint16*) src;
+
+	for (i = 0; i < width; i++)
 	{
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 4);
-		
-		src8 = (uint8*) srcData;
-		dst32 = (uint32*) dstData;
-		for (i = width * height; i > 0; i--)
-		{
-			pixel = *src8;
-			src8++;
-			red = clrconv->palette->entries[pixel].red;
-			green = clrconv->palette->entries[pixel].green;
-			blue = clrconv->palette->entries[pixel].blue;
-			pixel = BGR32(red, green, blue);
-			*dst32 = pixel;
-			dst32++;
-		}
-		return dstData;
+		GetBGR16(red, green, blue, src16[i]);
+		*dst++ = red;
+		*dst++ = green;
+		*dst++ = blue;
 	}
-
-	return srcData;
 }
 
-uint8* gdi_image_convert_15bpp(uint8* srcData, uint8* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
+static void gdi_convert_row_565_888_swap(uint8* dst, const uint8* src, int width, const uint32* lut)
 {
 	int i;
-	uint8 red;
-	uint8 green;
-	uint8 blue;
-	uint32 pixel;
-	uint16 *src16;
-	uint16 *dst16;
-	uint32 *dst32;
+	uint8 red, green, blue;
+	uint16* src16 = (uint16*) src;
 
-	if (dstBpp == 15 || (dstBpp == 16 && clrconv->rgb555))
+	for (i = 0; i < width; i++)
 	{
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 2);
+		GetBGR16(red, green, blue, src16[i]);
+		*dst++ = blue;
+		*dst++ = green;
+		*dst++ = red;
+	}
+}
 
-		memcpy(dstData, srcData, width * height * 2);
+static void gdi_convert_row_565_8888(uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	int i;
+	uint8 red, green, blue;
+	uint16* src16 = (uint16*) src;
+	uint32* dst32 = (uint32*) dst;
 
-		return dstData;
-	}
-	else if (dstBpp == 32)
+	for (i = 0; i < width; i++)
 	{
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 4);
-		
-		src16 = (uint16 *) srcData;
-		dst32 = (uint32 *) dstData;
-		for (i = width * height; i > 0; i--)
-		{
-			pixel = *src16;
-			src16++;
-			GetBGR16(red, green, blue, pixel);
-			pixel = BGR32(red, green, blue);
-			*dst32 = pixel;
-			dst32++;
-		}
-		return dstData;
+		GetBGR16(red, green, blue, src16[i]);
+		dst32[i] = BGR32(red, green, blue);
 	}
-	else if (dstBpp == 16)
+}
+
+static void gdi_convert_row_888_8888(uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	int i;
+	uint8 red, green, blue;
+	uint32* dst32 = (uint32*) dst;
+
+	for (i = 0; i < width; i++)
 	{
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 2);
-	
-		src16 = (uint16 *) srcData;
-		dst16 = (uint16 *) dstData;
-		for (i = width * height; i > 0; i--)
-		{
-			pixel = *src16;
-			src16++;
-			GetRGB_555(red, green, blue, pixel);
-			RGB_555_565(red, green, blue);
-			pixel = RGB565(red, green, blue);
-			*dst16 = pixel;
-			dst16++;
-		}
-		return dstData;
+		red = *src++;
+		green = *src++;
+		blue = *src++;
+		dst32[i] = BGR24(red, green, blue);
 	}
-
-	return srcData;
 }
 
-uint8* gdi_image_convert_16bpp(uint8* srcData, uint8* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
+static void gdi_convert_row_8888_565(uint8* dst, const uint8* src, int width, const uint32* lut)
 {
-	if (srcBpp == 15)
-		return gdi_image_convert_15bpp(srcData, dstData, width, height, srcBpp, dstBpp, clrconv);
+	int i;
+	uint8 red, green, blue;
+	uint32* src32 = (uint32*) src;
+	uint16* dst16 = (uint16*) dst;
 
-	if (dstBpp == 16)
+	for (i = 0; i < width; i++)
 	{
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 2);
-
-		if(clrconv->rgb555)
-		{
-			int i;
-			uint8 red, green, blue;
-			uint16* src16 = (uint16 *) srcData;
-			uint16* dst16 = (uint16 *) dstData;
+		GetBGR32(blue, green, red, src32[i]);
+		dst16[i] = RGB16(red, green, blue);
+	}
+}
 
-			for (i = width * height; i > 0; i--)
-			{
-				GetRGB_565(red, green, blue, (*src16));
-				RGB_565_555(red, green, blue);
-				(*dst16) = RGB555(red, green, blue);
-				src16++;
-				dst16++;
-			}
-		}
-		else
-		{
-			memcpy(dstData, srcData, width * height * 2);
-		}
+static void gdi_convert_row_8888_888(uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	int i;
 
-		return dstData;
-	}
-	else if (dstBpp == 24)
+	for (i = 0; i < width; i++)
 	{
-		int i;
-		uint8 *dst8;
-		uint16 *src16;
-		uint8 red, green, blue;
-
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 3);
+		*dst++ = src[0];
+		*dst++ = src[1];
+		*dst++ = src[2];
+		src += 4;
+	}
+}
 
-		dst8 = (uint8 *) dstData;
-		src16 = (uint16 *) srcData;
-		for (i = width * height; i > 0; i--)
-		{
-			GetBGR16(red, green, blue, *src16);
-			src16++;
+static void gdi_convert_row_8888_888_swap(uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	int i;
 
-			if (clrconv->invert)
-			{
-				*dst8++ = blue;
-				*dst8++ = green;
-				*dst8++ = red;
-			}
-			else
-			{
-				*dst8++ = red;
-				*dst8++ = green;
-				*dst8++ = blue;
-			}
-		}
-		return dstData;
-	}
-	else if (dstBpp == 32)
+	for (i = 0; i < width; i++)
 	{
-		int i;
-		uint32 pixel;
-		uint16 *src16;
-		uint32 *dst32;
-		uint8 red, green, blue;
-
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 4);
-
-		src16 = (uint16 *) srcData;
-		dst32 = (uint32 *) dstData;
-		for (i = width * height; i > 0; i--)
-		{
-			pixel = *src16;
-			src16++;
-			GetBGR16(red, green, blue, pixel);
-			pixel = BGR32(red, green, blue);
-			*dst32 = pixel;
-			dst32++;
-		}
-		return dstData;
+		*dst++ = src[2];
+		*dst++ = src[1];
+		*dst++ = src[0];
+		src += 4;
 	}
-
-	return srcData;
 }
 
-uint8* gdi_image_convert_24bpp(uint8* srcData, uint8* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
+static void gdi_convert_row_8888_alpha(uint8* dst, const uint8* src, int width, const uint32* lut)
 {
 	int i;
-	uint8 red;
-	uint8 green;
-	uint8 blue;
-	uint32 pixel;
-	uint32 *dst32;
 
-	if (dstBpp == 32)
+	for (i = 0; i < width; i++)
 	{
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 4);
-		
-		dst32 = (uint32 *) dstData;
-		for (i = width * height; i > 0; i--)
-		{
-			red = *(srcData++);
-			green = *(srcData++);
-			blue = *(srcData++);
-			pixel = BGR24(red, green, blue);
-			*dst32 = pixel;
-			dst32++;
-		}
-		return dstData;
+		*dst++ = src[0];
+		*dst++ = src[1];
+		*dst++ = src[2];
+		*dst++ = 0xFF;
+		src += 4;
 	}
+}
 
-	return srcData;
+static const p_gdi_convert_row gdi_convert_rows_c[GDI_CONVERSIONS] =
+{
+	gdi_convert_row_lut16,
+	gdi_convert_row_lut32,
+	gdi_convert_row_555_565,
+	gdi_convert_row_565_555,
+	gdi_convert_row_565_888,
+	gdi_convert_row_565_888_swap,
+	gdi_convert_row_565_8888,
+	gdi_convert_row_888_8888,
+	gdi_convert_row_8888_565,
+	gdi_convert_row_8888_888,
+	gdi_convert_row_8888_888_swap,
+	gdi_convert_row_8888_alpha
+};
+
+static p_gdi_convert_row gdi_convert_rows[GDI_CONVERSIONS] =
+{
+	gdi_convert_row_lut16,
+	gdi_convert_row_lut32,
+	gdi_convert_row_555_565,
+	gdi_convert_row_565_555,
+	gdi_convert_row_565_888,
+	gdi_convert_row_565_888_swap,
+	gdi_convert_row_565_8888,
+	gdi_convert_row_888_8888,
+	gdi_convert_row_8888_565,
+	gdi_convert_row_8888_888,
+	gdi_convert_row_8888_888_swap,
+	gdi_convert_row_8888_alpha
+};
+
+/* The portable version of a row conversion, SIMD routines finish rows with it */
+void gdi_convert_row(int conversion, uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	gdi_convert_rows_c[conversion](dst, src, width, lut);
+}
+
+/* Called by GDI_INIT_SIMD for the conversions it has faster routines for, NULL restores the portable one */
+void gdi_convert_set_row(int conversion, p_gdi_convert_row convert_row)
+{
+	gdi_convert_rows[conversion] = (convert_row != NULL) ? convert_row : gdi_convert_rows_c[conversion];
 }
 
-uint8* gdi_image_convert_32bpp(uint8* srcData, uint8* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
+#define GDI_CONVERT_COPY	-1
+#define GDI_CONVERT_NONE	-2
+
+/* The conversion between two formats, as the per pixel code of gdi_image_convert() used to do it */
+static int gdi_get_conversion(int srcBpp, int dstBpp, HCLRCONV clrconv)
 {
-	if (dstBpp == 16)
+	int rgb555 = (dstBpp == 15) || (dstBpp == 16 && clrconv->rgb555);
+
+	switch (srcBpp)
 	{
-		int index;
-		uint16 *dst16;
-		uint32 *src32;
-		uint8 red, green, blue;
+		case 8:
+			if (dstBpp == 8)
+				return GDI_CONVERT_COPY;
+			if (dstBpp == 15 || dstBpp == 16)
+				return GDI_CONVERT_LUT16;
+			if (dstBpp == 32)
+				return GDI_CONVERT_LUT32;
+			break;
 
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 2);
+		case 15:
+			if (rgb555)
+				return GDI_CONVERT_COPY;
+			/* 15 bpp sources have always been widened as 16 bpp ones */
+			if (dstBpp == 32)
+				return GDI_CONVERT_565_8888;
+			if (dstBpp == 16)
+				return GDI_CONVERT_555_565;
+			break;
 
-		dst16 = (uint16*) dstData;
-		src32 = (uint32*) srcData;
+		case 16:
+			if (dstBpp == 16)
+				return clrconv->rgb555 ? GDI_CONVERT_565_555 : GDI_CONVERT_COPY;
+			if (dstBpp == 24)
+				return clrconv->invert ? GDI_CONVERT_565_888_SWAP : GDI_CONVERT_565_888;
+			if (dstBpp == 32)
+				return GDI_CONVERT_565_8888;
+			break;
 
-		for (index = 0; index < width * height; index++)
-		{
-			GetBGR32(blue, green, red, *src32);
-			*dst16 = RGB16(red, green, blue);
-			src32++;
-			dst16++;
-		}
-		return dstData;
+		case 24:
+			if (dstBpp == 32)
+				return GDI_CONVERT_888_8888;
+			break;
+
+		case 32:
+			if (dstBpp == 16)
+				return GDI_CONVERT_8888_565;
+			if (dstBpp == 24)
+				return clrconv->invert ? GDI_CONVERT_8888_888_SWAP : GDI_CONVERT_8888_888;
+			if (dstBpp == 32)
+				return clrconv->alpha ? GDI_CONVERT_8888_ALPHA : GDI_CONVERT_COPY;
+			break;
+	}
+
+	return GDI_CONVERT_NONE;
+}
+
+/**
+ * Convert an image into a buffer provided by the caller, such as a part of a surface.
+ * @param srcData source pixels
+ * @param srcStride bytes from one source row to the next
+ * @param dstData destination pixels
+ * @param dstStride bytes from one destination row to the next
+ * @param width width in pixels
+ * @param height height in pixels
+ * @param srcBpp source bits per pixel
+ * @param dstBpp destination bits per pixel
+ * @param clrconv color conversion settings
+ * @return 0 if successful, 1 if the conversion is not supported
+ */
+
+int gdi_image_convert_rect(uint8* srcData, int srcStride, uint8* dstData, int dstStride, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
+{
+	int i, y;
+	int conversion;
+	int dstBytes;
+	uint8 red, green, blue;
+	uint32 lut[256];
+	RD_PALETTEENTRY* entry;
+	p_gdi_convert_row convert_row;
+
+	conversion = gdi_get_conversion(srcBpp, dstBpp, clrconv);
+	dstBytes = (dstBpp + 7) / 8;
+
+	if (conversion == GDI_CONVERT_NONE)
+		return 1;
+
+	/* whole images are converted as one long row */
+	if (srcStride == width * ((srcBpp + 7) / 8) && dstStride == width * dstBytes)
+	{
+		width *= height;
+		height = 1;
 	}
-	else if (dstBpp == 24)
+
+	if (conversion == GDI_CONVERT_COPY)
 	{
-		int index;
-		uint8 red, green, blue;
+		for (y = 0; y < height; y++)
+			memcpy(dstData + y * dstStride, srcData + y * srcStride, width * dstBytes);
 
-		if (dstData == NULL)
-			dstData = (uint8*) malloc(width * height * 3);
+		return 0;
+	}
 
-		for (index = 0; index < width * height; index++)
+	if (conversion == GDI_CONVERT_LUT16 || conversion == GDI_CONVERT_LUT32)
+	{
+		/* black until a palette is received */
+		memset(lut, 0, sizeof(lut));
+
+		for (i = 0; clrconv->palette != NULL && i < 256 && i < clrconv->palette->count; i++)
 		{
-			red = *(srcData++);
-			green = *(srcData++);
-			blue = *(srcData++);
+			entry = &clrconv->palette->entries[i];
+			red = entry->red;
+			green = entry->green;
+			blue = entry->blue;
 
-			if (clrconv->invert)
+			if (dstBpp == 32)
 			{
-				*dstData++ = blue;
-				*dstData++ = green;
-				*dstData++ = red;
+				lut[i] = BGR32(red, green, blue);
+			}
+			else if (dstBpp == 15 || clrconv->rgb555)
+			{
+				lut[i] = RGB15(red, green, blue);
 			}
 			else
 			{
-				*dstData++ = red;
-				*dstData++ = green;
-				*dstData++ = blue;
+				lut[i] = RGB16(red, green, blue);
 			}
-
-			srcData++;
 		}
-		return dstData;
 	}
-	else if (dstBpp == 32)
-	{
-		if (clrconv->alpha)
-		{
-			int x, y;
-			uint8 *dstp;
-
-			if (dstData == NULL)
-				dstData = (uint8*) malloc(width * height * 4);
-
-			memcpy(dstData, srcData, width * height * 4);
 
-			dstp = dstData;
-			for (y = 0; y < height; y++)
-			{
-				for (x = 0; x < width * 4; x += 4)
-				{
-					dstp += 3;
-					*dstp = 0xFF;
-					dstp++;
-				}
-			}
-		}
-		else
-		{
-			if (dstData == NULL)
-				dstData = (uint8*) malloc(width * height * 4);
+	convert_row = gdi_convert_rows[conversion];
 
-			memcpy(dstData, srcData, width * height * 4);
-		}
-		
-		return dstData;
-	}
+	for (y = 0; y < height; y++)
+		convert_row(dstData + y * dstStride, srcData + y * srcStride, width, lut);
 
-	return srcData;
+	return 0;
 }
 
-p_gdi_image_convert_bpp gdi_image_convert_[5] =
-{
-	NULL,
-	gdi_image_convert_8bpp,
-	gdi_image_convert_16bpp,
-	gdi_image_convert_24bpp,
-	gdi_image_convert_32bpp
-};
-
 uint8* gdi_image_convert(uint8* srcData, uint8* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv)
 {
-	p_gdi_image_convert_bpp _p_gdi_image_convert = gdi_image_convert_[IBPP(srcBpp)];
+	int srcBytes;
+	int dstBytes;
 
-	if (_p_gdi_image_convert != NULL)
-		return _p_gdi_image_convert(srcData, dstData, width, height, srcBpp, dstBpp, clrconv);
-	else
+	if (IBPP(srcBpp) == 0)
 		return 0;
+
+	if (gdi_get_conversion(srcBpp, dstBpp, clrconv) == GDI_CONVERT_NONE)
+		return srcData;
+
+	srcBytes = (srcBpp + 7) / 8;
+	dstBytes = (dstBpp + 7) / 8;
+
+	if (dstData == NULL)
+		dstData = (uint8*) malloc(width * height * dstBytes);
+
+	gdi_image_convert_rect(srcData, width * srcBytes, dstData, width * dstBytes, width, height, srcBpp, dstBpp, clrconv);
+
+	return dstData;
 }
 
 uint8*
@@ -233,12 +233,34 @@ typedef CLRCONV* HCLRCONV;
 
 #define IBPP(_bpp) (((_bpp + 1)/ 8) % 5)
 
-typedef uint8* (*p_gdi_image_convert_bpp)(uint8* srcData, uint8* dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv);
+/* Row Conversions, named after the source and destination pixel formats */
+enum GDI_CONVERSION
+{
+	GDI_CONVERT_LUT16, /* 8 bpp palette indices to 15 or 16 bpp */
+	GDI_CONVERT_LUT32, /* 8 bpp palette indices to 32 bpp */
+	GDI_CONVERT_555_565,
+	GDI_CONVERT_565_555,
+	GDI_CONVERT_565_888,
+	GDI_CONVERT_565_888_SWAP,
+	GDI_CONVERT_565_8888,
+	GDI_CONVERT_888_8888,
+	GDI_CONVERT_8888_565,
+	GDI_CONVERT_8888_888,
+	GDI_CONVERT_8888_888_SWAP,
+	GDI_CONVERT_8888_ALPHA, /* 32 bpp to 32 bpp with an opaque alpha byte */
+	GDI_CONVERSIONS
+};
+
+/* converts width pixels, lut holds the palette in the destination format for 8 bpp sources */
+typedef void (*p_gdi_convert_row)(uint8* dst, const uint8* src, int width, const uint32* lut);
 
 int gdi_get_pixel(uint8 * data, int x, int y, int width, int height, int bpp);
 void gdi_set_pixel(uint8* data, int x, int y, int width, int height, int bpp, int pixel);
 uint32 gdi_color_convert(uint32 srcColor, int srcBpp, int dstBpp, HCLRCONV clrconv);
 uint8* gdi_image_convert(uint8* srcData, uint8 *dstData, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv);
+int gdi_image_convert_rect(uint8* srcData, int srcStride, uint8* dstData, int dstStride, int width, int height, int srcBpp, int dstBpp, HCLRCONV clrconv);
+void gdi_convert_row(int conversion, uint8* dst, const uint8* src, int width, const uint32* lut);
+void gdi_convert_set_row(int conversion, p_gdi_convert_row convert_row);
 uint8* gdi_glyph_convert(int width, int height, uint8* data);
 uint8* gdi_mono_image_convert(uint8* srcData, int width, int height, int srcBpp, int dstBpp, uint32 bgcolor, uint32 fgcolor, HCLRCONV clrconv);
 int gdi_mono_cursor_convert(uint8* srcData, uint8* maskData, uint8* xorMask, uint8* andMask, int width, int height, int bpp, HCLRCONV clrconv);
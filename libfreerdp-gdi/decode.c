@@ -36,6 +36,7 @@ int gdi_decode_bitmap_data_ex(GDI *gdi, uint16 x, uint16 y, uint8 * data, int si
 	int tx, ty;
 	uint8* bitmapData;
 	uint32 bitmapDataLength;
+	RFX_SURFACE surface;
 	RFX_MESSAGE * message;
 
 	/* BITMAP_DATA_EX */
@@ -48,6 +49,37 @@ int gdi_decode_bitmap_data_ex(GDI *gdi, uint16 x, uint16 y, uint8 * data, int si
 	bitmapDataLength = GET_UINT32(data, 8); /* bitmapDataLength (4 bytes) */
 	bitmapData = data + 12; /* bitmapData */
 
+	if (gdi->dstBpp == 32)
+	{
+		/* 32bpp needs no conversion, decode straight into the primary surface */
+		surface.data = gdi->primary_buffer;
+		surface.width = gdi->width;
+		surface.height = gdi->height;
+		surface.stride = gdi->width * 4;
+		surface.pixel_format = RFX_PIXEL_FORMAT_BGRA;
+
+		message = rfx_process_message_surface((RFX_CONTEXT *) gdi->rfx_context,
+			bitmapData, bitmapDataLength, &surface, x, y);
+
+		for (i = 0; i < message->num_rects; i++)
+		{
+			gdi_InvalidateRegion(gdi->primary->hdc,
+					message->rects[i].x + x, message->rects[i].y + y,
+					message->rects[i].width, message->rects[i].height);
+		}
+
+		/* without rects the whole tiles have been drawn */
+		for (i = 0; message->num_rects == 0 && i < message->num_tiles; i++)
+		{
+			gdi_InvalidateRegion(gdi->primary->hdc,
+					message->tiles[i]->x + x, message->tiles[i]->y + y, 64, 64);
+		}
+
+		rfx_message_free(gdi->rfx_context, message);
+
+		return bitmapDataLength + 12;
+	}
+
 	/* decode bitmap data */
 	message = rfx_process_message((RFX_CONTEXT *) gdi->rfx_context, bitmapData, bitmapDataLength);
 
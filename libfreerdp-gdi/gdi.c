@@ -26,6 +26,8 @@
 #include "libgdi.h"
 
 #include "gdi.h"
+#include "gdi_region.h"
+#include "gdi_glyph.h"
 
 /* Ternary Raster Operation Table */
 const uint32 rop3_code_table[] =
@@ -435,6 +437,37 @@ gdi_bitmap_free(GDI_IMAGE *gdi_bmp)
 
 /* GDI callbacks registered in libfreerdp */
 
+/**
+ * Begin an update, the damage of the primary surface is reset.
+ * @param inst current instance
+ */
+
+static void
+gdi_ui_begin_update(struct rdp_inst * inst)
+{
+	GDI *gdi = GET_GDI(inst);
+	gdi_ValidateRegion(gdi->primary->hdc);
+}
+
+/**
+ * End an update, the damaged rectangles of the primary surface are passed
+ * to the update_region callback of the client, if any.
+ * @param inst current instance
+ */
+
+static void
+gdi_ui_end_update(struct rdp_inst * inst)
+{
+	GDI *gdi = GET_GDI(inst);
+	HGDI_WND hwnd = gdi->primary->hdc->hwnd;
+
+	if (hwnd->invalid->null || hwnd->count < 1)
+		return;
+
+	if (gdi->update_region != NULL)
+		gdi->update_region(inst, hwnd->cinvalid, hwnd->count);
+}
+
 static void
 gdi_ui_desktop_save(struct rdp_inst * inst, int offset, int x, int y, int cx, int cy)
 {
@@ -459,24 +492,11 @@ gdi_ui_desktop_restore(struct rdp_inst * inst, int offset, int x, int y, int cx,
 static RD_HGLYPH
 gdi_ui_create_glyph(struct rdp_inst * inst, int width, int height, uint8 * data)
 {
-	uint8* glyph;
-	GDI_IMAGE *gdi_bmp;
+	GDI *gdi = GET_GDI(inst);
 
 	DEBUG_GDI("gdi_ui_create_glyph: width:%d height:%d", width, height);
 
-	gdi_bmp = (GDI_IMAGE*) malloc(sizeof(GDI_IMAGE));
-	
-	gdi_bmp->hdc = gdi_GetDC();
-	gdi_bmp->hdc->bytesPerPixel = 1;
-	gdi_bmp->hdc->bitsPerPixel = 1;
-	glyph = gdi_glyph_convert(width, height, data);
-	gdi_bmp->bitmap = gdi_CreateBitmap(width, height, 1, glyph);
-	gdi_bmp->bitmap->bytesPerPixel = 1;
-	gdi_bmp->bitmap->bitsPerPixel = 1;
-	gdi_SelectObject(gdi_bmp->hdc, (HGDIOBJECT) gdi_bmp->bitmap);
-	gdi_bmp->org_bitmap = NULL;
-
-	return (RD_HGLYPH) gdi_bmp;
+	return (RD_HGLYPH) gdi_glyph_new(gdi->atlas, width, height, data);
 }
 
 /**
@@ -488,7 +508,7 @@ gdi_ui_create_glyph(struct rdp_inst * inst, int width, int height, uint8 * data)
 static void
 gdi_ui_destroy_glyph(struct rdp_inst * inst, RD_HGLYPH glyph)
 {
-	gdi_bitmap_free((GDI_IMAGE*) glyph);
+	gdi_glyph_free((HGDI_GLYPH) glyph);
 }
 
 /**
@@ -528,16 +548,182 @@ gdi_ui_create_bitmap(struct rdp_inst * inst, int width, int height, uint8* data)
 static void
 gdi_ui_paint_bitmap(struct rdp_inst * inst, int x, int y, int cx, int cy, int width, int height, uint8 * data)
 {
+	int srcx = 0;
+	int srcy = 0;
+	int srcStride;
+	uint8* srcp;
+	uint8* dstp;
+	HGDI_DC hdc;
+	HGDI_BITMAP bitmap;
 	GDI_IMAGE *gdi_bmp;
 	GDI *gdi = GET_GDI(inst);
 
 	DEBUG_GDI("ui_paint_bitmap: x:%d y:%d cx:%d cy:%d", x, y, cx, cy);
 
+	hdc = gdi->primary->hdc;
+	bitmap = gdi->primary->bitmap;
+
+	if (gdi_ClipCoords(hdc, &x, &y, &cx, &cy, &srcx, &srcy) == 0)
+		return;
+
+	/* convert the visible part straight into the surface */
+	if (cx <= width - srcx && cy <= height - srcy)
+	{
+		srcStride = width * ((gdi->srcBpp + 7) / 8);
+		srcp = data + (srcy * srcStride) + (srcx * ((gdi->srcBpp + 7) / 8));
+		dstp = bitmap->data + (y * bitmap->scanline) + (x * bitmap->bytesPerPixel);
+
+		if (gdi_image_convert_rect(srcp, srcStride, dstp, bitmap->scanline, cx, cy,
+			gdi->srcBpp, gdi->dstBpp, gdi->clrconv) == 0)
+		{
+			gdi_InvalidateRegion(hdc, x, y, cx, cy);
+			return;
+		}
+	}
+
 	gdi_bmp = (GDI_IMAGE*) inst->ui_create_bitmap(inst, width, height, data);
-	gdi_BitBlt(gdi->primary->hdc, x, y, cx, cy, gdi_bmp->hdc, 0, 0, GDI_SRCCOPY);
+	gdi_BitBlt(hdc, x, y, cx, cy, gdi_bmp->hdc, srcx, srcy, GDI_SRCCOPY);
 	inst->ui_destroy_bitmap(inst, (RD_HBITMAP) gdi_bmp);
 }
 
+/**
+ * Get the table converting bitmap update pixels to the primary surface format.\n
+ * Every possible source value is run once through the regular image conversion,
+ * 24 bpp pixels are handled one byte at a time. The table is rebuilt when the palette changes.
+ * @param gdi current GDI instance
+ * @return table, NULL if the conversion cannot be expressed as one
+ */
+
+static uint32*
+gdi_get_bitmap_colors(GDI* gdi)
+{
+	int i;
+	int count;
+	uint8* src;
+	uint8* dst;
+	uint8* result;
+
+	if (gdi->bitmap_colors_valid)
+		return gdi->bitmap_colors;
+
+	switch (gdi->srcBpp)
+	{
+		case 8:
+			if (gdi->clrconv->palette == NULL)
+				return NULL;
+			count = 256;
+			break;
+		case 15:
+		case 16:
+			count = 65536;
+			break;
+		case 24:
+			if (gdi->dstBpp != 32)
+				return NULL;
+			count = 3 * 256;
+			break;
+		default:
+			return NULL;
+	}
+
+	src = (uint8*) malloc(count * 3);
+	dst = (uint8*) malloc(count * 4);
+
+	if (gdi->srcBpp == 8)
+	{
+		for (i = 0; i < count; i++)
+			src[i] = i;
+	}
+	else if (gdi->srcBpp == 24)
+	{
+		memset(src, 0, count * 3);
+		for (i = 0; i < count; i++)
+			src[i * 3 + i / 256] = i % 256;
+	}
+	else
+	{
+		for (i = 0; i < count; i++)
+			((uint16*) src)[i] = i;
+	}
+
+	result = gdi_image_convert(src, dst, count, 1, gdi->srcBpp, gdi->dstBpp, gdi->clrconv);
+
+	if (result == dst)
+	{
+		if (gdi->bitmap_colors == NULL)
+			gdi->bitmap_colors = (uint32*) malloc(65536 * sizeof(uint32));
+
+		for (i = 0; i < count; i++)
+		{
+			if (gdi->dstBpp == 16)
+				gdi->bitmap_colors[i] = ((uint16*) dst)[i];
+			else
+				gdi->bitmap_colors[i] = ((uint32*) dst)[i];
+		}
+
+		gdi->bitmap_colors_valid = 1;
+	}
+
+	free(src);
+	free(dst);
+
+	return gdi->bitmap_colors_valid ? gdi->bitmap_colors : NULL;
+}
+
+/**
+ * Hand out the primary surface to decode a bitmap update into.
+ * @param inst current instance
+ * @param x x position
+ * @param y y position
+ * @param cx delta x
+ * @param cy delta y
+ * @param bpp bitmap bits per pixel
+ * @param dest destination to fill in
+ * @return 1 if the bitmap can be decoded into dest, 0 to use ui_paint_bitmap
+ */
+
+static int
+gdi_ui_begin_paint_bitmap(struct rdp_inst * inst, int x, int y, int cx, int cy, int bpp, RD_BITMAP_DEST * dest)
+{
+	HGDI_BITMAP bitmap;
+	GDI *gdi = GET_GDI(inst);
+
+	bitmap = gdi->primary->bitmap;
+
+	if ((bpp != gdi->srcBpp) || (x < 0) || (y < 0) || (cx <= 0) || (cy <= 0) ||
+		(x + cx > bitmap->width) || (y + cy > bitmap->height))
+		return 0;
+
+	dest->colors = gdi_get_bitmap_colors(gdi);
+
+	if (dest->colors == NULL)
+		return 0;
+
+	dest->data = bitmap->data + (y * bitmap->scanline) + (x * bitmap->bytesPerPixel);
+	dest->stride = bitmap->scanline;
+	dest->width = cx;
+	dest->height = cy;
+	dest->bpp = gdi->dstBpp;
+
+	return 1;
+}
+
+/**
+ * Finish a bitmap update decoded into the primary surface.
+ * @param inst current instance
+ * @param x x position
+ * @param y y position
+ * @param cx delta x
+ * @param cy delta y
+ */
+
+static void
+gdi_ui_end_paint_bitmap(struct rdp_inst * inst, int x, int y, int cx, int cy)
+{
+	GDI *gdi = GET_GDI(inst);
+	gdi_InvalidateRegion(gdi->primary->hdc, x, y, cx, cy);
+}
+
 /**
  * Destroy a bitmap.
  * @param inst current instance
@@ -725,11 +911,30 @@ gdi_ui_start_draw_glyphs(struct rdp_inst * inst, uint32 bgcolor, uint32 fgcolor)
 static void
 gdi_ui_draw_glyph(struct rdp_inst * inst, int x, int y, int cx, int cy, RD_HGLYPH glyph)
 {
-	GDI_IMAGE* gdi_bmp;
+	RD_GLYPH_POS pos;
 	GDI *gdi = GET_GDI(inst);
 
-	gdi_bmp = (GDI_IMAGE*) glyph;
-	gdi_BitBlt(gdi->drawing->hdc, x, y, cx, cy, gdi_bmp->hdc, 0, 0, GDI_DSPDxax);
+	pos.x = x;
+	pos.y = y;
+	pos.cx = cx;
+	pos.cy = cy;
+	pos.glyph = glyph;
+
+	gdi_DrawGlyphRun(gdi->drawing->hdc, &pos, 1);
+}
+
+/**
+ * Draw the glyphs of a text order at once.
+ * @param inst current instance
+ * @param glyphs glyphs and their positions
+ * @param count number of glyphs
+ */
+
+static void
+gdi_ui_draw_glyph_run(struct rdp_inst * inst, RD_GLYPH_POS * glyphs, int count)
+{
+	GDI *gdi = GET_GDI(inst);
+	gdi_DrawGlyphRun(gdi->drawing->hdc, glyphs, count);
 }
 
 /**
@@ -941,6 +1146,7 @@ gdi_ui_set_palette(struct rdp_inst * inst, RD_HPALETTE palette)
 	GDI *gdi = GET_GDI(inst);
 	DEBUG_GDI("gdi_ui_set_palette");
 	gdi->clrconv->palette = (RD_PALETTE*) palette;
+	gdi->bitmap_colors_valid = 0;
 }
 
 /**
@@ -1070,11 +1276,15 @@ gdi_ui_decode(struct rdp_inst * inst, uint8 * data, int size)
 static int
 gdi_register_callbacks(rdpInst * inst)
 {
+	inst->ui_begin_update = gdi_ui_begin_update;
+	inst->ui_end_update = gdi_ui_end_update;
 	inst->ui_desktop_save = gdi_ui_desktop_save;
 	inst->ui_desktop_restore = gdi_ui_desktop_restore;
 	inst->ui_create_bitmap = gdi_ui_create_bitmap;
 	inst->ui_paint_bitmap = gdi_ui_paint_bitmap;
 	inst->ui_destroy_bitmap = gdi_ui_destroy_bitmap;
+	inst->ui_begin_paint_bitmap = gdi_ui_begin_paint_bitmap;
+	inst->ui_end_paint_bitmap = gdi_ui_end_paint_bitmap;
 	inst->ui_line = gdi_ui_line;
 	inst->ui_rect = gdi_ui_rect;
 	inst->ui_polygon = gdi_ui_polygon;
@@ -1082,6 +1292,7 @@ gdi_register_callbacks(rdpInst * inst)
 	inst->ui_ellipse = gdi_ui_ellipse;
 	inst->ui_start_draw_glyphs = gdi_ui_start_draw_glyphs;
 	inst->ui_draw_glyph = gdi_ui_draw_glyph;
+	inst->ui_draw_glyph_run = gdi_ui_draw_glyph_run;
 	inst->ui_end_draw_glyphs = gdi_ui_end_draw_glyphs;
 	inst->ui_destblt = gdi_ui_destblt;
 	inst->ui_patblt = gdi_ui_patblt;
@@ -1098,6 +1309,8 @@ gdi_register_callbacks(rdpInst * inst)
 	inst->ui_set_surface = gdi_ui_switch_surface;
 	inst->ui_destroy_surface = gdi_ui_destroy_surface;
 	inst->ui_decode = gdi_ui_decode;
+	/* display lists are replayed through the callbacks above */
+	inst->ui_draw_list = NULL;
 	return 0;
 }
 
@@ -1168,11 +1381,14 @@ gdi_init(rdpInst * inst, uint32 flags)
 	gdi->drawing = gdi->primary;
 
 	gdi->primary->hdc->hwnd = (HGDI_WND) malloc(sizeof(GDI_WND));
+	memset(gdi->primary->hdc->hwnd, 0, sizeof(GDI_WND));
 	gdi->primary->hdc->hwnd->invalid = gdi_CreateRectRgn(0, 0, 0, 0);
 	gdi->primary->hdc->hwnd->invalid->null = 1;
+	gdi->primary->hdc->hwnd->max_invalid = GDI_MAX_INVALID_RECTS;
 
 	gdi->rfx_context = rfx_context_new();
 	gdi->tile = gdi_bitmap_new(gdi, 64, 64, 32, NULL);
+	gdi->atlas = gdi_atlas_new();
 
 	gdi_register_callbacks(inst);
 
@@ -1191,10 +1407,12 @@ void gdi_free(rdpInst* inst)
 	if (gdi)
 	{
 		gdi_bitmap_free(gdi->tile);
+		gdi_atlas_free(gdi->atlas);
 		rfx_context_free(gdi->rfx_context);
 		gdi_bitmap_free(gdi->primary);
 		gdi_DeleteObject((HGDIOBJECT) gdi->hdc);
 		free(gdi->clrconv);
+		free(gdi->bitmap_colors);
 		free(gdi);
 	}
 	
@@ -193,9 +193,16 @@ struct _GDI_BRUSH
 typedef struct _GDI_BRUSH GDI_BRUSH;
 typedef GDI_BRUSH* HGDI_BRUSH;
 
+/* default number of damage rectangles kept before falling back to the bounding box */
+#define GDI_MAX_INVALID_RECTS	32
+
 struct _GDI_WND
 {
-	HGDI_RGN invalid;
+	HGDI_RGN invalid; /* bounding box of the damage */
+	HGDI_RGN cinvalid; /* damage as banded rectangles */
+	int count; /* rectangles in cinvalid */
+	int ninvalid; /* rectangles allocated in cinvalid */
+	int max_invalid; /* above this many rectangles the bounding box is used */
 };
 typedef struct _GDI_WND GDI_WND;
 typedef GDI_WND* HGDI_WND;
@@ -258,10 +265,14 @@ struct _GDI
 	GDI_COLOR textColor;
 	void * rfx_context;
 	GDI_IMAGE *tile;
+	struct _GDI_ATLAS *atlas;
+	uint32* bitmap_colors;
+	int bitmap_colors_valid;
 
 	/* callbacks */
 	p_gdi_BitBlt BitBlt;
 	p_gdi_image_convert gdi_image_convert;
+	void (* update_region)(rdpInst * inst, HGDI_RGN rects, int count);
 };
 typedef struct _GDI GDI;
 
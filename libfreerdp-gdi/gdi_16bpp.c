@@ -29,6 +29,7 @@
 #include "gdi_region.h"
 #include "gdi_clipping.h"
 #include "gdi_drawing.h"
+#include "gdi_rop.h"
 
 #include "gdi_16bpp.h"
 
@@ -99,620 +100,13 @@ int FillRect_16bpp(HGDI_DC hdc, HGDI_RECT rect, HGDI_BRUSH hbr)
 	return 0;
 }
 
-static int BitBlt_BLACKNESS_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight)
+/* Solid pattern of an operation, glyphs are drawn in the text color */
+static uint32 gdi_get_pattern_color_16bpp(HGDI_DC hdc, int rop)
 {
-	int y;
-	uint8 *dstp;
+	if ((rop == GDI_DSPDxax) || (hdc->brush == NULL))
+		return gdi_get_color_16bpp(hdc, hdc->textColor);
 
-	for (y = 0; y < nHeight; y++)
-	{
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-			memset(dstp, 0, nWidth * hdcDest->bytesPerPixel);
-	}
-
-	return 0;
-}
-
-static int BitBlt_WHITENESS_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight)
-{
-	int y;
-	uint8 *dstp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-			memset(dstp, 0xFF, nWidth * hdcDest->bytesPerPixel);
-	}
-
-	return 0;
-}
-
-static int BitBlt_SRCCOPY_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int y;
-	uint8 *srcp;
-	uint8 *dstp;
-
-	if ((hdcDest->selectedObject != hdcSrc->selectedObject) ||
-	    gdi_CopyOverlap(nXDest, nYDest, nWidth, nHeight, nXSrc, nYSrc) == 0)
-	{
-		for (y = 0; y < nHeight; y++)
-		{
-			srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-			if (srcp != 0 && dstp != 0)
-			{
-				gdi_copy_mem(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
-			}
-		}
-
-		return 0;
-	}
-	
-	if (nYSrc < nYDest)
-	{
-		/* copy down (bottom to top) */
-		for (y = nHeight - 1; y >= 0; y--)
-		{
-			srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-			if (srcp != 0 && dstp != 0)
-			{
-				gdi_copy_mem(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
-			}
-		}
-	}
-	else if (nYSrc > nYDest || nXSrc > nXDest)
-	{
-		/* copy up or left (top top bottom) */
-		for (y = 0; y < nHeight; y++)
-		{
-			srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-			if (srcp != 0 && dstp != 0)
-			{
-				gdi_copy_mem(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
-			}
-		}
-	}
-	else
-	{
-		/* copy straight right */
-		for (y = 0; y < nHeight; y++)
-		{
-			srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-			if (srcp != 0 && dstp != 0)
-			{
-				gdi_copy_memb(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
-			}
-		}
-	}
-	
-	return 0;
-}
-
-static int BitBlt_NOTSRCCOPY_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = ~(*srcp);
-				srcp++;
-				dstp++;
-					
-				*dstp = ~(*srcp);
-				srcp++;
-				dstp++;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_DSTINVERT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight)
-{
-	int x, y;
-	uint8 *dstp;
-		
-	for (y = 0; y < nHeight; y++)
-	{
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = ~(*dstp);
-				dstp++;
-					
-				*dstp = ~(*dstp);
-				dstp++;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_SRCERASE_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-		
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = *srcp & ~(*dstp);
-				srcp++;
-				dstp++;
-					
-				*dstp = *srcp & ~(*dstp);
-				srcp++;
-				dstp++;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_NOTSRCERASE_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-		
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = ~(*srcp) & ~(*dstp);
-				srcp++;
-				dstp++;
-					
-				*dstp = ~(*srcp) & ~(*dstp);
-				srcp++;
-				dstp++;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_SRCINVERT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-		
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp ^= *srcp;
-				srcp++;
-				dstp++;
-					
-				*dstp ^= *srcp;
-				srcp++;
-				dstp++;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_SRCAND_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-		
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp &= *srcp;
-				srcp++;
-				dstp++;
-					
-				*dstp &= *srcp;
-				srcp++;
-				dstp++;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_SRCPAINT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-		
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp |= *srcp;
-				srcp++;
-				dstp++;
-					
-				*dstp |= *srcp;
-				srcp++;
-				dstp++;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_DSPDxax_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{	
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	uint8 *patp;
-	uint16 color16;
-	HGDI_BITMAP hSrcBmp;
-
-	/* D = (S & P) | (~S & D) */
-	/* DSPDxax, used to draw glyphs */
-
-	color16 = gdi_get_color_16bpp(hdcDest, hdcDest->textColor);
-
-	hSrcBmp = (HGDI_BITMAP) hdcSrc->selectedObject;
-	srcp = hSrcBmp->data;
-
-	if (hdcSrc->bytesPerPixel != 1)
-	{
-		printf("BitBlt_DSPDxax expects 1 bpp, unimplemented for %d\n", hdcSrc->bytesPerPixel);
-		return 0;
-	}
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				patp = (uint8*) &color16;
-
-				*dstp = (*srcp & *patp) | (~(*srcp) & *dstp);
-				dstp++;
-				patp++;
-
-				*dstp = (*srcp & *patp) | (~(*srcp) & *dstp);
-				dstp++;
-				patp++;
-				srcp++;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_SPna_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	uint8 *patp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);		
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				patp = gdi_get_brush_pointer(hdcDest, x, y);
-				
-				*dstp = *srcp & ~(*patp);
-				patp++;
-				srcp++;
-				dstp++;
-					
-				*dstp = *srcp & ~(*patp);
-				patp++;
-				srcp++;
-				dstp++;
-			}
-		}
-	}
-	
-	return 0;
-}
-
-static int BitBlt_DSna_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = ~(*srcp) & (*dstp);
-				srcp++;
-				dstp++;
-
-				*dstp = ~(*srcp) & (*dstp);
-				srcp++;
-				dstp++;
-			}
-		}
-	}
-
-	return 0;
-}
-
-
-static int BitBlt_MERGECOPY_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	uint8 *patp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				patp = gdi_get_brush_pointer(hdcDest, x, y);
-				
-				*dstp = *srcp & *patp;
-				patp++;
-				srcp++;
-				dstp++;
-					
-				*dstp = *srcp & *patp;
-				patp++;
-				srcp++;
-				dstp++;
-			}
-		}
-	}
-	
-	return 0;
-}
-
-static int BitBlt_MERGEPAINT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{				
-				*dstp = ~(*srcp) | *dstp;
-				srcp++;
-				dstp++;
-					
-				*dstp = ~(*srcp) | *dstp;
-				srcp++;
-				dstp++;
-			}
-		}
-	}
-	
-	return 0;
-}
-
-static int BitBlt_PATCOPY_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight)
-{
-	int x, y;
-	uint8 *dstp;
-	uint8 *patp;
-	uint16 color16;
-	uint16 *dstp16;
-
-	if(hdcDest->brush->style == GDI_BS_SOLID)
-	{
-		color16 = gdi_get_color_16bpp(hdcDest, hdcDest->brush->color);
-
-		for (y = 0; y < nHeight; y++)
-		{
-			dstp16 = (uint16*) gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-			if (dstp16 != 0)
-			{
-				for (x = 0; x < nWidth; x++)
-				{
-					*dstp16 = color16;
-					dstp16++;
-				}
-			}
-		}
-	}
-	else
-	{
-		for (y = 0; y < nHeight; y++)
-		{
-			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-			if (dstp != 0)
-			{
-				for (x = 0; x < nWidth; x++)
-				{
-					patp = gdi_get_brush_pointer(hdcDest, x, y);
-					
-					*dstp = *patp;
-					patp++;
-					dstp++;
-
-					*dstp = *patp;
-					patp++;
-					dstp++;
-				}
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_PATINVERT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight)
-{
-	int x, y;
-	uint8 *dstp;
-	uint8 *patp;
-	uint16 color16;
-	uint16 *dstp16;
-
-	if(hdcDest->brush->style == GDI_BS_SOLID)
-	{
-		color16 = gdi_get_color_16bpp(hdcDest, hdcDest->brush->color);
-
-		for (y = 0; y < nHeight; y++)
-		{
-			dstp16 = (uint16*) gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-			if (dstp16 != 0)
-			{
-				for (x = 0; x < nWidth; x++)
-				{
-					*dstp16 ^= color16;
-					dstp16++;
-				}
-			}
-		}
-	}
-	else
-	{
-		for (y = 0; y < nHeight; y++)
-		{
-			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-			if (dstp != 0)
-			{
-				for (x = 0; x < nWidth; x++)
-				{
-					patp = gdi_get_brush_pointer(hdcDest, x, y);
-					
-					*dstp = *patp ^ *dstp;
-					patp++;
-					dstp++;
-
-					*dstp = *patp ^ *dstp;
-					patp++;
-					dstp++;
-				}
-			}
-		}
-	}
-	
-	return 0;
-}
-
-static int BitBlt_PATPAINT_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	uint8 *patp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				patp = gdi_get_brush_pointer(hdcDest, x, y);
-				
-				*dstp = *dstp | (*patp | ~(*srcp));
-				patp++;
-				srcp++;
-				dstp++;
-					
-				*dstp = *dstp | (*patp | ~(*srcp));
-				patp++;
-				srcp++;
-				dstp++;
-			}
-		}
-	}
-	
-	return 0;
+	return gdi_get_color_16bpp(hdc, hdc->brush->color);
 }
 
 int BitBlt_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc, int rop)
@@ -729,84 +123,9 @@ int BitBlt_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeigh
 	}
 	
 	gdi_InvalidateRegion(hdcDest, nXDest, nYDest, nWidth, nHeight);
-	
-	switch (rop)
-	{
-		case GDI_BLACKNESS:
-			return BitBlt_BLACKNESS_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight);
-			break;
-
-		case GDI_WHITENESS:
-			return BitBlt_WHITENESS_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight);
-			break;
-
-		case GDI_SRCCOPY:
-			return BitBlt_SRCCOPY_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_SPna:
-			return BitBlt_SPna_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_DSna:
-			return BitBlt_DSna_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_DSPDxax:
-			return BitBlt_DSPDxax_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-			
-		case GDI_NOTSRCCOPY:
-			return BitBlt_NOTSRCCOPY_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_DSTINVERT:
-			return BitBlt_DSTINVERT_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight);
-			break;
-
-		case GDI_SRCERASE:
-			return BitBlt_SRCERASE_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_NOTSRCERASE:
-			return BitBlt_NOTSRCERASE_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_SRCINVERT:
-			return BitBlt_SRCINVERT_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_SRCAND:
-			return BitBlt_SRCAND_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_SRCPAINT:
-			return BitBlt_SRCPAINT_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_MERGECOPY:
-			return BitBlt_MERGECOPY_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_MERGEPAINT:
-			return BitBlt_MERGEPAINT_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_PATCOPY:
-			return BitBlt_PATCOPY_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight);
-			break;
 
-		case GDI_PATINVERT:
-			return BitBlt_PATINVERT_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight);
-			break;
-
-		case GDI_PATPAINT:
-			return BitBlt_PATPAINT_16bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-	}
-	
-	printf("BitBlt: unknown rop: 0x%08X\n", rop);
-	return 1;
+	return gdi_rop_blt(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc,
+		rop, gdi_get_pattern_color_16bpp(hdcDest, rop));
 }
 
 int PatBlt_16bpp(HGDI_DC hdc, int nXLeft, int nYLeft, int nWidth, int nHeight, int rop)
@@ -816,31 +135,8 @@ int PatBlt_16bpp(HGDI_DC hdc, int nXLeft, int nYLeft, int nWidth, int nHeight, i
 	
 	gdi_InvalidateRegion(hdc, nXLeft, nYLeft, nWidth, nHeight);
 
-	switch (rop)
-	{
-		case GDI_PATCOPY:
-			return BitBlt_PATCOPY_16bpp(hdc, nXLeft, nYLeft, nWidth, nHeight);
-			break;
-
-		case GDI_PATINVERT:
-			return BitBlt_PATINVERT_16bpp(hdc, nXLeft, nYLeft, nWidth, nHeight);
-			break;
-			
-		case GDI_DSTINVERT:
-			return BitBlt_DSTINVERT_16bpp(hdc, nXLeft, nYLeft, nWidth, nHeight);
-			break;
-
-		case GDI_BLACKNESS:
-			return BitBlt_BLACKNESS_16bpp(hdc, nXLeft, nYLeft, nWidth, nHeight);
-			break;
-
-		case GDI_WHITENESS:
-			return BitBlt_WHITENESS_16bpp(hdc, nXLeft, nYLeft, nWidth, nHeight);
-			break;
-	}
-	
-	printf("PatBlt: unknown rop: 0x%08X", rop);
-	return 1;
+	return gdi_rop_blt(hdc, nXLeft, nYLeft, nWidth, nHeight, NULL, 0, 0,
+		rop, gdi_get_pattern_color_16bpp(hdc, rop));
 }
 
 void SetPixel_BLACK_16bpp(uint16 *pixel, uint16 *pen)
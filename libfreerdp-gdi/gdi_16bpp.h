@@ -22,6 +22,7 @@
 
 typedef void (*pSetPixel16_ROP2)(uint16 *pixel, uint16 *pen);
 
+uint16 gdi_get_color_16bpp(HGDI_DC hdc, GDI_COLOR color);
 int FillRect_16bpp(HGDI_DC hdc, HGDI_RECT rect, HGDI_BRUSH hbr);
 int BitBlt_16bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc, int rop);
 int PatBlt_16bpp(HGDI_DC hdc, int nXLeft, int nYLeft, int nWidth, int nHeight, int rop);
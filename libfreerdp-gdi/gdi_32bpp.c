@@ -29,6 +29,7 @@
 #include "gdi_region.h"
 #include "gdi_clipping.h"
 #include "gdi_drawing.h"
+#include "gdi_rop.h"
 
 #include "gdi_32bpp.h"
 
@@ -85,707 +86,13 @@ int FillRect_32bpp(HGDI_DC hdc, HGDI_RECT rect, HGDI_BRUSH hbr)
 	return 0;
 }
 
-static int BitBlt_BLACKNESS_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight)
+/* Solid pattern of an operation, glyphs are drawn in the text color */
+static uint32 gdi_get_pattern_color_32bpp(HGDI_DC hdc, int rop)
 {
-	if (hdcDest->alpha)
-	{
-		int x, y;
-		uint8 *dstp;
-
-		for (y = 0; y < nHeight; y++)
-		{
-			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-			if (dstp != 0)
-			{
-				for (x = 0; x < nWidth; x++)
-				{
-					*dstp = 0;
-					dstp++;
-
-					*dstp = 0;
-					dstp++;
-
-					*dstp = 0;
-					dstp++;
-
-					*dstp = 0xFF;
-					dstp++;
-				}
-			}
-		}
-	}
-	else
-	{
-		int y;
-		uint8 *dstp;
-
-		for (y = 0; y < nHeight; y++)
-		{
-			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-			if (dstp != 0)
-				memset(dstp, 0, nWidth * hdcDest->bytesPerPixel);
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_WHITENESS_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight)
-{
-	int y;
-	uint8 *dstp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-			memset(dstp, 0xFF, nWidth * hdcDest->bytesPerPixel);
-	}
-
-	return 0;
-}
-
-static int BitBlt_SRCCOPY_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int y;
-	uint8 *srcp;
-	uint8 *dstp;
-
-	if ((hdcDest->selectedObject != hdcSrc->selectedObject) ||
-	    gdi_CopyOverlap(nXDest, nYDest, nWidth, nHeight, nXSrc, nYSrc) == 0)
-	{
-		for (y = 0; y < nHeight; y++)
-		{
-			srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-			if (srcp != 0 && dstp != 0)
-			{
-				gdi_copy_mem(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
-			}
-		}
-
-		return 0;
-	}
-	
-	if (nYSrc < nYDest)
-	{
-		/* copy down (bottom to top) */
-		for (y = nHeight - 1; y >= 0; y--)
-		{
-			srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-			if (srcp != 0 && dstp != 0)
-			{
-				gdi_copy_mem(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
-			}
-		}
-	}
-	else if (nYSrc > nYDest || nXSrc > nXDest)
-	{
-		/* copy up or left (top top bottom) */
-		for (y = 0; y < nHeight; y++)
-		{
-			srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-			if (srcp != 0 && dstp != 0)
-			{
-				gdi_copy_mem(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
-			}
-		}
-	}
-	else
-	{
-		/* copy straight right */
-		for (y = 0; y < nHeight; y++)
-		{
-			srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-			if (srcp != 0 && dstp != 0)
-			{
-				gdi_copy_memb(dstp, srcp, nWidth * hdcDest->bytesPerPixel);
-			}
-		}
-	}
-	
-	return 0;
-}
-
-static int BitBlt_NOTSRCCOPY_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = ~(*srcp);
-				srcp++;
-				dstp++;
-					
-				*dstp = ~(*srcp);
-				srcp++;
-				dstp++;
-
-				*dstp = ~(*srcp);
-				srcp += 2;
-				dstp += 2;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_DSTINVERT_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight)
-{
-	int x, y;
-	uint8 *dstp;
-		
-	for (y = 0; y < nHeight; y++)
-	{
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = ~(*dstp);
-				dstp++;
-					
-				*dstp = ~(*dstp);
-				dstp++;
-
-				*dstp = ~(*dstp);
-				dstp += 2;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_SRCERASE_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-		
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = *srcp & ~(*dstp);
-				srcp++;
-				dstp++;
-					
-				*dstp = *srcp & ~(*dstp);
-				srcp++;
-				dstp++;
-
-				*dstp = *srcp & ~(*dstp);
-				srcp += 2;
-				dstp += 2;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_NOTSRCERASE_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-		
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = ~(*srcp) & ~(*dstp);
-				srcp++;
-				dstp++;
-					
-				*dstp = ~(*srcp) & ~(*dstp);
-				srcp++;
-				dstp++;
-
-				*dstp = ~(*srcp) & ~(*dstp);
-				srcp += 2;
-				dstp += 2;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_SRCINVERT_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-		
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp ^= *srcp;
-				srcp++;
-				dstp++;
-					
-				*dstp ^= *srcp;
-				srcp++;
-				dstp++;
-
-				*dstp ^= *srcp;
-				srcp += 2;
-				dstp += 2;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_SRCAND_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-		
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp &= *srcp;
-				srcp++;
-				dstp++;
-					
-				*dstp &= *srcp;
-				srcp++;
-				dstp++;
-
-				*dstp &= *srcp;
-				srcp += 2;
-				dstp += 2;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_SRCPAINT_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-		
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp |= *srcp;
-				srcp++;
-				dstp++;
-					
-				*dstp |= *srcp;
-				srcp++;
-				dstp++;
-
-				*dstp |= *srcp;
-				srcp += 2;
-				dstp += 2;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_DSPDxax_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{	
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	uint8 *patp;
-	uint32 color32;
-	HGDI_BITMAP hSrcBmp;
-
-	/* D = (S & P) | (~S & D) */
-	/* DSPDxax, used to draw glyphs */
-
-	color32 = gdi_get_color_32bpp(hdcDest, hdcDest->textColor);
-
-	hSrcBmp = (HGDI_BITMAP) hdcSrc->selectedObject;
-	srcp = hSrcBmp->data;
-
-	if (hdcSrc->bytesPerPixel != 1)
-	{
-		printf("BitBlt_DSPDxax expects 1 bpp, unimplemented for %d\n", hdcSrc->bytesPerPixel);
-		return 0;
-	}
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				patp = (uint8*) &color32;
-
-				*dstp = (*srcp & *patp) | (~(*srcp) & *dstp);
-				dstp++;
-				patp++;
-
-				*dstp = (*srcp & *patp) | (~(*srcp) & *dstp);
-				dstp++;
-				patp++;
-
-				*dstp = (*srcp & *patp) | (~(*srcp) & *dstp);
-				dstp += 2;
-				srcp++;
-			}
-		}
-	}
-
-	return 0;
-}
-
-static int BitBlt_SPna_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	uint8 *patp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);		
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				patp = gdi_get_brush_pointer(hdcDest, x, y);
-				
-				*dstp = *srcp & ~(*patp);
-				patp++;
-				srcp++;
-				dstp++;
-					
-				*dstp = *srcp & ~(*patp);
-				patp++;
-				srcp++;
-				dstp++;
-
-				*dstp = *srcp & ~(*patp);
-				srcp += 2;
-				dstp += 2;
-			}
-		}
-	}
-	
-	return 0;
-}
-
-static int BitBlt_DSna_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				*dstp = ~(*srcp) & (*dstp);
-				srcp++;
-				dstp++;
-
-				*dstp = ~(*srcp) & (*dstp);
-				srcp++;
-				dstp++;
-
-				*dstp = ~(*srcp) & (*dstp);
-				srcp += 2;
-				dstp += 2;
-			}
-		}
-	}
-
-	return 0;
-}
-
-
-static int BitBlt_MERGECOPY_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	uint8 *patp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				patp = gdi_get_brush_pointer(hdcDest, x, y);
-				
-				*dstp = *srcp & *patp;
-				patp++;
-				srcp++;
-				dstp++;
-					
-				*dstp = *srcp & *patp;
-				patp++;
-				srcp++;
-				dstp++;
-
-				*dstp = *srcp & *patp;
-				dstp += 2;
-				srcp += 2;
-			}
-		}
-	}
-	
-	return 0;
-}
-
-static int BitBlt_MERGEPAINT_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{				
-				*dstp = ~(*srcp) | *dstp;
-				srcp++;
-				dstp++;
-					
-				*dstp = ~(*srcp) | *dstp;
-				srcp++;
-				dstp++;
-
-				*dstp = ~(*srcp) | *dstp;
-				dstp += 2;
-				srcp += 2;
-			}
-		}
-	}
-	
-	return 0;
-}
-
-static int BitBlt_PATCOPY_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight)
-{
-	int x, y;
-	uint8 *dstp;
-	uint8 *patp;
-	uint32 color32;
-	uint32 *dstp32;
-
-	if(hdcDest->brush->style == GDI_BS_SOLID)
-	{
-		color32 = gdi_get_color_32bpp(hdcDest, hdcDest->brush->color);
-
-		for (y = 0; y < nHeight; y++)
-		{
-			dstp32 = (uint32*) gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-			if (dstp32 != 0)
-			{
-				for (x = 0; x < nWidth; x++)
-				{
-					*dstp32 = color32;
-					dstp32++;
-				}
-			}
-		}
-	}
-	else
-	{
-		for (y = 0; y < nHeight; y++)
-		{
-			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-			if (dstp != 0)
-			{
-				for (x = 0; x < nWidth; x++)
-				{
-					patp = gdi_get_brush_pointer(hdcDest, x, y);
-				
-					*dstp = *patp;
-					patp++;
-					dstp++;
-					
-					*dstp = *patp;
-					patp++;
-					dstp++;
-
-					*dstp = *patp;
-					dstp += 2;
-				}
-			}
-		}
-	}
-	
-	return 0;
-}
-
-static int BitBlt_PATINVERT_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight)
-{
-	int x, y;
-	uint8 *dstp;
-	uint8 *patp;
-	uint32 color32;
-	uint32 *dstp32;
-		
-	if(hdcDest->brush->style == GDI_BS_SOLID)
-	{
-		color32 = gdi_get_color_32bpp(hdcDest, hdcDest->brush->color);
-
-		for (y = 0; y < nHeight; y++)
-		{
-			dstp32 = (uint32*) gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-			if (dstp32 != 0)
-			{
-				for (x = 0; x < nWidth; x++)
-				{
-					*dstp32 ^= color32;
-					dstp32++;
-				}
-			}
-		}
-	}
-	else
-	{
-		for (y = 0; y < nHeight; y++)
-		{
-			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-			if (dstp != 0)
-			{
-				for (x = 0; x < nWidth; x++)
-				{
-					patp = gdi_get_brush_pointer(hdcDest, x, y);
-					
-					*dstp = *patp ^ *dstp;
-					patp++;
-					dstp++;
-
-					*dstp = *patp ^ *dstp;
-					patp++;
-					dstp++;
-
-					*dstp = *patp ^ *dstp;
-					dstp += 2;
-				}
-			}
-		}
-	}
-	
-	return 0;
-}
+	if ((rop == GDI_DSPDxax) || (hdc->brush == NULL))
+		return gdi_get_color_32bpp(hdc, hdc->textColor);
 
-static int BitBlt_PATPAINT_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc)
-{
-	int x, y;
-	uint8 *srcp;
-	uint8 *dstp;
-	uint8 *patp;
-	
-	for (y = 0; y < nHeight; y++)
-	{
-		srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
-		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
-
-		if (dstp != 0)
-		{
-			for (x = 0; x < nWidth; x++)
-			{
-				patp = gdi_get_brush_pointer(hdcDest, x, y);
-				
-				*dstp = *dstp | (*patp | ~(*srcp));
-				patp++;
-				srcp++;
-				dstp++;
-					
-				*dstp = *dstp | (*patp | ~(*srcp));
-				patp++;
-				srcp++;
-				dstp++;
-
-				*dstp = *dstp | (*patp | ~(*srcp));
-				dstp += 2;
-				srcp += 2;
-			}
-		}
-	}
-	
-	return 0;
+	return gdi_get_color_32bpp(hdc, hdc->brush->color);
 }
 
 int BitBlt_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc, int rop)
@@ -802,84 +109,9 @@ int BitBlt_32bpp(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeigh
 	}
 	
 	gdi_InvalidateRegion(hdcDest, nXDest, nYDest, nWidth, nHeight);
-	
-	switch (rop)
-	{
-		case GDI_BLACKNESS:
-			return BitBlt_BLACKNESS_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight);
-			break;
-
-		case GDI_WHITENESS:
-			return BitBlt_WHITENESS_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight);
-			break;
-
-		case GDI_SRCCOPY:
-			return BitBlt_SRCCOPY_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_SPna:
-			return BitBlt_SPna_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_DSna:
-			return BitBlt_DSna_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_DSPDxax:
-			return BitBlt_DSPDxax_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-			
-		case GDI_NOTSRCCOPY:
-			return BitBlt_NOTSRCCOPY_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_DSTINVERT:
-			return BitBlt_DSTINVERT_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight);
-			break;
-
-		case GDI_SRCERASE:
-			return BitBlt_SRCERASE_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_NOTSRCERASE:
-			return BitBlt_NOTSRCERASE_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_SRCINVERT:
-			return BitBlt_SRCINVERT_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_SRCAND:
-			return BitBlt_SRCAND_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_SRCPAINT:
-			return BitBlt_SRCPAINT_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_MERGECOPY:
-			return BitBlt_MERGECOPY_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-
-		case GDI_MERGEPAINT:
-			return BitBlt_MERGEPAINT_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
 
-		case GDI_PATCOPY:
-			return BitBlt_PATCOPY_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight);
-			break;
-
-		case GDI_PATINVERT:
-			return BitBlt_PATINVERT_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight);
-			break;
-
-		case GDI_PATPAINT:
-			return BitBlt_PATPAINT_32bpp(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc);
-			break;
-	}
-	
-	printf("BitBlt: unknown rop: 0x%08X\n", rop);
-	return 1;
+	return gdi_rop_blt(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc,
+		rop, gdi_get_pattern_color_32bpp(hdcDest, rop));
 }
 
 int PatBlt_32bpp(HGDI_DC hdc, int nXLeft, int nYLeft, int nWidth, int nHeight, int rop)
@@ -889,31 +121,8 @@ int PatBlt_32bpp(HGDI_DC hdc, int nXLeft, int nYLeft, int nWidth, int nHeight, i
 	
 	gdi_InvalidateRegion(hdc, nXLeft, nYLeft, nWidth, nHeight);
 
-	switch (rop)
-	{
-		case GDI_PATCOPY:
-			return BitBlt_PATCOPY_32bpp(hdc, nXLeft, nYLeft, nWidth, nHeight);
-			break;
-
-		case GDI_PATINVERT:
-			return BitBlt_PATINVERT_32bpp(hdc, nXLeft, nYLeft, nWidth, nHeight);
-			break;
-			
-		case GDI_DSTINVERT:
-			return BitBlt_DSTINVERT_32bpp(hdc, nXLeft, nYLeft, nWidth, nHeight);
-			break;
-
-		case GDI_BLACKNESS:
-			return BitBlt_BLACKNESS_32bpp(hdc, nXLeft, nYLeft, nWidth, nHeight);
-			break;
-
-		case GDI_WHITENESS:
-			return BitBlt_WHITENESS_32bpp(hdc, nXLeft, nYLeft, nWidth, nHeight);
-			break;
-	}
-	
-	printf("PatBlt: unknown rop: 0x%08X", rop);
-	return 1;
+	return gdi_rop_blt(hdc, nXLeft, nYLeft, nWidth, nHeight, NULL, 0, 0,
+		rop, gdi_get_pattern_color_32bpp(hdc, rop));
 }
 
 void SetPixel_BLACK_32bpp(uint32 *pixel, uint32 *pen)
@@ -0,0 +1,380 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   GDI Glyph Atlas
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+   Glyphs are sent as 1 bpp bitmaps. They are widened once, when created,
+   to masks of one byte per pixel kept in the pages of an atlas instead of
+   in a bitmap and device context of their own each. A page holds cells of
+   one size class, so the cells of deleted glyphs are reused by glyphs of
+   about the same size and the masks of a font end up next to each other.
+   Glyphs larger than the biggest class get a page of their own.
+
+   Glyphs are owned by the glyph cache of the core, which outlives the GDI
+   when the client recreates it on resize. gdi_atlas_free() only detaches
+   the atlas then, and the last glyph deleted frees it.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <freerdp/freerdp.h>
+
+#include "gdi.h"
+#include "gdi_region.h"
+#include "gdi_clipping.h"
+#include "gdi_32bpp.h"
+#include "gdi_16bpp.h"
+
+#include "gdi_glyph.h"
+
+#define GDI_ATLAS_CLASSES	4	/* cell sides of 8, 16, 32 and 64 pixels */
+#define GDI_ATLAS_PAGE_SIZE	16384	/* bytes of masks in a page */
+
+struct _GDI_ATLAS_PAGE
+{
+	GDI_ATLAS* atlas;
+	GDI_ATLAS_PAGE* next;
+	int sizeClass; /* -1 for the page of a single large glyph */
+	int cellSize;
+	int cells;
+	int used;
+	int freeCell; /* first free cell, -1 when the page is full */
+	int* links; /* next free cell after each free cell */
+	GDI_GLYPH* glyphs;
+	uint8* data;
+};
+
+struct _GDI_ATLAS
+{
+	GDI_ATLAS_PAGE* pages[GDI_ATLAS_CLASSES * GDI_ATLAS_CLASSES];
+	int count; /* pages allocated */
+	int glyphs; /* glyphs not deleted yet */
+	int detached;
+};
+
+static p_gdi_glyph_row gdi_glyph_row_kernel = gdi_glyph_row;
+
+static int gdi_atlas_class(int size)
+{
+	int i;
+
+	for (i = 0; i < GDI_ATLAS_CLASSES; i++)
+	{
+		if (size <= (8 << i))
+			return i;
+	}
+
+	return -1;
+}
+
+static GDI_ATLAS_PAGE* gdi_atlas_page_new(GDI_ATLAS* atlas, int sizeClass, int cellSize, int cells)
+{
+	int i;
+	GDI_ATLAS_PAGE* page;
+
+	page = (GDI_ATLAS_PAGE*) malloc(sizeof(GDI_ATLAS_PAGE));
+	memset(page, 0, sizeof(GDI_ATLAS_PAGE));
+
+	page->atlas = atlas;
+	page->sizeClass = sizeClass;
+	page->cellSize = cellSize;
+	page->cells = cells;
+	page->links = (int*) malloc(cells * sizeof(int));
+	page->glyphs = (GDI_GLYPH*) malloc(cells * sizeof(GDI_GLYPH));
+	page->data = (uint8*) malloc(cells * cellSize + 1);
+
+	for (i = 0; i < cells; i++)
+		page->links[i] = (i + 1 < cells) ? i + 1 : -1;
+
+	page->freeCell = 0;
+	atlas->count++;
+
+	return page;
+}
+
+static void gdi_atlas_page_free(GDI_ATLAS_PAGE* page)
+{
+	page->atlas->count--;
+	free(page->links);
+	free(page->glyphs);
+	free(page->data);
+	free(page);
+}
+
+static void gdi_atlas_destroy(GDI_ATLAS* atlas)
+{
+	int i;
+	GDI_ATLAS_PAGE* page;
+
+	for (i = 0; i < GDI_ATLAS_CLASSES * GDI_ATLAS_CLASSES; i++)
+	{
+		while (atlas->pages[i] != NULL)
+		{
+			page = atlas->pages[i];
+			atlas->pages[i] = page->next;
+			gdi_atlas_page_free(page);
+		}
+	}
+
+	free(atlas);
+}
+
+GDI_ATLAS* gdi_atlas_new(void)
+{
+	GDI_ATLAS* atlas;
+
+	atlas = (GDI_ATLAS*) malloc(sizeof(GDI_ATLAS));
+	memset(atlas, 0, sizeof(GDI_ATLAS));
+
+	return atlas;
+}
+
+void gdi_atlas_free(GDI_ATLAS* atlas)
+{
+	if (atlas == NULL)
+		return;
+
+	atlas->detached = 1;
+
+	if (atlas->glyphs == 0)
+		gdi_atlas_destroy(atlas);
+}
+
+int gdi_atlas_get_pages(GDI_ATLAS* atlas)
+{
+	return atlas->count;
+}
+
+/**
+ * Create a glyph from a 1 bpp bitmap, its mask is stored in the atlas.
+ * @param atlas glyph atlas
+ * @param width glyph width
+ * @param height glyph height
+ * @param data rows of (width + 7) / 8 bytes, most significant bit first
+ * @return new glyph
+ */
+
+HGDI_GLYPH gdi_glyph_new(GDI_ATLAS* atlas, int width, int height, uint8* data)
+{
+	int x, y;
+	int cell;
+	int sizeClass;
+	int scanline;
+	uint8* srcp;
+	uint8* dstp;
+	HGDI_GLYPH glyph;
+	GDI_ATLAS_PAGE* page;
+
+	if (gdi_atlas_class(width) < 0 || gdi_atlas_class(height) < 0)
+	{
+		page = gdi_atlas_page_new(atlas, -1, width * height, 1);
+	}
+	else
+	{
+		sizeClass = gdi_atlas_class(width) * GDI_ATLAS_CLASSES + gdi_atlas_class(height);
+
+		for (page = atlas->pages[sizeClass]; page != NULL; page = page->next)
+		{
+			if (page->freeCell >= 0)
+				break;
+		}
+
+		if (page == NULL)
+		{
+			x = 8 << gdi_atlas_class(width);
+			y = 8 << gdi_atlas_class(height);
+			page = gdi_atlas_page_new(atlas, sizeClass, x * y, GDI_ATLAS_PAGE_SIZE / (x * y));
+			page->next = atlas->pages[sizeClass];
+			atlas->pages[sizeClass] = page;
+		}
+	}
+
+	cell = page->freeCell;
+	page->freeCell = page->links[cell];
+	page->used++;
+	atlas->glyphs++;
+
+	glyph = &page->glyphs[cell];
+	glyph->width = width;
+	glyph->height = height;
+	glyph->mask = page->data + cell * page->cellSize;
+	glyph->page = page;
+
+	scanline = (width + 7) / 8;
+	dstp = glyph->mask;
+
+	for (y = 0; y < height; y++)
+	{
+		srcp = data + y * scanline;
+
+		for (x = 0; x < width; x++)
+			*dstp++ = (srcp[x >> 3] & (0x80 >> (x & 7))) ? 0xFF : 0;
+	}
+
+	return glyph;
+}
+
+void gdi_glyph_free(HGDI_GLYPH glyph)
+{
+	int cell;
+	GDI_ATLAS* atlas;
+	GDI_ATLAS_PAGE* page;
+
+	page = glyph->page;
+	atlas = page->atlas;
+
+	cell = glyph - page->glyphs;
+	page->links[cell] = page->freeCell;
+	page->freeCell = cell;
+	page->used--;
+	atlas->glyphs--;
+
+	if (page->sizeClass < 0)
+		gdi_atlas_page_free(page);
+
+	if (atlas->detached && atlas->glyphs == 0)
+		gdi_atlas_destroy(atlas);
+}
+
+void gdi_glyph_row(uint8* dst, const uint8* mask, int width, uint32 color)
+{
+	int i;
+	uint32 m;
+	uint32 rgb;
+	uint32* dstp = (uint32*) dst;
+	static const uint8 rgb_mask[4] = { 0xFF, 0xFF, 0xFF, 0x00 };
+
+	memcpy(&rgb, rgb_mask, 4);
+
+	for (i = 0; i < width; i++)
+	{
+		m = (mask[i] * 0x01010101) & rgb;
+		dstp[i] = (color & m) | (dstp[i] & ~m);
+	}
+}
+
+/* Called by GDI_INIT_SIMD with the widest kernel the CPU can run */
+void gdi_glyph_set_row(p_gdi_glyph_row glyph_row)
+{
+	gdi_glyph_row_kernel = glyph_row;
+}
+
+static void gdi_glyph_row_16bpp(uint8* dst, const uint8* mask, int width, uint16 color)
+{
+	int i;
+	uint16 m;
+	uint16* dstp = (uint16*) dst;
+
+	for (i = 0; i < width; i++)
+	{
+		m = mask[i] * 0x0101;
+		dstp[i] = (color & m) | (dstp[i] & ~m);
+	}
+}
+
+static void gdi_glyph_row_8bpp(uint8* dst, const uint8* mask, int width, uint8 color)
+{
+	int i;
+
+	for (i = 0; i < width; i++)
+		dst[i] = (color & mask[i]) | (dst[i] & ~mask[i]);
+}
+
+/**
+ * Draw a run of glyphs in the text color, as DSPDxax blits of each of them
+ * would, and invalidate the area they cover at once.
+ * @param hdc device context
+ * @param glyphs positions of the glyphs
+ * @param count number of glyphs
+ * @return 0
+ */
+
+int gdi_DrawGlyphRun(HGDI_DC hdc, RD_GLYPH_POS* glyphs, int count)
+{
+	int i, j;
+	int x, y, w, h;
+	int srcx, srcy;
+	int left, top;
+	int right, bottom;
+	uint32 color;
+	uint8* dstp;
+	uint8* maskp;
+	HGDI_GLYPH glyph;
+
+	if (hdc->bytesPerPixel == 4)
+		color = gdi_get_color_32bpp(hdc, hdc->textColor);
+	else if (hdc->bytesPerPixel == 2)
+		color = gdi_get_color_16bpp(hdc, hdc->textColor);
+	else
+		color = (hdc->textColor >> 16) & 0xFF;
+
+	left = top = right = bottom = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		glyph = (HGDI_GLYPH) glyphs[i].glyph;
+
+		if (glyph == NULL)
+			continue;
+
+		x = glyphs[i].x;
+		y = glyphs[i].y;
+		w = (glyphs[i].cx < glyph->width) ? glyphs[i].cx : glyph->width;
+		h = (glyphs[i].cy < glyph->height) ? glyphs[i].cy : glyph->height;
+		srcx = 0;
+		srcy = 0;
+
+		if (gdi_ClipCoords(hdc, &x, &y, &w, &h, &srcx, &srcy) == 0 || w <= 0 || h <= 0)
+			continue;
+
+		for (j = 0; j < h; j++)
+		{
+			dstp = gdi_get_bitmap_pointer(hdc, x, y + j);
+			maskp = glyph->mask + (srcy + j) * glyph->width + srcx;
+
+			if (dstp == 0)
+				continue;
+
+			if (hdc->bytesPerPixel == 4)
+				gdi_glyph_row_kernel(dstp, maskp, w, color);
+			else if (hdc->bytesPerPixel == 2)
+				gdi_glyph_row_16bpp(dstp, maskp, w, (uint16) color);
+			else
+				gdi_glyph_row_8bpp(dstp, maskp, w, (uint8) color);
+		}
+
+		if (right == left)
+		{
+			left = x;
+			top = y;
+			right = x + w;
+			bottom = y + h;
+		}
+		else
+		{
+			left = (x < left) ? x : left;
+			top = (y < top) ? y : top;
+			right = (x + w > right) ? x + w : right;
+			bottom = (y + h > bottom) ? y + h : bottom;
+		}
+	}
+
+	if (right > left)
+		gdi_InvalidateRegion(hdc, left, top, right - left, bottom - top);
+
+	return 0;
+}
@@ -0,0 +1,49 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   GDI Glyph Atlas
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __GDI_GLYPH_H
+#define __GDI_GLYPH_H
+
+#include <freerdp/freerdp.h>
+#include "gdi.h"
+
+typedef struct _GDI_ATLAS GDI_ATLAS;
+typedef struct _GDI_ATLAS_PAGE GDI_ATLAS_PAGE;
+
+struct _GDI_GLYPH
+{
+	int width;
+	int height;
+	uint8* mask; /* 0x00 or 0xFF per pixel, rows are width bytes apart */
+	GDI_ATLAS_PAGE* page;
+};
+typedef struct _GDI_GLYPH GDI_GLYPH;
+typedef GDI_GLYPH* HGDI_GLYPH;
+
+/* masked fill of one 32 bpp row: dst = mask ? color : dst, alpha kept */
+typedef void (*p_gdi_glyph_row)(uint8* dst, const uint8* mask, int width, uint32 color);
+
+GDI_ATLAS* gdi_atlas_new(void);
+void gdi_atlas_free(GDI_ATLAS* atlas);
+int gdi_atlas_get_pages(GDI_ATLAS* atlas);
+HGDI_GLYPH gdi_glyph_new(GDI_ATLAS* atlas, int width, int height, uint8* data);
+void gdi_glyph_free(HGDI_GLYPH glyph);
+void gdi_glyph_row(uint8* dst, const uint8* mask, int width, uint32 color);
+void gdi_glyph_set_row(p_gdi_glyph_row glyph_row);
+int gdi_DrawGlyphRun(HGDI_DC hdc, RD_GLYPH_POS* glyphs, int count);
+
+#endif /* __GDI_GLYPH_H */
@@ -358,6 +358,238 @@ int gdi_PtInRect(HGDI_RECT rc, int x, int y)
 	return 0;
 }
 
+static int gdi_CompareInt(const void* a, const void* b)
+{
+	return *((int*) a) - *((int*) b);
+}
+
+/**
+ * Add a rectangle to the banded damage rectangles of a window.\n
+ * The rectangles are kept sorted by band and then by x. Bands never overlap,
+ * spans within a band never touch, and neighbouring bands with the same spans
+ * are merged, so the list stays as short as the shape allows.
+ * @param hwnd window
+ * @param left x1
+ * @param top y1
+ * @param right x2, exclusive
+ * @param bottom y2, exclusive
+ */
+
+static void gdi_UnionInvalidRect(HGDI_WND hwnd, int left, int top, int right, int bottom)
+{
+	int i, k;
+	int ya, yb;
+	int nys, nout;
+	int nspans, added;
+	int band, prev, prev_count;
+	int* ys;
+	int* spans;
+	HGDI_RGN cinvalid;
+	HGDI_RGN out;
+
+	cinvalid = hwnd->cinvalid;
+
+	/* nothing to do when an existing rectangle already covers it */
+	for (i = 0; i < hwnd->count; i++)
+	{
+		if (left >= cinvalid[i].x && right <= cinvalid[i].x + cinvalid[i].w &&
+			top >= cinvalid[i].y && bottom <= cinvalid[i].y + cinvalid[i].h)
+			return;
+	}
+
+	/* every band edge, each slab between two edges is one output band */
+	ys = (int*) malloc((hwnd->count * 2 + 2) * sizeof(int));
+	nys = 0;
+	ys[nys++] = top;
+	ys[nys++] = bottom;
+	for (i = 0; i < hwnd->count; i++)
+	{
+		ys[nys++] = cinvalid[i].y;
+		ys[nys++] = cinvalid[i].y + cinvalid[i].h;
+	}
+	qsort(ys, nys, sizeof(int), gdi_CompareInt);
+	for (i = 1, k = 1; i < nys; i++)
+	{
+		if (ys[i] != ys[k - 1])
+			ys[k++] = ys[i];
+	}
+	nys = k;
+
+	out = (HGDI_RGN) malloc(nys * (hwnd->count + 1) * sizeof(GDI_RGN));
+	spans = (int*) malloc((hwnd->count + 1) * 2 * sizeof(int));
+	nout = 0;
+	prev = -1;
+	prev_count = 0;
+
+	for (k = 0; k + 1 < nys; k++)
+	{
+		ya = ys[k];
+		yb = ys[k + 1];
+
+		/* spans of the band covering this slab, with the new span merged in */
+		nspans = 0;
+		added = !(top <= ya && yb <= bottom);
+		for (i = 0; i <= hwnd->count; i++)
+		{
+			int x1, x2;
+
+			if (i < hwnd->count)
+			{
+				if (cinvalid[i].y > ya || cinvalid[i].y + cinvalid[i].h < yb)
+					continue;
+				x1 = cinvalid[i].x;
+				x2 = cinvalid[i].x + cinvalid[i].w;
+				if (!added && left < x1)
+				{
+					x1 = left;
+					x2 = right;
+					added = 1;
+					i--;
+				}
+			}
+			else if (!added)
+			{
+				x1 = left;
+				x2 = right;
+				added = 1;
+			}
+			else
+			{
+				break;
+			}
+
+			if (nspans > 0 && x1 <= spans[nspans * 2 - 1])
+			{
+				if (x2 > spans[nspans * 2 - 1])
+					spans[nspans * 2 - 1] = x2;
+			}
+			else
+			{
+				spans[nspans * 2] = x1;
+				spans[nspans * 2 + 1] = x2;
+				nspans++;
+			}
+		}
+
+		if (nspans == 0)
+		{
+			prev = -1;
+			continue;
+		}
+
+		/* grow the band above when it ends here with the same spans */
+		if (prev >= 0 && prev_count == nspans && out[prev].y + out[prev].h == ya)
+		{
+			for (i = 0; i < nspans; i++)
+			{
+				if (out[prev + i].x != spans[i * 2] ||
+					out[prev + i].x + out[prev + i].w != spans[i * 2 + 1])
+					break;
+			}
+
+			if (i == nspans)
+			{
+				for (i = 0; i < nspans; i++)
+					out[prev + i].h += yb - ya;
+				continue;
+			}
+		}
+
+		band = nout;
+		for (i = 0; i < nspans; i++)
+		{
+			out[nout].objectType = GDIOBJECT_REGION;
+			out[nout].x = spans[i * 2];
+			out[nout].y = ya;
+			out[nout].w = spans[i * 2 + 1] - spans[i * 2];
+			out[nout].h = yb - ya;
+			out[nout].null = 0;
+			nout++;
+		}
+		prev = band;
+		prev_count = nspans;
+	}
+
+	free(spans);
+	free(ys);
+	free(hwnd->cinvalid);
+
+	hwnd->cinvalid = out;
+	hwnd->ninvalid = nys * (hwnd->count + 1);
+	hwnd->count = nout;
+
+	/* too fragmented, use the bounding box */
+	if (hwnd->count > ((hwnd->max_invalid > 0) ? hwnd->max_invalid : GDI_MAX_INVALID_RECTS))
+	{
+		left = out[0].x;
+		right = out[0].x + out[0].w;
+		for (i = 1; i < hwnd->count; i++)
+		{
+			if (out[i].x < left)
+				left = out[i].x;
+			if (out[i].x + out[i].w > right)
+				right = out[i].x + out[i].w;
+		}
+		out[0].x = left;
+		out[0].w = right - left;
+		out[0].h = out[hwnd->count - 1].y + out[hwnd->count - 1].h - out[0].y;
+		hwnd->count = 1;
+	}
+}
+
+/**
+ * Clip a rectangle to the window surface and add it to the damage rectangles.
+ * @param hwnd window
+ * @param bmp window surface
+ * @param x x1
+ * @param y y1
+ * @param w width
+ * @param h height
+ */
+
+static void gdi_InvalidateRect(HGDI_WND hwnd, HGDI_BITMAP bmp, int x, int y, int w, int h)
+{
+	int left = x;
+	int top = y;
+	int right = x + w;
+	int bottom = y + h;
+
+	if (left < 0)
+		left = 0;
+
+	if (top < 0)
+		top = 0;
+
+	if (bmp != NULL)
+	{
+		if (right > bmp->width)
+			right = bmp->width;
+
+		if (bottom > bmp->height)
+			bottom = bmp->height;
+	}
+
+	if (left >= right || top >= bottom)
+		return;
+
+	if (hwnd->count == 0)
+	{
+		if (hwnd->ninvalid < 1)
+		{
+			free(hwnd->cinvalid);
+			hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN));
+			hwnd->ninvalid = 1;
+		}
+
+		gdi_SetRgn(&hwnd->cinvalid[0], left, top, right - left, bottom - top);
+		hwnd->cinvalid[0].objectType = GDIOBJECT_REGION;
+		hwnd->count = 1;
+		return;
+	}
+
+	gdi_UnionInvalidRect(hwnd, left, top, right, bottom);
+}
+
 /**
  * Invalidate a given region, such that it is redrawn on the next region update.\n
  * @msdn{dd145003}
@@ -392,9 +624,13 @@ int gdi_InvalidateRegion(HGDI_DC hdc, int x, int y, int w, int h)
 		invalid->w = w;
 		invalid->h = h;
 		invalid->null = 0;
+		hdc->hwnd->count = 0;
+		gdi_InvalidateRect(hdc->hwnd, bmp, x, y, w, h);
 		return 0;
 	}
 
+	gdi_InvalidateRect(hdc->hwnd, bmp, x, y, w, h);
+
 	gdi_CRgnToRect(x, y, w, h, &rgn);
 	gdi_RgnToRect(invalid, &inv);
 
@@ -420,3 +656,20 @@ int gdi_InvalidateRegion(HGDI_DC hdc, int x, int y, int w, int h)
 
 	return 0;
 }
+
+/**
+ * Validate the whole window, dropping all damage.\n
+ * @msdn{dd145194}
+ * @param hdc device context
+ */
+
+void gdi_ValidateRegion(HGDI_DC hdc)
+{
+	if (hdc->hwnd == NULL)
+		return;
+
+	if (hdc->hwnd->invalid != NULL)
+		hdc->hwnd->invalid->null = 1;
+
+	hdc->hwnd->count = 0;
+}
@@ -40,5 +40,6 @@ int gdi_EqualRgn(HGDI_RGN hSrcRgn1, HGDI_RGN hSrcRgn2);
 int gdi_CopyRect(HGDI_RECT dst, HGDI_RECT src);
 int gdi_PtInRect(HGDI_RECT rc, int x, int y);
 int gdi_InvalidateRegion(HGDI_DC hdc, int x, int y, int w, int h);
+void gdi_ValidateRegion(HGDI_DC hdc);
 
 #endif /* __GDI_REGION_H */
@@ -0,0 +1,362 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   GDI Ternary Raster Operations
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+   A ternary raster operation code gives the result for each of the eight
+   combinations of a destination, source and pattern bit. Written as an
+   exclusive or of products of its operands (its algebraic normal form) it
+   becomes
+
+     r = c0 ^ c1 D ^ c2 S ^ c3 DS ^ c4 P ^ c5 DP ^ c6 SP ^ c7 DSP
+
+   which applies to every bit alike, so any of the 256 operations runs as a
+   single branch free row kernel over bytes, whatever the color depth. The
+   SSE2, AVX2 and NEON kernels installed by GDI_INIT_SIMD only differ from
+   gdi_rop_row() by how many bytes they process at once.
+
+   At 32 bpp the alpha byte of the destination is kept, except by SRCCOPY,
+   PATCOPY, BLACKNESS and WHITENESS which write whole pixels.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <freerdp/freerdp.h>
+
+#include "gdi.h"
+
+#include "gdi_rop.h"
+
+static p_gdi_rop_row gdi_rop_row_kernel = gdi_rop_row;
+
+/**
+ * Compile a ternary raster operation into the coefficients of its algebraic
+ * normal form, with a write mask that lets every byte through.
+ * @param rop raster operation code
+ * @param coef GDI_ROP_COEFS coefficients, all zeros or all ones
+ * @return operands used by the operation (GDI_ROP_D, GDI_ROP_S, GDI_ROP_P)
+ */
+
+int gdi_rop_compile(int rop, uint32 * coef)
+{
+	int i, k;
+	int operands;
+	uint8 code;
+	uint8 anf[8];
+
+	/* bit i of the code is the result for D = (i & 1), S = (i & 2), P = (i & 4) */
+	code = (rop >> 16) & 0xFF;
+
+	for (i = 0; i < 8; i++)
+		anf[i] = (code >> i) & 1;
+
+	for (k = 1; k < 8; k <<= 1)
+	{
+		for (i = 0; i < 8; i++)
+		{
+			if (i & k)
+				anf[i] ^= anf[i ^ k];
+		}
+	}
+
+	operands = 0;
+
+	for (i = 0; i < 8; i++)
+	{
+		coef[i] = anf[i] ? 0xFFFFFFFF : 0;
+
+		if (anf[i])
+			operands |= i;
+	}
+
+	coef[GDI_ROP_MASK] = 0xFFFFFFFF;
+
+	return operands;
+}
+
+void gdi_rop_row(uint8 * dst, const uint8 * src, const uint8 * pat, int n, const uint32 * coef)
+{
+	int i;
+	uint32 d, s, p, ds, r;
+	uint8 d8, s8, p8, ds8, r8, m8;
+
+	for (i = 0; i + 4 <= n; i += 4)
+	{
+		memcpy(&d, dst + i, 4);
+		memcpy(&s, src + i, 4);
+		memcpy(&p, pat + i, 4);
+
+		ds = d & s;
+		r = coef[0] ^ (d & coef[1]) ^ (s & coef[2]) ^ (ds & coef[3]) ^
+			(p & (coef[4] ^ (d & coef[5]) ^ (s & coef[6]) ^ (ds & coef[7])));
+		r = (r & coef[GDI_ROP_MASK]) | (d & ~coef[GDI_ROP_MASK]);
+
+		memcpy(dst + i, &r, 4);
+	}
+
+	/* the last bytes of 8 and 16 bpp rows */
+	for (; i < n; i++)
+	{
+		d8 = dst[i];
+		s8 = src[i];
+		p8 = pat[i];
+		m8 = ((const uint8 *) &coef[GDI_ROP_MASK])[i & 3];
+
+		ds8 = d8 & s8;
+		r8 = (uint8) coef[0] ^ (d8 & (uint8) coef[1]) ^ (s8 & (uint8) coef[2]) ^ (ds8 & (uint8) coef[3]) ^
+			(p8 & ((uint8) coef[4] ^ (d8 & (uint8) coef[5]) ^ (s8 & (uint8) coef[6]) ^ (ds8 & (uint8) coef[7])));
+
+		dst[i] = (r8 & m8) | (d8 & ~m8);
+	}
+}
+
+/* Called by GDI_INIT_SIMD with the widest kernel the CPU can run */
+void gdi_rop_set_row(p_gdi_rop_row rop_row)
+{
+	gdi_rop_row_kernel = rop_row;
+}
+
+static void gdi_rop_fill(uint8 * buf, int n, uint32 color, int bpp)
+{
+	int i;
+
+	if (bpp == 4)
+	{
+		for (i = 0; i < n / 4; i++)
+			((uint32 *) buf)[i] = color;
+	}
+	else if (bpp == 2)
+	{
+		for (i = 0; i < n / 2; i++)
+			((uint16 *) buf)[i] = (uint16) color;
+	}
+	else
+	{
+		memset(buf, color & 0xFF, n);
+	}
+}
+
+/* Repeat row y of the pattern over n bytes, from its first column */
+static void gdi_rop_tile(uint8 * buf, int n, HGDI_BITMAP pattern, int y)
+{
+	int size;
+	int length;
+
+	size = pattern->width * pattern->bytesPerPixel;
+
+	if (size > n)
+		size = n;
+
+	memcpy(buf, pattern->data + (y % pattern->height) * pattern->scanline, size);
+
+	while (size < n)
+	{
+		length = (size < n - size) ? size : n - size;
+		memcpy(buf + size, buf, length);
+		size += length;
+	}
+}
+
+/* Widen a source of one byte per pixel, such as a glyph, to the destination depth */
+static void gdi_rop_expand(uint8 * buf, const uint8 * src, int count, int bpp)
+{
+	int i;
+
+	if (bpp == 4)
+	{
+		for (i = 0; i < count; i++)
+			((uint32 *) buf)[i] = src[i] * 0x01010101;
+	}
+	else
+	{
+		for (i = 0; i < count; i++)
+			((uint16 *) buf)[i] = src[i] * 0x0101;
+	}
+}
+
+/**
+ * Perform any ternary raster operation on a clipped rectangle.\n
+ * The source may be the destination itself, in which case rows and row
+ * chunks are processed in an order that never reads what was written.
+ * @param hdcDest destination device context
+ * @param nXDest destination x1
+ * @param nYDest destination y1
+ * @param nWidth width
+ * @param nHeight height
+ * @param hdcSrc source device context, of the destination depth or of one
+ * byte per pixel, may be NULL when the operation has no source
+ * @param nXSrc source x1
+ * @param nYSrc source y1
+ * @param rop raster operation code
+ * @param color solid pattern in the destination format, used unless a
+ * pattern brush is selected. DSPDxax always uses it.
+ * @return 0 if successful, 1 if the source can not be used
+ */
+
+int gdi_rop_blt(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc, int rop, uint32 color)
+{
+	int i, j, y, k;
+	int n, length;
+	int chunk, chunks;
+	int bpp, operands;
+	int fill, expand, same;
+	int backwards, leftwards;
+	uint8 code;
+	uint8 * dstp;
+	uint8 * srcp;
+	const uint8 * s;
+	const uint8 * p;
+	HGDI_BITMAP pattern;
+	uint32 coef[GDI_ROP_COEFS];
+	uint32 sbuf[GDI_ROP_CHUNK / 4];
+	uint32 pbuf[GDI_ROP_CHUNK / 4];
+	static const uint8 alpha_mask[4] = { 0xFF, 0xFF, 0xFF, 0x00 };
+
+	code = (rop >> 16) & 0xFF;
+	operands = gdi_rop_compile(rop, coef);
+
+	bpp = hdcDest->bytesPerPixel;
+	n = nWidth * bpp;
+	chunk = GDI_ROP_CHUNK;
+	pattern = NULL;
+	expand = 0;
+	same = 0;
+
+	if (operands & GDI_ROP_S)
+	{
+		if ((hdcSrc == NULL) || ((hdcSrc->bytesPerPixel != bpp) && (hdcSrc->bytesPerPixel != 1)))
+		{
+			printf("BitBlt: no usable source for rop: 0x%08X\n", rop);
+			return 1;
+		}
+
+		expand = (hdcSrc->bytesPerPixel != bpp);
+		same = (hdcSrc->selectedObject == hdcDest->selectedObject);
+	}
+
+	/* when the source is the destination, rows are done bottom to top if
+	   they move down, and chunks right to left if they move right */
+	backwards = same && (nYSrc < nYDest);
+	leftwards = same && (nYSrc == nYDest) && (nXSrc < nXDest);
+
+	if (code == 0xCC && !expand)
+	{
+		/* SRCCOPY */
+		for (j = 0; j < nHeight; j++)
+		{
+			y = backwards ? nHeight - 1 - j : j;
+			srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
+			dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+
+			if (srcp != 0 && dstp != 0)
+				memmove(dstp, srcp, n);
+		}
+
+		return 0;
+	}
+
+	if (bpp == 4)
+		memcpy(&coef[GDI_ROP_MASK], alpha_mask, 4);
+
+	if (operands & GDI_ROP_P)
+	{
+		if ((hdcDest->brush != NULL) && (hdcDest->brush->style == GDI_BS_PATTERN) && (rop != GDI_DSPDxax))
+		{
+			pattern = hdcDest->brush->pattern;
+
+			if (pattern->bytesPerPixel != bpp)
+			{
+				printf("BitBlt: pattern brush of %d bytes per pixel unsupported\n", pattern->bytesPerPixel);
+				return 1;
+			}
+
+			/* every chunk starts on the first column of the pattern */
+			chunk = (GDI_ROP_CHUNK / (pattern->width * bpp)) * (pattern->width * bpp);
+		}
+	}
+	else if (operands == 0)
+	{
+		/* BLACKNESS and WHITENESS */
+		color = coef[0];
+
+		if (bpp == 4 && hdcDest->alpha)
+			color |= 0xFF000000;
+	}
+
+	if ((pattern == NULL) && ((operands & GDI_ROP_P) || (operands == 0)))
+		gdi_rop_fill((uint8 *) pbuf, (n < chunk) ? n : chunk, color, bpp);
+
+	/* constant results and PATCOPY copy whole pixels from the pattern row */
+	fill = (operands == 0) || (code == 0xF0);
+
+	chunks = (n + chunk - 1) / chunk;
+
+	for (j = 0; j < nHeight; j++)
+	{
+		y = backwards ? nHeight - 1 - j : j;
+		dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+		srcp = NULL;
+
+		if (dstp == 0)
+			continue;
+
+		if (operands & GDI_ROP_S)
+		{
+			srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc + y);
+
+			if (srcp == 0)
+				continue;
+		}
+
+		if (pattern != NULL)
+			gdi_rop_tile((uint8 *) pbuf, (n < chunk) ? n : chunk, pattern, y);
+
+		for (i = 0; i < chunks; i++)
+		{
+			k = (leftwards ? chunks - 1 - i : i) * chunk;
+			length = (n - k < chunk) ? n - k : chunk;
+
+			if (fill)
+			{
+				memcpy(dstp + k, pbuf, length);
+				continue;
+			}
+
+			if (expand)
+			{
+				gdi_rop_expand((uint8 *) sbuf, srcp + k / bpp, length / bpp, bpp);
+				s = (uint8 *) sbuf;
+			}
+			else if (same)
+			{
+				memcpy(sbuf, srcp + k, length);
+				s = (uint8 *) sbuf;
+			}
+			else
+			{
+				/* operations without a source read the destination instead */
+				s = (srcp != NULL) ? srcp + k : dstp + k;
+			}
+
+			p = (operands & GDI_ROP_P) ? (uint8 *) pbuf : dstp + k;
+
+			gdi_rop_row_kernel(dstp + k, s, p, length, coef);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,44 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   GDI Ternary Raster Operations
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __GDI_ROP_H
+#define __GDI_ROP_H
+
+#include <freerdp/freerdp.h>
+#include "gdi.h"
+
+/* operands of a ternary raster operation */
+#define GDI_ROP_D	0x01
+#define GDI_ROP_S	0x02
+#define GDI_ROP_P	0x04
+
+/* coefficients of a compiled raster operation, one per product of operands,
+   indexed by the operands it is made of, followed by the write mask */
+#define GDI_ROP_MASK	8
+#define GDI_ROP_COEFS	9
+
+/* bytes of a row handed to a row kernel at once */
+#define GDI_ROP_CHUNK	4096
+
+typedef void (*p_gdi_rop_row)(uint8 * dst, const uint8 * src, const uint8 * pat, int n, const uint32 * coef);
+
+int gdi_rop_compile(int rop, uint32 * coef);
+void gdi_rop_row(uint8 * dst, const uint8 * src, const uint8 * pat, int n, const uint32 * coef);
+void gdi_rop_set_row(p_gdi_rop_row rop_row);
+int gdi_rop_blt(HGDI_DC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HGDI_DC hdcSrc, int nXSrc, int nYSrc, int rop, uint32 color);
+
+#endif /* __GDI_ROP_H */
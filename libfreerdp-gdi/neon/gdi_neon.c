@@ -22,11 +22,110 @@
 #include <stdlib.h>
 
 #include <freerdp/freerdp.h>
+#include <arm_neon.h>
 #include "gdi.h"
+#include "color.h"
+#include "gdi_rop.h"
 
 #include "gdi_neon.h"
 
-void gdi_init_neon(GDI* gdi)
+/* gdi_rop_row() on 16 bytes at once, see gdi_rop.c */
+void gdi_rop_row_NEON(uint8 * dst, const uint8 * src, const uint8 * pat, int n, const uint32 * coef)
+{
+	int i;
+	uint8x16_t d, s, p, ds, r;
+	uint8x16_t c0 = vreinterpretq_u8_u32(vdupq_n_u32(coef[0]));
+	uint8x16_t c1 = vreinterpretq_u8_u32(vdupq_n_u32(coef[1]));
+	uint8x16_t c2 = vreinterpretq_u8_u32(vdupq_n_u32(coef[2]));
+	uint8x16_t c3 = vreinterpretq_u8_u32(vdupq_n_u32(coef[3]));
+	uint8x16_t c4 = vreinterpretq_u8_u32(vdupq_n_u32(coef[4]));
+	uint8x16_t c5 = vreinterpretq_u8_u32(vdupq_n_u32(coef[5]));
+	uint8x16_t c6 = vreinterpretq_u8_u32(vdupq_n_u32(coef[6]));
+	uint8x16_t c7 = vreinterpretq_u8_u32(vdupq_n_u32(coef[7]));
+	uint8x16_t mask = vreinterpretq_u8_u32(vdupq_n_u32(coef[GDI_ROP_MASK]));
+
+	for (i = 0; i + 16 <= n; i += 16)
+	{
+		d = vld1q_u8(dst + i);
+		s = vld1q_u8(src + i);
+		p = vld1q_u8(pat + i);
+
+		ds = vandq_u8(d, s);
+		r = veorq_u8(c4, vandq_u8(d, c5));
+		r = veorq_u8(r, vandq_u8(s, c6));
+		r = veorq_u8(r, vandq_u8(ds, c7));
+		r = vandq_u8(p, r);
+		r = veorq_u8(r, c0);
+		r = veorq_u8(r, vandq_u8(d, c1));
+		r = veorq_u8(r, vandq_u8(s, c2));
+		r = veorq_u8(r, vandq_u8(ds, c3));
+
+		/* (r & mask) | (d & ~mask) */
+		r = vbslq_u8(mask, r, d);
+
+		vst1q_u8(dst + i, r);
+	}
+
+	if (i < n)
+		gdi_rop_row(dst + i, src + i, pat + i, n - i, coef);
+}
+
+/* Row conversions, see color.c. They work on 8 pixels at once. */
+
+void gdi_convert_row_565_8888_NEON(uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	int i;
+	uint16x8_t p, t, g, l;
+	uint8x8x4_t out;
+
+	out.val[3] = vdup_n_u8(0);
+
+	for (i = 0; i + 8 <= width; i += 8)
+	{
+		p = vld1q_u16((const uint16_t*) (src + i * 2));
+
+		t = vshrq_n_u16(p, 11);
+		t = vorrq_u16(vshlq_n_u16(t, 3), vshrq_n_u16(t, 2));
+		g = vandq_u16(vshrq_n_u16(p, 5), vdupq_n_u16(0x3F));
+		g = vorrq_u16(vshlq_n_u16(g, 2), vshrq_n_u16(g, 4));
+		l = vandq_u16(p, vdupq_n_u16(0x1F));
+		l = vorrq_u16(vshlq_n_u16(l, 3), vshrq_n_u16(l, 2));
+
+		out.val[0] = vmovn_u16(l);
+		out.val[1] = vmovn_u16(g);
+		out.val[2] = vmovn_u16(t);
+
+		vst4_u8(dst + i * 4, out);
+	}
+
+	if (i < width)
+		gdi_convert_row(GDI_CONVERT_565_8888, dst + i * 4, src + i * 2, width - i, lut);
+}
+
+void gdi_convert_row_8888_565_NEON(uint8* dst, const uint8* src, int width, const uint32* lut)
 {
+	int i;
+	uint8x8x4_t p;
+	uint16x8_t v;
+
+	for (i = 0; i + 8 <= width; i += 8)
+	{
+		p = vld4_u8(src + i * 4);
 
+		v = vshlq_n_u16(vmovl_u8(vshr_n_u8(p.val[2], 3)), 11);
+		v = vorrq_u16(v, vshlq_n_u16(vmovl_u8(vshr_n_u8(p.val[1], 2)), 5));
+		v = vorrq_u16(v, vmovl_u8(vshr_n_u8(p.val[0], 3)));
+
+		vst1q_u16((uint16_t*) (dst + i * 2), v);
+	}
+
+	if (i < width)
+		gdi_convert_row(GDI_CONVERT_8888_565, dst + i * 2, src + i * 4, width - i, lut);
+}
+
+void gdi_init_neon(GDI* gdi)
+{
+	gdi_rop_set_row(gdi_rop_row_NEON);
+	gdi_convert_set_row(GDI_CONVERT_565_8888, gdi_convert_row_565_8888_NEON);
+	gdi_convert_set_row(GDI_CONVERT_8888_565, gdi_convert_row_8888_565_NEON);
 }
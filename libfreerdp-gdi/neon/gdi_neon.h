@@ -23,6 +23,9 @@
 #include "gdi.h"
 
 void gdi_init_neon(GDI* gdi);
+void gdi_rop_row_NEON(uint8 * dst, const uint8 * src, const uint8 * pat, int n, const uint32 * coef);
+void gdi_convert_row_565_8888_NEON(uint8* dst, const uint8* src, int width, const uint32* lut);
+void gdi_convert_row_8888_565_NEON(uint8* dst, const uint8* src, int width, const uint32* lut);
 
 #ifndef GDI_INIT_SIMD
 #define GDI_INIT_SIMD(_gdi) gdi_init_neon(_gdi)
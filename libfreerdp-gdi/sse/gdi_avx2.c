@@ -0,0 +1,209 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   GDI AVX2 Optimizations
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+   This file is the only one of libfreerdp-gdi built with -mavx2, its
+   routines are installed by gdi_init_sse() when the CPU reports AVX2
+   support at runtime. The results are identical to the C versions.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include <freerdp/freerdp.h>
+#include "gdi.h"
+#include "color.h"
+#include "gdi_rop.h"
+
+#include "gdi_sse.h"
+#include "gdi_avx2.h"
+
+/* gdi_rop_row() on 32 bytes at once, see gdi_rop.c */
+void gdi_rop_row_AVX2(uint8 * dst, const uint8 * src, const uint8 * pat, int n, const uint32 * coef)
+{
+	int i;
+	__m256i d, s, p, ds, r;
+	__m256i c0 = _mm256_set1_epi32(coef[0]);
+	__m256i c1 = _mm256_set1_epi32(coef[1]);
+	__m256i c2 = _mm256_set1_epi32(coef[2]);
+	__m256i c3 = _mm256_set1_epi32(coef[3]);
+	__m256i c4 = _mm256_set1_epi32(coef[4]);
+	__m256i c5 = _mm256_set1_epi32(coef[5]);
+	__m256i c6 = _mm256_set1_epi32(coef[6]);
+	__m256i c7 = _mm256_set1_epi32(coef[7]);
+	__m256i mask = _mm256_set1_epi32(coef[GDI_ROP_MASK]);
+
+	for (i = 0; i + 32 <= n; i += 32)
+	{
+		d = _mm256_loadu_si256((__m256i*) (dst + i));
+		s = _mm256_loadu_si256((__m256i*) (src + i));
+		p = _mm256_loadu_si256((__m256i*) (pat + i));
+
+		ds = _mm256_and_si256(d, s);
+		r = _mm256_xor_si256(c4, _mm256_and_si256(d, c5));
+		r = _mm256_xor_si256(r, _mm256_and_si256(s, c6));
+		r = _mm256_xor_si256(r, _mm256_and_si256(ds, c7));
+		r = _mm256_and_si256(p, r);
+		r = _mm256_xor_si256(r, c0);
+		r = _mm256_xor_si256(r, _mm256_and_si256(d, c1));
+		r = _mm256_xor_si256(r, _mm256_and_si256(s, c2));
+		r = _mm256_xor_si256(r, _mm256_and_si256(ds, c3));
+
+		/* (r & mask) | (d & ~mask) */
+		r = _mm256_or_si256(_mm256_and_si256(r, mask), _mm256_andnot_si256(mask, d));
+
+		_mm256_storeu_si256((__m256i*) (dst + i), r);
+	}
+
+	if (i < n)
+		gdi_rop_row_SSE2(dst + i, src + i, pat + i, n - i, coef);
+}
+
+/* Row conversions, see color.c */
+
+void gdi_convert_row_lut16_AVX2(uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	int i;
+	__m256i v0, v1;
+
+	for (i = 0; i + 16 <= width; i += 16)
+	{
+		v0 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*) (src + i)));
+		v1 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*) (src + i + 8)));
+		v0 = _mm256_i32gather_epi32((const int*) lut, v0, 4);
+		v1 = _mm256_i32gather_epi32((const int*) lut, v1, 4);
+
+		/* the pack interleaves the 128 bit lanes, put them back in order */
+		v0 = _mm256_permute4x64_epi64(_mm256_packus_epi32(v0, v1), 0xD8);
+		_mm256_storeu_si256((__m256i*) (dst + i * 2), v0);
+	}
+
+	if (i < width)
+		gdi_convert_row(GDI_CONVERT_LUT16, dst + i * 2, src + i, width - i, lut);
+}
+
+void gdi_convert_row_lut32_AVX2(uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	int i;
+	__m256i v;
+
+	for (i = 0; i + 8 <= width; i += 8)
+	{
+		v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*) (src + i)));
+		v = _mm256_i32gather_epi32((const int*) lut, v, 4);
+		_mm256_storeu_si256((__m256i*) (dst + i * 4), v);
+	}
+
+	if (i < width)
+		gdi_convert_row(GDI_CONVERT_LUT32, dst + i * 4, src + i, width - i, lut);
+}
+
+void gdi_convert_row_565_8888_AVX2(uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	int i;
+	__m256i p, lo, hi;
+	__m256i t, g, l;
+	__m256i m5 = _mm256_set1_epi16(0x1F);
+	__m256i m6 = _mm256_set1_epi16(0x3F);
+
+	for (i = 0; i + 16 <= width; i += 16)
+	{
+		p = _mm256_loadu_si256((__m256i*) (src + i * 2));
+
+		t = _mm256_srli_epi16(p, 11);
+		t = _mm256_or_si256(_mm256_slli_epi16(t, 3), _mm256_srli_epi16(t, 2));
+		g = _mm256_and_si256(_mm256_srli_epi16(p, 5), m6);
+		g = _mm256_or_si256(_mm256_slli_epi16(g, 2), _mm256_srli_epi16(g, 4));
+		l = _mm256_and_si256(p, m5);
+		l = _mm256_or_si256(_mm256_slli_epi16(l, 3), _mm256_srli_epi16(l, 2));
+
+		lo = _mm256_or_si256(_mm256_slli_epi16(g, 8), l);
+		hi = t;
+
+		/* the unpacks work within 128 bit lanes, pixels 0-3 and 8-11 then 4-7 and 12-15 */
+		p = _mm256_unpacklo_epi16(lo, hi);
+		t = _mm256_unpackhi_epi16(lo, hi);
+
+		_mm256_storeu_si256((__m256i*) (dst + i * 4), _mm256_permute2x128_si256(p, t, 0x20));
+		_mm256_storeu_si256((__m256i*) (dst + i * 4 + 32), _mm256_permute2x128_si256(p, t, 0x31));
+	}
+
+	if (i < width)
+		gdi_convert_row_565_8888_SSE2(dst + i * 4, src + i * 2, width - i, lut);
+}
+
+void gdi_convert_row_888_8888_AVX2(uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	int i;
+	__m256i v;
+	__m256i shuffle = _mm256_setr_epi8(
+		0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128,
+		0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128);
+
+	/* each lane loads 16 bytes for 4 pixels, stop before reading past the row */
+	for (i = 0; i + 10 <= width; i += 8)
+	{
+		v = _mm256_castsi128_si256(_mm_loadu_si128((__m128i*) (src + i * 3)));
+		v = _mm256_inserti128_si256(v, _mm_loadu_si128((__m128i*) (src + i * 3 + 12)), 1);
+		v = _mm256_shuffle_epi8(v, shuffle);
+		_mm256_storeu_si256((__m256i*) (dst + i * 4), v);
+	}
+
+	if (i < width)
+		gdi_convert_row(GDI_CONVERT_888_8888, dst + i * 4, src + i * 3, width - i, lut);
+}
+
+static __m256i gdi_pack_8888_565_AVX2(__m256i x)
+{
+	__m256i v;
+
+	v = _mm256_and_si256(_mm256_srli_epi32(x, 8), _mm256_set1_epi32(0xF800));
+	v = _mm256_or_si256(v, _mm256_and_si256(_mm256_srli_epi32(x, 5), _mm256_set1_epi32(0x07E0)));
+	v = _mm256_or_si256(v, _mm256_and_si256(_mm256_srli_epi32(x, 3), _mm256_set1_epi32(0x001F)));
+
+	return v;
+}
+
+void gdi_convert_row_8888_565_AVX2(uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	int i;
+	__m256i v0, v1;
+
+	for (i = 0; i + 16 <= width; i += 16)
+	{
+		v0 = gdi_pack_8888_565_AVX2(_mm256_loadu_si256((__m256i*) (src + i * 4)));
+		v1 = gdi_pack_8888_565_AVX2(_mm256_loadu_si256((__m256i*) (src + i * 4 + 32)));
+
+		v0 = _mm256_permute4x64_epi64(_mm256_packus_epi32(v0, v1), 0xD8);
+		_mm256_storeu_si256((__m256i*) (dst + i * 2), v0);
+	}
+
+	if (i < width)
+		gdi_convert_row_8888_565_SSE2(dst + i * 2, src + i * 4, width - i, lut);
+}
+
+void gdi_init_avx2(GDI* gdi)
+{
+	gdi_rop_set_row(gdi_rop_row_AVX2);
+	gdi_convert_set_row(GDI_CONVERT_LUT16, gdi_convert_row_lut16_AVX2);
+	gdi_convert_set_row(GDI_CONVERT_LUT32, gdi_convert_row_lut32_AVX2);
+	gdi_convert_set_row(GDI_CONVERT_565_8888, gdi_convert_row_565_8888_AVX2);
+	gdi_convert_set_row(GDI_CONVERT_888_8888, gdi_convert_row_888_8888_AVX2);
+	gdi_convert_set_row(GDI_CONVERT_8888_565, gdi_convert_row_8888_565_AVX2);
+}
@@ -22,11 +22,235 @@
 #include <stdlib.h>
 
 #include <freerdp/freerdp.h>
+#include <emmintrin.h>
 #include "gdi.h"
+#include "color.h"
+#include "gdi_rop.h"
+#include "gdi_glyph.h"
 
 #include "gdi_sse.h"
 
+#ifdef WITH_AVX2
+#include "gdi_avx2.h"
+
+static int gdi_cpu_has_avx2(void)
+{
+	/* checks the CPUID bits as well as OS support for saving the ymm registers */
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+#endif
+
+/* gdi_rop_row() on 16 bytes at once, see gdi_rop.c */
+void gdi_rop_row_SSE2(uint8 * dst, const uint8 * src, const uint8 * pat, int n, const uint32 * coef)
+{
+	int i;
+	__m128i d, s, p, ds, r;
+	__m128i c0 = _mm_set1_epi32(coef[0]);
+	__m128i c1 = _mm_set1_epi32(coef[1]);
+	__m128i c2 = _mm_set1_epi32(coef[2]);
+	__m128i c3 = _mm_set1_epi32(coef[3]);
+	__m128i c4 = _mm_set1_epi32(coef[4]);
+	__m128i c5 = _mm_set1_epi32(coef[5]);
+	__m128i c6 = _mm_set1_epi32(coef[6]);
+	__m128i c7 = _mm_set1_epi32(coef[7]);
+	__m128i mask = _mm_set1_epi32(coef[GDI_ROP_MASK]);
+
+	for (i = 0; i + 16 <= n; i += 16)
+	{
+		d = _mm_loadu_si128((__m128i*) (dst + i));
+		s = _mm_loadu_si128((__m128i*) (src + i));
+		p = _mm_loadu_si128((__m128i*) (pat + i));
+
+		ds = _mm_and_si128(d, s);
+		r = _mm_xor_si128(c4, _mm_and_si128(d, c5));
+		r = _mm_xor_si128(r, _mm_and_si128(s, c6));
+		r = _mm_xor_si128(r, _mm_and_si128(ds, c7));
+		r = _mm_and_si128(p, r);
+		r = _mm_xor_si128(r, c0);
+		r = _mm_xor_si128(r, _mm_and_si128(d, c1));
+		r = _mm_xor_si128(r, _mm_and_si128(s, c2));
+		r = _mm_xor_si128(r, _mm_and_si128(ds, c3));
+
+		/* (r & mask) | (d & ~mask) */
+		r = _mm_or_si128(_mm_and_si128(r, mask), _mm_andnot_si128(mask, d));
+
+		_mm_storeu_si128((__m128i*) (dst + i), r);
+	}
+
+	if (i < n)
+		gdi_rop_row(dst + i, src + i, pat + i, n - i, coef);
+}
+
+/* gdi_glyph_row() on 4 pixels at once, skipping those the glyph does not cover */
+void gdi_glyph_row_SSE2(uint8* dst, const uint8* mask, int width, uint32 color)
+{
+	int i;
+	uint32 bits;
+	__m128i d, m;
+	__m128i c = _mm_set1_epi32(color);
+	__m128i rgb = _mm_set1_epi32(0x00FFFFFF);
+
+	for (i = 0; i + 4 <= width; i += 4)
+	{
+		memcpy(&bits, mask + i, 4);
+
+		if (bits == 0)
+			continue;
+
+		/* widen each mask byte to the color bytes of its pixel */
+		m = _mm_cvtsi32_si128(bits);
+		m = _mm_unpacklo_epi8(m, m);
+		m = _mm_unpacklo_epi16(m, m);
+		m = _mm_and_si128(m, rgb);
+
+		d = _mm_loadu_si128((__m128i*) (dst + i * 4));
+		d = _mm_or_si128(_mm_and_si128(m, c), _mm_andnot_si128(m, d));
+		_mm_storeu_si128((__m128i*) (dst + i * 4), d);
+	}
+
+	if (i < width)
+		gdi_glyph_row(dst + i * 4, mask + i, width - i, color);
+}
+
+/* Row conversions, see color.c. They work on 8 pixels at once. */
+
+void gdi_convert_row_555_565_SSE2(uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	int i;
+	__m128i p, v;
+	__m128i rg = _mm_set1_epi16((short) 0xFFC0);
+	__m128i g0 = _mm_set1_epi16(0x0020);
+	__m128i b = _mm_set1_epi16(0x001F);
+
+	for (i = 0; i + 8 <= width; i += 8)
+	{
+		p = _mm_loadu_si128((__m128i*) (src + i * 2));
+
+		/* red and green move up a bit, the top green bit is repeated below them */
+		v = _mm_and_si128(_mm_slli_epi16(p, 1), rg);
+		v = _mm_or_si128(v, _mm_and_si128(_mm_srli_epi16(p, 4), g0));
+		v = _mm_or_si128(v, _mm_and_si128(p, b));
+
+		_mm_storeu_si128((__m128i*) (dst + i * 2), v);
+	}
+
+	if (i < width)
+		gdi_convert_row(GDI_CONVERT_555_565, dst + i * 2, src + i * 2, width - i, lut);
+}
+
+void gdi_convert_row_565_555_SSE2(uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	int i;
+	__m128i p, v;
+	__m128i rg = _mm_set1_epi16(0x7FE0);
+	__m128i b = _mm_set1_epi16(0x001F);
+
+	for (i = 0; i + 8 <= width; i += 8)
+	{
+		p = _mm_loadu_si128((__m128i*) (src + i * 2));
+
+		/* red and green move down a bit, dropping the low green bit */
+		v = _mm_and_si128(_mm_srli_epi16(p, 1), rg);
+		v = _mm_or_si128(v, _mm_and_si128(p, b));
+
+		_mm_storeu_si128((__m128i*) (dst + i * 2), v);
+	}
+
+	if (i < width)
+		gdi_convert_row(GDI_CONVERT_565_555, dst + i * 2, src + i * 2, width - i, lut);
+}
+
+void gdi_convert_row_565_8888_SSE2(uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	int i;
+	__m128i p, lo, hi;
+	__m128i t, g, l;
+	__m128i m5 = _mm_set1_epi16(0x1F);
+	__m128i m6 = _mm_set1_epi16(0x3F);
+
+	for (i = 0; i + 8 <= width; i += 8)
+	{
+		p = _mm_loadu_si128((__m128i*) (src + i * 2));
+
+		/* each field is widened to 8 bits by repeating its top bits below it */
+		t = _mm_srli_epi16(p, 11);
+		t = _mm_or_si128(_mm_slli_epi16(t, 3), _mm_srli_epi16(t, 2));
+		g = _mm_and_si128(_mm_srli_epi16(p, 5), m6);
+		g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+		l = _mm_and_si128(p, m5);
+		l = _mm_or_si128(_mm_slli_epi16(l, 3), _mm_srli_epi16(l, 2));
+
+		/* bytes 0 and 1 of each pixel, then byte 2 with a zero alpha byte */
+		lo = _mm_or_si128(_mm_slli_epi16(g, 8), l);
+		hi = t;
+
+		_mm_storeu_si128((__m128i*) (dst + i * 4), _mm_unpacklo_epi16(lo, hi));
+		_mm_storeu_si128((__m128i*) (dst + i * 4 + 16), _mm_unpackhi_epi16(lo, hi));
+	}
+
+	if (i < width)
+		gdi_convert_row(GDI_CONVERT_565_8888, dst + i * 4, src + i * 2, width - i, lut);
+}
+
+static __m128i gdi_pack_8888_565_SSE2(__m128i x)
+{
+	__m128i v;
+
+	v = _mm_and_si128(_mm_srli_epi32(x, 8), _mm_set1_epi32(0xF800));
+	v = _mm_or_si128(v, _mm_and_si128(_mm_srli_epi32(x, 5), _mm_set1_epi32(0x07E0)));
+	v = _mm_or_si128(v, _mm_and_si128(_mm_srli_epi32(x, 3), _mm_set1_epi32(0x001F)));
+
+	/* sign extend so that the signed saturation of the pack keeps all 16 bits */
+	return _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+}
+
+void gdi_convert_row_8888_565_SSE2(uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	int i;
+	__m128i v0, v1;
+
+	for (i = 0; i + 8 <= width; i += 8)
+	{
+		v0 = gdi_pack_8888_565_SSE2(_mm_loadu_si128((__m128i*) (src + i * 4)));
+		v1 = gdi_pack_8888_565_SSE2(_mm_loadu_si128((__m128i*) (src + i * 4 + 16)));
+
+		_mm_storeu_si128((__m128i*) (dst + i * 2), _mm_packs_epi32(v0, v1));
+	}
+
+	if (i < width)
+		gdi_convert_row(GDI_CONVERT_8888_565, dst + i * 2, src + i * 4, width - i, lut);
+}
+
+void gdi_convert_row_8888_alpha_SSE2(uint8* dst, const uint8* src, int width, const uint32* lut)
+{
+	int i;
+	__m128i p;
+	__m128i alpha = _mm_set1_epi32(0xFF000000);
+
+	for (i = 0; i + 4 <= width; i += 4)
+	{
+		p = _mm_loadu_si128((__m128i*) (src + i * 4));
+		_mm_storeu_si128((__m128i*) (dst + i * 4), _mm_or_si128(p, alpha));
+	}
+
+	if (i < width)
+		gdi_convert_row(GDI_CONVERT_8888_ALPHA, dst + i * 4, src + i * 4, width - i, lut);
+}
+
 void gdi_init_sse(GDI* gdi)
 {
+	gdi_rop_set_row(gdi_rop_row_SSE2);
+	gdi_glyph_set_row(gdi_glyph_row_SSE2);
+	gdi_convert_set_row(GDI_CONVERT_555_565, gdi_convert_row_555_565_SSE2);
+	gdi_convert_set_row(GDI_CONVERT_565_555, gdi_convert_row_565_555_SSE2);
+	gdi_convert_set_row(GDI_CONVERT_565_8888, gdi_convert_row_565_8888_SSE2);
+	gdi_convert_set_row(GDI_CONVERT_8888_565, gdi_convert_row_8888_565_SSE2);
+	gdi_convert_set_row(GDI_CONVERT_8888_ALPHA, gdi_convert_row_8888_alpha_SSE2);
 
+#ifdef WITH_AVX2
+	/* install the widest routines the CPU can run */
+	if (gdi_cpu_has_avx2())
+		gdi_init_avx2(gdi);
+#endif
 }
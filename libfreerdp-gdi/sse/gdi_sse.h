@@ -23,6 +23,13 @@
 #include "gdi.h"
 
 void gdi_init_sse(GDI* gdi);
+void gdi_rop_row_SSE2(uint8 * dst, const uint8 * src, const uint8 * pat, int n, const uint32 * coef);
+void gdi_glyph_row_SSE2(uint8* dst, const uint8* mask, int width, uint32 color);
+void gdi_convert_row_555_565_SSE2(uint8* dst, const uint8* src, int width, const uint32* lut);
+void gdi_convert_row_565_555_SSE2(uint8* dst, const uint8* src, int width, const uint32* lut);
+void gdi_convert_row_565_8888_SSE2(uint8* dst, const uint8* src, int width, const uint32* lut);
+void gdi_convert_row_8888_565_SSE2(uint8* dst, const uint8* src, int width, const uint32* lut);
+void gdi_convert_row_8888_alpha_SSE2(uint8* dst, const uint8* src, int width, const uint32* lut);
 
 #ifndef GDI_INIT_SIMD
 #define GDI_INIT_SIMD(_gdi) gdi_init_sse(_gdi)
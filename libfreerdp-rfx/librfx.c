@@ -26,8 +26,10 @@
 #include <freerdp/utils/stream.h>
 
 #include "rfx_pool.h"
+#include "rfx_thread.h"
 #include "rfx_decode.h"
 #include "rfx_encode.h"
+#include "rfx_rlgr.h"
 #include "rfx_quantization.h"
 #include "rfx_dwt.h"
 
@@ -58,8 +60,7 @@ void rfx_profiler_create(RFX_CONTEXT * context)
 	PROFILER_CREATE(context->prof_rfx_differential_decode, "rfx_differential_decode");
 	PROFILER_CREATE(context->prof_rfx_quantization_decode, "rfx_quantization_decode");
 	PROFILER_CREATE(context->prof_rfx_dwt_2d_decode, "rfx_dwt_2d_decode");
-	PROFILER_CREATE(context->prof_rfx_decode_YCbCr_to_RGB, "rfx_decode_YCbCr_to_RGB");
-	PROFILER_CREATE(context->prof_rfx_decode_format_RGB, "rfx_decode_format_RGB");
+	PROFILER_CREATE(context->prof_rfx_decode_YCbCr_to_RGB, "rfx_decode_YCbCr_to_pixels");
 
 	PROFILER_CREATE(context->prof_rfx_encode_rgb, "rfx_encode_rgb");
 	PROFILER_CREATE(context->prof_rfx_encode_component, "rfx_encode_component");
@@ -80,7 +81,6 @@ void rfx_profiler_free(RFX_CONTEXT * context)
 	PROFILER_FREE(context->prof_rfx_quantization_decode);
 	PROFILER_FREE(context->prof_rfx_dwt_2d_decode);
 	PROFILER_FREE(context->prof_rfx_decode_YCbCr_to_RGB);
-	PROFILER_FREE(context->prof_rfx_decode_format_RGB);
 
 	PROFILER_FREE(context->prof_rfx_encode_rgb);
 	PROFILER_FREE(context->prof_rfx_encode_component);
@@ -103,7 +103,6 @@ void rfx_profiler_print(RFX_CONTEXT * context)
 	PROFILER_PRINT(context->prof_rfx_quantization_decode);
 	PROFILER_PRINT(context->prof_rfx_dwt_2d_decode);
 	PROFILER_PRINT(context->prof_rfx_decode_YCbCr_to_RGB);
-	PROFILER_PRINT(context->prof_rfx_decode_format_RGB);
 
 	PROFILER_PRINT(context->prof_rfx_encode_rgb);
 	PROFILER_PRINT(context->prof_rfx_encode_component);
@@ -126,22 +125,28 @@ rfx_context_new(void)
 	memset(context, 0, sizeof(RFX_CONTEXT));
 
 	context->pool = rfx_pool_new();
+	context->arena = rfx_arena_new();
+
+	/* tiles are decoded serially unless rfx_context_set_threads() says otherwise */
+	context->num_threads = 1;
 
 	/* initialize the default pixel format */
 	rfx_context_set_pixel_format(context, RFX_PIXEL_FORMAT_BGRA);
 
-	/* align buffers to 16 byte boundary (needed for SSE/SSE2 instructions) */
-	context->y_r_buffer = (sint16 *)(((uintptr_t)context->y_r_mem + 16) & ~ 0x0F);
-	context->cb_g_buffer = (sint16 *)(((uintptr_t)context->cb_g_mem + 16) & ~ 0x0F);
-	context->cr_b_buffer = (sint16 *)(((uintptr_t)context->cr_b_mem + 16) & ~ 0x0F);
+	/* align buffers to 32 byte boundary (needed for SSE2/AVX2 instructions) */
+	context->y_r_buffer = (sint16 *)(((uintptr_t)context->y_r_mem + 32) & ~ 0x1F);
+	context->cb_g_buffer = (sint16 *)(((uintptr_t)context->cb_g_mem + 32) & ~ 0x1F);
+	context->cr_b_buffer = (sint16 *)(((uintptr_t)context->cr_b_mem + 32) & ~ 0x1F);
 
-	context->dwt_buffer = (sint16 *)(((uintptr_t)context->dwt_mem + 16) & ~ 0x0F);
+	context->dwt_buffer = (sint16 *)(((uintptr_t)context->dwt_mem + 32) & ~ 0x1F);
 
 	/* create profilers for default decoding routines */
 	rfx_profiler_create(context);
 	
 	/* set up default routines */
+	context->rlgr_decode = rfx_rlgr_decode_fast;
 	context->decode_YCbCr_to_RGB = rfx_decode_YCbCr_to_RGB;
+	context->decode_YCbCr_to_pixels = rfx_decode_YCbCr_to_pixels;
 	context->encode_RGB_to_YCbCr = rfx_encode_RGB_to_YCbCr;
 	context->quantization_decode = rfx_quantization_decode;	
 	context->quantization_encode = rfx_quantization_encode;	
@@ -160,6 +165,8 @@ rfx_context_free(RFX_CONTEXT * context)
 	if (context->quants != NULL)
 		free(context->quants);
 
+	rfx_workers_free(context->workers);
+	rfx_arena_free(context->arena);
 	rfx_pool_free(context->pool);
 
 	rfx_profiler_print(context);
@@ -169,31 +176,62 @@ rfx_context_free(RFX_CONTEXT * context)
 		free(context);
 }
 
-void
-rfx_context_set_pixel_format(RFX_CONTEXT * context, RFX_PIXEL_FORMAT pixel_format)
+static int
+rfx_pixel_format_bytes(RFX_PIXEL_FORMAT pixel_format)
 {
-	context->pixel_format = pixel_format;
 	switch (pixel_format)
 	{
 		case RFX_PIXEL_FORMAT_BGRA:
 		case RFX_PIXEL_FORMAT_RGBA:
-			context->bytes_per_pixel = 4;
-			break;
+			return 4;
 		case RFX_PIXEL_FORMAT_BGR:
 		case RFX_PIXEL_FORMAT_RGB:
-			context->bytes_per_pixel = 3;
-			break;
+			return 3;
 		default:
-			context->bytes_per_pixel = 0;
-			break;
+			return 0;
 	}
 }
 
+void
+rfx_context_set_pixel_format(RFX_CONTEXT * context, RFX_PIXEL_FORMAT pixel_format)
+{
+	context->pixel_format = pixel_format;
+	context->bytes_per_pixel = rfx_pixel_format_bytes(pixel_format);
+}
+
+void
+rfx_context_set_threads(RFX_CONTEXT * context, int num_threads)
+{
+#ifdef WITH_PROFILER
+	/* the profilers are not thread safe */
+	num_threads = 1;
+#endif
+
+	if (num_threads < 1)
+		num_threads = 1;
+
+	if (num_threads == context->num_threads)
+		return;
+
+	rfx_workers_free(context->workers);
+	context->workers = NULL;
+	context->num_threads = num_threads;
+
+	if (num_threads > 1)
+		context->workers = rfx_workers_new(context, num_threads);
+}
+
 static void
 rfx_process_message_sync(RFX_CONTEXT * context, uint8 * data, int size)
 {
 	uint32 magic;
 
+	if (size < 6)
+	{
+		DEBUG_RFX("RFX_SYNC too short (%d bytes)", size);
+		return;
+	}
+
 	/* RFX_SYNC */
 	magic = GET_UINT32(data, 0); /* magic (4 bytes), 0xCACCACCA */
 
@@ -219,6 +257,12 @@ rfx_process_message_codec_versions(RFX_CONTEXT * context, uint8 * data, int size
 {
 	int numCodecs;
 
+	if (size < 4)
+	{
+		DEBUG_RFX("RFX_CODEC_VERSIONS too short (%d bytes)", size);
+		return;
+	}
+
 	numCodecs = GET_UINT8(data, 0); /* numCodecs (1 byte), must be set to 0x01 */
 
 	if (numCodecs != 1)
@@ -240,6 +284,12 @@ rfx_process_message_channels(RFX_CONTEXT * context, uint8 * data, int size)
 	int channelId;
 	uint8 numChannels;
 
+	if (size < 6)
+	{
+		DEBUG_RFX("RFX_CHANNELS too short (%d bytes)", size);
+		return;
+	}
+
 	numChannels = GET_UINT8(data, 0); /* numChannels (1 byte), must bet set to 0x01 */
 
 	if (numChannels != 1)
@@ -264,6 +314,12 @@ rfx_process_message_context(RFX_CONTEXT * context, uint8 * data, int size)
 	uint16 tileSize;
 	uint16 properties;
 
+	if (size < 5)
+	{
+		DEBUG_RFX("RFX_CONTEXT too short (%d bytes)", size);
+		return;
+	}
+
 	ctxId = GET_UINT8(data, 0); /* ctxId (1 byte), must be set to 0x00 */
 	tileSize = GET_UINT16(data, 1); /* tileSize (2 bytes), must be set to CT_TILE_64x64 (0x0040) */
 	properties = GET_UINT16(data, 3); /* properties (2 bytes) */
@@ -302,6 +358,12 @@ rfx_process_message_frame_begin(RFX_CONTEXT * context, RFX_MESSAGE * message, ui
 	uint32 frameIdx;
 	uint16 numRegions;
 
+	if (size < 6)
+	{
+		DEBUG_RFX("RFX_FRAME_BEGIN too short (%d bytes)", size);
+		return;
+	}
+
 	frameIdx = GET_UINT32(data, 0); /* frameIdx (4 bytes), if codec is in video mode, must be ignored */
 	numRegions = GET_UINT16(data, 4); /* numRegions (2 bytes) */
 
@@ -318,26 +380,37 @@ static void
 rfx_process_message_region(RFX_CONTEXT * context, RFX_MESSAGE * message, uint8 * data, int size)
 {
 	int i;
+	uint16 numRects;
+
+	if (size < 3)
+	{
+		DEBUG_RFX("RFX_REGION too short (%d bytes)", size);
+		return;
+	}
 
 	/* regionFlags (1 byte) */
-	message->num_rects = GET_UINT16(data, 1); /* numRects (2 bytes) */
+	numRects = GET_UINT16(data, 1); /* numRects (2 bytes) */
 
-	if (message->num_rects < 1)
+	if (numRects < 1)
 	{
 		DEBUG_RFX("no rects.");
 		return;
 	}
 
-	if (message->rects != NULL)
-		message->rects = (RFX_RECT*) realloc((void*) message->rects, message->num_rects * sizeof(RFX_RECT));
-	else
-		message->rects = (RFX_RECT*) malloc(message->num_rects * sizeof(RFX_RECT));
-
 	data += 3;
 	size -= 3;
 
+	if (size < numRects * 8)
+	{
+		DEBUG_RFX("RFX_REGION too short for %d rects (%d bytes)", numRects, size);
+		return;
+	}
+
+	message->num_rects = numRects;
+	message->rects = (RFX_RECT*) rfx_arena_alloc(context->arena, numRects * sizeof(RFX_RECT));
+
 	/* rects */
-	for (i = 0; i < message->num_rects && size > 0; i++)
+	for (i = 0; i < message->num_rects; i++)
 	{
 		/* RFX_RECT */
 		message->rects[i].x = GET_UINT16(data, 0); /* x (2 bytes) */
@@ -349,12 +422,11 @@ rfx_process_message_region(RFX_CONTEXT * context, RFX_MESSAGE * message, uint8 *
 			i, message->rects[i].x, message->rects[i].y, message->rects[i].width, message->rects[i].height);
 
 		data += 8;
-		size -= 8;
 	}
 }
 
-static void
-rfx_process_message_tile(RFX_CONTEXT * context, RFX_TILE * tile, uint8 * data, int size)
+static int
+rfx_process_message_tile(RFX_CONTEXT * context, RFX_MESSAGE * message, RFX_TILE_JOB * job, uint8 * data, int size)
 {
 	uint8 quantIdxY;
 	uint8 quantIdxCb;
@@ -362,6 +434,12 @@ rfx_process_message_tile(RFX_CONTEXT * context, RFX_TILE * tile, uint8 * data, i
 	uint16 xIdx, yIdx;
 	uint16 YLen, CbLen, CrLen;
 
+	if (size < 13)
+	{
+		DEBUG_RFX("RFX_TILE too short (%d bytes)", size);
+		return 0;
+	}
+
 	/* RFX_TILE */
 	quantIdxY = GET_UINT8(data, 0); /* quantIdxY (1 byte) */
 	quantIdxCb = GET_UINT8(data, 1); /* quantIdxCb (1 byte) */
@@ -375,25 +453,206 @@ rfx_process_message_tile(RFX_CONTEXT * context, RFX_TILE * tile, uint8 * data, i
 	DEBUG_RFX("quantIdxY:%d quantIdxCb:%d quantIdxCr:%d xIdx:%d yIdx:%d YLen:%d CbLen:%d CrLen:%d",
 		quantIdxY, quantIdxCb, quantIdxCr, xIdx, yIdx, YLen, CbLen, CrLen);
 
+	if (13 + YLen + CbLen + CrLen > size)
+	{
+		DEBUG_RFX("RFX_TILE component data exceeds block (%d bytes)", size);
+		return 0;
+	}
+
+	if (quantIdxY >= message->num_quants || quantIdxCb >= message->num_quants ||
+		quantIdxCr >= message->num_quants)
+	{
+		DEBUG_RFX("RFX_TILE quantization index out of range");
+		return 0;
+	}
+
 	data += 13;
 
-	tile->x = xIdx * 64;
-	tile->y = yIdx * 64;
+	job->tile->x = xIdx * 64;
+	job->tile->y = yIdx * 64;
+
+	job->y_data = data;
+	job->y_size = YLen;
+	job->y_quants = message->quants + (quantIdxY * 10);
+	job->cb_data = data + YLen;
+	job->cb_size = CbLen;
+	job->cb_quants = message->quants + (quantIdxCb * 10);
+	job->cr_data = data + YLen + CbLen;
+	job->cr_size = CrLen;
+	job->cr_quants = message->quants + (quantIdxCr * 10);
+
+	return 1;
+}
+
+/*
+   Region index of the message on the surface as left, top, right, bottom,
+   clipped to the surface. A message without rects updates the whole surface.
+   Returns 0 if nothing of the region is on the surface.
+*/
+static int
+rfx_surface_get_region(RFX_MESSAGE * message, RFX_SURFACE * surface, int x, int y, int index, int * r)
+{
+	if (message->num_rects > 0)
+	{
+		r[0] = x + message->rects[index].x;
+		r[1] = y + message->rects[index].y;
+		r[2] = r[0] + message->rects[index].width;
+		r[3] = r[1] + message->rects[index].height;
+
+		r[0] = (r[0] < 0 ? 0 : r[0]);
+		r[1] = (r[1] < 0 ? 0 : r[1]);
+		r[2] = (r[2] > surface->width ? surface->width : r[2]);
+		r[3] = (r[3] > surface->height ? surface->height : r[3]);
+	}
+	else
+	{
+		r[0] = 0;
+		r[1] = 0;
+		r[2] = surface->width;
+		r[3] = surface->height;
+	}
+
+	return (r[0] < r[2] && r[1] < r[3]);
+}
+
+/* intersect region r with the tile at (left, top), returns 0 if they don't overlap */
+static int
+rfx_surface_clip_tile(int * r, int left, int top)
+{
+	r[0] = (r[0] < left ? left : r[0]);
+	r[1] = (r[1] < top ? top : r[1]);
+	r[2] = (r[2] > left + 64 ? left + 64 : r[2]);
+	r[3] = (r[3] > top + 64 ? top + 64 : r[3]);
+
+	return (r[0] < r[2] && r[1] < r[3]);
+}
+
+/* copy the visible parts of a tile decoded into its own data to the surface */
+static void
+rfx_surface_copy_tile(RFX_MESSAGE * message, RFX_SURFACE * surface, int x, int y, RFX_TILE * tile)
+{
+	int i;
+	int row;
+	int r[4];
+	int bpp;
+	int left;
+	int top;
+	uint8 * src;
+	uint8 * dst;
+
+	bpp = rfx_pixel_format_bytes(surface->pixel_format);
+	left = x + tile->x;
+	top = y + tile->y;
+
+	for (i = 0; i < message->num_rects || i == 0; i++)
+	{
+		if (!rfx_surface_get_region(message, surface, x, y, i, r) ||
+			!rfx_surface_clip_tile(r, left, top))
+			continue;
+
+		src = tile->data + ((r[1] - top) * 64 + (r[0] - left)) * bpp;
+		dst = surface->data + r[1] * surface->stride + r[0] * bpp;
 
-	rfx_decode_rgb(context,
-		data, YLen, context->quants + (quantIdxY * 10),
-		data + YLen, CbLen, context->quants + (quantIdxCb * 10),
-		data + YLen + CbLen, CrLen, context->quants + (quantIdxCr * 10), tile->data);
+		for (row = r[1]; row < r[3]; row++)
+		{
+			memcpy(dst, src, (r[2] - r[0]) * bpp);
+			src += 64 * bpp;
+			dst += surface->stride;
+		}
+	}
+}
+
+/*
+   Decide where the pixels of a tile go. Without a surface, or when the tile is
+   only partially visible, it is decoded into its own data. A tile completely
+   inside one of the rects is decoded straight into the surface. Returns 0 if
+   nothing of the tile is visible and decoding can be skipped.
+*/
+static int
+rfx_process_message_tile_target(RFX_CONTEXT * context, RFX_MESSAGE * message, RFX_TILE_JOB * job,
+	RFX_SURFACE * surface, int x, int y)
+{
+	int i;
+	int r[4];
+	int bpp;
+	int left;
+	int top;
+	int visible;
+
+	if (surface == NULL)
+	{
+		job->pixel_format = context->pixel_format;
+		job->dst = job->tile->data;
+		job->dst_stride = 64 * context->bytes_per_pixel;
+		return 1;
+	}
+
+	bpp = rfx_pixel_format_bytes(surface->pixel_format);
+	left = x + job->tile->x;
+	top = y + job->tile->y;
+	visible = 0;
+
+	job->pixel_format = surface->pixel_format;
+	job->dst = job->tile->data;
+	job->dst_stride = 64 * bpp;
+
+	for (i = 0; i < message->num_rects || i == 0; i++)
+	{
+		if (!rfx_surface_get_region(message, surface, x, y, i, r) ||
+			!rfx_surface_clip_tile(r, left, top))
+			continue;
+
+		visible = 1;
+
+		if (r[0] == left && r[1] == top && r[2] == left + 64 && r[3] == top + 64)
+		{
+			job->dst = surface->data + top * surface->stride + left * bpp;
+			job->dst_stride = surface->stride;
+			break;
+		}
+	}
+
+	return visible;
 }
 
 static void
-rfx_process_message_tileset(RFX_CONTEXT * context, RFX_MESSAGE * message, uint8 * data, int size)
+rfx_process_message_decode_job(RFX_CONTEXT * context, RFX_TILE_JOB * job)
+{
+	RFX_SCRATCH scratch;
+
+	scratch.y_r_buffer = context->y_r_buffer;
+	scratch.cb_g_buffer = context->cb_g_buffer;
+	scratch.cr_b_buffer = context->cr_b_buffer;
+	scratch.dwt_buffer = context->dwt_buffer;
+
+	rfx_decode_rgb_scratch(context, &scratch,
+		job->y_data, job->y_size, job->y_quants,
+		job->cb_data, job->cb_size, job->cb_quants,
+		job->cr_data, job->cr_size, job->cr_quants,
+		job->pixel_format, job->dst, job->dst_stride);
+}
+
+static void
+rfx_process_message_tileset(RFX_CONTEXT * context, RFX_MESSAGE * message, uint8 * data, int size,
+	RFX_SURFACE * surface, int x, int y)
 {
 	int i;
+	int numTiles;
+	int numJobs;
 	uint16 subtype;
 	uint32 blockLen;
 	uint32 blockType;
 	uint32 tilesDataSize;
+	uint32 * quants;
+	RFX_TILE_JOB serial_job;
+	RFX_TILE_JOB * jobs;
+	RFX_TILE_JOB * job;
+
+	if (size < 14)
+	{
+		DEBUG_RFX("RFX_TILESET too short (%d bytes)", size);
+		return;
+	}
 
 	subtype = GET_UINT16(data, 0); /* subtype (2 bytes) must be set to CBT_TILESET (0xCAC2) */
 
@@ -403,21 +662,27 @@ rfx_process_message_tileset(RFX_CONTEXT * context, RFX_MESSAGE * message, uint8
 		return;
 	}
 
+	if (message->tiles != NULL)
+	{
+		DEBUG_RFX("only one tileset per message is supported.");
+		return;
+	}
+
 	/* idx (2 bytes), must be set to 0x0000 */
 	/* properties (2 bytes) */
 
-	context->num_quants = GET_UINT8(data, 6); /* numQuant (1 byte) */
+	message->num_quants = GET_UINT8(data, 6); /* numQuant (1 byte) */
 	/* tileSize (1 byte), must be set to 0x40 */
 
-	if (context->num_quants < 1)
+	if (message->num_quants < 1)
 	{
 		DEBUG_RFX("no quantization value.");
 		return;
 	}
 
-	message->num_tiles = GET_UINT16(data, 8); /* numTiles (2 bytes) */
+	numTiles = GET_UINT16(data, 8); /* numTiles (2 bytes) */
 
-	if (message->num_tiles < 1)
+	if (numTiles < 1)
 	{
 		DEBUG_RFX("no tiles.");
 		return;
@@ -428,41 +693,50 @@ rfx_process_message_tileset(RFX_CONTEXT * context, RFX_MESSAGE * message, uint8
 	data += 14;
 	size -= 14;
 
-	if (context->quants != NULL)
-		context->quants = (uint32*) realloc((void*) context->quants, context->num_quants * 10 * sizeof(uint32));
-	else
-		context->quants = (uint32*) malloc(context->num_quants * 10 * sizeof(uint32));
+	if (size < message->num_quants * 5)
+	{
+		DEBUG_RFX("RFX_TILESET too short for %d quantization values", message->num_quants);
+		message->num_quants = 0;
+		return;
+	}
+
+	message->quants = (uint32*) rfx_arena_alloc(context->arena, message->num_quants * 10 * sizeof(uint32));
 
 	/* quantVals */
-	for (i = 0; i < context->num_quants && size > 0; i++)
+	for (i = 0; i < message->num_quants; i++)
 	{
 		/* RFX_CODEC_QUANT */
-		context->quants[i * 10] = (data[0] & 0x0F);
-		context->quants[i * 10 + 1] = (data[0] >> 4);
-		context->quants[i * 10 + 2] = (data[1] & 0x0F);
-		context->quants[i * 10 + 3] = (data[1] >> 4);
-		context->quants[i * 10 + 4] = (data[2] & 0x0F);
-		context->quants[i * 10 + 5] = (data[2] >> 4);
-		context->quants[i * 10 + 6] = (data[3] & 0x0F);
-		context->quants[i * 10 + 7] = (data[3] >> 4);
-		context->quants[i * 10 + 8] = (data[4] & 0x0F);
-		context->quants[i * 10 + 9] = (data[4] >> 4);
+		quants = message->quants + i * 10;
+		quants[0] = (data[0] & 0x0F);
+		quants[1] = (data[0] >> 4);
+		quants[2] = (data[1] & 0x0F);
+		quants[3] = (data[1] >> 4);
+		quants[4] = (data[2] & 0x0F);
+		quants[5] = (data[2] >> 4);
+		quants[6] = (data[3] & 0x0F);
+		quants[7] = (data[3] >> 4);
+		quants[8] = (data[4] & 0x0F);
+		quants[9] = (data[4] >> 4);
 
 		DEBUG_RFX("quant %d (%d %d %d %d %d %d %d %d %d %d).",
-			i, context->quants[i * 10], context->quants[i * 10 + 1],
-			context->quants[i * 10 + 2], context->quants[i * 10 + 3],
-			context->quants[i * 10 + 4], context->quants[i * 10 + 5],
-			context->quants[i * 10 + 6], context->quants[i * 10 + 7],
-			context->quants[i * 10 + 8], context->quants[i * 10 + 9]);
+			i, quants[0], quants[1], quants[2], quants[3], quants[4],
+			quants[5], quants[6], quants[7], quants[8], quants[9]);
 
 		data += 5;
 		size -= 5;
 	}
 
-	message->tiles = rfx_pool_get_tiles(context->pool, message->num_tiles);
+	message->tiles = (RFX_TILE**) rfx_arena_alloc(context->arena, numTiles * sizeof(RFX_TILE*));
+
+	if (context->workers != NULL)
+		jobs = rfx_workers_get_jobs(context->workers, numTiles);
+	else
+		jobs = &serial_job;
+
+	numJobs = 0;
 
 	/* tiles */
-	for (i = 0; i < message->num_tiles && size > 0; i++)
+	for (i = 0; i < numTiles && size >= 6; i++)
 	{
 		/* RFX_TILE */
 		blockType = GET_UINT16(data, 0); /* blockType (2 bytes), must be set to CBT_TILE (0xCAC3) */
@@ -474,25 +748,68 @@ rfx_process_message_tileset(RFX_CONTEXT * context, RFX_MESSAGE * message, uint8
 			break;
 		}
 
-		rfx_process_message_tile(context, message->tiles[i], data + 6, blockLen - 6);
+		if (blockLen < 6 || blockLen > size)
+		{
+			DEBUG_RFX("invalid tile blockLen %d, %d bytes left", blockLen, size);
+			break;
+		}
+
+		/* with worker threads, tiles are only collected here and decoded by rfx_workers_run() below */
+		job = (context->workers != NULL ? &jobs[numJobs] : jobs);
+		job->tile = rfx_pool_get_tile(context->pool);
+
+		if (!rfx_process_message_tile(context, message, job, data + 6, blockLen - 6))
+		{
+			rfx_pool_put_tile(context->pool, job->tile);
+			break;
+		}
+
+		message->tiles[message->num_tiles++] = job->tile;
+
+		/* tiles outside of the clipping region are not decoded at all */
+		if (rfx_process_message_tile_target(context, message, job, surface, x, y))
+		{
+			if (context->workers == NULL)
+			{
+				rfx_process_message_decode_job(context, job);
+
+				if (surface != NULL && job->dst == job->tile->data)
+					rfx_surface_copy_tile(message, surface, x, y, job->tile);
+			}
+
+			numJobs++;
+		}
 
 		size -= blockLen;
 		data += blockLen;
 	}
+
+	if (context->workers != NULL)
+	{
+		rfx_workers_run(context->workers, numJobs);
+
+		for (i = 0; surface != NULL && i < numJobs; i++)
+		{
+			if (jobs[i].dst == jobs[i].tile->data)
+				rfx_surface_copy_tile(message, surface, x, y, jobs[i].tile);
+		}
+	}
 }
 
-RFX_MESSAGE *
-rfx_process_message(RFX_CONTEXT * context, uint8 * data, int size)
+static RFX_MESSAGE *
+rfx_process_message_blocks(RFX_CONTEXT * context, uint8 * data, int size,
+	RFX_SURFACE * surface, int x, int y)
 {
 	uint32 offset;
 	uint32 blockLen;
 	uint32 blockType;
 	RFX_MESSAGE * message;
 
-	message = (RFX_MESSAGE *) malloc(sizeof(RFX_MESSAGE));
+	message = (RFX_MESSAGE *) rfx_arena_alloc(context->arena, sizeof(RFX_MESSAGE));
 	memset(message, 0, sizeof(RFX_MESSAGE));
+	context->num_messages++;
 
-	while (size > 0)
+	while (size >= 6)
 	{
 		/* RFX_BLOCKT */
 		blockType = GET_UINT16(data, 0); /* blockType (2 bytes) */
@@ -509,6 +826,12 @@ rfx_process_message(RFX_CONTEXT * context, uint8 * data, int size)
 			offset = 8;
 		}
 
+		if (blockLen < offset || blockLen > size)
+		{
+			DEBUG_RFX("invalid blockLen %d, %d bytes left", blockLen, size);
+			break;
+		}
+
 		switch (blockType)
 		{
 			case WBT_SYNC:
@@ -540,7 +863,8 @@ rfx_process_message(RFX_CONTEXT * context, uint8 * data, int size)
 				break;
 
 			case WBT_EXTENSION:
-				rfx_process_message_tileset(context, message, data + offset, blockLen - offset);
+				rfx_process_message_tileset(context, message, data + offset, blockLen - offset,
+					surface, x, y);
 				break;
 
 			default:
@@ -555,21 +879,37 @@ rfx_process_message(RFX_CONTEXT * context, uint8 * data, int size)
 	return message;
 }
 
+RFX_MESSAGE *
+rfx_process_message(RFX_CONTEXT * context, uint8 * data, int size)
+{
+	return rfx_process_message_blocks(context, data, size, NULL, 0, 0);
+}
+
+/*
+   Same as rfx_process_message(), but the tiles are decoded into surface, with
+   the message origin at (x, y), and only where the message rects (and the
+   surface) allow it. Tiles covered by a rect are decoded in place, without an
+   intermediate copy. The data of the returned tiles is unspecified, only the
+   rects and tile positions are meaningful.
+*/
+RFX_MESSAGE *
+rfx_process_message_surface(RFX_CONTEXT * context, uint8 * data, int size,
+	RFX_SURFACE * surface, int x, int y)
+{
+	return rfx_process_message_blocks(context, data, size, surface, x, y);
+}
+
 void
 rfx_message_free(RFX_CONTEXT * context, RFX_MESSAGE * message)
 {
 	if (message != NULL)
 	{
-		if (message->rects != NULL)
-			free(message->rects);
-
 		if (message->tiles != NULL)
-		{
 			rfx_pool_put_tiles(context->pool, message->tiles, message->num_tiles);
-			free(message->tiles);
-		}
 
-		free(message);
+		/* rects, quants and the tile array live in the arena as well */
+		if (--(context->num_messages) == 0)
+			rfx_arena_reset(context->arena);
 	}
 }
 
@@ -92,6 +92,127 @@ void rfx_decode_YCbCr_to_RGB_NEON(sint16 * y_r_buffer, sint16 * cb_g_buffer, sin
 	}
 }
 
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_decode_YCbCr_to_pixels_format_NEON(sint16 * y_buf, sint16 * cb_buf, sint16 * cr_buf,
+	RFX_PIXEL_FORMAT pixel_format, uint8 * dst_buf, int dst_stride)
+{
+	int16x8_t zero = vdupq_n_s16(0);
+	int16x8_t max = vdupq_n_s16(255);
+	int16x8_t y_add = vdupq_n_s16(128);
+	uint8x8_t alpha = vdup_n_u8(0xFF);
+	uint8 * dst;
+	int x, row;
+	int i = 0;
+
+	for (row = 0; row < 64; row++)
+	{
+		dst = dst_buf + row * dst_stride;
+
+		for (x = 0; x < 64; x += 8, i += 8)
+		{
+			prefetch_data(&y_buf[i]);
+			prefetch_data(&cb_buf[i]);
+			prefetch_data(&cr_buf[i]);
+
+			int16x8_t y = vld1q_s16(&y_buf[i]);
+			y = vaddq_s16(y, y_add);
+
+			int16x8_t cb = vld1q_s16(&cb_buf[i]);
+			int16x8_t cr = vld1q_s16(&cr_buf[i]);
+
+			// r = between((y + cr + (cr >> 2) + (cr >> 3) + (cr >> 5)), 0, 255);
+			int16x8_t r = vaddq_s16(y, cr);
+			r = vaddq_s16(r, vshrq_n_s16(cr, 2));
+			r = vaddq_s16(r, vshrq_n_s16(cr, 3));
+			r = vaddq_s16(r, vshrq_n_s16(cr, 5));
+			r = vminq_s16(vmaxq_s16(r, zero), max);
+
+			// g = between(y - (cb >> 2) - (cb >> 4) - (cb >> 5) - (cr >> 1) - (cr >> 3) - (cr >> 4) - (cr >> 5), 0, 255);
+			int16x8_t g = vsubq_s16(y, vshrq_n_s16(cb, 2));
+			g = vsubq_s16(g, vshrq_n_s16(cb, 4));
+			g = vsubq_s16(g, vshrq_n_s16(cb, 5));
+			g = vsubq_s16(g, vshrq_n_s16(cr, 1));
+			g = vsubq_s16(g, vshrq_n_s16(cr, 3));
+			g = vsubq_s16(g, vshrq_n_s16(cr, 4));
+			g = vsubq_s16(g, vshrq_n_s16(cr, 5));
+			g = vminq_s16(vmaxq_s16(g, zero), max);
+
+			// b = between((y + cb + (cb >> 1) + (cb >> 2) + (cb >> 6)), 0, 255);
+			int16x8_t b = vaddq_s16(y, cb);
+			b = vaddq_s16(b, vshrq_n_s16(cb, 1));
+			b = vaddq_s16(b, vshrq_n_s16(cb, 2));
+			b = vaddq_s16(b, vshrq_n_s16(cb, 6));
+			b = vminq_s16(vmaxq_s16(b, zero), max);
+
+			// values are within 0..255 already, narrow and interleave them on the store
+			uint8x8_t r8 = vmovn_u16(vreinterpretq_u16_s16(r));
+			uint8x8_t g8 = vmovn_u16(vreinterpretq_u16_s16(g));
+			uint8x8_t b8 = vmovn_u16(vreinterpretq_u16_s16(b));
+
+			switch (pixel_format)
+			{
+				case RFX_PIXEL_FORMAT_BGRA:
+				{
+					uint8x8x4_t bgra = { { b8, g8, r8, alpha } };
+					vst4_u8(dst, bgra);
+					dst += 32;
+					break;
+				}
+				case RFX_PIXEL_FORMAT_RGBA:
+				{
+					uint8x8x4_t rgba = { { r8, g8, b8, alpha } };
+					vst4_u8(dst, rgba);
+					dst += 32;
+					break;
+				}
+				case RFX_PIXEL_FORMAT_BGR:
+				{
+					uint8x8x3_t bgr = { { b8, g8, r8 } };
+					vst3_u8(dst, bgr);
+					dst += 24;
+					break;
+				}
+				case RFX_PIXEL_FORMAT_RGB:
+				{
+					uint8x8x3_t rgb = { { r8, g8, b8 } };
+					vst3_u8(dst, rgb);
+					dst += 24;
+					break;
+				}
+				default:
+					break;
+			}
+		}
+	}
+}
+
+void rfx_decode_YCbCr_to_pixels_NEON(sint16 * y_buf, sint16 * cb_buf, sint16 * cr_buf,
+	RFX_PIXEL_FORMAT pixel_format, uint8 * dst_buf, int dst_stride)
+{
+	// the format is a constant in each branch, so every one gets its own loop
+	switch (pixel_format)
+	{
+		case RFX_PIXEL_FORMAT_BGRA:
+			rfx_decode_YCbCr_to_pixels_format_NEON(y_buf, cb_buf, cr_buf,
+				RFX_PIXEL_FORMAT_BGRA, dst_buf, dst_stride);
+			break;
+		case RFX_PIXEL_FORMAT_RGBA:
+			rfx_decode_YCbCr_to_pixels_format_NEON(y_buf, cb_buf, cr_buf,
+				RFX_PIXEL_FORMAT_RGBA, dst_buf, dst_stride);
+			break;
+		case RFX_PIXEL_FORMAT_BGR:
+			rfx_decode_YCbCr_to_pixels_format_NEON(y_buf, cb_buf, cr_buf,
+				RFX_PIXEL_FORMAT_BGR, dst_buf, dst_stride);
+			break;
+		case RFX_PIXEL_FORMAT_RGB:
+			rfx_decode_YCbCr_to_pixels_format_NEON(y_buf, cb_buf, cr_buf,
+				RFX_PIXEL_FORMAT_RGB, dst_buf, dst_stride);
+			break;
+		default:
+			break;
+	}
+}
+
 static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
 rfx_quantization_decode_block_NEON(sint16 * buffer, const int buffer_size, const uint32 factor)
 {
@@ -123,7 +244,7 @@ rfx_quantization_decode_NEON(sint16 * buffer, const uint32 * quantization_values
 	rfx_quantization_decode_block_NEON(buffer + 3584, 256, quantization_values[6]); /* HH2 */
 	rfx_quantization_decode_block_NEON(buffer + 3840, 64, quantization_values[2]); /* HL3 */
 	rfx_quantization_decode_block_NEON(buffer + 3904, 64, quantization_values[1]); /* LH3 */
-	rfx_quantization_decode_block_NEON(buffer + 3868, 64, quantization_values[3]); /* HH3 */
+	rfx_quantization_decode_block_NEON(buffer + 3968, 64, quantization_values[3]); /* HH3 */
 	rfx_quantization_decode_block_NEON(buffer + 4032, 64, quantization_values[0]); /* LL3 */
 }
 
@@ -361,11 +482,12 @@ void rfx_init_neon(RFX_CONTEXT * context)
 	{
 		DEBUG_RFX("Using NEON optimizations");
 
-		IF_PROFILER(context->prof_rfx_decode_YCbCr_to_RGB->name = "rfx_decode_YCbCr_to_RGB_NEON");
+		IF_PROFILER(context->prof_rfx_decode_YCbCr_to_RGB->name = "rfx_decode_YCbCr_to_pixels_NEON");
 		IF_PROFILER(context->prof_rfx_quantization_decode->name = "rfx_quantization_decode_NEON");
 		IF_PROFILER(context->prof_rfx_dwt_2d_decode->name = "rfx_dwt_2d_decode_NEON");
 
 		context->decode_YCbCr_to_RGB = rfx_decode_YCbCr_to_RGB_NEON;
+		context->decode_YCbCr_to_pixels = rfx_decode_YCbCr_to_pixels_NEON;
 		context->quantization_decode = rfx_quantization_decode_NEON;
 		context->dwt_2d_decode = rfx_dwt_2d_decode_NEON;
 	}
@@ -27,61 +27,6 @@
 
 #include "rfx_decode.h"
 
-#ifdef WIN32
-static __inline void
-#else
-static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
-#endif
-rfx_decode_format_RGB(sint16 * r_buf, sint16 * g_buf, sint16 * b_buf,
-	RFX_PIXEL_FORMAT pixel_format, uint8 * dst_buf)
-{
-	sint16 * r = r_buf;
-	sint16 * g = g_buf;
-	sint16 * b = b_buf;
-	uint8 * dst = dst_buf;
-	int i;
-	
-	switch (pixel_format)
-	{
-		case RFX_PIXEL_FORMAT_BGRA:
-			for (i = 0; i < 4096; i++)
-			{
-				*dst++ = (uint8) (*b++);
-				*dst++ = (uint8) (*g++);
-				*dst++ = (uint8) (*r++);
-				*dst++ = 0xFF;
-			}
-			break;
-		case RFX_PIXEL_FORMAT_RGBA:
-			for (i = 0; i < 4096; i++)
-			{
-				*dst++ = (uint8) (*r++);
-				*dst++ = (uint8) (*g++);
-				*dst++ = (uint8) (*b++);
-				*dst++ = 0xFF;
-			}
-			break;
-		case RFX_PIXEL_FORMAT_BGR:
-			for (i = 0; i < 4096; i++)
-			{
-				*dst++ = (uint8) (*b++);
-				*dst++ = (uint8) (*g++);
-				*dst++ = (uint8) (*r++);
-			}
-			break;
-		case RFX_PIXEL_FORMAT_RGB:
-			for (i = 0; i < 4096; i++)
-			{
-				*dst++ = (uint8) (*r++);
-				*dst++ = (uint8) (*g++);
-				*dst++ = (uint8) (*b++);
-			}
-			break;
-		default:
-			break;
-	}
-}
-
 #define MINMAX(_v,_l,_h) ((_v) < (_l) ? (_l) : ((_v) > (_h) ? (_h) : (_v)))
 
 void
@@ -105,16 +50,115 @@ rfx_decode_YCbCr_to_RGB(sint16 * y_r_buf, sint16 * cb_g_buf, sint16 * cr_b_buf)
 	}
 }
 
+/* same arithmetic as rfx_decode_YCbCr_to_RGB(), for coefficient _i */
+#define YCbCr_TO_RGB(_i) \
+	y = y_buf[_i] + 128; \
+	cb = cb_buf[_i]; \
+	cr = cr_buf[_i]; \
+	r = (y + cr + (cr >> 2) + (cr >> 3) + (cr >> 5)); \
+	r = MINMAX(r, 0, 255); \
+	g = (y - ((cb >> 2) + (cb >> 4) + (cb >> 5)) - ((cr >> 1) + (cr >> 3) + (cr >> 4) + (cr >> 5))); \
+	g = MINMAX(g, 0, 255); \
+	b = (y + cb + (cb >> 1) + (cb >> 2) + (cb >> 6)); \
+	b = MINMAX(b, 0, 255)
+
+#ifdef WIN32
+static __inline void
+#else
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+#endif
+rfx_decode_YCbCr_to_pixels_format(sint16 * y_buf, sint16 * cb_buf, sint16 * cr_buf,
+	RFX_PIXEL_FORMAT pixel_format, uint8 * dst_buf, int dst_stride)
+{
+	sint16 y, cb, cr;
+	sint16 r, g, b;
+	uint8 * dst;
+	int x, row;
+	int i = 0;
+
+	for (row = 0; row < 64; row++)
+	{
+		dst = dst_buf + row * dst_stride;
+
+		for (x = 0; x < 64; x++, i++)
+		{
+			YCbCr_TO_RGB(i);
+
+			switch (pixel_format)
+			{
+				case RFX_PIXEL_FORMAT_BGRA:
+					*dst++ = (uint8) b;
+					*dst++ = (uint8) g;
+					*dst++ = (uint8) r;
+					*dst++ = 0xFF;
+					break;
+				case RFX_PIXEL_FORMAT_RGBA:
+					*dst++ = (uint8) r;
+					*dst++ = (uint8) g;
+					*dst++ = (uint8) b;
+					*dst++ = 0xFF;
+					break;
+				case RFX_PIXEL_FORMAT_BGR:
+					*dst++ = (uint8) b;
+					*dst++ = (uint8) g;
+					*dst++ = (uint8) r;
+					break;
+				case RFX_PIXEL_FORMAT_RGB:
+					*dst++ = (uint8) r;
+					*dst++ = (uint8) g;
+					*dst++ = (uint8) b;
+					break;
+				default:
+					break;
+			}
+		}
+	}
+}
+
+void
+rfx_decode_YCbCr_to_pixels(sint16 * y_buf, sint16 * cb_buf, sint16 * cr_buf,
+	RFX_PIXEL_FORMAT pixel_format, uint8 * dst_buf, int dst_stride)
+{
+	/* the format is a constant in each branch, so every one gets its own loop */
+	switch (pixel_format)
+	{
+		case RFX_PIXEL_FORMAT_BGRA:
+			rfx_decode_YCbCr_to_pixels_format(y_buf, cb_buf, cr_buf,
+				RFX_PIXEL_FORMAT_BGRA, dst_buf, dst_stride);
+			break;
+		case RFX_PIXEL_FORMAT_RGBA:
+			rfx_decode_YCbCr_to_pixels_format(y_buf, cb_buf, cr_buf,
+				RFX_PIXEL_FORMAT_RGBA, dst_buf, dst_stride);
+			break;
+		case RFX_PIXEL_FORMAT_BGR:
+			rfx_decode_YCbCr_to_pixels_format(y_buf, cb_buf, cr_buf,
+				RFX_PIXEL_FORMAT_BGR, dst_buf, dst_stride);
+			break;
+		case RFX_PIXEL_FORMAT_RGB:
+			rfx_decode_YCbCr_to_pixels_format(y_buf, cb_buf, cr_buf,
+				RFX_PIXEL_FORMAT_RGB, dst_buf, dst_stride);
+			break;
+		default:
+			break;
+	}
+}
+
 static void
 rfx_decode_component(RFX_CONTEXT * context, const uint32 * quantization_values,
-	const uint8 * data, int size, sint16 * buffer)
+	const uint8 * data, int size, sint16 * buffer, sint16 * dwt_buffer)
 {
+	int n;
+
 	PROFILER_ENTER(context->prof_rfx_decode_component);
 
 	PROFILER_ENTER(context->prof_rfx_rlgr_decode);
-		rfx_rlgr_decode(context->mode, data, size, buffer, 4096);
+		n = context->rlgr_decode(context->mode, data, size, buffer, 4096);
 	PROFILER_EXIT(context->prof_rfx_rlgr_decode);
 
+	/* trailing zero coefficients are not encoded, don't leave the previous tile's values there */
+	if (n < 4096)
+		memset(buffer + n, 0, (4096 - n) * sizeof(sint16));
+
 	PROFILER_ENTER(context->prof_rfx_differential_decode);
 		rfx_differential_decode(buffer + 4032, 64);
 	PROFILER_EXIT(context->prof_rfx_differential_decode);
@@ -124,34 +168,51 @@ rfx_decode_component(RFX_CONTEXT * context, const uint32 * quantization_values,
 	PROFILER_EXIT(context->prof_rfx_quantization_decode);
 
 	PROFILER_ENTER(context->prof_rfx_dwt_2d_decode);
-		context->dwt_2d_decode(buffer, context->dwt_buffer);
+		context->dwt_2d_decode(buffer, dwt_buffer);
 	PROFILER_EXIT(context->prof_rfx_dwt_2d_decode);
 
 	PROFILER_EXIT(context->prof_rfx_decode_component);
 }
 
 uint8*
-rfx_decode_rgb(RFX_CONTEXT * context,
+rfx_decode_rgb_scratch(RFX_CONTEXT * context, RFX_SCRATCH * scratch,
 	const uint8 * y_data, int y_size, const uint32 * y_quants,
 	const uint8 * cb_data, int cb_size, const uint32 * cb_quants,
-	const uint8 * cr_data, int cr_size, const uint32 * cr_quants, uint8* rgb_buffer)
+	const uint8 * cr_data, int cr_size, const uint32 * cr_quants,
+	RFX_PIXEL_FORMAT pixel_format, uint8 * dst_buf, int dst_stride)
 {
 	PROFILER_ENTER(context->prof_rfx_decode_rgb);
 
-	rfx_decode_component(context, y_quants, y_data, y_size, context->y_r_buffer); /* YData */
-	rfx_decode_component(context, cb_quants, cb_data, cb_size, context->cb_g_buffer); /* CbData */
-	rfx_decode_component(context, cr_quants, cr_data, cr_size, context->cr_b_buffer); /* CrData */
+	rfx_decode_component(context, y_quants, y_data, y_size, scratch->y_r_buffer, scratch->dwt_buffer); /* YData */
+	rfx_decode_component(context, cb_quants, cb_data, cb_size, scratch->cb_g_buffer, scratch->dwt_buffer); /* CbData */
+	rfx_decode_component(context, cr_quants, cr_data, cr_size, scratch->cr_b_buffer, scratch->dwt_buffer); /* CrData */
 
+	/* color conversion and packing in one pass, straight into the tile or surface */
 	PROFILER_ENTER(context->prof_rfx_decode_YCbCr_to_RGB);
-		context->decode_YCbCr_to_RGB(context->y_r_buffer, context->cb_g_buffer, context->cr_b_buffer);
+		context->decode_YCbCr_to_pixels(scratch->y_r_buffer, scratch->cb_g_buffer, scratch->cr_b_buffer,
+			pixel_format, dst_buf, dst_stride);
 	PROFILER_EXIT(context->prof_rfx_decode_YCbCr_to_RGB);
 
-	PROFILER_ENTER(context->prof_rfx_decode_format_RGB);
-		rfx_decode_format_RGB(context->y_r_buffer, context->cb_g_buffer, context->cr_b_buffer,
-			context->pixel_format, rgb_buffer);
-	PROFILER_EXIT(context->prof_rfx_decode_format_RGB);
-	
 	PROFILER_EXIT(context->prof_rfx_decode_rgb);
 
-	return rgb_buffer;
+	return dst_buf;
+}
+
+uint8*
+rfx_decode_rgb(RFX_CONTEXT * context,
+	const uint8 * y_data, int y_size, const uint32 * y_quants,
+	const uint8 * cb_data, int cb_size, const uint32 * cb_quants,
+	const uint8 * cr_data, int cr_size, const uint32 * cr_quants, uint8* rgb_buffer)
+{
+	RFX_SCRATCH scratch;
+
+	scratch.y_r_buffer = context->y_r_buffer;
+	scratch.cb_g_buffer = context->cb_g_buffer;
+	scratch.cr_b_buffer = context->cr_b_buffer;
+	scratch.dwt_buffer = context->dwt_buffer;
+
+	return rfx_decode_rgb_scratch(context, &scratch,
+		y_data, y_size, y_quants, cb_data, cb_size, cb_quants,
+		cr_data, cr_size, cr_quants,
+		context->pixel_format, rgb_buffer, 64 * context->bytes_per_pixel);
 }
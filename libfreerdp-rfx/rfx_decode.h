@@ -22,8 +22,21 @@
 
 #include <freerdp/rfx.h>
 
+/* scratch buffers used while decoding a single tile, one set per thread */
+struct _RFX_SCRATCH
+{
+	sint16 * y_r_buffer;
+	sint16 * cb_g_buffer;
+	sint16 * cr_b_buffer;
+	sint16 * dwt_buffer;
+};
+typedef struct _RFX_SCRATCH RFX_SCRATCH;
+
 void
 rfx_decode_YCbCr_to_RGB(sint16 * y_r_buf, sint16 * cb_g_buf, sint16 * cr_b_buf);
+void
+rfx_decode_YCbCr_to_pixels(sint16 * y_buf, sint16 * cb_buf, sint16 * cr_buf,
+	RFX_PIXEL_FORMAT pixel_format, uint8 * dst_buf, int dst_stride);
 
 unsigned char *
 rfx_decode_rgb(RFX_CONTEXT * context,
@@ -31,5 +44,12 @@ rfx_decode_rgb(RFX_CONTEXT * context,
 	const uint8 * cb_data, int cb_size, const uint32 * cb_quants,
 	const uint8 * cr_data, int cr_size, const uint32 * cr_quants, uint8* rgb_buffer);
 
+uint8 *
+rfx_decode_rgb_scratch(RFX_CONTEXT * context, RFX_SCRATCH * scratch,
+	const uint8 * y_data, int y_size, const uint32 * y_quants,
+	const uint8 * cb_data, int cb_size, const uint32 * cb_quants,
+	const uint8 * cr_data, int cr_size, const uint32 * cr_quants,
+	RFX_PIXEL_FORMAT pixel_format, uint8 * dst_buf, int dst_stride);
+
 #endif
 
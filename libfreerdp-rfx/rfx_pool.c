@@ -97,17 +97,79 @@ void rfx_pool_put_tiles(RFX_POOL* pool, RFX_TILE** tiles, int count)
 	}
 }
 
-RFX_TILE** rfx_pool_get_tiles(RFX_POOL* pool, int count)
+/*
+ * Every arena block starts with a pointer to the block it replaced, so that
+ * blocks outgrown in the middle of a frame stay valid until the next reset.
+ * Once a frame fits, the arena settles on a single block and stops allocating.
+ */
+#define ARENA_HEADER_SIZE	((int) sizeof(uint8*))
+#define ARENA_ALIGN(_n)		(((_n) + 7) & ~7)
+
+RFX_ARENA* rfx_arena_new()
 {
-	int i;
-	RFX_TILE** tiles;
+	RFX_ARENA* arena;
 
-	tiles = (RFX_TILE**) malloc(sizeof(RFX_TILE*) * count);
+	arena = (RFX_ARENA*) malloc(sizeof(RFX_ARENA));
+	memset(arena, 0, sizeof(RFX_ARENA));
 
-	for (i = 0; i < count; i++)
+	arena->size = 4096;
+	arena->block = (uint8*) malloc(arena->size);
+	memset(arena->block, 0, ARENA_HEADER_SIZE);
+	arena->used = ARENA_HEADER_SIZE;
+
+	return arena;
+}
+
+static void rfx_arena_free_retired(RFX_ARENA* arena)
+{
+	uint8* block;
+	uint8* prev;
+
+	memcpy(&block, arena->block, ARENA_HEADER_SIZE);
+	memset(arena->block, 0, ARENA_HEADER_SIZE);
+
+	while (block != NULL)
 	{
-		tiles[i] = rfx_pool_get_tile(pool);
+		memcpy(&prev, block, ARENA_HEADER_SIZE);
+		free(block);
+		block = prev;
 	}
+}
 
-	return tiles;
+void rfx_arena_free(RFX_ARENA* arena)
+{
+	rfx_arena_free_retired(arena);
+	free(arena->block);
+	free(arena);
+}
+
+void* rfx_arena_alloc(RFX_ARENA* arena, int size)
+{
+	uint8* block;
+	void* ptr;
+
+	size = ARENA_ALIGN(size);
+
+	if (arena->used + size > arena->size)
+	{
+		while (arena->size < ARENA_HEADER_SIZE + size)
+			arena->size *= 2;
+		arena->size *= 2;
+
+		block = (uint8*) malloc(arena->size);
+		memcpy(block, &arena->block, ARENA_HEADER_SIZE);
+		arena->block = block;
+		arena->used = ARENA_HEADER_SIZE;
+	}
+
+	ptr = arena->block + arena->used;
+	arena->used += size;
+
+	return ptr;
+}
+
+void rfx_arena_reset(RFX_ARENA* arena)
+{
+	rfx_arena_free_retired(arena);
+	arena->used = ARENA_HEADER_SIZE;
 }
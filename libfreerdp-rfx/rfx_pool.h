@@ -27,7 +27,11 @@ void rfx_pool_free(RFX_POOL* pool);
 void rfx_pool_put_tile(RFX_POOL* pool, RFX_TILE* tile);
 RFX_TILE* rfx_pool_get_tile(RFX_POOL* pool);
 void rfx_pool_put_tiles(RFX_POOL* pool, RFX_TILE** tiles, int count);
-RFX_TILE** rfx_pool_get_tiles(RFX_POOL* pool, int count);
+
+RFX_ARENA* rfx_arena_new();
+void rfx_arena_free(RFX_ARENA* arena);
+void* rfx_arena_alloc(RFX_ARENA* arena, int size);
+void rfx_arena_reset(RFX_ARENA* arena);
 
 #endif /* __RFX_POOL_H */
 
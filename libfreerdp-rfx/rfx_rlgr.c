@@ -231,6 +231,254 @@ rfx_rlgr_decode(RLGR_MODE mode, const uint8 * data, int data_size, sint16 * buff
 	return (dst - buffer);
 }
 
+/*
+ * rfx_rlgr_decode_fast() follows exactly the control flow of rfx_rlgr_decode()
+ * but reads the bitstream through a 64-bit reservoir: unary runs of 0s (RL
+ * escapes) and 1s (GR prefixes) are counted with a single count-leading-zeros
+ * instead of bit by bit, and all other fields are plain shifts. Like
+ * rfx_bitstream_get_bits(), bits past the end of the data read as 0, so both
+ * decoders produce identical output even for truncated data.
+ */
+
+#if defined(__GNUC__)
+#define CLZ64(_v) __builtin_clzll(_v)
+#else
+static int CLZ64(uint64 v)
+{
+	int n = 0;
+
+	while (!(v & 0x8000000000000000ULL))
+	{
+		v <<= 1;
+		n++;
+	}
+
+	return n;
+}
+#endif
+
+struct _RLGR_READER
+{
+	const uint8 * src;
+	const uint8 * end;
+	uint64 bits; /* MSB first, count valid bits followed by zeroes */
+	int count;
+	int left; /* bits not yet consumed, including the ones in the reservoir */
+};
+typedef struct _RLGR_READER RLGR_READER;
+
+static __inline void
+rlgr_reader_refill(RLGR_READER * r)
+{
+	while (r->count <= 56 && r->src < r->end)
+	{
+		r->bits |= ((uint64) *(r->src)++) << (56 - r->count);
+		r->count += 8;
+	}
+}
+
+static __inline void
+rlgr_reader_skip(RLGR_READER * r, int n)
+{
+	/* n may be 64, which a single shift does not handle */
+	r->bits <<= (n >> 1);
+	r->bits <<= n - (n >> 1);
+	r->count -= n;
+	r->left -= n;
+
+	if (r->count < 0)
+		r->count = 0;
+}
+
+static __inline uint32
+rlgr_reader_get_bits(RLGR_READER * r, int n)
+{
+	uint32 v;
+
+	/* like rfx_bitstream_get_bits(), a read across the end returns only the bits left */
+	if (n > r->left)
+		n = r->left;
+
+	if (n <= 0)
+		return 0;
+
+	rlgr_reader_refill(r);
+	v = (uint32) (r->bits >> (64 - n));
+	rlgr_reader_skip(r, n);
+
+	return v;
+}
+
+#define FastGetBits(nBits) rlgr_reader_get_bits(&reader, nBits)
+#define FastEOS() (reader.left <= 0)
+
+static uint16
+rfx_rlgr_get_gr_code_fast(RLGR_READER * r, int * krp, int * kr)
+{
+	int vk;
+	int ones;
+	uint16 mag;
+
+	/* chew up/count leading 1s and escape 0 */
+	for (vk = 0;;)
+	{
+		rlgr_reader_refill(r);
+		ones = (~(r->bits) ? CLZ64(~(r->bits)) : 64);
+
+		if (ones < r->count || r->count == 0)
+		{
+			vk += ones;
+			rlgr_reader_skip(r, ones + 1);
+			break;
+		}
+
+		/* every valid bit in the reservoir is a 1 */
+		vk += r->count;
+		rlgr_reader_skip(r, r->count);
+	}
+
+	/* get next *kr bits, and combine with leading 1s */
+	mag = (vk << *kr) | rlgr_reader_get_bits(r, *kr);
+
+	/* adjust krp and kr based on vk */
+	if (!vk)
+	{
+		UpdateParam(*krp, -2, *kr);
+	}
+	else if (vk != 1)
+	{
+		/* at 1, no change! */
+		UpdateParam(*krp, vk, *kr);
+	}
+
+	return mag;
+}
+
+int
+rfx_rlgr_decode_fast(RLGR_MODE mode, const uint8 * data, int data_size, sint16 * buffer, int buffer_size)
+{
+	int k;
+	int kp;
+	int kr;
+	int krp;
+	int zeros;
+	sint16 * dst;
+	RLGR_READER reader;
+
+	reader.src = data;
+	reader.end = data + data_size;
+	reader.bits = 0;
+	reader.count = 0;
+	reader.left = data_size * 8;
+	dst = buffer;
+
+	/* initialize the parameters */
+	k = 1;
+	kp = k << LSGR;
+	kr = 1;
+	krp = kr << LSGR;
+
+	while (!FastEOS() && buffer_size > 0)
+	{
+		int run;
+		if (k)
+		{
+			int mag;
+			uint32 sign;
+
+			/* RL MODE */
+			while (!FastEOS())
+			{
+				rlgr_reader_refill(&reader);
+				zeros = (reader.bits ? CLZ64(reader.bits) : 64);
+
+				if (zeros > reader.count)
+					zeros = reader.count;
+
+				rlgr_reader_skip(&reader, zeros);
+
+				/* each RL escape "0" translates to a run (1<<k) of zeros */
+				while (zeros-- > 0)
+				{
+					WriteZeroes(1 << k);
+					UpdateParam(kp, UP_GR, k); /* raise k and kp up because of zero run */
+				}
+
+				if (reader.count > 0)
+				{
+					/* consume the "1" terminating the escapes */
+					rlgr_reader_skip(&reader, 1);
+					break;
+				}
+			}
+
+			/* next k bits will contain remaining run or zeros */
+			run = FastGetBits(k);
+			WriteZeroes(run);
+
+			/* get nonzero value, starting with sign bit and then GRCode for magnitude -1 */
+			sign = FastGetBits(1);
+
+			/* magnitude - 1 was coded (because it was nonzero) */
+			mag = (int) rfx_rlgr_get_gr_code_fast(&reader, &krp, &kr) + 1;
+
+			WriteValue(sign ? -mag : mag);
+			UpdateParam(kp, -DN_GR, k); /* lower k and kp because of nonzero term */
+		}
+		else
+		{
+			uint32 mag;
+			uint32 nIdx;
+			uint32 val1;
+			uint32 val2;
+
+			/* GR (GOLOMB-RICE) MODE */
+			mag = rfx_rlgr_get_gr_code_fast(&reader, &krp, &kr); /* values coded are 2 * magnitude - sign */
+
+			if (mode == RLGR1)
+			{
+				if (!mag)
+				{
+					WriteValue(0);
+					UpdateParam(kp, UQ_GR, k); /* raise k and kp due to zero */
+				}
+				else
+				{
+					WriteValue(GetIntFrom2MagSign(mag));
+					UpdateParam(kp, -DQ_GR, k); /* lower k and kp due to nonzero */
+				}
+			}
+			else /* mode == RLGR3 */
+			{
+				/* maximum possible bits for first term */
+				nIdx = (mag ? 64 - CLZ64((uint64) mag) : 0);
+
+				/* decode val1 is first term's (2 * mag - sign) value */
+				val1 = FastGetBits(nIdx);
+
+				/* val2 is second term's (2 * mag - sign) value */
+				val2 = mag - val1;
+
+				if (val1 && val2)
+				{
+					/* raise k and kp if both terms nonzero */
+					UpdateParam(kp, -2 * DQ_GR, k);
+				}
+				else if (!val1 && !val2)
+				{
+					/* lower k and kp if both terms zero */
+					UpdateParam(kp, 2 * UQ_GR, k);
+				}
+
+				WriteValue(GetIntFrom2MagSign(val1));
+				WriteValue(GetIntFrom2MagSign(val2));
+			}
+		}
+	}
+
+	return (dst - buffer);
+}
+
 /* Returns the next coefficient (a signed int) to encode, from the input stream */
 #define GetNextInput(_n) \
 { \
@@ -25,6 +25,8 @@
 int
 rfx_rlgr_decode(RLGR_MODE mode, const uint8 * data, int data_size, sint16 * buffer, int buffer_size);
 int
+rfx_rlgr_decode_fast(RLGR_MODE mode, const uint8 * data, int data_size, sint16 * buffer, int buffer_size);
+int
 rfx_rlgr_encode(RLGR_MODE mode, const sint16 * data, int data_size, uint8 * buffer, int buffer_size);
 
 #endif
@@ -0,0 +1,248 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   RemoteFX Codec Library - Tile Decoding Threads
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+   Tiles of a tileset are independent of each other once the quantization
+   values are known, so they are handed out one at a time to a small set of
+   worker threads. The calling thread decodes tiles as well, using the scratch
+   buffers of the context, so num_threads includes the caller. Every worker
+   owns its own aligned scratch buffers, the output is identical to the
+   serial path.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "rfx_decode.h"
+#include "rfx_thread.h"
+
+#include "librfx.h"
+
+struct _RFX_WORKER
+{
+	pthread_t thread;
+	RFX_WORKERS * workers;
+	RFX_SCRATCH scratch;
+
+	sint16 y_r_mem[4096+16]; /* 4096 = 64x64 (+ 16x2 = 32 for mem align) */
+	sint16 cb_g_mem[4096+16]; /* 4096 = 64x64 (+ 16x2 = 32 for mem align) */
+	sint16 cr_b_mem[4096+16]; /* 4096 = 64x64 (+ 16x2 = 32 for mem align) */
+	sint16 dwt_mem[32*32*2*2 + 16]; /* maximum sub-band width is 32 */
+};
+typedef struct _RFX_WORKER RFX_WORKER;
+
+struct _RFX_WORKERS
+{
+	RFX_CONTEXT * context;
+
+	int num_workers;
+	RFX_WORKER ** worker;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t start_cond;
+	pthread_cond_t done_cond;
+
+	/* the current batch of tiles, protected by mutex */
+	int generation;
+	int terminate;
+	int num_jobs;
+	int next_job;
+	int busy;
+
+	int max_jobs;
+	RFX_TILE_JOB * jobs;
+};
+
+static void
+rfx_workers_decode_job(RFX_CONTEXT * context, RFX_SCRATCH * scratch, RFX_TILE_JOB * job)
+{
+	rfx_decode_rgb_scratch(context, scratch,
+		job->y_data, job->y_size, job->y_quants,
+		job->cb_data, job->cb_size, job->cb_quants,
+		job->cr_data, job->cr_size, job->cr_quants,
+		job->pixel_format, job->dst, job->dst_stride);
+}
+
+/* decode tiles of the current batch until none are left, called with mutex held */
+static void
+rfx_workers_drain(RFX_WORKERS * workers, RFX_SCRATCH * scratch)
+{
+	RFX_TILE_JOB * job;
+
+	while (workers->next_job < workers->num_jobs)
+	{
+		job = &workers->jobs[workers->next_job++];
+
+		pthread_mutex_unlock(&workers->mutex);
+		rfx_workers_decode_job(workers->context, scratch, job);
+		pthread_mutex_lock(&workers->mutex);
+	}
+}
+
+static void *
+rfx_worker_thread_func(void * arg)
+{
+	RFX_WORKER * worker = (RFX_WORKER *) arg;
+	RFX_WORKERS * workers = worker->workers;
+	int generation = 0;
+
+	pthread_mutex_lock(&workers->mutex);
+
+	while (1)
+	{
+		while (!workers->terminate && workers->generation == generation)
+			pthread_cond_wait(&workers->start_cond, &workers->mutex);
+
+		if (workers->terminate)
+			break;
+
+		generation = workers->generation;
+		workers->busy++;
+
+		rfx_workers_drain(workers, &worker->scratch);
+
+		if (--(workers->busy) == 0)
+			pthread_cond_signal(&workers->done_cond);
+	}
+
+	pthread_mutex_unlock(&workers->mutex);
+
+	return NULL;
+}
+
+RFX_WORKERS *
+rfx_workers_new(RFX_CONTEXT * context, int num_threads)
+{
+	int i;
+	RFX_WORKER * worker;
+	RFX_WORKERS * workers;
+
+	workers = (RFX_WORKERS *) malloc(sizeof(RFX_WORKERS));
+	memset(workers, 0, sizeof(RFX_WORKERS));
+
+	workers->context = context;
+
+	pthread_mutex_init(&workers->mutex, NULL);
+	pthread_cond_init(&workers->start_cond, NULL);
+	pthread_cond_init(&workers->done_cond, NULL);
+
+	/* the calling thread counts as one of the decoding threads */
+	workers->worker = (RFX_WORKER **) malloc(sizeof(RFX_WORKER *) * (num_threads - 1));
+
+	for (i = 0; i < num_threads - 1; i++)
+	{
+		worker = (RFX_WORKER *) malloc(sizeof(RFX_WORKER));
+		memset(worker, 0, sizeof(RFX_WORKER));
+
+		worker->workers = workers;
+
+		/* align buffers to 32 byte boundary (needed for SSE2/AVX2 instructions) */
+		worker->scratch.y_r_buffer = (sint16 *)(((uintptr_t)worker->y_r_mem + 32) & ~ 0x1F);
+		worker->scratch.cb_g_buffer = (sint16 *)(((uintptr_t)worker->cb_g_mem + 32) & ~ 0x1F);
+		worker->scratch.cr_b_buffer = (sint16 *)(((uintptr_t)worker->cr_b_mem + 32) & ~ 0x1F);
+		worker->scratch.dwt_buffer = (sint16 *)(((uintptr_t)worker->dwt_mem + 32) & ~ 0x1F);
+
+		if (pthread_create(&worker->thread, NULL, rfx_worker_thread_func, worker) != 0)
+		{
+			DEBUG_RFX("failed to create decoding thread %d", i);
+			free(worker);
+			break;
+		}
+
+		workers->worker[workers->num_workers++] = worker;
+	}
+
+	DEBUG_RFX("%d decoding threads", workers->num_workers + 1);
+
+	return workers;
+}
+
+void
+rfx_workers_free(RFX_WORKERS * workers)
+{
+	int i;
+
+	if (workers == NULL)
+		return;
+
+	pthread_mutex_lock(&workers->mutex);
+	workers->terminate = 1;
+	pthread_cond_broadcast(&workers->start_cond);
+	pthread_mutex_unlock(&workers->mutex);
+
+	for (i = 0; i < workers->num_workers; i++)
+	{
+		pthread_join(workers->worker[i]->thread, NULL);
+		free(workers->worker[i]);
+	}
+
+	pthread_cond_destroy(&workers->done_cond);
+	pthread_cond_destroy(&workers->start_cond);
+	pthread_mutex_destroy(&workers->mutex);
+
+	if (workers->jobs != NULL)
+		free(workers->jobs);
+
+	free(workers->worker);
+	free(workers);
+}
+
+RFX_TILE_JOB *
+rfx_workers_get_jobs(RFX_WORKERS * workers, int count)
+{
+	if (count > workers->max_jobs)
+	{
+		workers->max_jobs = count;
+		workers->jobs = (RFX_TILE_JOB *) realloc((void*) workers->jobs, sizeof(RFX_TILE_JOB) * count);
+	}
+
+	return workers->jobs;
+}
+
+void
+rfx_workers_run(RFX_WORKERS * workers, int count)
+{
+	RFX_SCRATCH scratch;
+	RFX_CONTEXT * context = workers->context;
+
+	scratch.y_r_buffer = context->y_r_buffer;
+	scratch.cb_g_buffer = context->cb_g_buffer;
+	scratch.cr_b_buffer = context->cr_b_buffer;
+	scratch.dwt_buffer = context->dwt_buffer;
+
+	pthread_mutex_lock(&workers->mutex);
+
+	workers->num_jobs = count;
+	workers->next_job = 0;
+	workers->generation++;
+
+	if (count > 1)
+		pthread_cond_broadcast(&workers->start_cond);
+
+	rfx_workers_drain(workers, &scratch);
+
+	/* tiles may still be in flight on other threads */
+	while (workers->busy > 0)
+		pthread_cond_wait(&workers->done_cond, &workers->mutex);
+
+	workers->num_jobs = 0;
+
+	pthread_mutex_unlock(&workers->mutex);
+}
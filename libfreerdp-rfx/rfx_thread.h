@@ -0,0 +1,49 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   RemoteFX Codec Library - Tile Decoding Threads
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __RFX_THREAD_H
+#define __RFX_THREAD_H
+
+#include <freerdp/rfx.h>
+
+/* everything needed to decode one tile, collected while parsing the tileset */
+struct _RFX_TILE_JOB
+{
+	RFX_TILE * tile;
+	const uint8 * y_data;
+	const uint8 * cb_data;
+	const uint8 * cr_data;
+	int y_size;
+	int cb_size;
+	int cr_size;
+	const uint32 * y_quants;
+	const uint32 * cb_quants;
+	const uint32 * cr_quants;
+
+	/* where the pixels go, the tile data or a caller supplied surface */
+	RFX_PIXEL_FORMAT pixel_format;
+	uint8 * dst;
+	int dst_stride;
+};
+typedef struct _RFX_TILE_JOB RFX_TILE_JOB;
+
+RFX_WORKERS* rfx_workers_new(RFX_CONTEXT * context, int num_threads);
+void rfx_workers_free(RFX_WORKERS * workers);
+RFX_TILE_JOB* rfx_workers_get_jobs(RFX_WORKERS * workers, int count);
+void rfx_workers_run(RFX_WORKERS * workers, int count);
+
+#endif /* __RFX_THREAD_H */
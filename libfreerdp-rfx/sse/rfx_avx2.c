@@ -0,0 +1,815 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   RemoteFX Codec Library - AVX2 Optimizations
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+   This file is the only one built with -mavx2, its routines are installed by
+   rfx_init_sse() when the CPU reports AVX2 support at runtime. The results
+   are identical to the SSE2 versions, 16 coefficients are processed at once.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "rfx_sse.h"
+
+#include "rfx_avx2.h"
+
+static __inline __m256i __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+_mm256_between_epi16(__m256i val, __m256i min, __m256i max)
+{
+	__m256i ret;
+	ret = _mm256_max_epi16(val, min);
+	return _mm256_min_epi16(ret, max);
+}
+
+void
+rfx_decode_YCbCr_to_RGB_AVX2(sint16 * y_r_buffer, sint16 * cb_g_buffer, sint16 * cr_b_buffer)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i max = _mm256_set1_epi16(255);
+
+	__m256i * y_r_buf = (__m256i*) y_r_buffer;
+	__m256i * cb_g_buf = (__m256i*) cb_g_buffer;
+	__m256i * cr_b_buf = (__m256i*) cr_b_buffer;
+
+	__m256i y;
+	__m256i cr;
+	__m256i cb;
+	__m256i r;
+	__m256i g;
+	__m256i b;
+
+	int i;
+
+	for (i = 0; i < (4096 * sizeof(sint16) / sizeof(__m256i)); i++)
+	{
+		/* y = y_r_buf[i] + 128; */
+		y = _mm256_load_si256(&y_r_buf[i]);
+		y = _mm256_add_epi16(y, _mm256_set1_epi16(128));
+
+		/* cr = cr_b_buf[i]; */
+		cr = _mm256_load_si256(&cr_b_buf[i]);
+
+		/* r = between(y + cr + (cr >> 2) + (cr >> 3) + (cr >> 5), 0, 255); */
+		r = _mm256_add_epi16(y, cr);
+		r = _mm256_add_epi16(r, _mm256_srai_epi16(cr, 2));
+		r = _mm256_add_epi16(r, _mm256_srai_epi16(cr, 3));
+		r = _mm256_add_epi16(r, _mm256_srai_epi16(cr, 5));
+		r = _mm256_between_epi16(r, zero, max);
+		_mm256_store_si256(&y_r_buf[i], r);
+
+		/* cb = cb_g_buf[i]; */
+		cb = _mm256_load_si256(&cb_g_buf[i]);
+
+		/* g = between(y - (cb >> 2) - (cb >> 4) - (cb >> 5) - (cr >> 1) - (cr >> 3) - (cr >> 4) - (cr >> 5), 0, 255); */
+		g = _mm256_sub_epi16(y, _mm256_srai_epi16(cb, 2));
+		g = _mm256_sub_epi16(g, _mm256_srai_epi16(cb, 4));
+		g = _mm256_sub_epi16(g, _mm256_srai_epi16(cb, 5));
+		g = _mm256_sub_epi16(g, _mm256_srai_epi16(cr, 1));
+		g = _mm256_sub_epi16(g, _mm256_srai_epi16(cr, 3));
+		g = _mm256_sub_epi16(g, _mm256_srai_epi16(cr, 4));
+		g = _mm256_sub_epi16(g, _mm256_srai_epi16(cr, 5));
+		g = _mm256_between_epi16(g, zero, max);
+		_mm256_store_si256(&cb_g_buf[i], g);
+
+		/* b = between(y + cb + (cb >> 1) + (cb >> 2) + (cb >> 6), 0, 255); */
+		b = _mm256_add_epi16(y, cb);
+		b = _mm256_add_epi16(b, _mm256_srai_epi16(cb, 1));
+		b = _mm256_add_epi16(b, _mm256_srai_epi16(cb, 2));
+		b = _mm256_add_epi16(b, _mm256_srai_epi16(cb, 6));
+		b = _mm256_between_epi16(b, zero, max);
+		_mm256_store_si256(&cr_b_buf[i], b);
+	}
+}
+
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_YCbCr_to_RGB_AVX2(sint16 * y_buf, sint16 * cb_buf, sint16 * cr_buf, __m256i * r, __m256i * g, __m256i * b)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i max = _mm256_set1_epi16(255);
+	__m256i y;
+	__m256i cb;
+	__m256i cr;
+
+	y = _mm256_load_si256((__m256i*) y_buf);
+	y = _mm256_add_epi16(y, _mm256_set1_epi16(128));
+	cb = _mm256_load_si256((__m256i*) cb_buf);
+	cr = _mm256_load_si256((__m256i*) cr_buf);
+
+	*r = _mm256_add_epi16(y, cr);
+	*r = _mm256_add_epi16(*r, _mm256_srai_epi16(cr, 2));
+	*r = _mm256_add_epi16(*r, _mm256_srai_epi16(cr, 3));
+	*r = _mm256_add_epi16(*r, _mm256_srai_epi16(cr, 5));
+	*r = _mm256_between_epi16(*r, zero, max);
+
+	*g = _mm256_sub_epi16(y, _mm256_srai_epi16(cb, 2));
+	*g = _mm256_sub_epi16(*g, _mm256_srai_epi16(cb, 4));
+	*g = _mm256_sub_epi16(*g, _mm256_srai_epi16(cb, 5));
+	*g = _mm256_sub_epi16(*g, _mm256_srai_epi16(cr, 1));
+	*g = _mm256_sub_epi16(*g, _mm256_srai_epi16(cr, 3));
+	*g = _mm256_sub_epi16(*g, _mm256_srai_epi16(cr, 4));
+	*g = _mm256_sub_epi16(*g, _mm256_srai_epi16(cr, 5));
+	*g = _mm256_between_epi16(*g, zero, max);
+
+	*b = _mm256_add_epi16(y, cb);
+	*b = _mm256_add_epi16(*b, _mm256_srai_epi16(cb, 1));
+	*b = _mm256_add_epi16(*b, _mm256_srai_epi16(cb, 2));
+	*b = _mm256_add_epi16(*b, _mm256_srai_epi16(cb, 6));
+	*b = _mm256_between_epi16(*b, zero, max);
+}
+
+/* 32 pixels of c0, c1, c2 and 0xFF bytes, the unpacks work within each 128 bit lane */
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_store_4bpp_AVX2(uint8 * dst, __m256i c0, __m256i c1, __m256i c2)
+{
+	__m256i alpha = _mm256_set1_epi8((char) 0xFF);
+	__m256i c01_lo = _mm256_unpacklo_epi8(c0, c1);
+	__m256i c01_hi = _mm256_unpackhi_epi8(c0, c1);
+	__m256i c2a_lo = _mm256_unpacklo_epi8(c2, alpha);
+	__m256i c2a_hi = _mm256_unpackhi_epi8(c2, alpha);
+	__m256i p0 = _mm256_unpacklo_epi16(c01_lo, c2a_lo); /* pixels 0..3, 16..19 */
+	__m256i p1 = _mm256_unpackhi_epi16(c01_lo, c2a_lo); /* pixels 4..7, 20..23 */
+	__m256i p2 = _mm256_unpacklo_epi16(c01_hi, c2a_hi); /* pixels 8..11, 24..27 */
+	__m256i p3 = _mm256_unpackhi_epi16(c01_hi, c2a_hi); /* pixels 12..15, 28..31 */
+
+	_mm256_storeu_si256((__m256i*) dst, _mm256_permute2x128_si256(p0, p1, 0x20));
+	_mm256_storeu_si256((__m256i*) (dst + 32), _mm256_permute2x128_si256(p2, p3, 0x20));
+	_mm256_storeu_si256((__m256i*) (dst + 64), _mm256_permute2x128_si256(p0, p1, 0x31));
+	_mm256_storeu_si256((__m256i*) (dst + 96), _mm256_permute2x128_si256(p2, p3, 0x31));
+}
+
+/* 16 pixels of c0, c1, c2 bytes, each 16 byte store takes its bytes from all three */
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_store_3bpp_16_AVX2(uint8 * dst, __m128i c0, __m128i c1, __m128i c2)
+{
+	__m128i p;
+
+	p = _mm_shuffle_epi8(c0, _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5));
+	p = _mm_or_si128(p, _mm_shuffle_epi8(c1, _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1)));
+	p = _mm_or_si128(p, _mm_shuffle_epi8(c2, _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1)));
+	_mm_storeu_si128((__m128i*) dst, p);
+
+	p = _mm_shuffle_epi8(c0, _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1));
+	p = _mm_or_si128(p, _mm_shuffle_epi8(c1, _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10)));
+	p = _mm_or_si128(p, _mm_shuffle_epi8(c2, _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1)));
+	_mm_storeu_si128((__m128i*) (dst + 16), p);
+
+	p = _mm_shuffle_epi8(c0, _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1));
+	p = _mm_or_si128(p, _mm_shuffle_epi8(c1, _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1)));
+	p = _mm_or_si128(p, _mm_shuffle_epi8(c2, _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15)));
+	_mm_storeu_si128((__m128i*) (dst + 32), p);
+}
+
+/* 32 pixels of c0, c1, c2 bytes */
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_store_3bpp_AVX2(uint8 * dst, __m256i c0, __m256i c1, __m256i c2)
+{
+	rfx_store_3bpp_16_AVX2(dst, _mm256_castsi256_si128(c0),
+		_mm256_castsi256_si128(c1), _mm256_castsi256_si128(c2));
+	rfx_store_3bpp_16_AVX2(dst + 48, _mm256_extracti128_si256(c0, 1),
+		_mm256_extracti128_si256(c1, 1), _mm256_extracti128_si256(c2, 1));
+}
+
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_decode_YCbCr_to_pixels_format_AVX2(sint16 * y_buf, sint16 * cb_buf, sint16 * cr_buf,
+	RFX_PIXEL_FORMAT pixel_format, uint8 * dst_buf, int dst_stride)
+{
+	__m256i r0, g0, b0;
+	__m256i r1, g1, b1;
+	__m256i r, g, b;
+	uint8 * dst;
+	int x, row;
+	int i = 0;
+
+	for (row = 0; row < 64; row++)
+	{
+		dst = dst_buf + row * dst_stride;
+
+		for (x = 0; x < 64; x += 32, i += 32)
+		{
+			rfx_YCbCr_to_RGB_AVX2(y_buf + i, cb_buf + i, cr_buf + i, &r0, &g0, &b0);
+			rfx_YCbCr_to_RGB_AVX2(y_buf + i + 16, cb_buf + i + 16, cr_buf + i + 16, &r1, &g1, &b1);
+
+			/* values are within 0..255 already, the pack interleaves the lanes so put them back in order */
+			r = _mm256_permute4x64_epi64(_mm256_packus_epi16(r0, r1), 0xD8);
+			g = _mm256_permute4x64_epi64(_mm256_packus_epi16(g0, g1), 0xD8);
+			b = _mm256_permute4x64_epi64(_mm256_packus_epi16(b0, b1), 0xD8);
+
+			switch (pixel_format)
+			{
+				case RFX_PIXEL_FORMAT_BGRA:
+					rfx_store_4bpp_AVX2(dst, b, g, r);
+					dst += 128;
+					break;
+				case RFX_PIXEL_FORMAT_RGBA:
+					rfx_store_4bpp_AVX2(dst, r, g, b);
+					dst += 128;
+					break;
+				case RFX_PIXEL_FORMAT_BGR:
+					rfx_store_3bpp_AVX2(dst, b, g, r);
+					dst += 96;
+					break;
+				case RFX_PIXEL_FORMAT_RGB:
+					rfx_store_3bpp_AVX2(dst, r, g, b);
+					dst += 96;
+					break;
+				default:
+					break;
+			}
+		}
+	}
+}
+
+void
+rfx_decode_YCbCr_to_pixels_AVX2(sint16 * y_buf, sint16 * cb_buf, sint16 * cr_buf,
+	RFX_PIXEL_FORMAT pixel_format, uint8 * dst_buf, int dst_stride)
+{
+	/* the format is a constant in each branch, so every one gets its own loop */
+	switch (pixel_format)
+	{
+		case RFX_PIXEL_FORMAT_BGRA:
+			rfx_decode_YCbCr_to_pixels_format_AVX2(y_buf, cb_buf, cr_buf,
+				RFX_PIXEL_FORMAT_BGRA, dst_buf, dst_stride);
+			break;
+		case RFX_PIXEL_FORMAT_RGBA:
+			rfx_decode_YCbCr_to_pixels_format_AVX2(y_buf, cb_buf, cr_buf,
+				RFX_PIXEL_FORMAT_RGBA, dst_buf, dst_stride);
+			break;
+		case RFX_PIXEL_FORMAT_BGR:
+			rfx_decode_YCbCr_to_pixels_format_AVX2(y_buf, cb_buf, cr_buf,
+				RFX_PIXEL_FORMAT_BGR, dst_buf, dst_stride);
+			break;
+		case RFX_PIXEL_FORMAT_RGB:
+			rfx_decode_YCbCr_to_pixels_format_AVX2(y_buf, cb_buf, cr_buf,
+				RFX_PIXEL_FORMAT_RGB, dst_buf, dst_stride);
+			break;
+		default:
+			break;
+	}
+}
+
+void
+rfx_encode_RGB_to_YCbCr_AVX2(sint16 * y_r_buffer, sint16 * cb_g_buffer, sint16 * cr_b_buffer)
+{
+	__m256i min = _mm256_set1_epi16(-128);
+	__m256i max = _mm256_set1_epi16(127);
+
+	__m256i * y_r_buf = (__m256i*) y_r_buffer;
+	__m256i * cb_g_buf = (__m256i*) cb_g_buffer;
+	__m256i * cr_b_buf = (__m256i*) cr_b_buffer;
+
+	__m256i y;
+	__m256i cr;
+	__m256i cb;
+	__m256i r;
+	__m256i g;
+	__m256i b;
+
+	int i;
+
+	for (i = 0; i < (4096 * sizeof(sint16) / sizeof(__m256i)); i++)
+	{
+		r = _mm256_load_si256(&y_r_buf[i]);
+		g = _mm256_load_si256(&cb_g_buf[i]);
+		b = _mm256_load_si256(&cr_b_buf[i]);
+
+		/* y = ((r >> 2) + (r >> 5) + (r >> 6)) + ((g >> 1) + (g >> 4) + (g >> 6) + (g >> 7)) + ((b >> 4) + (b >> 5) + (b >> 6)); */
+		/* y_r_buf[i] = MINMAX(y, 0, 255) - 128; */
+		y = _mm256_add_epi16(_mm256_srai_epi16(r, 2), _mm256_srai_epi16(r, 5));
+		y = _mm256_add_epi16(y, _mm256_srai_epi16(r, 6));
+		y = _mm256_add_epi16(y, _mm256_srai_epi16(g, 1));
+		y = _mm256_add_epi16(y, _mm256_srai_epi16(g, 4));
+		y = _mm256_add_epi16(y, _mm256_srai_epi16(g, 6));
+		y = _mm256_add_epi16(y, _mm256_srai_epi16(g, 7));
+		y = _mm256_add_epi16(y, _mm256_srai_epi16(b, 4));
+		y = _mm256_add_epi16(y, _mm256_srai_epi16(b, 5));
+		y = _mm256_add_epi16(y, _mm256_srai_epi16(b, 6));
+		y = _mm256_add_epi16(y, min);
+		y = _mm256_between_epi16(y, min, max);
+		_mm256_store_si256(&y_r_buf[i], y);
+
+		/* cb = 0 - ((r >> 3) + (r >> 5) + (r >> 7)) - ((g >> 2) + (g >> 4) + (g >> 6)) + (b >> 1); */
+		/* cb_g_buf[i] = MINMAX(cb, -128, 127); */
+		cb = _mm256_sub_epi16(_mm256_srai_epi16(b, 1), _mm256_srai_epi16(r, 3));
+		cb = _mm256_sub_epi16(cb, _mm256_srai_epi16(r, 5));
+		cb = _mm256_sub_epi16(cb, _mm256_srai_epi16(r, 7));
+		cb = _mm256_sub_epi16(cb, _mm256_srai_epi16(g, 2));
+		cb = _mm256_sub_epi16(cb, _mm256_srai_epi16(g, 4));
+		cb = _mm256_sub_epi16(cb, _mm256_srai_epi16(g, 6));
+		cb = _mm256_between_epi16(cb, min, max);
+		_mm256_store_si256(&cb_g_buf[i], cb);
+
+		/* cr = (r >> 1) - ((g >> 2) + (g >> 3) + (g >> 5) + (g >> 7)) - ((b >> 4) + (b >> 6)); */
+		/* cr_b_buf[i] = MINMAX(cr, -128, 127); */
+		cr = _mm256_sub_epi16(_mm256_srai_epi16(r, 1), _mm256_srai_epi16(g, 2));
+		cr = _mm256_sub_epi16(cr, _mm256_srai_epi16(g, 3));
+		cr = _mm256_sub_epi16(cr, _mm256_srai_epi16(g, 5));
+		cr = _mm256_sub_epi16(cr, _mm256_srai_epi16(g, 7));
+		cr = _mm256_sub_epi16(cr, _mm256_srai_epi16(b, 4));
+		cr = _mm256_sub_epi16(cr, _mm256_srai_epi16(b, 6));
+		cr = _mm256_between_epi16(cr, min, max);
+		_mm256_store_si256(&cr_b_buf[i], cr);
+	}
+}
+
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_quantization_decode_block_AVX2(sint16 * buffer, const int buffer_size, const uint32 factor)
+{
+	int shift = factor - 6;
+	__m128i count;
+	__m256i a;
+	__m256i * ptr = (__m256i*) buffer;
+	__m256i * buf_end = (__m256i*) (buffer + buffer_size);
+
+	if (shift <= 0)
+		return;
+
+	count = _mm_cvtsi32_si128(shift);
+	do
+	{
+		a = _mm256_load_si256(ptr);
+		a = _mm256_sll_epi16(a, count);
+		_mm256_store_si256(ptr, a);
+
+		ptr++;
+	} while (ptr < buf_end);
+}
+
+void
+rfx_quantization_decode_AVX2(sint16 * buffer, const uint32 * quantization_values)
+{
+	rfx_quantization_decode_block_AVX2(buffer, 1024, quantization_values[8]); /* HL1 */
+	rfx_quantization_decode_block_AVX2(buffer + 1024, 1024, quantization_values[7]); /* LH1 */
+	rfx_quantization_decode_block_AVX2(buffer + 2048, 1024, quantization_values[9]); /* HH1 */
+	rfx_quantization_decode_block_AVX2(buffer + 3072, 256, quantization_values[5]); /* HL2 */
+	rfx_quantization_decode_block_AVX2(buffer + 3328, 256, quantization_values[4]); /* LH2 */
+	rfx_quantization_decode_block_AVX2(buffer + 3584, 256, quantization_values[6]); /* HH2 */
+	rfx_quantization_decode_block_AVX2(buffer + 3840, 64, quantization_values[2]); /* HL3 */
+	rfx_quantization_decode_block_AVX2(buffer + 3904, 64, quantization_values[1]); /* LH3 */
+	rfx_quantization_decode_block_AVX2(buffer + 3968, 64, quantization_values[3]); /* HH3 */
+	rfx_quantization_decode_block_AVX2(buffer + 4032, 64, quantization_values[0]); /* LL3 */
+}
+
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_quantization_encode_block_AVX2(sint16 * buffer, const int buffer_size, const uint32 factor)
+{
+	int shift = factor - 6;
+	__m128i count;
+	__m256i a;
+	__m256i * ptr = (__m256i*) buffer;
+	__m256i * buf_end = (__m256i*) (buffer + buffer_size);
+
+	if (shift <= 0)
+		return;
+
+	count = _mm_cvtsi32_si128(shift);
+	do
+	{
+		a = _mm256_load_si256(ptr);
+		a = _mm256_sra_epi16(a, count);
+		_mm256_store_si256(ptr, a);
+
+		ptr++;
+	} while (ptr < buf_end);
+}
+
+void
+rfx_quantization_encode_AVX2(sint16 * buffer, const uint32 * quantization_values)
+{
+	rfx_quantization_encode_block_AVX2(buffer, 1024, quantization_values[8]); /* HL1 */
+	rfx_quantization_encode_block_AVX2(buffer + 1024, 1024, quantization_values[7]); /* LH1 */
+	rfx_quantization_encode_block_AVX2(buffer + 2048, 1024, quantization_values[9]); /* HH1 */
+	rfx_quantization_encode_block_AVX2(buffer + 3072, 256, quantization_values[5]); /* HL2 */
+	rfx_quantization_encode_block_AVX2(buffer + 3328, 256, quantization_values[4]); /* LH2 */
+	rfx_quantization_encode_block_AVX2(buffer + 3584, 256, quantization_values[6]); /* HH2 */
+	rfx_quantization_encode_block_AVX2(buffer + 3840, 64, quantization_values[2]); /* HL3 */
+	rfx_quantization_encode_block_AVX2(buffer + 3904, 64, quantization_values[1]); /* LH3 */
+	rfx_quantization_encode_block_AVX2(buffer + 3968, 64, quantization_values[3]); /* HH3 */
+	rfx_quantization_encode_block_AVX2(buffer + 4032, 64, quantization_values[0]); /* LL3 */
+}
+
+/*
+   The horizontal passes walk a sub-band as one run of rows. An 8 wide sub-band
+   fills half a register, so two rows are processed at once and the edge
+   fix-ups apply to both halves. Wider sub-bands take a whole number of
+   registers per row and only the first and last lane of a row are patched.
+*/
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_dwt_2d_row_masks_AVX2(int subband_width, int * row_width, __m256i * first_mask, __m256i * last_mask)
+{
+	if (subband_width < 16)
+	{
+		*row_width = 16;
+		*first_mask = _mm256_setr_epi16(-1, 0, 0, 0, 0, 0, 0, 0, -1, 0, 0, 0, 0, 0, 0, 0);
+		*last_mask = _mm256_setr_epi16(0, 0, 0, 0, 0, 0, 0, -1, 0, 0, 0, 0, 0, 0, 0, -1);
+	}
+	else
+	{
+		*row_width = subband_width;
+		*first_mask = _mm256_setr_epi16(-1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+		*last_mask = _mm256_setr_epi16(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -1);
+	}
+}
+
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_dwt_2d_decode_block_horiz_AVX2(sint16 * l, sint16 * h, sint16 * dst, int subband_width)
+{
+	int y, n;
+	int row_width;
+	sint16 * l_ptr = l;
+	sint16 * h_ptr = h;
+	sint16 * dst_ptr = dst;
+	__m256i first_mask;
+	__m256i last_mask;
+	__m256i l_n;
+	__m256i h_n;
+	__m256i h_n_m;
+	__m256i tmp_n;
+	__m256i dst_n;
+	__m256i dst_n_p;
+	__m256i dst1;
+	__m256i dst2;
+
+	rfx_dwt_2d_row_masks_AVX2(subband_width, &row_width, &first_mask, &last_mask);
+
+	for (y = 0; y < subband_width * subband_width; y += row_width)
+	{
+		/* Even coefficients */
+		for (n = 0; n < row_width; n += 16)
+		{
+			/* dst[2n] = l[n] - ((h[n-1] + h[n] + 1) >> 1); */
+
+			l_n = _mm256_load_si256((__m256i*) l_ptr);
+
+			h_n = _mm256_load_si256((__m256i*) h_ptr);
+			h_n_m = _mm256_loadu_si256((__m256i*) (h_ptr - 1));
+			if (n == 0)
+				h_n_m = _mm256_blendv_epi8(h_n_m, h_n, first_mask);
+
+			tmp_n = _mm256_add_epi16(h_n, h_n_m);
+			tmp_n = _mm256_add_epi16(tmp_n, _mm256_set1_epi16(1));
+			tmp_n = _mm256_srai_epi16(tmp_n, 1);
+
+			dst_n = _mm256_sub_epi16(l_n, tmp_n);
+
+			_mm256_store_si256((__m256i*) l_ptr, dst_n);
+
+			l_ptr += 16;
+			h_ptr += 16;
+		}
+		l_ptr -= row_width;
+		h_ptr -= row_width;
+
+		/* Odd coefficients */
+		for (n = 0; n < row_width; n += 16)
+		{
+			/* dst[2n + 1] = (h[n] << 1) + ((dst[2n] + dst[2n + 2]) >> 1); */
+
+			h_n = _mm256_load_si256((__m256i*) h_ptr);
+			h_n = _mm256_slli_epi16(h_n, 1);
+
+			dst_n = _mm256_load_si256((__m256i*) l_ptr);
+			dst_n_p = _mm256_loadu_si256((__m256i*) (l_ptr + 1));
+			if (n == row_width - 16)
+				dst_n_p = _mm256_blendv_epi8(dst_n_p, dst_n, last_mask);
+
+			tmp_n = _mm256_add_epi16(dst_n_p, dst_n);
+			tmp_n = _mm256_srai_epi16(tmp_n, 1);
+
+			tmp_n = _mm256_add_epi16(tmp_n, h_n);
+
+			/* unpack works within 128-bit lanes, put the halves back in order */
+			dst1 = _mm256_unpacklo_epi16(dst_n, tmp_n);
+			dst2 = _mm256_unpackhi_epi16(dst_n, tmp_n);
+
+			_mm256_store_si256((__m256i*) dst_ptr, _mm256_permute2x128_si256(dst1, dst2, 0x20));
+			_mm256_store_si256((__m256i*) (dst_ptr + 16), _mm256_permute2x128_si256(dst1, dst2, 0x31));
+
+			l_ptr += 16;
+			h_ptr += 16;
+			dst_ptr += 32;
+		}
+	}
+}
+
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_dwt_2d_decode_block_vert_AVX2(sint16 * l, sint16 * h, sint16 * dst, int subband_width)
+{
+	int x, n;
+	sint16 * l_ptr = l;
+	sint16 * h_ptr = h;
+	sint16 * dst_ptr = dst;
+	__m256i l_n;
+	__m256i h_n;
+	__m256i tmp_n;
+	__m256i h_n_m;
+	__m256i dst_n;
+	__m256i dst_n_m;
+	__m256i dst_n_p;
+
+	int total_width = subband_width + subband_width;
+
+	/* Even coefficients */
+	for (n = 0; n < subband_width; n++)
+	{
+		for (x = 0; x < total_width; x += 16)
+		{
+			/* dst[2n] = l[n] - ((h[n-1] + h[n] + 1) >> 1); */
+
+			l_n = _mm256_load_si256((__m256i*) l_ptr);
+			h_n = _mm256_load_si256((__m256i*) h_ptr);
+
+			tmp_n = _mm256_add_epi16(h_n, _mm256_set1_epi16(1));
+			if (n == 0)
+				tmp_n = _mm256_add_epi16(tmp_n, h_n);
+			else
+			{
+				h_n_m = _mm256_load_si256((__m256i*) (h_ptr - total_width));
+				tmp_n = _mm256_add_epi16(tmp_n, h_n_m);
+			}
+			tmp_n = _mm256_srai_epi16(tmp_n, 1);
+
+			dst_n = _mm256_sub_epi16(l_n, tmp_n);
+			_mm256_store_si256((__m256i*) dst_ptr, dst_n);
+
+			l_ptr += 16;
+			h_ptr += 16;
+			dst_ptr += 16;
+		}
+		dst_ptr += total_width;
+	}
+
+	h_ptr = h;
+	dst_ptr = dst + total_width;
+
+	/* Odd coefficients */
+	for (n = 0; n < subband_width; n++)
+	{
+		for (x = 0; x < total_width; x += 16)
+		{
+			/* dst[2n + 1] = (h[n] << 1) + ((dst[2n] + dst[2n + 2]) >> 1); */
+
+			h_n = _mm256_load_si256((__m256i*) h_ptr);
+			dst_n_m = _mm256_load_si256((__m256i*) (dst_ptr - total_width));
+			h_n = _mm256_slli_epi16(h_n, 1);
+
+			tmp_n = dst_n_m;
+			if (n == subband_width - 1)
+				tmp_n = _mm256_add_epi16(tmp_n, dst_n_m);
+			else
+			{
+				dst_n_p = _mm256_load_si256((__m256i*) (dst_ptr + total_width));
+				tmp_n = _mm256_add_epi16(tmp_n, dst_n_p);
+			}
+			tmp_n = _mm256_srai_epi16(tmp_n, 1);
+
+			dst_n = _mm256_add_epi16(tmp_n, h_n);
+			_mm256_store_si256((__m256i*) dst_ptr, dst_n);
+
+			h_ptr += 16;
+			dst_ptr += 16;
+		}
+		dst_ptr += total_width;
+	}
+}
+
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_dwt_2d_decode_block_AVX2(sint16 * buffer, sint16 * idwt, int subband_width)
+{
+	sint16 * hl, * lh, * hh, * ll;
+	sint16 * l_dst, * h_dst;
+
+	/* Inverse DWT in horizontal direction, results in 2 sub-bands in L, H order in tmp buffer idwt. */
+	/* The 4 sub-bands are stored in HL(0), LH(1), HH(2), LL(3) order. */
+	/* The lower part L uses LL(3) and HL(0). */
+	/* The higher part H uses LH(1) and HH(2). */
+
+	ll = buffer + subband_width * subband_width * 3;
+	hl = buffer;
+	l_dst = idwt;
+
+	rfx_dwt_2d_decode_block_horiz_AVX2(ll, hl, l_dst, subband_width);
+
+	lh = buffer + subband_width * subband_width;
+	hh = buffer + subband_width * subband_width * 2;
+	h_dst = idwt + subband_width * subband_width * 2;
+
+	rfx_dwt_2d_decode_block_horiz_AVX2(lh, hh, h_dst, subband_width);
+
+	/* Inverse DWT in vertical direction, results are stored in original buffer. */
+	rfx_dwt_2d_decode_block_vert_AVX2(l_dst, h_dst, buffer, subband_width);
+}
+
+void
+rfx_dwt_2d_decode_AVX2(sint16 * buffer, sint16 * dwt_buffer)
+{
+	rfx_dwt_2d_decode_block_AVX2(buffer + 3840, dwt_buffer, 8);
+	rfx_dwt_2d_decode_block_AVX2(buffer + 3072, dwt_buffer, 16);
+	rfx_dwt_2d_decode_block_AVX2(buffer, dwt_buffer, 32);
+}
+
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_dwt_2d_encode_block_vert_AVX2(sint16 * src, sint16 * l, sint16 * h, int subband_width)
+{
+	int total_width;
+	int x;
+	int n;
+	__m256i src_2n;
+	__m256i src_2n_1;
+	__m256i src_2n_2;
+	__m256i h_n;
+	__m256i h_n_m;
+	__m256i l_n;
+
+	total_width = subband_width << 1;
+
+	for (n = 0; n < subband_width; n++)
+	{
+		for (x = 0; x < total_width; x += 16)
+		{
+			src_2n = _mm256_load_si256((__m256i*) src);
+			src_2n_1 = _mm256_load_si256((__m256i*) (src + total_width));
+			if (n < subband_width - 1)
+				src_2n_2 = _mm256_load_si256((__m256i*) (src + 2 * total_width));
+			else
+				src_2n_2 = src_2n_1;
+
+			/* h[n] = (src[2n + 1] - ((src[2n] + src[2n + 2]) >> 1)) >> 1 */
+
+			h_n = _mm256_add_epi16(src_2n, src_2n_2);
+			h_n = _mm256_srai_epi16(h_n, 1);
+			h_n = _mm256_sub_epi16(src_2n_1, h_n);
+			h_n = _mm256_srai_epi16(h_n, 1);
+
+			_mm256_store_si256((__m256i*) h, h_n);
+
+			if (n == 0)
+				h_n_m = h_n;
+			else
+				h_n_m = _mm256_load_si256((__m256i*) (h - total_width));
+
+			/* l[n] = src[2n] + ((h[n - 1] + h[n]) >> 1) */
+
+			l_n = _mm256_add_epi16(h_n_m, h_n);
+			l_n = _mm256_srai_epi16(l_n, 1);
+			l_n = _mm256_add_epi16(l_n, src_2n);
+
+			_mm256_store_si256((__m256i*) l, l_n);
+
+			src += 16;
+			l += 16;
+			h += 16;
+		}
+		src += total_width;
+	}
+}
+
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_dwt_2d_encode_block_horiz_AVX2(sint16 * src, sint16 * l, sint16 * h, int subband_width)
+{
+	int y;
+	int n;
+	int row_width;
+	__m256i first_mask;
+	__m256i last_mask;
+	__m256i deinterleave;
+	__m256i a;
+	__m256i b;
+	__m256i tail;
+	__m256i src_2n;
+	__m256i src_2n_1;
+	__m256i src_2n_2;
+	__m256i h_n;
+	__m256i h_n_m;
+	__m256i h_prev;
+	__m256i l_n;
+
+	rfx_dwt_2d_row_masks_AVX2(subband_width, &row_width, &first_mask, &last_mask);
+
+	/* even samples to the low, odd samples to the high 64 bits of each lane */
+	deinterleave = _mm256_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15,
+		0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+
+	h_prev = _mm256_setzero_si256();
+
+	for (y = 0; y < subband_width * subband_width; y += row_width)
+	{
+		for (n = 0; n < row_width; n += 16)
+		{
+			a = _mm256_shuffle_epi8(_mm256_load_si256((__m256i*) src), deinterleave);
+			a = _mm256_permute4x64_epi64(a, 0xD8);
+			b = _mm256_shuffle_epi8(_mm256_load_si256((__m256i*) (src + 16)), deinterleave);
+			b = _mm256_permute4x64_epi64(b, 0xD8);
+
+			src_2n = _mm256_permute2x128_si256(a, b, 0x20);
+			src_2n_1 = _mm256_permute2x128_si256(a, b, 0x31);
+
+			/* src[2n + 2] is src_2n moved down by one, at the end of a row it is src[2n + 1] like the SSE2 version */
+			if (n == row_width - 16)
+				tail = src_2n_1;
+			else
+				tail = _mm256_set1_epi16(src[32]);
+			src_2n_2 = _mm256_alignr_epi8(_mm256_permute2x128_si256(src_2n, tail, 0x21), src_2n, 2);
+			if (n == row_width - 16)
+				src_2n_2 = _mm256_blendv_epi8(src_2n_2, src_2n_1, last_mask);
+
+			/* h[n] = (src[2n + 1] - ((src[2n] + src[2n + 2]) >> 1)) >> 1 */
+
+			h_n = _mm256_add_epi16(src_2n, src_2n_2);
+			h_n = _mm256_srai_epi16(h_n, 1);
+			h_n = _mm256_sub_epi16(src_2n_1, h_n);
+			h_n = _mm256_srai_epi16(h_n, 1);
+
+			_mm256_store_si256((__m256i*) h, h_n);
+
+			/* h[n - 1] is h_n moved up by one, taking the last value of the previous register */
+			h_n_m = _mm256_alignr_epi8(h_n, _mm256_permute2x128_si256(h_prev, h_n, 0x21), 14);
+			if (n == 0)
+				h_n_m = _mm256_blendv_epi8(h_n_m, h_n, first_mask);
+			h_prev = h_n;
+
+			/* l[n] = src[2n] + ((h[n - 1] + h[n]) >> 1) */
+
+			l_n = _mm256_add_epi16(h_n_m, h_n);
+			l_n = _mm256_srai_epi16(l_n, 1);
+			l_n = _mm256_add_epi16(l_n, src_2n);
+
+			_mm256_store_si256((__m256i*) l, l_n);
+
+			src += 32;
+			l += 16;
+			h += 16;
+		}
+	}
+}
+
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_dwt_2d_encode_block_AVX2(sint16 * buffer, sint16 * dwt, int subband_width)
+{
+	sint16 * hl, * lh, * hh, * ll;
+	sint16 * l_src, * h_src;
+
+	/* DWT in vertical direction, results in 2 sub-bands in L, H order in tmp buffer dwt. */
+
+	l_src = dwt;
+	h_src = dwt + subband_width * subband_width * 2;
+
+	rfx_dwt_2d_encode_block_vert_AVX2(buffer, l_src, h_src, subband_width);
+
+	/* DWT in horizontal direction, results in 4 sub-bands in HL(0), LH(1), HH(2), LL(3) order, stored in original buffer. */
+	/* The lower part L generates LL(3) and HL(0). */
+	/* The higher part H generates LH(1) and HH(2). */
+
+	ll = buffer + subband_width * subband_width * 3;
+	hl = buffer;
+
+	lh = buffer + subband_width * subband_width;
+	hh = buffer + subband_width * subband_width * 2;
+
+	rfx_dwt_2d_encode_block_horiz_AVX2(l_src, ll, hl, subband_width);
+	rfx_dwt_2d_encode_block_horiz_AVX2(h_src, lh, hh, subband_width);
+}
+
+void
+rfx_dwt_2d_encode_AVX2(sint16 * buffer, sint16 * dwt_buffer)
+{
+	rfx_dwt_2d_encode_block_AVX2(buffer, dwt_buffer, 32);
+	rfx_dwt_2d_encode_block_AVX2(buffer + 3072, dwt_buffer, 16);
+	rfx_dwt_2d_encode_block_AVX2(buffer + 3840, dwt_buffer, 8);
+}
+
+void rfx_init_avx2(RFX_CONTEXT * context)
+{
+		DEBUG_RFX("Using AVX2 optimizations");
+
+		IF_PROFILER(context->prof_rfx_decode_YCbCr_to_RGB->name = "rfx_decode_YCbCr_to_pixels_AVX2");
+		IF_PROFILER(context->prof_rfx_encode_RGB_to_YCbCr->name = "rfx_encode_RGB_to_YCbCr_AVX2");
+		IF_PROFILER(context->prof_rfx_quantization_decode->name = "rfx_quantization_decode_AVX2");
+		IF_PROFILER(context->prof_rfx_quantization_encode->name = "rfx_quantization_encode_AVX2");
+		IF_PROFILER(context->prof_rfx_dwt_2d_decode->name = "rfx_dwt_2d_decode_AVX2");
+		IF_PROFILER(context->prof_rfx_dwt_2d_encode->name = "rfx_dwt_2d_encode_AVX2");
+
+		context->decode_YCbCr_to_RGB = rfx_decode_YCbCr_to_RGB_AVX2;
+		context->decode_YCbCr_to_pixels = rfx_decode_YCbCr_to_pixels_AVX2;
+		context->encode_RGB_to_YCbCr = rfx_encode_RGB_to_YCbCr_AVX2;
+		context->quantization_decode = rfx_quantization_decode_AVX2;
+		context->quantization_encode = rfx_quantization_encode_AVX2;
+		context->dwt_2d_decode = rfx_dwt_2d_decode_AVX2;
+		context->dwt_2d_encode = rfx_dwt_2d_encode_AVX2;
+}
@@ -0,0 +1,34 @@
+/*
+   FreeRDP: A Remote Desktop Protocol client.
+   RemoteFX Codec Library - AVX2 Optimizations
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef __RFX_AVX2_H
+#define __RFX_AVX2_H
+
+#include <freerdp/rfx.h>
+
+void rfx_init_avx2(RFX_CONTEXT * context);
+
+void rfx_decode_YCbCr_to_RGB_AVX2(sint16 * y_r_buffer, sint16 * cb_g_buffer, sint16 * cr_b_buffer);
+void rfx_decode_YCbCr_to_pixels_AVX2(sint16 * y_buf, sint16 * cb_buf, sint16 * cr_buf,
+	RFX_PIXEL_FORMAT pixel_format, uint8 * dst_buf, int dst_stride);
+void rfx_encode_RGB_to_YCbCr_AVX2(sint16 * y_r_buffer, sint16 * cb_g_buffer, sint16 * cr_b_buffer);
+void rfx_quantization_decode_AVX2(sint16 * buffer, const uint32 * quantization_values);
+void rfx_quantization_encode_AVX2(sint16 * buffer, const uint32 * quantization_values);
+void rfx_dwt_2d_decode_AVX2(sint16 * buffer, sint16 * dwt_buffer);
+void rfx_dwt_2d_encode_AVX2(sint16 * buffer, sint16 * dwt_buffer);
+
+#endif /* __RFX_AVX2_H */
@@ -24,11 +24,23 @@
 #include "rfx_sse2.h"
 #include "rfx_sse.h"
 
+#ifdef WITH_AVX2
+#include "rfx_avx2.h"
+
+static int
+rfx_cpu_has_avx2(void)
+{
+	/* checks the CPUID bits as well as OS support for saving the ymm registers */
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+#endif
+
 void rfx_init_sse(RFX_CONTEXT * context)
 {
 		DEBUG_RFX("Using SSE2 optimizations");
 
-		IF_PROFILER(context->prof_rfx_decode_YCbCr_to_RGB->name = "rfx_decode_YCbCr_to_RGB_SSE2");
+		IF_PROFILER(context->prof_rfx_decode_YCbCr_to_RGB->name = "rfx_decode_YCbCr_to_pixels_SSE2");
 		IF_PROFILER(context->prof_rfx_encode_RGB_to_YCbCr->name = "rfx_encode_RGB_to_YCbCr_SSE2");
 		IF_PROFILER(context->prof_rfx_quantization_decode->name = "rfx_quantization_decode_SSE2");
 		IF_PROFILER(context->prof_rfx_quantization_encode->name = "rfx_quantization_encode_SSE2");
@@ -36,9 +48,16 @@ void rfx_init_sse(RFX_CONTEXT * context)
 		IF_PROFILER(context->prof_rfx_dwt_2d_encode->name = "rfx_dwt_2d_encode_SSE2");
 		
 		context->decode_YCbCr_to_RGB = rfx_decode_YCbCr_to_RGB_SSE2;
+		context->decode_YCbCr_to_pixels = rfx_decode_YCbCr_to_pixels_SSE2;
 		context->encode_RGB_to_YCbCr = rfx_encode_RGB_to_YCbCr_SSE2;
 		context->quantization_decode = rfx_quantization_decode_SSE2;
 		context->quantization_encode = rfx_quantization_encode_SSE2;
 		context->dwt_2d_decode = rfx_dwt_2d_decode_SSE2;
 		context->dwt_2d_encode = rfx_dwt_2d_encode_SSE2;
+
+#ifdef WITH_AVX2
+		/* install the widest routines the CPU can run */
+		if (rfx_cpu_has_avx2())
+			rfx_init_avx2(context);
+#endif
 }
@@ -104,6 +104,159 @@ rfx_decode_YCbCr_to_RGB_SSE2(sint16 * y_r_buffer, sint16 * cb_g_buffer, sint16 *
 	}
 }
 
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_YCbCr_to_RGB_SSE2(sint16 * y_buf, sint16 * cb_buf, sint16 * cr_buf, __m128i * r, __m128i * g, __m128i * b)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i max = _mm_set1_epi16(255);
+	__m128i y;
+	__m128i cb;
+	__m128i cr;
+
+	y = _mm_load_si128((__m128i*) y_buf);
+	y = _mm_add_epi16(y, _mm_set1_epi16(128));
+	cb = _mm_load_si128((__m128i*) cb_buf);
+	cr = _mm_load_si128((__m128i*) cr_buf);
+
+	*r = _mm_add_epi16(y, cr);
+	*r = _mm_add_epi16(*r, _mm_srai_epi16(cr, 2));
+	*r = _mm_add_epi16(*r, _mm_srai_epi16(cr, 3));
+	*r = _mm_add_epi16(*r, _mm_srai_epi16(cr, 5));
+	*r = _mm_between_epi16(*r, zero, max);
+
+	*g = _mm_sub_epi16(y, _mm_srai_epi16(cb, 2));
+	*g = _mm_sub_epi16(*g, _mm_srai_epi16(cb, 4));
+	*g = _mm_sub_epi16(*g, _mm_srai_epi16(cb, 5));
+	*g = _mm_sub_epi16(*g, _mm_srai_epi16(cr, 1));
+	*g = _mm_sub_epi16(*g, _mm_srai_epi16(cr, 3));
+	*g = _mm_sub_epi16(*g, _mm_srai_epi16(cr, 4));
+	*g = _mm_sub_epi16(*g, _mm_srai_epi16(cr, 5));
+	*g = _mm_between_epi16(*g, zero, max);
+
+	*b = _mm_add_epi16(y, cb);
+	*b = _mm_add_epi16(*b, _mm_srai_epi16(cb, 1));
+	*b = _mm_add_epi16(*b, _mm_srai_epi16(cb, 2));
+	*b = _mm_add_epi16(*b, _mm_srai_epi16(cb, 6));
+	*b = _mm_between_epi16(*b, zero, max);
+}
+
+/* 16 pixels of c0, c1, c2 and 0xFF bytes */
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_store_4bpp_SSE2(uint8 * dst, __m128i c0, __m128i c1, __m128i c2)
+{
+	__m128i alpha = _mm_set1_epi8((char) 0xFF);
+	__m128i c01_lo = _mm_unpacklo_epi8(c0, c1);
+	__m128i c01_hi = _mm_unpackhi_epi8(c0, c1);
+	__m128i c2a_lo = _mm_unpacklo_epi8(c2, alpha);
+	__m128i c2a_hi = _mm_unpackhi_epi8(c2, alpha);
+
+	_mm_storeu_si128((__m128i*) dst, _mm_unpacklo_epi16(c01_lo, c2a_lo));
+	_mm_storeu_si128((__m128i*) (dst + 16), _mm_unpackhi_epi16(c01_lo, c2a_lo));
+	_mm_storeu_si128((__m128i*) (dst + 32), _mm_unpacklo_epi16(c01_hi, c2a_hi));
+	_mm_storeu_si128((__m128i*) (dst + 48), _mm_unpackhi_epi16(c01_hi, c2a_hi));
+}
+
+/* 16 pixels of c0, c1, c2 bytes, SSE2 has no byte shuffle so the bytes go out one by one */
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_store_3bpp_SSE2(uint8 * dst, __m128i c0, __m128i c1, __m128i c2)
+{
+	uint8 c[3][16] __attribute__((aligned(16)));
+	int i;
+
+	_mm_store_si128((__m128i*) c[0], c0);
+	_mm_store_si128((__m128i*) c[1], c1);
+	_mm_store_si128((__m128i*) c[2], c2);
+
+	for (i = 0; i < 16; i++)
+	{
+		*dst++ = c[0][i];
+		*dst++ = c[1][i];
+		*dst++ = c[2][i];
+	}
+}
+
+static __inline void __attribute__((__gnu_inline__, __always_inline__, __artificial__))
+rfx_decode_YCbCr_to_pixels_format_SSE2(sint16 * y_buf, sint16 * cb_buf, sint16 * cr_buf,
+	RFX_PIXEL_FORMAT pixel_format, uint8 * dst_buf, int dst_stride)
+{
+	__m128i r0, g0, b0;
+	__m128i r1, g1, b1;
+	__m128i r, g, b;
+	uint8 * dst;
+	int x, row;
+	int i = 0;
+
+	for (row = 0; row < 64; row++)
+	{
+		dst = dst_buf + row * dst_stride;
+
+		for (x = 0; x < 64; x += 16, i += 16)
+		{
+			rfx_YCbCr_to_RGB_SSE2(y_buf + i, cb_buf + i, cr_buf + i, &r0, &g0, &b0);
+			rfx_YCbCr_to_RGB_SSE2(y_buf + i + 8, cb_buf + i + 8, cr_buf + i + 8, &r1, &g1, &b1);
+
+			/* values are within 0..255 already */
+			r = _mm_packus_epi16(r0, r1);
+			g = _mm_packus_epi16(g0, g1);
+			b = _mm_packus_epi16(b0, b1);
+
+			switch (pixel_format)
+			{
+				case RFX_PIXEL_FORMAT_BGRA:
+					rfx_store_4bpp_SSE2(dst, b, g, r);
+					dst += 64;
+					break;
+				case RFX_PIXEL_FORMAT_RGBA:
+					rfx_store_4bpp_SSE2(dst, r, g, b);
+					dst += 64;
+					break;
+				case RFX_PIXEL_FORMAT_BGR:
+					rfx_store_3bpp_SSE2(dst, b, g, r);
+					dst += 48;
+					break;
+				case RFX_PIXEL_FORMAT_RGB:
+					rfx_store_3bpp_SSE2(dst, r, g, b);
+					dst += 48;
+					break;
+				default:
+					break;
+			}
+		}
+	}
+}
+
+void
+rfx_decode_YCbCr_to_pixels_SSE2(sint16 * y_buf, sint16 * cb_buf, sint16 * cr_buf,
+	RFX_PIXEL_FORMAT pixel_format, uint8 * dst_buf, int dst_stride)
+{
+	_mm_prefetch_buffer((char *) y_buf, 4096 * sizeof(sint16));
+	_mm_prefetch_buffer((char *) cb_buf, 4096 * sizeof(sint16));
+	_mm_prefetch_buffer((char *) cr_buf, 4096 * sizeof(sint16));
+
+	/* the format is a constant in each branch, so every one gets its own loop */
+	switch (pixel_format)
+	{
+		case RFX_PIXEL_FORMAT_BGRA:
+			rfx_decode_YCbCr_to_pixels_format_SSE2(y_buf, cb_buf, cr_buf,
+				RFX_PIXEL_FORMAT_BGRA, dst_buf, dst_stride);
+			break;
+		case RFX_PIXEL_FORMAT_RGBA:
+			rfx_decode_YCbCr_to_pixels_format_SSE2(y_buf, cb_buf, cr_buf,
+				RFX_PIXEL_FORMAT_RGBA, dst_buf, dst_stride);
+			break;
+		case RFX_PIXEL_FORMAT_BGR:
+			rfx_decode_YCbCr_to_pixels_format_SSE2(y_buf, cb_buf, cr_buf,
+				RFX_PIXEL_FORMAT_BGR, dst_buf, dst_stride);
+			break;
+		case RFX_PIXEL_FORMAT_RGB:
+			rfx_decode_YCbCr_to_pixels_format_SSE2(y_buf, cb_buf, cr_buf,
+				RFX_PIXEL_FORMAT_RGB, dst_buf, dst_stride);
+			break;
+		default:
+			break;
+	}
+}
+
 void
 rfx_encode_RGB_to_YCbCr_SSE2(sint16 * y_r_buffer, sint16 * cb_g_buffer, sint16 * cr_b_buffer)
 {
@@ -212,7 +365,7 @@ rfx_quantization_decode_SSE2(sint16 * buffer, const uint32 * quantization_values
 	rfx_quantization_decode_block_SSE2(buffer + 3584, 256, quantization_values[6]); /* HH2 */
 	rfx_quantization_decode_block_SSE2(buffer + 3840, 64, quantization_values[2]); /* HL3 */
 	rfx_quantization_decode_block_SSE2(buffer + 3904, 64, quantization_values[1]); /* LH3 */
-	rfx_quantization_decode_block_SSE2(buffer + 3868, 64, quantization_values[3]); /* HH3 */
+	rfx_quantization_decode_block_SSE2(buffer + 3968, 64, quantization_values[3]); /* HH3 */
 	rfx_quantization_decode_block_SSE2(buffer + 4032, 64, quantization_values[0]); /* LL3 */
 }
 
@@ -249,7 +402,7 @@ rfx_quantization_encode_SSE2(sint16 * buffer, const uint32 * quantization_values
 	rfx_quantization_encode_block_SSE2(buffer + 3584, 256, quantization_values[6]); /* HH2 */
 	rfx_quantization_encode_block_SSE2(buffer + 3840, 64, quantization_values[2]); /* HL3 */
 	rfx_quantization_encode_block_SSE2(buffer + 3904, 64, quantization_values[1]); /* LH3 */
-	rfx_quantization_encode_block_SSE2(buffer + 3868, 64, quantization_values[3]); /* HH3 */
+	rfx_quantization_encode_block_SSE2(buffer + 3968, 64, quantization_values[3]); /* HH3 */
 	rfx_quantization_encode_block_SSE2(buffer + 4032, 64, quantization_values[0]); /* LL3 */
 }
 
@@ -23,6 +23,8 @@
 #include <freerdp/rfx.h>
 
 void rfx_decode_YCbCr_to_RGB_SSE2(sint16 * y_r_buffer, sint16 * cb_g_buffer, sint16 * cr_b_buffer);
+void rfx_decode_YCbCr_to_pixels_SSE2(sint16 * y_buf, sint16 * cb_buf, sint16 * cr_buf,
+	RFX_PIXEL_FORMAT pixel_format, uint8 * dst_buf, int dst_stride);
 void rfx_encode_RGB_to_YCbCr_SSE2(sint16 * y_r_buffer, sint16 * cb_g_buffer, sint16 * cr_b_buffer);
 void rfx_quantization_decode_SSE2(sint16 * buffer, const uint32 * quantization_values);
 void rfx_quantization_encode_SSE2(sint16 * buffer, const uint32 * quantization_values);
@@ -23,11 +23,15 @@
 
 #include <freerdp/utils/memory.h>
 
+/* allocations made so far, not exact when several threads allocate */
+static unsigned long alloc_count = 0;
+
 void *
 xmalloc(size_t size)
 {
 	void * mem;
 
+	alloc_count++;
 	if (size < 1)
 	{
 		size = 1;
@@ -45,6 +49,7 @@ xrealloc(void * oldmem, size_t size)
 {
 	void * mem;
 
+	alloc_count++;
 	if (size < 1)
 	{
 		size = 1;
@@ -84,3 +89,9 @@ xstrdup(const char * s)
 
 	return mem;
 }
+
+unsigned long
+xmalloc_count(void)
+{
+	return alloc_count;
+}
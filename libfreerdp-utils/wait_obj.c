@@ -170,3 +170,11 @@ wait_obj_select(struct wait_obj ** listobj, int numobj, int * listr, int numr,
 	return rv;
 }
 
+/* add the descriptor that becomes readable when obj is set to fds */
+int
+wait_obj_get_fds(struct wait_obj * obj, void ** fds, int * count)
+{
+	fds[*count] = (void *) (long) obj->pipe_fd[0];
+	(*count)++;
+	return 0;
+}